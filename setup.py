@@ -1,10 +1,13 @@
 from setuptools import Extension, setup
 
-module = Extension("spkmeansmodule", sources=['spkmeans.c', 'spkmeansmodule.c'])
+module = Extension("spkmeansmodule", sources=['spkmeans.c', 'spkmeansmodule.c'],
+                   extra_compile_args=['-fno-math-errno', '-fno-trapping-math', '-pthread'],
+                   extra_link_args=['-pthread'])
 setup(
     name='spkmeansmodule',
     version='1.1',
     author='Ben_&_Ofek',
     description='Spectral Clustering module',
+    python_requires='>=3.9',
     ext_modules=[module]
 )
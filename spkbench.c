@@ -0,0 +1,460 @@
+#include "spkmeans.h"
+#include "spkinnerfunctions.h"
+#include "spkbench.h"
+/* This file implements the C benchmark - synthetic data, kernels' timings and JSON results */
+
+/* The kernels' goals - named after them, then "kMeans", the W reference and the Nystrom spk */
+static const GOAL KERNEL_GOAL[] = {wam, ddg, lnorm, spk, jacobi};
+static const char *OTHER_KERNEL_STRING[] = {"kmeans", "wam-reference", "nystrom"};
+
+/*******************************************************************************
+********************************** Main ****************************************
+*******************************************************************************/
+
+/**
+ * Benchmark program.
+ * Write the kernels' timings of every (n, d, k) of the sweep as JSON.
+ */
+int main(int argc, char *argv[]) {
+    int i, j, t, kernel, written;
+    BenchPlan plan;
+    BenchCase bc;
+    SpkContext context, caseContext, *ctx = &context;
+    initContext(ctx); /* Init C memory containers and configuration */
+
+    if (assignBenchInput(ctx, &plan, argc, argv) == EOF) {
+        printf(INVALID_INPUT_MSG);
+        freeAllMemory(ctx);
+        exit(0);
+    }
+    fprintf(plan.json, "{\"benchmark\": \"spkbench\", \"config\": {\"threads\": %d, "
+                       "\"solver\": \"%s\", \"tol\": %e, \"affinity\": \"%s\", "
+                       "\"kmeans\": \"%s\", \"init\": \"%s\", \"seed\": %lu, "
+                       "\"warmups\": %d, \"repeats\": %d},\n\"results\": [",
+            plan.config.numOfThreads, SOLVER_STRING[plan.config.solver], plan.config.jacobiTol,
+            AFFINITY_STRING[plan.config.affinity], KMEANS_STRING[plan.config.kmeans],
+            INIT_STRING[plan.config.init], plan.config.seed, plan.warmups, plan.repeats);
+    for (i = 0; i < plan.numOfSizes; ++i) {
+        for (j = 0; j < plan.numOfDimensions; ++j) {
+            for (t = 0; t < plan.numOfClusters; ++t) {
+                bc.n = plan.sizes[i];
+                bc.d = plan.dimensions[j];
+                bc.k = plan.clusters[t];
+                if (bc.k >= bc.n)
+                    continue; /* As the spk goal - invalid */
+                fprintf(stderr, "spkbench: n=%d d=%d k=%d\n", bc.n, bc.d, bc.k);
+                initContext(&caseContext);
+                caseContext.config = plan.config;
+                BenchAssert(&plan, initBenchCase(&caseContext, &plan, &bc) != EOF);
+                for (kernel = 0; kernel < nystromKernel; ++kernel) {
+                    BenchAssert(&plan, measureKernel(&caseContext, &plan, &bc, kernel) != EOF);
+                }
+                for (kernel = 0; kernel < plan.numOfLandmarks; ++kernel) {
+                    bc.landmarks = plan.landmarks[kernel];
+                    if (bc.landmarks <= bc.n)
+                        BenchAssert(&plan, measureKernel(&caseContext, &plan, &bc,
+                                                         nystromKernel) != EOF);
+                }
+                freeAllMemory(&caseContext);
+            }
+        }
+    }
+    fprintf(plan.json, "\n]}\n");
+    written = !ferror(plan.json); /* Close the file even if a write failed */
+    MyAssert((plan.json == stdout || fclose(plan.json) != EOF) && written);
+
+    freeAllMemory(ctx);
+    return 0;
+}
+
+/*******************************************************************************
+********************************** Input ***************************************
+*******************************************************************************/
+
+/* This function reads the cmd-line arguments into the plan. */
+int assignBenchInput(SpkContext *ctx, BenchPlan *plan, int argc, char **argv) {
+    int i, spkArgc = REQUIRED_NUM_OF_ARGUMENTS;
+    long value;
+    char **spkArgv, *sizes = NULL, *dimensions = NULL, *clusters = NULL, *landmarks = NULL;
+    char *jsonPath = NULL;
+
+    /* The spkmeans options - after REQUIRED_NUM_OF_ARGUMENTS placeholders */
+    spkArgv = (char **) myAlloc(ctx, NULL, (argc + REQUIRED_NUM_OF_ARGUMENTS) * sizeof(char *));
+    if (spkArgv == NULL) return EOF; /* Memory allocation fail */
+    for (i = 0; i < REQUIRED_NUM_OF_ARGUMENTS; ++i) {
+        spkArgv[i] = argv[0];
+    }
+    plan->warmups = BENCH_DEFAULT_WARMUPS;
+    plan->repeats = BENCH_DEFAULT_REPEATS;
+    for (i = 1; i < argc; ++i) {
+        if (!strncmp(argv[i], N_OPTION, strlen(N_OPTION))) {
+            sizes = argv[i] + strlen(N_OPTION);
+        } else if (!strncmp(argv[i], D_OPTION, strlen(D_OPTION))) {
+            dimensions = argv[i] + strlen(D_OPTION);
+        } else if (!strncmp(argv[i], K_OPTION, strlen(K_OPTION))) {
+            clusters = argv[i] + strlen(K_OPTION);
+        } else if (!strncmp(argv[i], NYSTROM_OPTION, strlen(NYSTROM_OPTION))) {
+            landmarks = argv[i] + strlen(NYSTROM_OPTION);
+        } else if (!strncmp(argv[i], WARMUPS_OPTION, strlen(WARMUPS_OPTION))) {
+            value = str2NonNegativeLong(argv[i] + strlen(WARMUPS_OPTION));
+            if (value == EOF || value > INT_MAX)
+                return EOF;
+            plan->warmups = (int) value;
+        } else if (!strncmp(argv[i], REPEATS_OPTION, strlen(REPEATS_OPTION))) {
+            plan->repeats = str2PositiveInt(argv[i] + strlen(REPEATS_OPTION));
+            if (plan->repeats == EOF)
+                return EOF;
+        } else if (!strncmp(argv[i], JSON_OPTION, strlen(JSON_OPTION))) {
+            jsonPath = argv[i] + strlen(JSON_OPTION);
+        } else
+            spkArgv[spkArgc++] = argv[i];
+    }
+    /* Benchmarks run to convergence - "classic" stops after MAX_JACOBI_ITER rotations */
+    ctx->config.solver = ql;
+    if (assignOptionalInput(ctx, spkArgc, spkArgv) == EOF)
+        return EOF;
+    MyFree(ctx, spkArgv);
+    plan->config = ctx->config;
+    plan->config.verbose = 0;
+    plan->config.profile = 1; /* The results' stages */
+    plan->config.tracePath = NULL;
+
+    if (str2IntList(sizes != NULL ? sizes : BENCH_DEFAULT_N, plan->sizes,
+                    &plan->numOfSizes) == EOF ||
+        str2IntList(dimensions != NULL ? dimensions : BENCH_DEFAULT_D, plan->dimensions,
+                    &plan->numOfDimensions) == EOF ||
+        str2IntList(clusters != NULL ? clusters : BENCH_DEFAULT_K, plan->clusters,
+                    &plan->numOfClusters) == EOF)
+        return EOF;
+    plan->numOfLandmarks = 0;
+    if (landmarks != NULL && str2IntList(landmarks, plan->landmarks,
+                                         &plan->numOfLandmarks) == EOF)
+        return EOF;
+    for (i = 0; i < plan->numOfLandmarks; ++i) {
+        if (plan->landmarks[i] == 0 || plan->config.affinity != dense)
+            return EOF; /* As "--nystrom=M" */
+    }
+    for (i = 0; i < plan->numOfSizes; ++i) {
+        if (plan->sizes[i] < 2)
+            return EOF;
+    }
+    for (i = 0; i < plan->numOfDimensions; ++i) {
+        if (plan->dimensions[i] == 0)
+            return EOF;
+    }
+    plan->numOfResults = 0;
+    plan->json = stdout;
+    if (jsonPath != NULL) {
+        plan->json = fopen(jsonPath, "w");
+        if (plan->json == NULL)
+            return EOF;
+    }
+    return 0;
+}
+
+/* This function parses a comma separated list of non-negative ints. */
+int str2IntList(const char *list, int *values, int *numOfValues) {
+    long value;
+    char *str, *next, buffer[BENCH_MAX_SWEEP * BENCH_MAX_DIGITS];
+
+    /* The default lists are constant - parse a copy */
+    if (strlen(list) >= sizeof(buffer))
+        return EOF;
+    strcpy(buffer, list);
+    *numOfValues = 0;
+    for (str = buffer; str != NULL; str = next) {
+        next = strchr(str, ',');
+        if (next != NULL)
+            *next++ = END_OF_STRING;
+        value = str2NonNegativeLong(str);
+        if (value == EOF || value > INT_MAX || *numOfValues == BENCH_MAX_SWEEP)
+            return EOF;
+        values[(*numOfValues)++] = (int) value;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+******************************** Kernels ***************************************
+*******************************************************************************/
+
+/* This function generates k Gaussian blobs - point i around center i mod k. */
+double **gaussianBlobs(SpkContext *ctx, int n, int d, int k, unsigned long seed) {
+    int i, j;
+    double radius, angle;
+    unsigned long state = seed;
+    double **centers = (double **) alloc2DArray(ctx, k, d, sizeof(double), SIZE_OF_VOID_2PTR,
+                                                NULL);
+    double **vectors = (double **) alloc2DArray(ctx, n, d, sizeof(double), SIZE_OF_VOID_2PTR,
+                                                NULL);
+    if (centers == NULL || vectors == NULL) return NULL; /* Memory allocation fail */
+
+    for (i = 0; i < k; ++i) {
+        for (j = 0; j < d; ++j) {
+            centers[i][j] = (2.0 * randomUniform(&state) - 1.0) * BLOB_SPREAD;
+        }
+    }
+    for (i = 0; i < n; ++i) {
+        for (j = 0; j < d; ++j) {
+            /* Box-Muller - 1 - U is in (0, 1] */
+            radius = sqrt(-2.0 * log(1.0 - randomUniform(&state)));
+            angle = 2.0 * BLOB_PI * randomUniform(&state);
+            vectors[i][j] = centers[i % k][j] + BLOB_DEVIATION * radius * cos(angle);
+        }
+    }
+    MyMatFree(ctx, centers);
+    return vectors;
+}
+
+/* This function forms the Weighted Adjacency Matrix pair by pair - the reference. */
+double **referenceWeightedMatrix(SpkContext *ctx, double **vectorsArray, int numOfVectors,
+                                 int dimension) {
+    int i, j;
+    double norm;
+    double **wMatrix = allocSymMatrix(ctx, numOfVectors, NULL);
+
+    if (wMatrix != NULL) { /* Memory allocation fail */
+        for (i = 0; i < numOfVectors; i++) {
+            wMatrix[i][i] = 0.0; /* No loops allowed */
+            for (j = i + 1; j < numOfVectors; j++) {
+                norm = sqrt(vectorsSqNorm(vectorsArray[i], vectorsArray[j], dimension));
+                wMatrix[i][j] = exp(-0.5 * norm);
+            }
+        }
+    }
+    return wMatrix;
+}
+
+/* This function calculates the max difference of two packed symmetric matrices. */
+double symMatrixMaxDiff(double **matrix, double **otherMatrix, int n) {
+    int i, j;
+    double maxDiff = 0.0;
+
+    for (i = 0; i < n; i++) {
+        for (j = i; j < n; j++) {
+            maxDiff = MAX(maxDiff, fabs(matrix[i][j] - otherMatrix[i][j]));
+        }
+    }
+    return maxDiff;
+}
+
+/* This function builds a case's data and kernels' inputs (untimed). */
+int initBenchCase(SpkContext *ctx, const BenchPlan *plan, BenchCase *bc) {
+    int i, k = bc->k;
+    double **wMat, **lnormMat, **tMat, **clusters;
+
+    bc->vectors = gaussianBlobs(ctx, bc->n, bc->d, k != 0 ? k : BENCH_DEFAULT_BLOBS,
+                                plan->config.seed);
+    if (bc->vectors == NULL) return EOF;
+    /* W and Lnorm - copied out of the arena, the next run replaces them */
+    wMat = dataAdjustmentMatrices(ctx, bc->vectors, wam, &k, bc->d, bc->n);
+    bc->wMat = allocSymMatrix(ctx, bc->n, NULL);
+    if (wMat == NULL || bc->wMat == NULL) return EOF;
+    for (i = 0; i < bc->n; ++i) {
+        memcpy(bc->wMat[i] + i, wMat[i] + i, (bc->n - i) * sizeof(double));
+    }
+    lnormMat = dataAdjustmentMatrices(ctx, bc->vectors, lnorm, &k, bc->d, bc->n);
+    bc->lnormMat = allocSymMatrix(ctx, bc->n, NULL);
+    if (lnormMat == NULL || bc->lnormMat == NULL) return EOF;
+    for (i = 0; i < bc->n; ++i) {
+        memcpy(bc->lnormMat[i] + i, lnormMat[i] + i, (bc->n - i) * sizeof(double));
+    }
+    tMat = dataAdjustmentMatrices(ctx, bc->vectors, spk, &k, bc->d, bc->n);
+    if (tMat == NULL) return EOF;
+    bc->numOfClusters = k;
+    bc->tMat = (double **) alloc2DArray(ctx, bc->n, k, sizeof(double), SIZE_OF_VOID_2PTR, NULL);
+    if (bc->tMat == NULL) return EOF; /* Memory allocation fail */
+    for (i = 0; i < bc->n; ++i) {
+        memcpy(bc->tMat[i], tMat[i], k * sizeof(double));
+    }
+    bc->labels = NULL;
+    if (plan->numOfLandmarks > 0) { /* The Nystrom kernel's reference */
+        clusters = kMeans(ctx, bc->tMat, bc->n, k, k, NULL, MAX_KMEANS_ITER);
+        if (clusters == NULL) return EOF;
+        bc->labels = clusters[k];
+    }
+    return 0;
+}
+
+/* This function runs a kernel once - its input is copied first (untimed). */
+double runKernel(SpkContext *run, const BenchCase *bc, KERNEL kernel, double *accuracy) {
+    int i, status, k = bc->k;
+    double seconds, **input = NULL, **result, **clusters;
+    SpkContext ariContext;
+
+    if (run->config.numOfThreads > 1 && initThreadPool(run, run->config.numOfThreads - 1) == EOF)
+        return EOF; /* Workers started before the clock */
+    if (kernel == jacobiKernel) { /* Jacobi works in place */
+        input = allocSymMatrix(run, bc->n, NULL);
+        if (input == NULL) return EOF; /* Memory allocation fail */
+        for (i = 0; i < bc->n; ++i) {
+            memcpy(input[i] + i, bc->lnormMat[i] + i, (bc->n - i) * sizeof(double));
+        }
+    } else if (kernel == kmeansKernel) {
+        input = (double **) alloc2DArray(run, bc->n, bc->numOfClusters, sizeof(double),
+                                         SIZE_OF_VOID_2PTR, NULL);
+        if (input == NULL) return EOF; /* Memory allocation fail */
+        for (i = 0; i < bc->n; ++i) {
+            memcpy(input[i], bc->tMat[i], bc->numOfClusters * sizeof(double));
+        }
+    }
+
+    seconds = wallTime();
+    switch (kernel) {
+        case jacobiKernel:
+            result = jacobiAlgorithm(run, input, bc->n);
+            break;
+        case kmeansKernel:
+            result = kMeans(run, input, bc->n, bc->numOfClusters, bc->numOfClusters, NULL,
+                            MAX_KMEANS_ITER);
+            break;
+        case wamReferenceKernel:
+            result = referenceWeightedMatrix(run, bc->vectors, bc->n, bc->d);
+            break;
+        case nystromKernel:
+            run->config.numOfLandmarks = bc->landmarks;
+            result = dataAdjustmentMatrices(run, bc->vectors, spk, &k, bc->d, bc->n);
+            break;
+        default: /* The goals' stages */
+            result = dataAdjustmentMatrices(run, bc->vectors, KERNEL_GOAL[kernel], &k, bc->d,
+                                            bc->n);
+    }
+    seconds = wallTime() - seconds;
+    if (result == NULL) return EOF;
+    if (kernel == wamReferenceKernel && accuracy != NULL) { /* The same W */
+        *accuracy = symMatrixMaxDiff(result, bc->wMat, bc->n);
+        if (!(*accuracy <= WAM_REFERENCE_TOL)) {
+            fprintf(stderr, "spkbench: W differs from the reference by %e\n", *accuracy);
+            return EOF;
+        }
+    }
+    if (kernel == nystromKernel && accuracy != NULL) { /* Its clusters against the exact ones */
+        initContext(&ariContext); /* Not in the run's stages and reports */
+        ariContext.config = run->config;
+        ariContext.config.profile = 0;
+        ariContext.config.tracePath = NULL;
+        ariContext.threadPool = run->threadPool;
+        clusters = kMeans(&ariContext, result, bc->n, k, k, NULL, MAX_KMEANS_ITER);
+        status = clusters == NULL ? EOF : adjustedRandIndex(&ariContext, bc->labels,
+                                                              bc->numOfClusters, clusters[k],
+                                                              k, bc->n, accuracy);
+        ariContext.threadPool = NULL; /* Lent - stays with the run */
+        freeAllMemory(&ariContext);
+        if (status == EOF) return EOF;
+    }
+    return seconds;
+}
+
+/* This function times a kernel - warmups, then repeats - each in a fresh context. */
+int measureKernel(SpkContext *ctx, BenchPlan *plan, const BenchCase *bc, KERNEL kernel) {
+    int i;
+    double seconds, accuracy = 0.0;
+    double *samples = (double *) myAlloc(ctx, NULL, plan->repeats * sizeof(double));
+    SpkContext run;
+    if (samples == NULL) return EOF; /* Memory allocation fail */
+
+    for (i = -plan->warmups; i < plan->repeats; ++i) {
+        initContext(&run);
+        run.config = plan->config;
+        seconds = runKernel(&run, bc, kernel, i == plan->repeats - 1 ? &accuracy : NULL);
+        if (seconds == EOF) {
+            freeAllMemory(&run);
+            return EOF;
+        }
+        if (i >= 0)
+            samples[i] = seconds;
+        if (i == plan->repeats - 1) { /* The last repeat's stages */
+            qsort(samples, plan->repeats, sizeof(double), compareDoubles);
+            writeBenchResult(plan, bc, kernel, samples, &run, accuracy);
+        }
+        freeAllMemory(&run);
+    }
+    MyFree(ctx, samples);
+    return 0;
+}
+
+/*******************************************************************************
+********************************** Output **************************************
+*******************************************************************************/
+
+/* This function writes a kernel's result as a JSON object. */
+void writeBenchResult(BenchPlan *plan, const BenchCase *bc, KERNEL kernel,
+                      const double *samples, const SpkContext *run, double accuracy) {
+    int i, repeats = plan->repeats;
+    double sum = 0.0;
+    const StageReport *stage;
+    FILE *json = plan->json;
+
+    for (i = 0; i < repeats; ++i) {
+        sum += samples[i];
+    }
+    fprintf(json, "%s\n{\"n\": %d, \"d\": %d, \"k\": %d, \"clusters\": %d, \"kernel\": \"%s\", "
+                  "\"repeats\": %d, \"min\": %.9f, \"median\": %.9f, \"mean\": %.9f, "
+                  "\"max\": %.9f, \"samples\": [", plan->numOfResults++ > 0 ? "," : "", bc->n,
+            bc->d, bc->k, bc->numOfClusters,
+            kernel < kmeansKernel ? GOAL_STRING[KERNEL_GOAL[kernel]] :
+                                    OTHER_KERNEL_STRING[kernel - kmeansKernel], repeats,
+            samples[0], repeats % 2 ? samples[repeats / 2] :
+                        (samples[repeats / 2 - 1] + samples[repeats / 2]) / 2.0,
+            sum / repeats, samples[repeats - 1]);
+    for (i = 0; i < repeats; ++i) {
+        fprintf(json, "%s%.9f", i > 0 ? ", " : "", samples[i]);
+    }
+    fprintf(json, "], ");
+    if (kernel == nystromKernel)
+        fprintf(json, "\"landmarks\": %d, \"ari\": %.6f, ", bc->landmarks, accuracy);
+    else if (kernel == wamReferenceKernel)
+        fprintf(json, "\"max_diff\": %e, ", accuracy);
+    fprintf(json, "\"stages\": [");
+    for (i = 0; i < run->report.profile.numOfStages; ++i) {
+        stage = &run->report.profile.stages[i];
+        fprintf(json, "%s{\"name\": \"%s\", \"start\": %.9f, \"seconds\": %.9f, \"bytes\": %ld",
+                i > 0 ? ", " : "", stage->name, stage->start, stage->seconds, stage->bytes);
+        if (stage->counterName != NULL)
+            fprintf(json, ", \"%s\": %ld", stage->counterName, stage->counter);
+        fprintf(json, "}");
+    }
+    fprintf(json, "]}");
+}
+
+/* This function calculates the adjusted Rand index of two labelings. */
+int adjustedRandIndex(SpkContext *ctx, const double *labels, int k, const double *otherLabels,
+                      int otherK, int n, double *ari) {
+    int i, j;
+    double index = 0.0, rows = 0.0, columns = 0.0, expected, max;
+    double *counts = (double *) myAlloc(ctx, NULL, (k + 1) * (otherK + 1) * sizeof(double));
+    double *rowSums = counts + k * otherK, *columnSums = rowSums + k;
+    if (counts == NULL) return EOF; /* Memory allocation fail */
+
+    /* The contingency table and its margins */
+    for (i = 0; i < (k + 1) * (otherK + 1); ++i) {
+        counts[i] = 0.0;
+    }
+    for (i = 0; i < n; ++i) {
+        counts[(int) labels[i] * otherK + (int) otherLabels[i]] += 1.0;
+        rowSums[(int) labels[i]] += 1.0;
+        columnSums[(int) otherLabels[i]] += 1.0;
+    }
+    /* Pairs in the same cluster - of both, of each, and the expected index */
+    for (i = 0; i < k * otherK; ++i) {
+        index += counts[i] * (counts[i] - 1.0) / 2.0;
+    }
+    for (i = 0; i < k; ++i) {
+        rows += rowSums[i] * (rowSums[i] - 1.0) / 2.0;
+    }
+    for (j = 0; j < otherK; ++j) {
+        columns += columnSums[j] * (columnSums[j] - 1.0) / 2.0;
+    }
+    expected = rows * columns / (n * (n - 1.0) / 2.0);
+    max = (rows + columns) / 2.0;
+    *ari = max == expected ? 1.0 : (index - expected) / (max - expected);
+    MyFree(ctx, counts);
+    return 0;
+}
+
+/* This function compares two doubles (qsort ascending). */
+int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
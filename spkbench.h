@@ -0,0 +1,211 @@
+#ifndef FINAL_PROJECT_SPKBENCH_H
+#define FINAL_PROJECT_SPKBENCH_H
+/* This header contains constants, types and functions of the C benchmark -
+ *      times the goals' stages and the jacobi / kmeans kernels on synthetic data */
+
+/*******************************************************************************
+********************************* Constants ************************************
+*******************************************************************************/
+/* Sweep - default values and max values per list */
+#define BENCH_MAX_SWEEP 16
+#define BENCH_MAX_DIGITS 12 /* Chars per list value, the comma included */
+#define BENCH_DEFAULT_N "500,1000"
+#define BENCH_DEFAULT_D "4,16"
+#define BENCH_DEFAULT_K "3,8"
+#define BENCH_DEFAULT_WARMUPS 1
+#define BENCH_DEFAULT_REPEATS 5
+/* Gaussian blobs - centers uniform in [-BLOB_SPREAD, BLOB_SPREAD]^d, unit deviation */
+#define BLOB_SPREAD 10.0
+#define BLOB_DEVIATION 1.0
+#define BLOB_PI 3.14159265358979323846 /* Box-Muller's angle - M_PI isn't C90 */
+#define BENCH_DEFAULT_BLOBS 4 /* Blobs of a k = 0 (eigengap) case */
+/* Max |W - W'| of "weightedMatrix" against the per-pair reference - exp's and the
+ *      Gram form's rounding (the distances' cancellation for close points) */
+#define WAM_REFERENCE_TOL 1.0E-9
+/* MyAssert that closes the JSON results file first */
+#define BenchAssert(plan, exp)  \
+if (!(exp)) {                   \
+if ((plan)->json != stdout) {   \
+fclose((plan)->json); }         \
+MyAssert(0);                    \
+}
+
+/* Benchmark options - the other options are the spkmeans ones */
+#define N_OPTION "--n="
+#define D_OPTION "--d="
+#define K_OPTION "--k="
+#define WARMUPS_OPTION "--warmups="
+#define REPEATS_OPTION "--repeats="
+#define JSON_OPTION "--json="
+
+/*******************************************************************************
+*********************************** Types **************************************
+*******************************************************************************/
+/* Timed kernels - the goals' stages through "dataAdjustmentMatrices", then
+ *      "jacobiAlgorithm" on Lnorm, "kMeans" on T, the per-pair W reference
+ *      ("referenceWeightedMatrix") and the Nystrom spk (once per m) */
+typedef enum {
+    wamKernel, ddgKernel, lnormKernel, spkKernel, jacobiKernel, kmeansKernel,
+    wamReferenceKernel, nystromKernel, NUM_OF_KERNELS
+} KERNEL;
+
+/* Benchmark plan - the sweep and each run's configuration */
+typedef struct {
+    SpkConfig config; /* Applied to each run's context */
+    int sizes[BENCH_MAX_SWEEP], numOfSizes; /* n values */
+    int dimensions[BENCH_MAX_SWEEP], numOfDimensions; /* d values */
+    int clusters[BENCH_MAX_SWEEP], numOfClusters; /* k values, 0 - eigengap */
+    int landmarks[BENCH_MAX_SWEEP], numOfLandmarks; /* Nystrom's m values, none - not run */
+    int warmups; /* Untimed runs before the repeats */
+    int repeats;
+    FILE *json; /* Results' output */
+    int numOfResults; /* Written so far */
+} BenchPlan;
+
+/* A (n, d, k) case - the data and the kernels' inputs */
+typedef struct {
+    int n, d, k; /* k - as requested, 0 - eigengap */
+    int numOfClusters; /* Resolved k - T's columns */
+    double **vectors; /* n * d Gaussian blobs */
+    double **wMat; /* Packed W ("weightedMatrix") - the wam reference kernel's check */
+    double **lnormMat; /* Packed Lnorm - "jacobiAlgorithm"'s input */
+    double **tMat; /* n * numOfClusters T - "kMeans"' input */
+    double *labels; /* Exact spk's labels ("kMeans" on T) - the Nystrom kernel's reference */
+    int landmarks; /* The Nystrom kernel's m */
+} BenchCase;
+
+/*******************************************************************************
+**************************** Functions Declaration *****************************
+*******************************************************************************/
+
+/**
+ * Benchmark program - runs every kernel on every (n, d, k) of the sweep and
+ *      writes the timings as JSON.
+ * @param argv - Optional: --n=LIST --d=LIST --k=LIST --nystrom=LIST (comma separated),
+ *      --warmups=N, --repeats=N, --json=PATH (default - stdout) and the spkmeans
+ *      options (--threads=N, --solver=NAME, --kmeans=NAME, --init=NAME, --seed=N, ...)
+ */
+int main(int argc, char *argv[]);
+
+/**
+ * This function reads the cmd-line arguments into the plan.
+ * @param ctx Benchmark's context (see "SpkContext")
+ * @param plan Plan to be assigned
+ * @param argc Number of cmd-line arguments
+ * @param argv cmd-line arguments as array of strings
+ * @return 0 if all the arguments are valid, EOF otherwise
+ */
+int assignBenchInput(SpkContext *ctx, BenchPlan *plan, int argc, char **argv);
+
+/**
+ * This function parses a comma separated list of non-negative ints.
+ * @param list List as string
+ * @param values Values to be assigned
+ * @param numOfValues Number of values to be assigned
+ * @return 0 if valid, EOF otherwise (also more than BENCH_MAX_SWEEP values)
+ */
+int str2IntList(const char *list, int *values, int *numOfValues);
+
+/**
+ * This function generates k Gaussian blobs - point i around center i mod k.
+ * @param ctx Run context (see "SpkContext")
+ * @param n Number of points
+ * @param d Dimension
+ * @param k Number of blobs
+ * @param seed Random sequence's seed
+ * @return n * d matrix ("alloc2DArray"), NULL on failure
+ */
+double **gaussianBlobs(SpkContext *ctx, int n, int d, int k, unsigned long seed);
+
+/**
+ * This function forms the Weighted Adjacency Matrix pair by pair - the loop
+ *      "weightedMatrix" replaced (libm's exp of each direct distance), kept
+ *      as the wam kernel's reference: its timing and W.
+ * @param ctx Run context (see "SpkContext")
+ * @param vectorsArray Vectors
+ * @param numOfVectors Number of vectors
+ * @param dimension Vectors' dimension
+ * @return Packed symmetric W (see "allocSymMatrix"), NULL if memory allocation fail
+ */
+double **referenceWeightedMatrix(SpkContext *ctx, double **vectorsArray, int numOfVectors,
+                                 int dimension);
+
+/**
+ * This function calculates the max difference of two packed symmetric matrices.
+ * @param matrix Packed symmetric matrix (see "allocSymMatrix")
+ * @param otherMatrix Packed symmetric matrix
+ * @param n Matrices' dimension
+ * @return max |matrix[i][j] - otherMatrix[i][j]|
+ */
+double symMatrixMaxDiff(double **matrix, double **otherMatrix, int n);
+
+/**
+ * This function builds a case's data and kernels' inputs (untimed).
+ * @param ctx Case's context (see "SpkContext") - holds the case's memory
+ * @param plan Benchmark's plan
+ * @param bc Case to be built, its n, d and k set
+ * @return 0 if built, EOF on failure
+ */
+int initBenchCase(SpkContext *ctx, const BenchPlan *plan, BenchCase *bc);
+
+/**
+ * This function runs a kernel once - its input is copied first (untimed).
+ * @param run Run's context (see "SpkContext")
+ * @param bc Case
+ * @param kernel Kernel to run
+ * @param accuracy The kernel's accuracy to be assigned (untimed), NULL - not computed:
+ *      Nystrom - adjusted Rand index of "kMeans" on its T against the exact labels
+ *      (in a context of its own - not in run's stages), wam reference - max |W - W'|
+ *      against "weightedMatrix"'s (above WAM_REFERENCE_TOL - a failure)
+ * @return Kernel's wall time in seconds, EOF on failure
+ */
+double runKernel(SpkContext *run, const BenchCase *bc, KERNEL kernel, double *accuracy);
+
+/**
+ * This function times a kernel - warmups, then repeats - each in a fresh
+ *      context, and writes its result.
+ * @param ctx Case's context (see "SpkContext") - holds the samples
+ * @param plan Benchmark's plan
+ * @param bc Case
+ * @param kernel Kernel to time
+ * @return 0 on success, EOF on failure
+ */
+int measureKernel(SpkContext *ctx, BenchPlan *plan, const BenchCase *bc, KERNEL kernel);
+
+/**
+ * This function writes a kernel's result as a JSON object:
+ *      {"n", "d", "k", "clusters" (resolved k), "kernel", "repeats", "min",
+ *       "median", "mean", "max", "samples": [...], "stages": [{"name", "start", "seconds", "bytes", counter}]}
+ *      The Nystrom kernel's also has "landmarks" (m) and "ari" - its clusters' accuracy,
+ *      the wam reference's "max_diff" - max |W - W'|.
+ * @param plan Benchmark's plan
+ * @param bc Case
+ * @param kernel Kernel
+ * @param samples Repeats' wall times, sorted
+ * @param run Last repeat's context - its recorded stages
+ * @param accuracy The kernel's accuracy (see "runKernel")
+ */
+void writeBenchResult(BenchPlan *plan, const BenchCase *bc, KERNEL kernel,
+                      const double *samples, const SpkContext *run, double accuracy);
+
+/**
+ * This function calculates the adjusted Rand index of two labelings -
+ *      1 for the same partition, about 0 for independent ones.
+ * @param ctx Run context (see "SpkContext")
+ * @param labels First labeling ("kMeans"' labels row), values 0 to k - 1
+ * @param k First labeling's number of clusters
+ * @param otherLabels Second labeling, values 0 to otherK - 1
+ * @param otherK Second labeling's number of clusters
+ * @param n Number of points
+ * @param ari Index to be assigned
+ * @return 0 on success, EOF if memory allocation fail
+ */
+int adjustedRandIndex(SpkContext *ctx, const double *labels, int k, const double *otherLabels,
+                      int otherK, int n, double *ari);
+
+/**
+ * This function compares two doubles (qsort ascending).
+ */
+int compareDoubles(const void *a, const void *b);
+
+#endif /* FINAL_PROJECT_SPKBENCH_H */
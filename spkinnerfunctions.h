@@ -12,40 +12,152 @@
 #include <string.h>
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /*******************************************************************************
 ********************************* Constants ************************************
 *******************************************************************************/
 #define EPSILON 1.0E-15
 #define MAX_JACOBI_ITER 100
-#define MAX_FEATURES 10
+#define THRESHOLD_SWEEPS 3 /* Cyclic Jacobi - sweeps with a rotation threshold */
+#define THRESHOLD_FACTOR 0.2 /* Threshold = factor * mean abs off-diagonal element */
+#define NEGLIGIBLE_FACTOR 100.0 /* Skip a_pq if 100|a_pq| doesn't change a_pp, a_qq */
+#define MAX_QL_ITER 30 /* QL iterations per eigenvalue */
+#define QL_EPSILON 2.220446049250313E-16 /* 2^-52 */
+#define LANCZOS_EXTRA_VECTORS 20 /* Krylov basis size - max(2 * nev, nev + extra) */
+#define MAX_LANCZOS_RESTARTS 1000
+#define LANCZOS_EIGEN_CAP 20 /* Lanczos, k = 0 - default eigengap candidates */
+#define MATVEC_LANES 8 /* Row block lanes of the packed mat-vec, each with its own sums */
+#define RANDOM_MULTIPLIER 1103515245UL /* Lanczos start vectors - 31 bit LCG */
+#define RANDOM_INCREMENT 12345UL
+#define RANDOM_MASK 0x7FFFFFFFUL
 #define COMMA_CHAR ','
+#define NEW_LINE_CHAR '\n'
 #define REQUIRED_NUM_OF_ARGUMENTS 4
+#define THREADS_OPTION "--threads="
+#define SOLVER_OPTION "--solver="
+#define TOL_OPTION "--tol="
+#define EIGENCAP_OPTION "--eigencap="
+#define AFFINITY_OPTION "--affinity="
+#define KMEANS_OPTION "--kmeans="
+#define BATCH_OPTION "--batch="
+#define BATCH_TOL_OPTION "--batch-tol="
+#define SEED_OPTION "--seed="
+#define INIT_OPTION "--init="
+#define NYSTROM_OPTION "--nystrom="
+#define LANDMARKS_OPTION "--landmarks="
+#define AFFINITY_PARAM_CHAR ':' /* knn:K, eps:E */
+#define SAVE_BINARY_OPTION "--save-binary="
+#define OUTPUT_OPTION "--output="
+#define OUTPUT_TEXT "text"
+#define OUTPUT_BINARY "binary"
+#define VERBOSE_OPTION "--verbose"
+#define PROFILE_OPTION "--profile"
+#define TRACE_OPTION "--trace="
+#define TRACE_END "\n], \"displayTimeUnit\": \"ms\"}\n" /* Trace file's closing - "writeTrace" */
+#define CACHE_OPTION "--cache="
 #define K_ARGUMENT 1
 #define GOAL_ARGUMENT 2
-#define MAX_DATAPOINTS 50
 #define END_OF_STRING '\0'
 #define PRINT_FORMAT "%.4f"
 #define ERROR_MSG "An Error Has Occured\n"
 #define INVALID_INPUT_MSG "Invalid Input!\n"
+/* Weighted matrix kernel */
+#define GRAM_BLOCK_SIZE 64 /* Tile edge - a few tiles of doubles fit in L1/L2 */
+#define DEGREE_LANES 64 /* Row block lanes, each with its own degree partial sums */
+#define LOG2E 1.4426950408889634074
+#define LN2_HI 6.93147180369123816490e-01 /* ln2 = LN2_HI + LN2_LO (Cody-Waite) */
+#define LN2_LO 1.90821492927058770002e-10
+#define EXP_SHIFTER 6755399441055744.0 /* 1.5 * 2^52 - rounds to nearest integer */
+#define EXP_MIN_ARG (-708.0) /* exp(x) below this underflows to zero */
+#define EXP_BIAS 1023UL
+#define EXP_MANTISSA_BITS 52
+/* Input reader */
+#define READ_CHUNK_SIZE (1 << 20) /* Bytes per fread, the buffer grows for longer lines */
+#define INITIAL_ROWS_CAPACITY 64 /* Datapoints' block doubles when full */
+#define FAST_PARSE_DIGITS 15 /* Any 15 digits integer is exact as a double */
+#define FAST_PARSE_MAX_EXP 22 /* 10^22 is the largest exact power of ten */
+#define BYTES_PER_MB 1.0E6
+#define BINARY_MAGIC "SPKBIN1" /* Binary input format's signature (8 bytes with '\0') */
+#define BINARY_DTYPE_LE "<f8" /* numpy style dtype - float64, byte order */
+#define BINARY_DTYPE_BE ">f8"
+/* Result writer */
+#define OUTPUT_BUFFER_SIZE (1 << 20) /* Bytes buffered before a write to stdout */
+#define MAX_VALUE_CHARS 320 /* "%.4f" of any double - 309 digits, sign, point, decimals */
+#define MAX_INDEX_CHARS 20 /* unsigned long's digits */
+#define FORMAT_SCALE 1.0E4 /* 4 digits after the decimal point */
+#if ULONG_MAX > 0xFFFFFFFFUL
+#define FORMAT_FAST_LIMIT 1.0E15 /* Scaled values below 2^52 - exact fraction */
+#else
+#define FORMAT_FAST_LIMIT 4.0E9 /* Scaled values below 2^32 - the units fit a 32-bit long */
+#endif
+#define FORMAT_TIE_TOL 8.881784197001252E-16 /* 2^-50 - relative distance from a .5 tie */
+/* Accelerated kmeans */
+#define ELKAN_MIN_K 20 /* triangle - Elkan's k lower bounds pay off from here */
+#define BOUND_SLACK 1.0E-9 /* Relative margin of the bounds' tests over rounding errors */
+#define KMEANS_LANES 64 /* Assignment step - vector block lanes, each with its own sums */
+#define KMEANS_LANE_MIN 1024 /* Min vectors per lane - smaller inputs sum in a single lane */
+#define SCALABLE_ROUNDS 5 /* k-means|| oversampling rounds */
+#define SCALABLE_OVERSAMPLING 2.0 /* k-means|| - expected candidates per round / k */
+/* Nystrom */
+#define NYSTROM_LANES 64 /* Affinity block - row block lanes, each with its own column sums */
+#define NYSTROM_LANE_MIN 256 /* Min rows per lane */
+#define NYSTROM_RCOND 1.0E-10 /* Landmarks' kernel eigenvalues kept - relative to the largest */
+/* Eigenpairs cache - files named by their key, a 64 bit FNV-1a hash in hex */
+#define CACHE_MAGIC "SPKEIG2" /* Cache file's signature (8 bytes with '\0') */
+#define CACHE_FILE_FORMAT "%s/spk-%s.eig" /* Directory, key */
+#define CACHE_TEMP_FORMAT "%s.%ld.%lx" /* File, writer's pid and context - renamed when done */
+#define CACHE_PATH_EXTRA 64 /* Path's chars beyond the directory */
+#define CACHE_KEY_CHARS 16 /* Key's hex digits */
+/* FNV-1a 64 in 16 bit limbs, least significant first - C90 has no 64 bit
+ * integer type, and a limb's products and carries fit in an unsigned long */
+#define FNV_LIMBS 4
+#define FNV_LIMB_BITS 16
+#define FNV_LIMB_MASK 0xFFFFUL
+#define FNV_OFFSET_LIMBS {0x2325UL, 0x8422UL, 0x9CE4UL, 0xCBF2UL} /* 0xCBF29CE484222325 */
+#define FNV_PRIME_LIMBS {0x01B3UL, 0x0000UL, 0x0100UL, 0x0000UL} /* 0x100000001B3 */
+#define BATCH_PATIENCE 10 /* Mini-batch - steps without a better smoothed inertia */
+/* Thread pool */
+#define CHUNKS_PER_THREAD 8 /* Chunks handed to each thread in a row loop */
+/* Memory plan */
+#define ARENA_ALIGNMENT 64 /* Bytes - arena buffers and matrix rows (cache line, AVX-512) */
 
 /*******************************************************************************
 ********************************* Macros ***************************************
 *******************************************************************************/
 /* x^2 macro */
 #define SQ(x) ((x)*(x))
+/* Min of two values */
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
 
-/* Custom logical assert macro - print error, free memory and exit program */
+/* Custom logical assert macro (CLI) - print error, free memory and exit program */
 #define MyAssert(exp)       \
 if (!(exp)) {               \
 fprintf(stderr, ERROR_MSG); \
-freeAllMemory();            \
+freeCliMemory();            \
 exit(EXIT_FAILURE);         \
 }
 
 /* Enum macros */
 #define GENERATE_STRING(STRING) #STRING,
 static const char *GOAL_STRING[] = {FOREACH_GOAL(GENERATE_STRING)};
+static const char *SOLVER_STRING[] = {FOREACH_SOLVER(GENERATE_STRING)};
+static const char *AFFINITY_STRING[] = {FOREACH_AFFINITY(GENERATE_STRING)};
+static const char *KMEANS_STRING[] = {FOREACH_KMEANS(GENERATE_STRING)};
+static const char *INIT_STRING[] = {FOREACH_INIT(GENERATE_STRING)};
+
+/* Exact powers of ten for the fast float parser */
+static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                               1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+                               1e20, 1e21, 1e22};
 
 /*******************************************************************************
 ********************************* Struct ***************************************
@@ -57,12 +169,268 @@ typedef struct {
     int counter; /* Number of vectors (datapoints) in cluster */
 } Cluster;
 
+/* Arena regions - each one's buffers are replaced from stage to stage:
+ * matrixRegion - W -> Lnorm (in place), then D (ddg) or T (spk)
+ * vectorsRegion - W's degrees, then the eigenvectors and eigenvalues
+ * workRegion - W's scratch, then the eigensolver's workspace */
+typedef enum {
+    matrixRegion,
+    vectorsRegion,
+    workRegion,
+    NUM_OF_REGIONS
+} REGION;
+
+/* A run's stage buffers - ARENA_ALIGNMENT aligned regions planned up front by
+ *      "planMemory". A region's buffers are bump allocated and released all at
+ *      once by "resetRegion" when its stage is over.
+ * Allocated as a single "myAlloc" block - the struct, then the regions */
+struct SpkArena {
+    SpkArena *prev; /* Context's previous arena - its results may still be in use */
+    char *base;
+    size_t size;
+    size_t regionStart[NUM_OF_REGIONS]; /* Offsets from base */
+    size_t regionSize[NUM_OF_REGIONS];
+    size_t regionUsed[NUM_OF_REGIONS];
+    size_t highWater[NUM_OF_REGIONS];
+};
+
+/* Triangle inequality bounds of the accelerated kmeans (Hamerly / Elkan).
+ * Distances here are euclidean (not squared).
+ * Allocated as a single "myAlloc" block - the struct, then the arrays */
+typedef struct {
+    KMEANS variant; /* hamerly / elkan */
+    int numOfBounds; /* Lower bounds per vector - 1 (hamerly) or k (elkan) */
+    double *upper; /* Per vector - bound of the distance to its centroid */
+    double *lower; /* Per vector - hamerly: bound of the distance to any other
+                    * centroid, elkan: bounds of the distances to each centroid */
+    double *drift; /* Per centroid - its move in the last update */
+    double *halfGap; /* Per centroid - half the distance to the closest other one */
+    double *halfDists; /* elkan - k * k half distances between the centroids */
+    double maxDrift; /* The largest drift in the last update */
+    long distances; /* Vector to centroid distances computed */
+    int valid; /* 0 - an empty cluster's nan centroid, full (lloyd) scans from now on */
+} KMeansBounds;
+
+/* Arguments of the parallel seeding's squared distances update */
+typedef struct {
+    double **vectorsArray;
+    int *centers; /* Candidates' vector indexes */
+    double *minSqDists; /* Per vector - squared distance to the closest candidate */
+    int *nearest; /* Per vector - the closest candidate (position in centers) */
+    int firstCenter; /* Update by centers [firstCenter, numOfCenters) */
+    int numOfCenters;
+    int numOfVectors;
+    int dimension;
+} SeedingArgs;
+
+/* Arguments of the parallel kmeans assignment step.
+ * The vectors are split to fixed lanes (contiguous blocks), each lane sums
+ *      its vectors per cluster and the lanes are reduced in order - the
+ *      centroids don't depend on the number of threads */
+typedef struct {
+    double **vectorsArray;
+    Cluster *clustersArray;
+    double *vecToClusterLabeling;
+    KMeansBounds *bounds; /* NULL - lloyd's full scans */
+    double *laneSums; /* Per lane - k * dimension sums, then k counters */
+    long *laneDistances; /* Per lane - distances computed by the bounded variants */
+    int k;
+    int numOfVectors;
+    int dimension;
+    int numOfLanes;
+    int laneSize; /* Vectors per lane, the last one may have less */
+    int firstIteration; /* 1 - no labels / bounds yet */
+} KMeansAssignArgs;
+
+/* Loop body run by the thread pool on items [begin, end) */
+typedef void (*ParallelTask)(void *args, int begin, int end, int threadId);
+
+/* A worker thread's arguments */
+typedef struct {
+    ThreadPool *pool;
+    int threadId;
+} PoolWorker;
+
+/* Thread pool - the calling thread works as thread 0.
+ * Allocated as a single "myAlloc" block - the struct, workers, workerArgs */
+struct ThreadPool {
+    pthread_t *workers;
+    PoolWorker *workerArgs;
+    int numOfWorkers;
+    pthread_mutex_t lock;
+    pthread_cond_t jobReady, jobDone;
+    ParallelTask task;
+    void *args;
+    int numOfItems, chunkSize, nextItem;
+    int activeWorkers; /* Workers that didn't finish the current job yet */
+    unsigned long jobId;
+    int shutdown;
+};
+
+/* Arguments of the parallel weighted matrix stage */
+typedef struct {
+    double **vectorsArray;
+    const double *sqNorms;
+    double *tileBuffers; /* One tile buffer per thread */
+    double *degreeSums; /* One partial degrees array per lane */
+    double **wMatrix;
+    int numOfVectors;
+    int dimension;
+    int numOfLanes;
+} WeightedMatrixArgs;
+
+/* Arguments of the parallel laplacian stage */
+typedef struct {
+    double **wMatrix;
+    const double *invSqrtDegrees; /* D^-1/2 diagonal */
+    int n;
+} MatrixRowsArgs;
+
+/* A point's neighbour - sparse affinity */
+typedef struct {
+    int index;
+    double sqDist;
+} Neighbour;
+
+/* Arguments of the parallel sparse affinity stages */
+typedef struct {
+    double **vectors;
+    int n;
+    int dimension;
+    int numOfNeighbours; /* knn - K */
+    double maxSqDist; /* eps - pairs closer than this have weight above E */
+    Neighbour *neighbours; /* knn - each point's K nearest, a max-heap */
+    Neighbour *entries; /* knn - symmetrized rows, before the merge of duplicates */
+    long *rowStart; /* knn - entries' rows offsets */
+    long *rowCounts; /* Entries per row */
+    CsrMatrix *csr;
+    double *degrees;
+} SparseAffinityArgs;
+
+/* Arguments of the parallel Nystrom stages.
+ * The affinity block's rows are split to fixed lanes, each lane sums its
+ *      rows' columns and the lanes are reduced in order */
+typedef struct {
+    double **vectorsArray;
+    const int *landmarks;
+    double **cMat; /* n * m affinity block C, then G's rank columns, then T's k in place */
+    double *laneSums; /* Per lane - C's m column sums */
+    const double *weights; /* A^+ * C^T * 1 - the degrees are C * weights - 1 */
+    double **pMat; /* rank * m - A^-1/2's kept eigenvectors, scaled (G = D^-1/2 * C * P^T) */
+    double **rMat; /* k * rank - G^T * G's eigenvectors, scaled (T's rows = G * R^T) */
+    double *scratch; /* Per thread - a row of m */
+    double **gram; /* Packed rank * rank G^T * G */
+    double **tMat; /* cMat */
+    int numOfVectors;
+    int dimension;
+    int numOfLandmarks;
+    int rank;
+    int k;
+    int numOfLanes;
+    int laneSize; /* Rows per lane, the last one may have less */
+} NystromArgs;
+
+/* Arguments of the parallel jacobi round - one rotation per index pair */
+typedef struct {
+    double **a;
+    double **v;
+    int n;
+    int numOfPairs;
+    const int *first; /* Pair k rotates (first[k], second[k]), first < second */
+    const int *second; /* second[k] == n - no partner (odd n) */
+    const double *cosines; /* cosines[k] == 1, sines[k] == 0 - no rotation */
+    const double *sines;
+} JacobiRoundArgs;
+
+/* Linear operator y = A * x - the iterative eigensolvers' view of a matrix */
+typedef struct LinearOperator LinearOperator;
+struct LinearOperator {
+    void (*apply)(const LinearOperator *op, const double *x, double *y);
+    SpkContext *ctx; /* Context of apply's parallel loops */
+    const void *matrix;
+    double *workspace; /* Scratch of the apply function */
+    int n;
+};
+
+/* Arguments of the parallel mat-vecs */
+typedef struct {
+    const void *matrix; /* Packed (double **) or CsrMatrix */
+    const double *x;
+    double *y;
+    double *laneSums; /* Packed - numOfLanes * n partial sums */
+    int n;
+    int numOfLanes;
+} MatVecArgs;
+
+/* Chunked csv file reader - the lines are parsed in place in the buffer */
+typedef struct {
+    FILE *file;
+    char *buffer; /* capacity + 1 bytes, the data is '\0' terminated */
+    size_t capacity;
+    size_t begin; /* Unparsed data - buffer[begin, end) */
+    size_t end;
+    long bytes; /* Bytes read so far */
+    int eof;
+    int error;
+} CsvReader;
+
+/* Binary input file's header, followed by rows * cols float64 values (row-major).
+ * 32 bytes - the values are 8 bytes aligned in the mapped file */
+typedef struct {
+    char magic[8]; /* BINARY_MAGIC */
+    char dtype[8]; /* BINARY_DTYPE_LE / BINARY_DTYPE_BE - the writer's byte order */
+    int64_t rows; /* Fixed 8 bytes - the same layout with a 32-bit long */
+    int64_t cols;
+} BinaryHeader;
+
+/* Eigenpairs cache file's header, followed by the sorted eigenvalues and their
+ *      eigenvectors (rows in the same order) - float64, the writer's byte order.
+ * 48 bytes - the values are 8 bytes aligned in the mapped file */
+typedef struct {
+    char magic[8]; /* CACHE_MAGIC */
+    char dtype[8]; /* BINARY_DTYPE_LE / BINARY_DTYPE_BE */
+    char key[CACHE_KEY_CHARS]; /* See "eigenpairsKey" - hex digits, no '\0' */
+    int64_t n; /* Lnorm's dimension - fixed 8 bytes, as "BinaryHeader"'s */
+    int64_t numOfEigenpairs; /* The smallest ones */
+} CacheHeader;
+
+/* A mapped cache file - a context's list (see "SpkContext") */
+struct SpkMapping {
+    void *addr;
+    size_t length;
+    SpkMapping *next;
+};
+
+/* Buffered stdout writer of the print functions */
+typedef struct {
+    char data[OUTPUT_BUFFER_SIZE];
+    size_t length;
+    int binary; /* Raw float64 values instead of csv text */
+} OutputBuffer;
+
+/* Memory mapped input file */
+typedef struct {
+    void *addr; /* NULL - none */
+    size_t length;
+} MappedFile;
+
 /* Eigenvalue type for the jacobi algorithm */
 typedef struct {
     double value;
     int vector;
 } Eigenvalue;
 
+/* Arguments of the parallel range of k clusterings - Lnorm's shared eigenpairs */
+typedef struct {
+    SpkConfig config; /* Each clustering's context's */
+    Eigenvalue *eigenvalues;
+    double **eigenvectorsMat;
+    SpkClustering *clusterings; /* Their k set, the results' buffers allocated */
+    int *status; /* Per clustering - "spkClusterK"'s result, 0 or EOF */
+    ThreadPool *threadPool; /* The caller's, lent to the contexts, NULL - none */
+    int numOfDatapoints;
+} SpkRangeArgs;
+
 /*******************************************************************************
 **************************** Functions Declaration *****************************
 *******************************************************************************/
@@ -71,53 +439,430 @@ typedef struct {
 
 /**
  * This function form the Weighted Adjacency Matrix out of vectors list.
+ * W is a packed symmetric matrix (see "allocSymMatrix").
+ * The degrees (W's row sums) are summed while the rows are filled.
+ * @param ctx Run context (see "SpkContext")
  * @param vectorsArray Vectors as a matrix
  * @param numOfVectors number of vectors
  * @param dimension vectors' dimension
+ * @param degrees To be assigned with W's row sums (numOfVectors doubles)
  * @return Weighted Adjacency Matrix as matrix (2D double array), NULL on failure
  */
-double **weightedMatrix(double **vectorsArray, int numOfVectors, int dimension);
+double **weightedMatrix(SpkContext *ctx, double **vectorsArray, int numOfVectors, int dimension,
+                        double *degrees);
+
+/**
+ * This function calculates the scratch "weightedMatrix" needs - the squared
+ *      norms, the lanes' partial degrees and a tile buffer per thread.
+ * @param ctx Run context (see "SpkContext")
+ * @param numOfVectors number of vectors
+ * @param dimension vectors' dimension
+ * @return Number of doubles
+ */
+size_t weightedMatrixScratch(SpkContext *ctx, int numOfVectors, int dimension);
+
+/**
+ * Parallel task - fills the weighted matrix tiles of lanes [begin, end).
+ * Lane l owns the row blocks l, l + numOfLanes, ... (balances the triangle)
+ *      and sums their degrees into its own partial array, so the result
+ *      doesn't depend on the number of threads.
+ * @param args WeightedMatrixArgs
+ * @param begin First lane
+ * @param end Last lane (exclusive)
+ * @param threadId Calling thread's index (selects its tile buffer)
+ */
+void weightedMatrixTask(void *args, int begin, int end, int threadId);
 
 /**
- * This function form the Diagonal Degree Matrix of Weighted Adjacency Matrix.
- * @param wMatrix Weighted Adjacency Matrix
+ * Parallel task - Lnorm's rows [begin, end).
+ * @param args MatrixRowsArgs
+ * @param begin First row
+ * @param end Last row (exclusive)
+ * @param threadId Calling thread's index
+ */
+void laplacianTask(void *args, int begin, int end, int threadId);
+
+/**
+ * This function fills one upper triangle tile of the Weighted Adjacency Matrix.
+ * Distances are computed as ||x||^2 + ||y||^2 - 2x*y over the tile.
+ * @param vectorsArray Vectors as a matrix
+ * @param sqNorms Vectors' squared euclidean norms
+ * @param tileBuffer Scratch buffer of GRAM_BLOCK_SIZE * dimension doubles
+ * @param wMatrix Packed Weighted Adjacency Matrix to fill
+ * @param numOfVectors number of vectors
+ * @param dimension vectors' dimension
+ * @param degreeSums Partial degrees to add the tile's row and column sums to
+ * @param rowBlock Tile's first row
+ * @param colBlock Tile's first column (rowBlock <= colBlock)
+ */
+void weightedMatrixTile(double **vectorsArray, const double *sqNorms, double *tileBuffer,
+                        double **wMatrix, int numOfVectors, int dimension,
+                        double *degreeSums, int rowBlock, int colBlock);
+
+/**
+ * This function replaces each element x (x <= 0) of an array with exp(x).
+ * Branch free polynomial evaluation, so the compiler can vectorize the loop.
+ * @param array Array of exponents, overwritten with the results
+ * @param len Array's length
+ */
+void vectorExp(double *array, int len);
+
+/**
+ * This function form the Diagonal Degree Matrix out of W's degrees.
+ * @param ctx Run context (see "SpkContext")
+ * @param degrees W's row sums
  * @param n W's dimension
  * @return Diagonal matrix, NULL on failure
  */
-double **dMatrix(double **wMatrix, int n);
+double **dMatrix(SpkContext *ctx, const double *degrees, int n);
 
 /**
- * This function form the Normalized Graph Laplacian matrix in a given D + W matrix.
- * Overwrite W matrix to be Lnorm.
- * @param wMatrix Weighted Adjacency Matrix
- * @param dMatrix Diagonal Degree Matrix
- * @param numOfVectors W/D's dimension
+ * This function form the Normalized Graph Laplacian matrix in a given W + degrees.
+ * Overwrite W matrix to be Lnorm and the degrees to be D^-1/2 diagonal.
+ * @param ctx Run context (see "SpkContext")
+ * @param wMatrix Packed Weighted Adjacency Matrix
+ * @param degrees W's row sums
+ * @param numOfVectors W's dimension
  * @return Lnorm matrix
  */
-double **laplacian(double **wMatrix, double **dMatrix, int numOfVectors);
+double **laplacian(SpkContext *ctx, double **wMatrix, double *degrees, int numOfVectors);
 
 /**
  * This function form T matrix from Lnorm eigenvalues, eigenvectors and k.
+ * @param ctx Run context (see "SpkContext")
  * @param eigenvalues Lnorm's eigenvalues sorted
  * @param eigenvectorsMat Lnorm's eigenvectors sorted
  * @param n Lnorm's dimension
  * @param k Number of clusters for the kmeans
  * @return T matrix, NULL on failure
  */
-double **initTMatrix(Eigenvalue *eigenvalues, double **eigenvectorsMat, int n, int k);
+double **initTMatrix(SpkContext *ctx, Eigenvalue *eigenvalues, double **eigenvectorsMat, int n,
+                     int k);
 
 /**
  * This function calculate the optimum k using Eigengap Heuristic method.
  * @param eigenvalues Lnorm's eigenvalues sorted
  * @param n Lnorm's dimension > 1
+ * @param numOfEigenvalues Number of (smallest) eigenvalues available > 1
  * @return Optimum k (number of clusters) for the kmeans
  */
-int eigengapHeuristicKCalc(Eigenvalue *eigenvalues, int n);
+int eigengapHeuristicKCalc(Eigenvalue *eigenvalues, int n, int numOfEigenvalues);
+
+/**
+ * This function calculates the number of eigenvalues the eigengap heuristic
+ *      looks at - n / 2 + 1, capped by ctx->config.eigenCap (if set) or, for the
+ *      lanczos solver, by LANCZOS_EIGEN_CAP - its cost grows with the candidates.
+ * @param ctx Run context (see "SpkContext")
+ * @param n Lnorm's dimension > 1
+ * @return Number of eigenvalues
+ */
+int eigengapCandidates(SpkContext *ctx, int n);
+
+/**
+ * This function runs the spk algorithm's steps 1 to 3 - W, Lnorm and Lnorm's
+ *      eigenpairs - stopping early at the wam, ddg and lnorm goals.
+ * @param ctx Run context (see "SpkContext")
+ * @param datapointsArray Datapoints
+ * @param goal Desired goal
+ * @param k Number of clusters (0 - eigengap) - the eigenpairs "lanczos" computes
+ * @param dimension Datapoints' dimension
+ * @param numOfDatapoints Number of datapoints
+ * @param eigenvalues spk - to be assigned with the sorted eigenvalues
+ * @param numOfEigenpairs spk - to be assigned with the number of eigenpairs
+ * @return spk - the eigenvectors (rows, see "Eigenvalue"), else the goal's
+ *      matrix (see "dataAdjustmentMatrices"), NULL on failure
+ */
+double **spectralSteps(SpkContext *ctx, double **datapointsArray, GOAL goal, int k,
+                       int dimension, int numOfDatapoints, Eigenvalue **eigenvalues,
+                       int *numOfEigenpairs);
+
+/**
+ * Parallel task - the clusterings [begin, end) of a range of k, each in its own context
+ *      (running on the lent thread pool, if any). Sets their status.
+ * @param args SpkRangeArgs
+ * @param begin First clustering
+ * @param end Last clustering (exclusive)
+ * @param threadId Calling thread's index
+ */
+void spkRangeTask(void *args, int begin, int end, int threadId);
+
+/**
+ * This function forms one k's T out of the shared eigenpairs and clusters it.
+ * @param ctx Clustering's context (see "SpkContext") - holds T and kmeans' memory
+ * @param rangeArgs The range's eigenpairs
+ * @param clustering Clustering to be filled, its k set
+ * @return 0 on success, EOF on failure
+ */
+int spkClusterK(SpkContext *ctx, const SpkRangeArgs *rangeArgs, SpkClustering *clustering);
+
+/************************** Sparse Affinity Functions *************************/
+
+/**
+ * This function builds the symmetrized K nearest neighbours W in CSR format
+ *      (brute force search, O(n^2 * d) time, O(n * K) memory).
+ * @param ctx Run context (see "SpkContext")
+ * @param vectorsArray Vectors
+ * @param numOfVectors Number of vectors
+ * @param dimension Vectors' dimension
+ * @param numOfNeighbours K (capped by n - 1)
+ * @param degrees To be assigned with W's degrees
+ * @return W, NULL if memory allocation fail
+ */
+CsrMatrix *knnWeightedMatrix(SpkContext *ctx, double **vectorsArray, int numOfVectors,
+                             int dimension, int numOfNeighbours, double *degrees);
+
+/**
+ * This function builds the epsilon graph W (weights above minWeight) in CSR
+ *      format - counts each row's entries, then fills them.
+ * @param ctx Run context (see "SpkContext")
+ * @param vectorsArray Vectors
+ * @param numOfVectors Number of vectors
+ * @param dimension Vectors' dimension
+ * @param minWeight E, 0 < E < 1
+ * @param degrees To be assigned with W's degrees
+ * @return W, NULL if memory allocation fail
+ */
+CsrMatrix *epsWeightedMatrix(SpkContext *ctx, double **vectorsArray, int numOfVectors,
+                             int dimension, double minWeight, double *degrees);
+
+/**
+ * Parallel task - the K nearest neighbours of vectors [begin, end).
+ * @param args SparseAffinityArgs
+ * @param begin First vector
+ * @param end Last vector (exclusive)
+ * @param threadId Calling thread's index
+ */
+void knnTask(void *args, int begin, int end, int threadId);
+
+/**
+ * Parallel task - sorts the symmetrized rows [begin, end) by column and
+ *      merges duplicates (pairs that are neighbours both ways).
+ * @param args SparseAffinityArgs
+ * @param begin First row
+ * @param end Last row (exclusive)
+ * @param threadId Calling thread's index
+ */
+void knnMergeTask(void *args, int begin, int end, int threadId);
+
+/**
+ * Parallel task - copies the merged rows [begin, end) into the CSR matrix.
+ * @param args SparseAffinityArgs
+ * @param begin First row
+ * @param end Last row (exclusive)
+ * @param threadId Calling thread's index
+ */
+void knnCopyTask(void *args, int begin, int end, int threadId);
+
+/**
+ * Parallel task - epsilon graph rows [begin, end): counts the entries
+ *      (args->csr == NULL), or fills them.
+ * @param args SparseAffinityArgs
+ * @param begin First row
+ * @param end Last row (exclusive)
+ * @param threadId Calling thread's index
+ */
+void epsTask(void *args, int begin, int end, int threadId);
+
+/**
+ * Parallel task - turns the squared distances of rows [begin, end) into
+ *      weights (0 on the diagonal) and sums the degrees.
+ * @param args SparseAffinityArgs
+ * @param begin First row
+ * @param end Last row (exclusive)
+ * @param threadId Calling thread's index
+ */
+void csrWeightsTask(void *args, int begin, int end, int threadId);
+
+/**
+ * This function scales a CSR W into Lnorm in place, as "laplacian".
+ * Isolated points (degree 0) get an identity row.
+ * @param ctx Run context (see "SpkContext")
+ * @param wMatrix W
+ * @param degrees W's degrees, destroyed (D^-1/2)
+ * @return Lnorm
+ */
+CsrMatrix *sparseLaplacian(SpkContext *ctx, CsrMatrix *wMatrix, double *degrees);
+
+/**
+ * Parallel task - Lnorm's rows [begin, end), CSR.
+ * @param args SparseAffinityArgs
+ * @param begin First row
+ * @param end Last row (exclusive)
+ * @param threadId Calling thread's index
+ */
+void sparseLaplacianTask(void *args, int begin, int end, int threadId);
+
+/**
+ * Comparator function for the neighbours max-heap - by distance, then index.
+ * @param p1 Neighbour
+ * @param p2 Neighbour
+ * @return Positive if p1 is farther, negative if closer, 0 if the same
+ */
+int cmpNeighbours(const void *p1, const void *p2);
+
+/**
+ * Comparator function for the rows merge qsort - by index.
+ * @param p1 Neighbour
+ * @param p2 Neighbour
+ * @return p1's index - p2's index
+ */
+int cmpNeighbourIndexes(const void *p1, const void *p2);
+
+/**
+ * This function restores the max-heap property from the root down.
+ * @param heap The heap
+ * @param size heap's size
+ */
+void siftDownNeighbours(Neighbour *heap, int size);
+
+/**
+ * This function restores the max-heap property from the last element up.
+ * @param heap The heap
+ * @param size heap's size (the new element included)
+ */
+void siftUpNeighbours(Neighbour *heap, int size);
+
+/**
+ * This function allocates a CSR matrix as one "myAlloc" block.
+ * @param ctx Run context (see "SpkContext")
+ * @param n Matrix's dimension
+ * @param nnz Number of stored entries
+ * @return The matrix, NULL if memory allocation fail
+ */
+CsrMatrix *allocCsrMatrix(SpkContext *ctx, int n, long nnz);
+
+/**
+ * This function copies a CSR matrix into a packed symmetric matrix.
+ * @param ctx Run context (see "SpkContext")
+ * @param csr The sparse matrix
+ * @return The packed matrix, NULL if memory allocation fail
+ */
+double **csrToSymMatrix(SpkContext *ctx, const CsrMatrix *csr);
+
+/****************************** Nystrom Functions *****************************/
+
+/**
+ * Parallel task - the affinity block C's rows of lanes [begin, end) and the
+ *      lanes' column sums.
+ * @param args NystromArgs
+ * @param begin First lane
+ * @param end Last lane (exclusive)
+ * @param threadId Calling thread's index
+ */
+void nystromAffinityTask(void *args, int begin, int end, int threadId);
+
+/**
+ * Parallel task - G's rows [begin, end), in place of C's: the approximate
+ *      degree scales the row (D^-1/2), then it's projected on P's rows.
+ * @param args NystromArgs
+ * @param begin First row
+ * @param end Last row (exclusive)
+ * @param threadId Calling thread's index
+ */
+void nystromEmbeddingTask(void *args, int begin, int end, int threadId);
+
+/**
+ * Parallel task - G^T * G's packed rows [begin, end).
+ * @param args NystromArgs
+ * @param begin First row
+ * @param end Last row (exclusive)
+ * @param threadId Calling thread's index
+ */
+void nystromGramTask(void *args, int begin, int end, int threadId);
+
+/**
+ * Parallel task - T's rows [begin, end), in place of G's - G's rows projected
+ *      on R's rows, normalized (a zero row is left zero).
+ * @param args NystromArgs
+ * @param begin First row
+ * @param end Last row (exclusive)
+ * @param threadId Calling thread's index
+ */
+void nystromTTask(void *args, int begin, int end, int threadId);
+
+/**
+ * This function projects a row on a matrix's rows - out[j] = <row, mat[j]>.
+ * @param row Row of n elements
+ * @param mat Matrix of m rows of n elements
+ * @param n Row's length
+ * @param m Number of rows
+ * @param out m projections (may not overlap row)
+ */
+void projectRow(const double *row, double **mat, int n, int m, double *out);
+
+/************************** Eigenpairs Cache Functions ************************/
+
+/**
+ * This function calculates the cache key of a run's eigenpairs - a hash of
+ *      the datapoints and of the parameters Lnorm's eigenpairs depend on: the
+ *      solver and the ones it uses (cyclic / parallel - tol and max sweeps,
+ *      lanczos - tol), the affinity and its parameter (knn / eps). Not the
+ *      threads - they don't change them.
+ * @param ctx Run context (see "SpkContext")
+ * @param datapointsArray Datapoints
+ * @param numOfDatapoints Number of datapoints
+ * @param dimension Datapoints' dimension
+ * @param key To be assigned with the 64 bit FNV-1a hash - CACHE_KEY_CHARS hex
+ *      digits and '\0'
+ */
+void eigenpairsKey(SpkContext *ctx, double **datapointsArray, int numOfDatapoints,
+                   int dimension, char *key);
+
+/**
+ * This function adds bytes to a FNV-1a hash.
+ * @param hash Hash so far, FNV_LIMBS limbs (FNV_OFFSET_LIMBS - none), updated
+ * @param data Bytes to add
+ * @param size Number of bytes
+ */
+void fnv1a(unsigned long *hash, const void *data, size_t size);
+
+/**
+ * This function builds a key's cache file path in ctx->config.cacheDir.
+ * @param ctx Run context (see "SpkContext")
+ * @param key Eigenpairs' key (see "eigenpairsKey")
+ * @return Path ("myAlloc" block), NULL if memory allocation fail
+ */
+char *eigenpairsPath(SpkContext *ctx, const char *key);
+
+/**
+ * This function looks the eigenpairs up in the cache. A hit is memory mapped
+ *      (read only) - the eigenvectors' rows point into the file - and its
+ *      arena planned (the eigenvalues and T, see "planMemory").
+ * Counts the lookup (and the hit) in ctx->report.cache.
+ * @param ctx Run context (see "SpkContext")
+ * @param path Cache file (see "eigenpairsPath")
+ * @param key Eigenpairs' key - the file's must match
+ * @param n Lnorm's dimension
+ * @param k Number of clusters (0 - eigengap) - the eigenpairs needed, as "spectralSteps"'
+ * @param eigenvalues To be assigned with the sorted eigenvalues
+ * @param numOfEigenpairs To be assigned with the number of eigenpairs
+ * @return The eigenvectors (rows, in the eigenvalues' order), NULL on a miss
+ *      (no file, another key's, fewer eigenpairs) or failure
+ */
+double **loadEigenpairs(SpkContext *ctx, const char *path, const char *key, int n, int k,
+                        Eigenvalue **eigenvalues, int *numOfEigenpairs);
+
+/**
+ * This function writes the sorted eigenpairs to the cache - to a temporary
+ *      file, renamed when complete, so a reader never maps a partial file.
+ * A write failure (e.g. no such directory) only leaves the cache as is.
+ * @param ctx Run context (see "SpkContext")
+ * @param path Cache file (see "eigenpairsPath")
+ * @param key Eigenpairs' key
+ * @param n Lnorm's dimension
+ * @param eigenvectorsMat Eigenvectors (rows)
+ * @param eigenvalues Sorted eigenvalues
+ * @param numOfEigenpairs Number of eigenpairs
+ */
+void storeEigenpairs(SpkContext *ctx, const char *path, const char *key, int n,
+                     double **eigenvectorsMat, const Eigenvalue *eigenvalues,
+                     int numOfEigenpairs);
 
 /****************************** KMeans Functions ******************************/
 
 /**
  * This function initialize the clusters array.
+ * @param ctx Run context (see "SpkContext")
  * @param vectorsArray Vectors to be clustered
  * @param k Number of desired clusters
  * @param dimension vectors' dimension
@@ -125,23 +870,50 @@ int eigengapHeuristicKCalc(Eigenvalue *eigenvalues, int n);
  *          centroids (for kmeans++ only), NULL for kmeans
  * @return Initialized Clusters array
  */
-Cluster *initClusters(double **vectorsArray, int k, int dimension,
+Cluster *initClusters(SpkContext *ctx, double **vectorsArray, int k, int dimension,
                       const int *firstCentralIndexes);
 
 /**
- * This function assign the closest cluster for each vector.
- * The function also cont the number of vectors for each cluster
- *      and sum the vectors components for later use.
+ * This function allocates the kmeans assignment step's lanes - at most
+ *      KMEANS_LANES, of at least KMEANS_LANE_MIN vectors - and sets its arguments.
+ * @param ctx Run context (see "SpkContext")
+ * @param args The assignment step's arguments
  * @param vectorsArray Vectors to be clustered
  * @param clustersArray Clusters array
  * @param vecToClusterLabeling Vector to cluster labeling array
+ * @param bounds The bounds (hamerly / elkan), NULL - lloyd
  * @param k Number of clusters
  * @param numOfVectors Number of vectors
  * @param dimension Vectors' dimension
+ * @return 0 on success, EOF if memory allocation fail (args->laneSums - the block)
  */
-void assignVectorsToClusters(double **vectorsArray, Cluster *clustersArray,
-                             double *vecToClusterLabeling, int k,
-                             int numOfVectors, int dimension);
+int initKMeansLanes(SpkContext *ctx, KMeansAssignArgs *args, double **vectorsArray,
+                    Cluster *clustersArray, double *vecToClusterLabeling, KMeansBounds *bounds,
+                    int k, int numOfVectors, int dimension);
+
+/**
+ * This function assign the closest cluster for each vector.
+ * The function also cont the number of vectors for each cluster
+ *      and sum the vectors components for later use.
+ * The lanes run on the thread pool, each with its own sums and counters,
+ *      reduced in the lanes' order.
+ * With bounds, skips the distances they rule out - the first iteration
+ *      computes all the distances and sets the bounds. A bound test passes
+ *      only by a BOUND_SLACK margin and ties are broken towards the lower
+ *      index, so the labels are exactly lloyd's.
+ * @param ctx Run context (see "SpkContext")
+ * @param args The assignment step's arguments (see "initKMeansLanes")
+ */
+void assignVectorsToClusters(SpkContext *ctx, KMeansAssignArgs *args);
+
+/**
+ * Parallel task - assigns the vectors of lanes [begin, end) and sums them per cluster.
+ * @param args KMeansAssignArgs
+ * @param begin First lane
+ * @param end Last lane (exclusive)
+ * @param threadId Calling thread's index
+ */
+void kMeansAssignTask(void *args, int begin, int end, int threadId);
 
 /**
  * This function finds vector's closest cluster (in terms of euclidean norm).
@@ -167,7 +939,7 @@ double vectorsSqNorm(const double *vec1, const double *vec2, int dimension);
  * @param clustersArray Clusters array
  * @param k Number of clusters
  * @param dimension Vectors' dimension
- * @return Number of clusters' components changed during last iteration
+ * @return Number of clusters' centroids that moved during last iteration
  */
 int recalcCentroids(Cluster *clustersArray, int k, int dimension);
 
@@ -181,6 +953,165 @@ int recalcCentroids(Cluster *clustersArray, int k, int dimension);
  */
 void initCurrCentroidAndCounter(Cluster *clustersArray, int k, int dimension);
 
+/**
+ * This function allocates the accelerated kmeans' bounds.
+ * @param ctx Run context (see "SpkContext")
+ * @param variant hamerly / elkan
+ * @param numOfVectors Number of vectors
+ * @param k Number of clusters
+ * @return The bounds (no assignment yet), NULL if memory allocation fail
+ */
+KMeansBounds *initKMeansBounds(SpkContext *ctx, KMEANS variant, int numOfVectors, int k);
+
+/**
+ * Hamerly's assignment of a single vector.
+ * @param bounds The bounds
+ * @param vec Vector to be clustered
+ * @param i Vector's index
+ * @param clustersArray Clusters array
+ * @param label Vector's cluster in the last iteration
+ * @param k Number of clusters
+ * @param dimension Vectors' dimension
+ * @param firstIteration 1 - compute all the distances
+ * @param distances Distances computed counter
+ * @return Vector's closest cluster index
+ */
+int hamerlyAssign(KMeansBounds *bounds, const double *vec, int i, Cluster *clustersArray,
+                  int label, int k, int dimension, int firstIteration, long *distances);
+
+/**
+ * Elkan's assignment of a single vector.
+ * @param bounds The bounds
+ * @param vec Vector to be clustered
+ * @param i Vector's index
+ * @param clustersArray Clusters array
+ * @param label Vector's cluster in the last iteration
+ * @param k Number of clusters
+ * @param dimension Vectors' dimension
+ * @param firstIteration 1 - compute all the distances
+ * @param distances Distances computed counter
+ * @return Vector's closest cluster index
+ */
+int elkanAssign(KMeansBounds *bounds, const double *vec, int i, Cluster *clustersArray,
+                int label, int k, int dimension, int firstIteration, long *distances);
+
+/**
+ * This function computes the centroids' half gaps (and elkan's half distances)
+ *      for the next assignment step.
+ * @param bounds The bounds
+ * @param clustersArray Clusters array (prevCentroid - the centroids)
+ * @param k Number of clusters
+ * @param dimension Vectors' dimension
+ */
+void centroidsHalfGaps(KMeansBounds *bounds, Cluster *clustersArray, int k, int dimension);
+
+/**
+ * This function moves the bounds by the centroids' drift after an update -
+ *      the upper bounds grow by their centroid's move, the lower ones shrink.
+ * An empty cluster (nan centroid) invalidates the bounds.
+ * @param ctx Run context (see "SpkContext")
+ * @param args The assignment step's arguments (clustersArray -
+ *      prevCentroid -> currCentroid)
+ */
+void updateKMeansBounds(SpkContext *ctx, KMeansAssignArgs *args);
+
+/**
+ * Parallel task - moves the bounds of vectors [begin, end).
+ * @param args KMeansAssignArgs
+ * @param begin First vector
+ * @param end Last vector (exclusive)
+ * @param threadId Calling thread's index
+ */
+void kMeansBoundsTask(void *args, int begin, int end, int threadId);
+
+/**
+ * This function checks a bound test - a < b by the BOUND_SLACK margin.
+ * @param a Smaller side
+ * @param b Larger side
+ * @return 1 if a < b surely (despite the rounding errors), else 0
+ */
+int surelyBelow(double a, double b);
+
+/**
+ * This function updates the vectors' squared distances to their closest
+ *      candidate by the new candidates (on the thread pool).
+ * @param ctx Run context (see "SpkContext")
+ * @param args Seeding arguments - [firstCenter, numOfCenters) are the new candidates
+ */
+void updateSeedingDists(SpkContext *ctx, SeedingArgs *args);
+
+/**
+ * Parallel task - updates the squared distances of vectors [begin, end).
+ * @param args SeedingArgs
+ * @param begin First vector
+ * @param end Last vector (exclusive)
+ * @param threadId Calling thread's index
+ */
+void seedingDistsTask(void *args, int begin, int end, int threadId);
+
+/**
+ * This function draws an index with probability weights[i] / sum(weights)
+ *      (uniformly if all the weights are 0).
+ * @param weights Non negative weights
+ * @param n Number of weights
+ * @param state Random sequence's state
+ * @return The drawn index
+ */
+int weightedDraw(const double *weights, int n, unsigned long *state);
+
+/**
+ * This function runs k-means|| - SCALABLE_ROUNDS rounds, each one draws every
+ *      vector as a candidate with probability SCALABLE_OVERSAMPLING * k *
+ *      D^2 / sum(D^2), then picks k of the candidates by k-means++, weighted by
+ *      the number of vectors closest to each candidate.
+ * @param ctx Run context (see "SpkContext")
+ * @param args Seeding arguments (centers - room for numOfVectors candidates)
+ * @param seeds The k seeds (output)
+ * @param numOfVectors Number of vectors
+ * @param k Number of desired clusters
+ * @param state Random sequence's state (first candidate already drawn)
+ * @return 0 on success, EOF if memory allocation fail
+ */
+int scalableSeeds(SpkContext *ctx, SeedingArgs *args, int *seeds, int numOfVectors, int k,
+                  unsigned long *state);
+
+/**
+ * This function draws k seeds by a seeding method (see "kMeansSeeds").
+ * @param ctx Run context (see "SpkContext")
+ * @param vectorsArray Vectors
+ * @param numOfVectors Number of vectors
+ * @param dimension Vectors' dimension
+ * @param k Number of seeds (<= numOfVectors)
+ * @param init Seeding method
+ * @return k vectors indexes, NULL if memory allocation fail
+ */
+int *drawSeeds(SpkContext *ctx, double **vectorsArray, int numOfVectors, int dimension, int k,
+               INIT init);
+
+/**
+ * This function runs mini-batch kmeans (Sculley) - each step samples
+ *      ctx->config.batchSize vectors (with repetitions, ctx->config.seed's
+ *      sequence), assigns them to the closest centroids and moves each
+ *      centroid towards its vectors with its own learning rate - 1 / (number of
+ *      vectors it got so far).
+ * Stops once the mean squared centroid move of a step <= ctx->config.batchTol,
+ *      or the batches' inertia (moving average) didn't improve for
+ *      BATCH_PATIENCE steps, or after maxIter epochs (maxIter * N vectors).
+ *      Then labels all the vectors.
+ * @param ctx Run context (see "SpkContext")
+ * @param vectorsArray Vectors to be clustered
+ * @param clustersArray Clusters array (currCentroid - the initial centroids)
+ * @param vecToClusterLabeling Vector to cluster labeling array (output)
+ * @param numOfVectors Number of vectors
+ * @param dimension Vectors' dimension
+ * @param k Number of clusters
+ * @param maxIter Max epochs
+ * @return Number of steps, EOF if memory allocation fail
+ */
+int miniBatchKMeans(SpkContext *ctx, double **vectorsArray, Cluster *clustersArray,
+                    double *vecToClusterLabeling, int numOfVectors, int dimension, int k,
+                    int maxIter);
+
 /**
  * This function organize KMeans result into a matrix:
  *      First k rows - Clusters centroids
@@ -196,41 +1127,344 @@ double **buildFinalCentroidsMat(Cluster *clustersArray, double *vecToClusterLabe
 
 /******************************** Jacobi Functions ****************************/
 
+/**
+ * This function runs the ctx->config.solver variant on a symmetric matrix -
+ *      "jacobiAlgorithm" within an already planned run (see "planMemory").
+ * @param ctx Run context (see "SpkContext")
+ * @param matrix A packed symmetric matrix (see "allocSymMatrix")
+ * @param n matrix's dimension
+ * @return Transposed eigenvectors matrix (V^T), NULL on failure
+ */
+double **runEigensolver(SpkContext *ctx, double **matrix, int n);
+
 /**
  * This function performs a single jacobi rotation.
- * @param a A symmetric matrix to perform the rotation on
+ * @param a A packed symmetric matrix to perform the rotation on
  * @param v The cumulative eigenvectors matrix
  * @param n a's dimension
  * @param i Pivot row index
- * @param j Pivot column index
+ * @param j Pivot column index (i < j)
  * @return Off-diag Frobenius norm delta
  */
 double jacobiRotate(double **a, double **v, int n, int i, int j);
 
+/**
+ * Classic Jacobi - rotates the max abs off diagonal element each time.
+ * Stops after MAX_JACOBI_ITER rotations or when a rotation changed Off(A)^2
+ *      by less than EPSILON.
+ * @param ctx Run context (see "SpkContext")
+ * @param a A packed symmetric matrix
+ * @param v The cumulative eigenvectors matrix (starts as identity)
+ * @param n a's dimension
+ * @return 1 - success, 0 - memory allocation fail
+ */
+int jacobiClassic(SpkContext *ctx, double **a, double **v, int n);
+
+/**
+ * Cyclic-by-row threshold Jacobi - sweeps over the upper triangle row by row,
+ *      rotating the elements above the sweep's threshold.
+ * Stops when Off(A) <= ctx->config.jacobiTol * ||A||_F or after
+ *      ctx->config.maxSweeps sweeps.
+ * @param ctx Run context (see "SpkContext")
+ * @param a A packed symmetric matrix
+ * @param v The cumulative eigenvectors matrix (starts as identity)
+ * @param n a's dimension
+ * @return 1 - success, 0 - memory allocation fail
+ */
+int jacobiCyclic(SpkContext *ctx, double **a, double **v, int n);
+
+/**
+ * Parallel (round-robin) threshold Jacobi.
+ * Each sweep is n - 1 rounds (n + 1 - 1 for odd n) of n / 2 disjoint index
+ *      pairs (Brent-Luk ordering). Disjoint rotations commute, so all the
+ *      rotations of a round are computed from the same matrix and applied at
+ *      once - split between the threads by blocks of pairs.
+ * Threshold and convergence rules are the ones of "jacobiCyclic".
+ * @param ctx Run context (see "SpkContext")
+ * @param a A packed symmetric matrix
+ * @param v The cumulative eigenvectors matrix (starts as identity)
+ * @param n a's dimension
+ * @return 1 - success, 0 - memory allocation fail
+ */
+int jacobiParallel(SpkContext *ctx, double **a, double **v, int n);
+
+/**
+ * This function calculates the rotation (c, s) zeroing a[p][q], as in "jacobiRotate".
+ * @param a A packed symmetric matrix
+ * @param p Row index
+ * @param q Column index (p < q)
+ * @param c To be assigned with cos
+ * @param s To be assigned with sin
+ */
+void jacobiRotationParams(double **a, int p, int q, double *c, double *s);
+
+/**
+ * Parallel task - applies the round's rotations to A, one block row of pairs
+ *      ([begin, end)) at a time: B' = G1 * B * G2^T for each 2x2 block B
+ *      between pair k1 and pair k2 >= k1.
+ * @param args JacobiRoundArgs
+ * @param begin First pair
+ * @param end Last pair (exclusive)
+ * @param threadId Calling thread's index
+ */
+void jacobiRoundBlocksTask(void *args, int begin, int end, int threadId);
+
+/**
+ * Parallel task - applies the round's rotations of pairs [begin, end) to the
+ *      eigenvectors matrix.
+ * @param args JacobiRoundArgs
+ * @param begin First pair
+ * @param end Last pair (exclusive)
+ * @param threadId Calling thread's index
+ */
+void jacobiRoundVectorsTask(void *args, int begin, int end, int threadId);
+
+/**
+ * Householder tridiagonalization + implicit shift QL (EISPACK tred2 / tql2).
+ * Writes the eigenvalues on a's diagonal and zeroes its off-diagonal, as the
+ *      Jacobi solvers do.
+ * @param ctx Run context (see "SpkContext")
+ * @param a A packed symmetric matrix
+ * @param v n * n matrix, to be assigned with the eigenvectors as rows (V^T)
+ * @param n a's dimension
+ * @return 1 - success, 0 - memory allocation fail or no convergence
+ */
+int tridiagonalQL(SpkContext *ctx, double **a, double **v, int n);
+
+/**
+ * Householder reduction of a symmetric matrix to tridiagonal form (tred2).
+ * @param v The full symmetric matrix, replaced by the orthogonal
+ *      transformation (columns)
+ * @param d To be assigned with the diagonal
+ * @param e To be assigned with the subdiagonal in e[1..n-1], e[0] = 0
+ * @param n v's dimension
+ */
+void householderTridiagonal(double **v, double *d, double *e, int n);
+
+/**
+ * Implicit shift QL on a symmetric tridiagonal matrix (tql2).
+ * @param ctx Run context (see "SpkContext")
+ * @param w The tridiagonalization's transformation, transposed - its rows are
+ *      rotated into the eigenvectors
+ * @param d The diagonal, to be replaced by the eigenvalues
+ * @param e The subdiagonal in e[1..n-1], destroyed
+ * @param n w's dimension
+ * @return Number of QL iterations, EOF if an eigenvalue didn't converge
+ *      after MAX_QL_ITER iterations
+ */
+int implicitQL(SpkContext *ctx, double **w, double *d, double *e, int n);
+
+/**
+ * Full decomposition with the Lanczos solver (jacobi goal) - same contract as
+ *      the Jacobi solvers.
+ * @param ctx Run context (see "SpkContext")
+ * @param a A packed symmetric matrix
+ * @param v n * n matrix, to be assigned with the eigenvectors as rows (V^T)
+ * @param n a's dimension
+ * @return 1 - success, 0 - memory allocation fail or no convergence
+ */
+int lanczosFull(SpkContext *ctx, double **a, double **v, int n);
+
+/**
+ * This function computes the nev smallest eigenpairs of a symmetric matrix
+ *      with the Lanczos solver.
+ * @param ctx Run context (see "SpkContext")
+ * @param op The matrix
+ * @param nev Number of eigenpairs (<= n)
+ * @param eigenvalues To be assigned with the nev eigenvalues, sorted
+ * @return nev * n eigenvectors matrix (rows), NULL if memory allocation fail
+ *      or no convergence
+ */
+double **partialEigenpairs(SpkContext *ctx, const LinearOperator *op, int nev,
+                           Eigenvalue **eigenvalues);
+
+/**
+ * This function sets a linear operator over a packed symmetric matrix.
+ * @param ctx Run context (see "SpkContext")
+ * @param op To be assigned with the operator (release op->workspace with MyFree)
+ * @param a A packed symmetric matrix
+ * @param n a's dimension
+ * @return 1 - success, 0 - memory allocation fail
+ */
+int symMatOperator(SpkContext *ctx, LinearOperator *op, double **a, int n);
+
+/**
+ * This function sets a linear operator over a CSR matrix.
+ * @param ctx Run context (see "SpkContext")
+ * @param op To be assigned with the operator (no workspace)
+ * @param csr The sparse matrix
+ */
+void csrOperator(SpkContext *ctx, LinearOperator *op, const CsrMatrix *csr);
+
+/**
+ * This function calculates the Lanczos basis size - min(n, max(2 * nev, nev + extra)).
+ * @param n Matrix's dimension
+ * @param nev Number of eigenpairs
+ * @return Number of basis vectors (ncv)
+ */
+int lanczosBasisSize(int n, int nev);
+
+/**
+ * Thick restart Lanczos (Wu-Simon) for the smallest eigenpairs, with full
+ *      reorthogonalization (classical Gram-Schmidt, twice).
+ * Each restart extends the basis to ncv = min(n, max(2 * nev, nev + extra))
+ *      vectors, takes the Ritz pairs of the projected matrix (tred2 + tql2)
+ *      and keeps the smallest nev + (ncv - nev) / 2 of them.
+ * Stops once the nev smallest Ritz pairs' residuals are below
+ *      ctx->config.jacobiTol * ||A||, or after MAX_LANCZOS_RESTARTS restarts -
+ *      then with the last Ritz pairs and ctx->report.lanczos.converged = 0.
+ * Fills ctx->report.lanczos.
+ * @param ctx Run context (see "SpkContext")
+ * @param op The matrix
+ * @param nev Number of eigenpairs (<= n)
+ * @param vectors nev * n matrix, to be assigned with the eigenvectors (rows)
+ * @param eigenvalues To be assigned with the nev eigenvalues, sorted, and
+ *      their vectors' rows
+ * @return 1 - success, 0 - memory allocation fail or QL failure (nan/inf input)
+ */
+int lanczosEigen(SpkContext *ctx, const LinearOperator *op, int nev, double **vectors,
+                 Eigenvalue *eigenvalues);
+
+/**
+ * This function combines the Lanczos basis into Ritz vectors:
+ *      out[i] = sum_j s[ritz[i].vector][j] * q[j]. out may be q itself.
+ * @param q ncv basis vectors (rows)
+ * @param s The projected matrix's eigenvectors (rows)
+ * @param ritz Sorted Ritz values and their rows in s
+ * @param count Number of Ritz vectors to build (<= ncv)
+ * @param ncv Basis size
+ * @param n Vectors' dimension
+ * @param out To be assigned with the Ritz vectors (rows)
+ * @param coords Scratch of ncv doubles
+ */
+void ritzVectors(double **q, double **s, const Eigenvalue *ritz, int count, int ncv,
+                 int n, double **out, double *coords);
+
+/**
+ * This function orthogonalizes x against q[0..count - 1] (classical
+ *      Gram-Schmidt, twice).
+ * @param q Orthonormal vectors (rows)
+ * @param count Number of vectors
+ * @param n Vectors' dimension
+ * @param x The vector to orthogonalize
+ * @param h To be assigned with the projections q[i] * x, may be NULL
+ * @return ||x|| after the orthogonalization
+ */
+double orthogonalize(double **q, int count, int n, double *x, double *h);
+
+/**
+ * This function fills a vector with pseudo random values in [-0.5, 0.5).
+ * @param x The vector
+ * @param n x's dimension
+ * @param seed Sequence seed
+ */
+void randomVector(double *x, int n, unsigned long seed);
+
+/**
+ * This function draws the next value of a pseudo random sequence (31 bit LCG).
+ * @param state Sequence's state, starts as the seed
+ * @return Value in [0, 1)
+ */
+double randomUniform(unsigned long *state);
+
+/**
+ * Packed symmetric mat-vec, y = A * x, op->matrix is the packed matrix and
+ *      op->workspace holds MATVEC_LANES * n doubles.
+ * The row blocks are split between fixed lanes and the lanes are summed in
+ *      order - the result doesn't depend on the number of threads.
+ * @param op The matrix
+ * @param x Input vector
+ * @param y Output vector
+ */
+void packedSymMatVec(const LinearOperator *op, const double *x, double *y);
+
+/**
+ * CSR mat-vec, y = A * x, op->matrix is the CsrMatrix - rows split between
+ *      the threads.
+ * @param op The matrix
+ * @param x Input vector
+ * @param y Output vector
+ */
+void csrMatVec(const LinearOperator *op, const double *x, double *y);
+
+/**
+ * Parallel task - the CSR mat-vec of rows [begin, end).
+ * @param args MatVecArgs
+ * @param begin First row
+ * @param end Last row (exclusive)
+ * @param threadId Calling thread's index
+ */
+void csrMatVecTask(void *args, int begin, int end, int threadId);
+
+/**
+ * Parallel task - the packed mat-vec of lanes [begin, end).
+ * @param args MatVecArgs
+ * @param begin First lane
+ * @param end Last lane (exclusive)
+ * @param threadId Calling thread's index
+ */
+void packedMatVecTask(void *args, int begin, int end, int threadId);
+
+/**
+ * This function calculates the Frobenius norm of a packed symmetric matrix's
+ *      off-diagonal, Off(A).
+ * @param a A packed symmetric matrix
+ * @param n a's dimension
+ * @param diagSqSum To be assigned with the sum of the squared diagonal, may be NULL
+ * @return Off(A)
+ */
+double offDiagNorm(double **a, int n, double *diagSqSum);
+
 /** This function chooses the pivot index for the jacobi rotation
- *      - the max abs off diagonal element > 0.
+ *      - the max abs off diagonal element > 0, the first one in row-major
+ *      order on ties - from the rows' cached maxima, O(n).
  * If the matrix is already diagonal - assign pivotRow with special value EOF
- * @param matrix Symmetric matrix for the jacobi rotation
+ * @param matrix Packed symmetric matrix for the jacobi rotation
  * @param n matrix's dimension
+ * @param rowArgmax Each row's max abs element column (see "rowMaxIndex")
  * @param pivotRow To assign pivot's row index
  * @param pivotCol to assing pivot's column index
  */
-void pivotIndex(double **matrix, int n, int *pivotRow, int *pivotCol);
+void pivotIndex(double **matrix, int n, const int *rowArgmax, int *pivotRow, int *pivotCol);
+
+/**
+ * This function finds the column of row's max abs element right of the
+ *      diagonal - the first one on ties.
+ * @param matrix Packed symmetric matrix
+ * @param n matrix's dimension
+ * @param row Row index
+ * @return The column index, EOF for the last row
+ */
+int rowMaxIndex(double **matrix, int n, int row);
+
+/**
+ * This function updates the rows' cached maxima after a rotation of (i, j).
+ * Rows i, j and the rows whose max was in column i or j are rescanned, the
+ *      other rows only compare their max with their new i, j elements.
+ * @param matrix Packed symmetric matrix (rotated)
+ * @param n matrix's dimension
+ * @param rowArgmax Each row's max abs element column, to update
+ * @param i Rotated row index
+ * @param j Rotated column index (i < j)
+ */
+void updateRowMaxima(double **matrix, int n, int *rowArgmax, int i, int j);
 
 /**
  * Build an n * n identity matrix.
+ * @param ctx Run context (see "SpkContext")
  * @param n matrix's dimension
  * @return Identity matrix, NULL on failure
  */
-double **initIdentityMatrix(int n);
+double **initIdentityMatrix(SpkContext *ctx, int n);
 
 /**
  * Sorting eigenvalues using qsort and comparator (makes it stable).
+ * @param ctx Run context (see "SpkContext")
  * @param a Diagonal matrix (after jacobi's algorithm)
  * @param n a's dimension
  * @return Sorted eigenvalues array
  */
-Eigenvalue *sortEigenvalues(double **a, int n);
+Eigenvalue *sortEigenvalues(SpkContext *ctx, double **a, int n);
 
 /**
  * Comparator function for the eigenvalues qsort.
@@ -249,6 +1483,20 @@ int cmpEigenvalues (const void *p1, const void *p2);
  */
 void printMatrix(double **matrix, int rows, int cols);
 
+/**
+ * This function print a packed symmetric matrix in csv format (both triangles).
+ * @param matrix Packed symmetric matrix to be printed
+ * @param n Matrix's dimension
+ */
+void printSymMatrix(double **matrix, int n);
+
+/**
+ * This function print a CSR matrix - one "row,column,value" line per stored
+ *      entry, in row-major order.
+ * @param csr Sparse matrix to be printed
+ */
+void printCsrMatrix(const CsrMatrix *csr);
+
 /**
  * The function prints the jacobi result in csv format:
  *      first line - eigenvalues
@@ -259,35 +1507,423 @@ void printMatrix(double **matrix, int rows, int cols);
  */
 void printJacobi(double **a, double **v, int n);
 
+/**
+ * This function writes matrix's rows (csv lines / raw values) to the output buffer.
+ * @param matrix Matrix
+ * @param rows Number of matrix's rows
+ * @param cols Number of matrix's columns
+ */
+void outputRows(double **matrix, int rows, int cols);
+
+/**
+ * This function starts a printed matrix - the binary format's header
+ *      (see "BinaryHeader"), nothing in text mode.
+ * @param rows Number of matrix's rows
+ * @param cols Number of matrix's columns
+ */
+void outputHeader(long rows, int cols);
+
+/**
+ * This function writes a value - "%.4f" text (NegZero applied) or its raw 8 bytes.
+ * @param value Value
+ */
+void outputValue(double value);
+
+/**
+ * This function writes an index - decimal text or a raw double.
+ * @param index Index
+ */
+void outputIndex(int index);
+
+/**
+ * This function writes a separator (comma / new line) in text mode.
+ * @param ch Separator
+ */
+void outputSeparator(char ch);
+
+/**
+ * This function writes the output buffer to stdout.
+ */
+void flushOutput();
+
+/**
+ * This function formats a value exactly as printf("%.4f") does.
+ * Values below 10^11 (4 * 10^5 with a 32-bit long) are rounded in integer
+ *      units of 10^-4, unless the scaled value is too close to a .5 tie to
+ *      decide - those and the large / non finite values are formatted by sprintf.
+ * @param value Value
+ * @param dest Buffer of at least MAX_VALUE_CHARS chars (not '\0' terminated)
+ * @return Number of chars written
+ */
+int formatValue(double value, char *dest);
+
+/**
+ * This function formats a non negative integer in decimal.
+ * @param number Number
+ * @param dest Buffer (not '\0' terminated)
+ * @param minDigits Pad with leading zeros to this number of digits (<= MAX_INDEX_CHARS)
+ * @return Number of chars written
+ */
+int formatUnsigned(unsigned long number, char *dest, int minDigits);
+
+/****************************** Memory Plan ***********************************/
+
+/**
+ * This function plans a run's stage buffers and allocates their arena -
+ *      the peak footprint of the pipeline for (n, dimension, goal) with
+ *      ctx->config's affinity, solver and threads. Any allocation failure
+ *      happens here, before the work begins.
+ * The previous arena (if any) is kept - its results may still be in use.
+ * Fills ctx->report.memory.
+ * @param ctx Run context (see "SpkContext")
+ * @param goal Goal (jacobi - the eigensolver alone)
+ * @param n Number of datapoints / matrix's dimension
+ * @param dimension Datapoints' dimension
+ * @param k Number of clusters, 0 - eigengap heuristic
+ * @return 1 - success, 0 - memory allocation fail
+ */
+int planMemory(SpkContext *ctx, GOAL goal, int n, int dimension, int k);
+
+/**
+ * This function calculates the eigensolver's workspace - the buffers the
+ *      ctx->config.solver variant allocates in the work region.
+ * @param ctx Run context (see "SpkContext")
+ * @param n Matrix's dimension
+ * @param nev Number of eigenpairs (lanczos), n - all of them
+ * @param packed 1 - a packed matrix (mat-vec lanes), 0 - CSR
+ * @return Bytes
+ */
+size_t solverWorkBytes(SpkContext *ctx, int n, int nev, int packed);
+
+/**
+ * This function plans the Nystrom approximation's buffers (see "nystromTMatrix")
+ *      and allocates their arena - the n * m affinity block (G and T in place),
+ *      the m * m matrices and the two small eigenproblems.
+ * Fills ctx->report.memory.
+ * @param ctx Run context (see "SpkContext")
+ * @param n Number of datapoints
+ * @return 1 - success, 0 - memory allocation fail
+ */
+int planNystromMemory(SpkContext *ctx, int n);
+
+/**
+ * This function calculates the number of lanes of the Nystrom affinity block's rows.
+ * @param n Number of datapoints
+ * @return Number of lanes (<= NYSTROM_LANES)
+ */
+int nystromLanes(int n);
+
+/**
+ * This function allocates the arena's single block and splits it into regions.
+ * @param ctx Run context (see "SpkContext")
+ * @param regionSizes Each region's bytes (ARENA_ALIGNMENT multiples)
+ * @return 1 - success, 0 - memory allocation fail
+ */
+int initArena(SpkContext *ctx, const size_t *regionSizes);
+
+/**
+ * This function allocates a buffer from a region of the context's arena.
+ * Beyond the plan (or with no arena) it falls back to "myAlloc" and counts
+ *      an overflow in ctx->report.memory.
+ * Release with MyFree - arena buffers are skipped (see "resetRegion").
+ * @param ctx Run context (see "SpkContext")
+ * @param region Arena region
+ * @param size Size of block in bytes
+ * @return ARENA_ALIGNMENT aligned buffer, NULL if memory allocation fail
+ */
+void *arenaAlloc(SpkContext *ctx, REGION region, size_t size);
+
+/**
+ * This function builds a matrix in an arena region - rows padded to
+ *      ARENA_ALIGNMENT bytes, followed by the row pointers.
+ * @param ctx Run context (see "SpkContext")
+ * @param region Arena region
+ * @param rows Matrix's number of rows
+ * @param cols Matrix's number of columns
+ * @return Pointer to a matrix array, NULL if memory allocation fail
+ */
+double **arenaMatrix(SpkContext *ctx, REGION region, int rows, int cols);
+
+/**
+ * This function builds a packed symmetric matrix (see "allocSymMatrix") in an arena region.
+ * @param ctx Run context (see "SpkContext")
+ * @param region Arena region
+ * @param n Matrix's dimension
+ * @return Pointer to a packed matrix, NULL if memory allocation fail
+ */
+double **arenaSymMatrix(SpkContext *ctx, REGION region, int n);
+
+/**
+ * This function releases all the buffers of an arena region - its stage is over.
+ * @param ctx Run context (see "SpkContext")
+ * @param region Arena region
+ */
+void resetRegion(SpkContext *ctx, REGION region);
+
+/**
+ * This function rounds a size up to a multiple of ARENA_ALIGNMENT.
+ * @param size Bytes
+ * @return Aligned size
+ */
+size_t alignedSize(size_t size);
+
+/**
+ * This function calculates an "arenaMatrix" matrix's bytes.
+ * @param rows Matrix's number of rows
+ * @param cols Matrix's number of columns
+ * @return Bytes (ARENA_ALIGNMENT multiple)
+ */
+size_t arenaMatrixBytes(int rows, int cols);
+
+/**
+ * This function calculates an "arenaSymMatrix" matrix's bytes.
+ * @param n Matrix's dimension
+ * @return Bytes (ARENA_ALIGNMENT multiple)
+ */
+size_t arenaSymMatrixBytes(int n);
+
+/**
+ * This function points a packed symmetric matrix's rows into a block
+ *      (the "allocSymMatrix" layout - the row pointers follow the values).
+ * @param blockMem n * (n + 1) / 2 doubles + n row pointers
+ * @param n Matrix's dimension
+ * @return Pointer to a packed matrix
+ */
+double **symMatrixRows(double *blockMem, int n);
+
+/******************************* Thread Pool **********************************/
+
+/**
+ * This function runs task over items [0, numOfItems) on ctx->config.numOfThreads
+ *      threads. Items are handed out dynamically in chunks of chunkSize.
+ * Tasks must not allocate memory (the memory list isn't thread safe).
+ * @param ctx Run context (see "SpkContext")
+ * @param task Loop body
+ * @param args Task's arguments
+ * @param numOfItems Number of items
+ * @param chunkSize Items per chunk (> 0)
+ */
+void parallelFor(SpkContext *ctx, ParallelTask task, void *args, int numOfItems, int chunkSize);
+
+/**
+ * This function computes the chunk size for a row loop over n rows.
+ * @param ctx Run context (see "SpkContext")
+ * @param n Number of rows
+ * @return Chunk size (> 0)
+ */
+int rowsChunkSize(SpkContext *ctx, int n);
+
+/**
+ * This function starts the thread pool workers.
+ * @param ctx Run context (see "SpkContext")
+ * @param numOfWorkers Number of worker threads (without the caller)
+ * @return 0 on success, EOF on failure
+ */
+int initThreadPool(SpkContext *ctx, int numOfWorkers);
+
+/**
+ * The worker threads' main loop - waits for jobs until shutdown.
+ * @param worker Pointer to the worker's PoolWorker
+ * @return NULL
+ */
+void *threadPoolWorker(void *worker);
+
+/**
+ * This function runs the current job's chunks until none are left.
+ * Called with the pool lock held, returns with it held.
+ * @param pool The thread pool
+ * @param threadId Calling thread's index
+ */
+void runJobChunks(ThreadPool *pool, int threadId);
+
 /*************************** Auxiliary Functions ******************************/
 
+/**
+ * This function frees the CLI's memory - the input file's mapping and the
+ *      context's memory list (called by MyAssert on errors).
+ */
+void freeCliMemory();
+
+/**
+ * This function prints the algorithms' reports (ctx->report) to stderr.
+ * @param ctx Run context (see "SpkContext")
+ */
+void printReports(SpkContext *ctx);
+
 /**
  * This function read cmd-line arguments, validate and assign them the matching variables.
+ * @param ctx Run context (see "SpkContext")
  * @param argc Number of cmd-line arguments
  * @param argv cmd-line arguments as array of strings
  * @param k K to be assigned
  * @param goal Goal to be assigned
  * @param filenamePtr filename ptr to be assigned
  */
-void validateAndAssignInput(int argc, char **argv, int *k, GOAL *goal, char **filenamePtr);
+void validateAndAssignInput(SpkContext *ctx, int argc, char **argv, int *k, GOAL *goal,
+                            char **filenamePtr);
+
+/**
+ * This function reads the optional cmd-line arguments (after the required ones)
+ *      into ctx->config.
+ * @param ctx Run context (see "SpkContext")
+ * @param argc Number of cmd-line arguments
+ * @param argv cmd-line arguments as array of strings
+ * @return 0 if all the optional arguments are valid, EOF otherwise
+ */
+int assignOptionalInput(SpkContext *ctx, int argc, char **argv);
+
+/**
+ * This function converts a string into a positive double.
+ * @param str String to convert
+ * @return The number, EOF if not a positive double
+ */
+double str2PositiveDouble(const char *str);
+
+/**
+ * This function converts a string into a positive int.
+ * @param str String to convert
+ * @return The number, EOF if not a positive int
+ */
+int str2PositiveInt(const char *str);
+
+/**
+ * This function converts a string into a non negative long.
+ * @param str String to convert
+ * @return The number, EOF if not a non negative long
+ */
+long str2NonNegativeLong(const char *str);
 
 /**
  * The function read from csv format file (extension .txt/.csv) into matrix.
+ * The file is read in chunks and parsed in place, the datapoints' block grows
+ *      geometrically - no limit on the number of rows / columns.
+ * Fills ctx->report.read.
+ * @param ctx Run context (see "SpkContext")
  * @param rows To be assigned with matrix's number of rows
  * @param cols To be assigned with matrix's number of columns
  * @param fileName Filename of .csv/.txt file in csv format
- * @param goal SPK desired goal
+ * @param goal SPK desired goal (jacobi - the matrix must be square)
  * @return File content as a matrix
  */
-double **readDataFromFile(int *rows, int *cols, char *fileName, GOAL goal);
+double **readDataFromFile(SpkContext *ctx, int *rows, int *cols, char *fileName, GOAL goal);
+
+/**
+ * This function checks if the file is in the binary input format (by its magic).
+ * @param fileName File to check
+ * @return 1 if binary, 0 otherwise
+ */
+int isBinaryFile(const char *fileName);
+
+/**
+ * This function maps a binary input file to memory (private copy-on-write
+ *      mapping) and builds the row pointers straight into the mapped values.
+ * The mapping is released by "freeCliMemory".
+ * @param ctx Run context (see "SpkContext")
+ * @param rows To be assigned with matrix's number of rows
+ * @param cols To be assigned with matrix's number of columns
+ * @param fileName Binary file
+ * @return The mapped matrix (only the row pointers are a "myAlloc" block)
+ */
+double **mapBinaryFile(SpkContext *ctx, int *rows, int *cols, const char *fileName);
+
+/**
+ * This function writes a matrix in the binary input format.
+ * @param fileName File to write
+ * @param matrix Matrix
+ * @param rows Matrix's number of rows
+ * @param cols Matrix's number of columns
+ */
+void writeBinaryFile(const char *fileName, double **matrix, int rows, int cols);
+
+/**
+ * This function fills a binary format's header.
+ * @param header Header to fill
+ * @param rows Matrix's number of rows
+ * @param cols Matrix's number of columns
+ */
+void initBinaryHeader(BinaryHeader *header, long rows, int cols);
+
+/**
+ * This function returns the binary format's dtype of this machine's byte order.
+ * @return BINARY_DTYPE_LE or BINARY_DTYPE_BE
+ */
+const char *nativeDtype();
+
+/**
+ * This function opens the file and allocates the reader's buffer.
+ * @param ctx Run context (see "SpkContext")
+ * @param reader Reader to init
+ * @param fileName File to read
+ */
+void openCsvReader(SpkContext *ctx, CsvReader *reader, const char *fileName);
+
+/**
+ * This function closes the reader's file and frees its buffer.
+ * @param ctx Run context (see "SpkContext")
+ * @param reader Reader to close
+ */
+void closeCsvReader(SpkContext *ctx, CsvReader *reader);
+
+/**
+ * This function moves the unparsed data to the buffer's head and reads the
+ *      next chunk after it. A full buffer (a line longer than it) is doubled.
+ * @param ctx Run context (see "SpkContext")
+ * @param reader Reader
+ * @return 0 on success, EOF on a read / memory error (reader->error is set)
+ */
+int fillCsvBuffer(SpkContext *ctx, CsvReader *reader);
+
+/**
+ * This function returns the next line of the file, refilling the buffer as needed.
+ * The line is valid till the next call.
+ * @param ctx Run context (see "SpkContext")
+ * @param reader Reader
+ * @param lineEnd To be assigned with the line's end (its '\n' or the data's end)
+ * @return Line's head, NULL at the end of the file or on error
+ */
+char *nextCsvLine(SpkContext *ctx, CsvReader *reader, char **lineEnd);
+
+/**
+ * This function parses one csv line of numbers.
+ * @param line Line's head
+ * @param lineEnd Line's end
+ * @param values To be assigned with the numbers
+ * @param maxValues values' size
+ * @return Number of values, EOF if malformed or longer than maxValues
+ */
+int parseCsvLine(const char *line, const char *lineEnd, double *values, int maxValues);
+
+/**
+ * This function counts the values of a csv line (commas + 1).
+ * @param line Line's head
+ * @param lineEnd Line's end
+ * @return Number of values
+ */
+int countCsvValues(const char *line, const char *lineEnd);
+
+/**
+ * This function skips spaces, tabs and carriage returns.
+ * @param str String
+ * @param end String's end
+ * @return First other character, end if none
+ */
+const char *skipSpaces(const char *str, const char *end);
+
+/**
+ * This function parses a decimal floating point number.
+ * Up to 15 significant digits with a small exponent are exact in doubles and
+ *      converted with one multiplication / division (correctly rounded, as
+ *      strtod), anything else falls back to strtod.
+ * @param str String, the number's head
+ * @param end To be assigned with the number's end (str if not a number)
+ * @return The number
+ */
+double parseDouble(const char *str, const char **end);
 
 /**
- * This function calculates and assign the Data's number of features,
- *      while reading the first line of the file.
- * @param dimension To be assigned with number of features
- * @param file The opened file pointer
- * @param firstLine To be assigned with the first line in the file
+ * This function returns a monotonic wall clock time.
+ * @return Time in seconds
  */
-void calcDim(int *dimension, FILE *file, double *firstLine);
+double wallTime();
 
 #endif /* FINAL_PROJECT_SPKINNERFUNCTIONS_H */
\ No newline at end of file
@@ -2,61 +2,98 @@
 #include "spkinnerfunctions.h"
 /* This file implements all C functions - SPK, KMEANS, JACOBI and others */
 
+/* CLI's run context - freed by "freeCliMemory" on errors */
+static SpkContext *cliContext;
+/* Binary input file - mapped by "readDataFromFile" */
+static MappedFile mappedInput;
+/* Results' output buffer */
+static OutputBuffer outputBuffer;
+
 /*******************************************************************************
 ********************************** Main ****************************************
 *******************************************************************************/
 
+#ifndef SPK_NO_MAIN /* Other programs (the tests, the benchmark) link the C API only */
 /**
  * Main spectral clustering program.
  * Print the result according to the user's goal.
  * @param argv - User's arguments: k, goal, filename
  */
 int main(int argc, char *argv[]) {
-    int k, dimension, numOfDatapoints;
+    int k, dimension, numOfDatapoints, stage;
     GOAL goal;
     char *filename;
-    double **datapointsArray, **calcMat;
-    headOfMemList = NULL, freeUsedMem = NULL; /* Init C memory containers */
+    double **datapointsArray, **calcMat = NULL;
+    CsrMatrix *csrMat = NULL;
+    SpkContext context, *ctx = &context;
+    initContext(ctx); /* Init C memory containers and configuration */
+    cliContext = ctx;
 
     /* Validate and read user's input */
-    validateAndAssignInput(argc, argv, &k, &goal, &filename);
-    datapointsArray = readDataFromFile(&numOfDatapoints, &dimension, filename, goal);
+    validateAndAssignInput(ctx, argc, argv, &k, &goal, &filename);
+    outputBuffer.binary = ctx->config.binaryOutput;
+    stage = stageBegin(ctx, "read");
+    datapointsArray = readDataFromFile(ctx, &numOfDatapoints, &dimension, filename, goal);
+    stageEnd(ctx, stage, "rows", numOfDatapoints);
+    if (ctx->config.saveBinaryPath != NULL)
+        writeBinaryFile(ctx->config.saveBinaryPath, datapointsArray, numOfDatapoints, dimension);
     if (goal == spk && k >= numOfDatapoints) {
         printf(INVALID_INPUT_MSG);
     } else { /* SPK algorithm */
         if (goal == jacobi) {
-            calcMat = jacobiAlgorithm(datapointsArray, numOfDatapoints);
+            datapointsArray = packSymMatrix(datapointsArray, numOfDatapoints);
+            calcMat = jacobiAlgorithm(ctx, datapointsArray, numOfDatapoints);
+        } else if (ctx->config.affinity != dense && (goal == wam || goal == lnorm)) {
+            /* Sparse W/Lnorm - printed as CSR entries */
+            csrMat = sparseAdjustmentMatrices(ctx, datapointsArray, goal, dimension,
+                                              numOfDatapoints, NULL);
         } else { /* Get T/W/D/Lnorm matrix */
-            calcMat = dataAdjustmentMatrices(datapointsArray, goal, &k, dimension,
+            calcMat = dataAdjustmentMatrices(ctx, datapointsArray, goal, &k, dimension,
                                              numOfDatapoints);
-            MyRecycleMatFree(datapointsArray);
+            if (mappedInput.addr == NULL) { /* Mapped values aren't a "myAlloc" block */
+                MyRecycleMatFree(ctx, datapointsArray);
+            }
         }
-        MyAssert(calcMat != NULL);
+        MyAssert(calcMat != NULL || csrMat != NULL);
 
         /* Print results */
+        if (goal != spk)
+            stage = stageBegin(ctx, "print");
         switch (goal) {
             case jacobi:
                 printJacobi(datapointsArray, calcMat, numOfDatapoints);
                 break;
             case wam:
-            case ddg:
             case lnorm:
+                if (csrMat != NULL)
+                    printCsrMatrix(csrMat);
+                else
+                    printSymMatrix(calcMat, numOfDatapoints);
+                break;
+            case ddg:
                 printMatrix(calcMat, numOfDatapoints, numOfDatapoints);
                 break;
             case spk:
                 /* Run kmeans on T matrix */
-                calcMat = kMeans(calcMat, numOfDatapoints, k, k, NULL, MAX_KMEANS_ITER);
+                calcMat = kMeans(ctx, calcMat, numOfDatapoints, k, k, NULL, MAX_KMEANS_ITER);
                 MyAssert(calcMat != NULL);
+                stage = stageBegin(ctx, "print");
                 printMatrix(calcMat, k, k);
                 break;
             default:
                 MyAssert(0); /* Unexpected goal error */
         }
+        stageEnd(ctx, stage, NULL, 0);
+        if (ctx->config.verbose)
+            printReports(ctx);
+        if (ctx->config.tracePath != NULL)
+            MyAssert(writeTrace(ctx, ctx->config.tracePath, 0) == 0); /* Trace written */
     }
 
-    freeAllMemory();
+    freeCliMemory();
     return 0;
 }
+#endif /* SPK_NO_MAIN */
 
 /*******************************************************************************
 ***************************** Spectral Clustering ******************************
@@ -64,109 +101,359 @@ int main(int argc, char *argv[]) {
 
 /* The function runs spk algorithm steps and stop at the desired goal.
  * The function returns the relevant matrix depended on the GOAL. */
-double **dataAdjustmentMatrices(double **datapointsArray, GOAL goal, int *k,
+double **dataAdjustmentMatrices(SpkContext *ctx, double **datapointsArray, GOAL goal, int *k,
                                 int dimension, int numOfDatapoints) {
-    double **tMat, **wMat, **lnormMat, **eigenvectorsMat, **ddgMat;
-    GOAL task;
+    int numOfEigenpairs, stage;
+    double **tMat, **eigenvectorsMat;
     Eigenvalue *eigenvalues;
 
-    task = wam; /* Start from the first step */
-    /* The Weighted Adjacency Matrix - step 1.1.1 */
-    wMat = weightedMatrix(datapointsArray, numOfDatapoints, dimension);
-    if (task++ == goal || wMat == NULL)
-        return wMat;
-    /* The Diagonal Degree Matrix - step 1.1.2 */
-    ddgMat = dMatrix(wMat, numOfDatapoints);
-    if (task++ == goal || ddgMat == NULL)
-        return ddgMat;
-    /* The Normalized Graph Laplacian - step 2 */
-    lnormMat = laplacian(wMat, ddgMat, numOfDatapoints);
-    if (task == goal || lnormMat == NULL)
-        return lnormMat;
-    MyRecycleMatFree(ddgMat);
-    /* Determine k and obtain the first k eigenvectors using Jacobi algorithm - step 3 */
-    eigenvectorsMat = jacobiAlgorithm(lnormMat, numOfDatapoints);
-    eigenvalues = sortEigenvalues(lnormMat, numOfDatapoints);
-    if (eigenvectorsMat == NULL || eigenvalues == NULL) return NULL;
-    MyRecycleMatFree(lnormMat);
+    if (goal == spk && ctx->config.numOfLandmarks > 0) /* Approximate W - steps 1 to 5 */
+        return nystromTMatrix(ctx, datapointsArray, k, dimension, numOfDatapoints);
+    eigenvectorsMat = spectralSteps(ctx, datapointsArray, goal, *k, dimension, numOfDatapoints,
+                                    &eigenvalues, &numOfEigenpairs);
+    if (goal != spk || eigenvectorsMat == NULL)
+        return eigenvectorsMat;
 
+    stage = stageBegin(ctx, "tmatrix");
     if (*k == 0) /* If k not provided */
-        *k = eigengapHeuristicKCalc(eigenvalues, numOfDatapoints);
+        *k = eigengapHeuristicKCalc(eigenvalues, numOfDatapoints, numOfEigenpairs);
     /* Form the matrix T (from U) - step 4 + 5 */
-    tMat = initTMatrix(eigenvalues, eigenvectorsMat, numOfDatapoints, *k);
-    MyRecycleMatFree(eigenvectorsMat);
-    MyFree(eigenvalues);
+    tMat = initTMatrix(ctx, eigenvalues, eigenvectorsMat, numOfDatapoints, *k);
+    stageEnd(ctx, stage, "k", *k);
     return tMat;
 }
 
+/* This function runs the spk algorithm's steps 1 to 3 (stops at the wam, ddg and lnorm goals). */
+double **spectralSteps(SpkContext *ctx, double **datapointsArray, GOAL goal, int k,
+                       int dimension, int numOfDatapoints, Eigenvalue **eigenvalues,
+                       int *numOfEigenpairs) {
+    int stage;
+    char key[CACHE_KEY_CHARS + 1], *cacheFile = NULL;
+    double **wMat, **lnormMat = NULL, **eigenvectorsMat, **ddgMat, *degrees;
+    CsrMatrix *lnormCsr = NULL;
+    LinearOperator op;
+
+    if (goal == spk && ctx->config.cacheDir != NULL) { /* Cached eigenpairs - straight to step 4 */
+        stage = stageBegin(ctx, "cache");
+        eigenpairsKey(ctx, datapointsArray, numOfDatapoints, dimension, key);
+        cacheFile = eigenpairsPath(ctx, key);
+        if (cacheFile == NULL) return NULL; /* Memory allocation fail */
+        eigenvectorsMat = loadEigenpairs(ctx, cacheFile, key, numOfDatapoints, k, eigenvalues,
+                                         numOfEigenpairs);
+        stageEnd(ctx, stage, "hits", ctx->report.cache.hits);
+        if (eigenvectorsMat != NULL) {
+            MyFree(ctx, cacheFile);
+            return eigenvectorsMat;
+        }
+    }
+    /* The Weighted Adjacency Matrix + its degrees - steps 1.1.1, 1.1.2 */
+    if (ctx->config.affinity != dense) { /* Sparse W and Lnorm (CSR) - steps 1, 2 */
+        degrees = (double *) myAlloc(ctx, NULL, numOfDatapoints * sizeof(double));
+        if (degrees == NULL) return NULL;
+        lnormCsr = sparseAdjustmentMatrices(ctx, datapointsArray, goal, dimension,
+                                            numOfDatapoints, degrees);
+        /* The graph's size is known - plan the dense stages that follow */
+        if (lnormCsr == NULL || !planMemory(ctx, goal, numOfDatapoints, dimension, k))
+            return NULL;
+        if (goal == ddg) {
+            MyFree(ctx, lnormCsr);
+            stage = stageBegin(ctx, "ddg");
+            ddgMat = dMatrix(ctx, degrees, numOfDatapoints);
+            stageEnd(ctx, stage, NULL, 0);
+            return ddgMat;
+        }
+        MyFree(ctx, degrees);
+        if (goal != spk || ctx->config.solver != lanczos) { /* Packed copy for the other solvers */
+            lnormMat = csrToSymMatrix(ctx, lnormCsr);
+            MyFree(ctx, lnormCsr);
+            if (goal != spk || lnormMat == NULL)
+                return lnormMat;
+        }
+    } else {
+        if (!planMemory(ctx, goal, numOfDatapoints, dimension, k))
+            return NULL; /* Peak memory not available - nothing done yet */
+        degrees = (double *) arenaAlloc(ctx, vectorsRegion, numOfDatapoints * sizeof(double));
+        if (degrees == NULL) return NULL;
+        stage = stageBegin(ctx, "wam");
+        wMat = weightedMatrix(ctx, datapointsArray, numOfDatapoints, dimension, degrees);
+        stageEnd(ctx, stage, NULL, 0);
+        resetRegion(ctx, workRegion); /* W's scratch */
+        if (goal == wam || wMat == NULL)
+            return wMat;
+        if (goal == ddg) { /* The Diagonal Degree Matrix - expand the degrees */
+            resetRegion(ctx, matrixRegion); /* D replaces W */
+            stage = stageBegin(ctx, "ddg");
+            ddgMat = dMatrix(ctx, degrees, numOfDatapoints);
+            stageEnd(ctx, stage, NULL, 0);
+            return ddgMat;
+        }
+        /* The Normalized Graph Laplacian, W scaled in place - step 2 */
+        stage = stageBegin(ctx, "lnorm");
+        lnormMat = laplacian(ctx, wMat, degrees, numOfDatapoints);
+        stageEnd(ctx, stage, NULL, 0);
+        resetRegion(ctx, vectorsRegion); /* The degrees */
+        if (goal == lnorm)
+            return lnormMat;
+    }
+    /* Determine k and obtain the first k eigenvectors using Jacobi algorithm - step 3 */
+    if (ctx->config.solver == lanczos) { /* Only the eigenpairs step 4 looks at */
+        *numOfEigenpairs = k != 0 ? k : eigengapCandidates(ctx, numOfDatapoints);
+        if (lnormCsr != NULL)
+            csrOperator(ctx, &op, lnormCsr);
+        else if (!symMatOperator(ctx, &op, lnormMat, numOfDatapoints))
+            return NULL;
+        stage = stageBegin(ctx, "eigensolver");
+        eigenvectorsMat = partialEigenpairs(ctx, &op, *numOfEigenpairs, eigenvalues);
+        stageEnd(ctx, stage, "mat-vecs", ctx->report.lanczos.matVecs);
+        MyFree(ctx, op.workspace);
+    } else {
+        *numOfEigenpairs = numOfDatapoints;
+        eigenvectorsMat = runEigensolver(ctx, lnormMat, numOfDatapoints);
+        stage = stageBegin(ctx, "sort");
+        *eigenvalues = sortEigenvalues(ctx, lnormMat, numOfDatapoints);
+        stageEnd(ctx, stage, NULL, 0);
+    }
+    if (eigenvectorsMat == NULL || *eigenvalues == NULL) return NULL;
+    if (lnormMat != NULL) {
+        resetRegion(ctx, matrixRegion); /* T replaces Lnorm */
+    } else {
+        MyFree(ctx, lnormCsr);
+    }
+    if (cacheFile != NULL) { /* A miss - the next runs reuse the eigenpairs */
+        stage = stageBegin(ctx, "cache");
+        storeEigenpairs(ctx, cacheFile, key, numOfDatapoints, eigenvectorsMat, *eigenvalues,
+                        *numOfEigenpairs);
+        stageEnd(ctx, stage, "writes", ctx->report.cache.writes);
+        MyFree(ctx, cacheFile);
+    }
+    return eigenvectorsMat;
+}
+
 /* This function form The Weighted Adjacency Matrix out of vectors list. */
-double **weightedMatrix(double **vectorsArray, int numOfVectors, int dimension) {
-    int i, j;
-    double norm;
-    double **wMatrix = (double **) alloc2DArray(numOfVectors, numOfVectors,
-                                                sizeof(double), sizeof(double *), freeUsedMem);
+double **weightedMatrix(SpkContext *ctx, double **vectorsArray, int numOfVectors, int dimension,
+                        double *degrees) {
+    int i, t, numOfLanes;
+    size_t scratchSize;
+    double *sqNorms;
+    WeightedMatrixArgs args;
+    double **wMatrix = arenaSymMatrix(ctx, matrixRegion, numOfVectors);
 
-    if (wMatrix != NULL) { /* Memory allocation fail */
-        for (i = 0; i < numOfVectors; i++) {
-            wMatrix[i][i] = 0.0; /* No loops allowed */
-            for (j = i + 1; j < numOfVectors; j++) {
-                norm = sqrt(vectorsSqNorm(vectorsArray[i], vectorsArray[j],
-                                          dimension));
-                wMatrix[i][j] = exp(-0.5 * norm);
-                wMatrix[j][i] = wMatrix[i][j]; /* Symmetry */
-            }
+    numOfLanes = MIN(DEGREE_LANES, (numOfVectors + GRAM_BLOCK_SIZE - 1) / GRAM_BLOCK_SIZE);
+    /* Vectors' squared norms, lanes' partial degrees, tile buffers */
+    scratchSize = weightedMatrixScratch(ctx, numOfVectors, dimension) * sizeof(double);
+    sqNorms = (double *) arenaAlloc(ctx, workRegion, scratchSize);
+    if (wMatrix == NULL || sqNorms == NULL) return NULL; /* Memory allocation fail */
+
+    for (i = 0; i < numOfVectors; i++) {
+        sqNorms[i] = 0.0;
+        for (t = 0; t < dimension; t++) {
+            sqNorms[i] += SQ(vectorsArray[i][t]);
+        }
+    }
+    args.vectorsArray = vectorsArray;
+    args.sqNorms = sqNorms;
+    args.degreeSums = sqNorms + numOfVectors;
+    args.tileBuffers = args.degreeSums + numOfVectors * numOfLanes;
+    args.wMatrix = wMatrix;
+    args.numOfVectors = numOfVectors;
+    args.dimension = dimension;
+    args.numOfLanes = numOfLanes;
+    memset(args.degreeSums, 0, numOfVectors * numOfLanes * sizeof(double));
+    parallelFor(ctx, weightedMatrixTask, &args, numOfLanes, 1);
+
+    /* Reduce the lanes' partial degrees - fixed order */
+    for (i = 0; i < numOfVectors; i++) {
+        degrees[i] = 0.0;
+        for (t = 0; t < numOfLanes; t++) {
+            degrees[i] += args.degreeSums[t * numOfVectors + i];
         }
     }
+    MyFree(ctx, sqNorms);
     return wMatrix;
 }
 
-/* This function form the Diagonal Degree Matrix of Weighted Adjacency Matrix. */
-double **dMatrix(double **wMatrix, int n) {
+/* This function calculates the scratch "weightedMatrix" needs (doubles). */
+size_t weightedMatrixScratch(SpkContext *ctx, int numOfVectors, int dimension) {
+    int numOfLanes = MIN(DEGREE_LANES, (numOfVectors + GRAM_BLOCK_SIZE - 1) / GRAM_BLOCK_SIZE);
+
+    /* Vectors' squared norms + per lane partial degrees +
+     * scratch for one transposed tile per thread */
+    return (size_t) numOfVectors * (1 + numOfLanes) +
+           (size_t) ctx->config.numOfThreads * GRAM_BLOCK_SIZE * dimension;
+}
+
+/* Parallel task - fills the weighted matrix tiles of lanes [begin, end). */
+void weightedMatrixTask(void *args, int begin, int end, int threadId) {
+    int lane, rowBlock, colBlock;
+    WeightedMatrixArgs *wArgs = (WeightedMatrixArgs *) args;
+    double *tileBuffer = wArgs->tileBuffers + threadId * GRAM_BLOCK_SIZE * wArgs->dimension;
+
+    for (lane = begin; lane < end; lane++) {
+        /* Upper triangle tile by tile */
+        for (rowBlock = lane * GRAM_BLOCK_SIZE; rowBlock < wArgs->numOfVectors;
+             rowBlock += wArgs->numOfLanes * GRAM_BLOCK_SIZE) {
+            for (colBlock = rowBlock; colBlock < wArgs->numOfVectors;
+                 colBlock += GRAM_BLOCK_SIZE) {
+                weightedMatrixTile(wArgs->vectorsArray, wArgs->sqNorms, tileBuffer,
+                                   wArgs->wMatrix, wArgs->numOfVectors, wArgs->dimension,
+                                   wArgs->degreeSums + lane * wArgs->numOfVectors,
+                                   rowBlock, colBlock);
+            }
+        }
+    }
+}
+
+/* This function fills one upper triangle tile of the Weighted Adjacency Matrix. */
+void weightedMatrixTile(double **vectorsArray, const double *sqNorms, double *tileBuffer,
+                        double **wMatrix, int numOfVectors, int dimension,
+                        double *degreeSums, int rowBlock, int colBlock) {
+    int i, j, t, first, rowEnd, colEnd, width;
+    double *wRow, *tileRow, coefficient, sqDist, rowSum;
+    const double *vec;
+
+    rowEnd = MIN(rowBlock + GRAM_BLOCK_SIZE, numOfVectors);
+    colEnd = MIN(colBlock + GRAM_BLOCK_SIZE, numOfVectors);
+    width = colEnd - colBlock;
+    /* Pack the tile's column vectors transposed - unit stride inner loops */
+    for (j = colBlock; j < colEnd; j++) {
+        vec = vectorsArray[j];
+        for (t = 0; t < dimension; t++) {
+            tileBuffer[t * width + j - colBlock] = vec[t];
+        }
+    }
+
+    for (i = rowBlock; i < rowEnd; i++) {
+        wRow = wMatrix[i];
+        if (rowBlock == colBlock)
+            wRow[i] = 0.0; /* No loops allowed */
+        first = i < colBlock ? colBlock : i + 1; /* Upper triangle only */
+        if (first >= colEnd)
+            continue;
+
+        /* -2x*y accumulated one component at a time over the whole tile row */
+        for (j = first; j < colEnd; j++) {
+            wRow[j] = 0.0;
+        }
+        for (t = 0; t < dimension; t++) {
+            coefficient = -2.0 * vectorsArray[i][t];
+            tileRow = tileBuffer + t * width - colBlock;
+            for (j = first; j < colEnd; j++) {
+                wRow[j] += coefficient * tileRow[j];
+            }
+        }
+        /* ||x - y||^2 = ||x||^2 + ||y||^2 - 2x*y, rounding may get it below zero */
+        for (j = first; j < colEnd; j++) {
+            sqDist = wRow[j] + sqNorms[i] + sqNorms[j];
+            wRow[j] = -0.5 * sqrt(sqDist > 0.0 ? sqDist : 0.0);
+        }
+        vectorExp(wRow + first, colEnd - first);
+        rowSum = 0.0;
+        for (j = first; j < colEnd; j++) {
+            rowSum += wRow[j];
+            degreeSums[j] += wRow[j]; /* Symmetry - W[j][i] == W[i][j] */
+        }
+        degreeSums[i] += rowSum;
+    }
+}
+
+/* This function replaces each element x (x <= 0) of an array with exp(x). */
+void vectorExp(double *array, int len) {
+    int i;
+#if ULONG_MAX > 0xFFFFFFFFUL /* 2^k is built from the bits of a 64 bit long */
+    double x, kd, r, p, shifted, scale;
+    unsigned long bits;
+
+    for (i = 0; i < len; i++) {
+        x = array[i] > EXP_MIN_ARG ? array[i] : EXP_MIN_ARG;
+        /* x = k * ln2 + r, |r| <= ln2 / 2 */
+        shifted = x * LOG2E + EXP_SHIFTER; /* k sits in the low mantissa bits */
+        kd = shifted - EXP_SHIFTER;
+        r = (x - kd * LN2_HI) - kd * LN2_LO;
+        /* exp(r) - degree 13 Taylor polynomial (Horner) */
+        p = 1.0 / 6227020800.0;
+        p = p * r + 1.0 / 479001600.0;
+        p = p * r + 1.0 / 39916800.0;
+        p = p * r + 1.0 / 3628800.0;
+        p = p * r + 1.0 / 362880.0;
+        p = p * r + 1.0 / 40320.0;
+        p = p * r + 1.0 / 5040.0;
+        p = p * r + 1.0 / 720.0;
+        p = p * r + 1.0 / 120.0;
+        p = p * r + 1.0 / 24.0;
+        p = p * r + 1.0 / 6.0;
+        p = p * r + 0.5;
+        p = p * r + 1.0;
+        p = p * r + 1.0;
+        /* exp(x) = 2^k * exp(r) */
+        memcpy(&bits, &shifted, sizeof(bits));
+        bits = (bits + EXP_BIAS) << EXP_MANTISSA_BITS;
+        memcpy(&scale, &bits, sizeof(scale));
+        array[i] = array[i] > EXP_MIN_ARG ? p * scale : 0.0;
+    }
+#else
+    for (i = 0; i < len; i++) {
+        array[i] = exp(array[i]);
+    }
+#endif
+}
+
+/* This function form the Diagonal Degree Matrix out of W's degrees. */
+double **dMatrix(SpkContext *ctx, const double *degrees, int n) {
     int i, j;
-    double **dMatrix, sum;
-    dMatrix = (double **) alloc2DArray(n, n, sizeof(double), sizeof(double *),
-                                       freeUsedMem);
+    double **dMatrix;
+    dMatrix = arenaMatrix(ctx, matrixRegion, n, n);
 
     if (dMatrix != NULL) { /* Memory allocation fail */
         for (i = 0; i < n; i++) {
-            sum = 0.0;
             for (j = 0; j < n; j++) {
                 dMatrix[i][j] = 0.0; /* Off-diag set to zero */
-                sum += wMatrix[i][j]; /* Sum W's i row */
             }
-            dMatrix[i][i] = sum;
+            dMatrix[i][i] = degrees[i];
         }
     }
     return dMatrix;
 }
 
-/* This function form the Normalized Graph Laplacian matrix in a given D + W matrix. */
-double **laplacian(double **wMatrix, double **dMatrix, int numOfVectors) {
-    int i, j;
-    double **lMatrix = wMatrix;
+/* This function form the Normalized Graph Laplacian matrix in a given W + degrees. */
+double **laplacian(SpkContext *ctx, double **wMatrix, double *degrees, int numOfVectors) {
+    int i;
+    MatrixRowsArgs args;
 
     /* Calc D^-1/2 */
     for (i = 0; i < numOfVectors; i++) {
-        dMatrix[i][i] = 1 / sqrt(dMatrix[i][i]);
+        degrees[i] = 1 / sqrt(degrees[i]);
     }
 
     /* Lnorm = I - D^-1/2 * W * D^-1/2 */
-    for (i = 0; i < numOfVectors; i++) {
-        for (j = 0; j < numOfVectors; j++) {
-            lMatrix[i][j] = -1.0 * dMatrix[i][i] * dMatrix[j][j] * wMatrix[i][j];
-            if (i == j) /* Identity matrix: Add 1 to the primary diagonal */
-                lMatrix[i][j] += 1.0;
+    args.wMatrix = wMatrix;
+    args.invSqrtDegrees = degrees;
+    args.n = numOfVectors;
+    parallelFor(ctx, laplacianTask, &args, numOfVectors, rowsChunkSize(ctx, numOfVectors));
+    return wMatrix;
+}
+
+/* Parallel task - Lnorm's rows [begin, end). */
+void laplacianTask(void *args, int begin, int end, int threadId) {
+    int i, j;
+    MatrixRowsArgs *rowsArgs = (MatrixRowsArgs *) args;
+    double **lMatrix = rowsArgs->wMatrix;
+    const double *invSqrtDegrees = rowsArgs->invSqrtDegrees;
+    (void) threadId;
+
+    for (i = begin; i < end; i++) {
+        for (j = i; j < rowsArgs->n; j++) { /* Upper triangle */
+            lMatrix[i][j] *= -1.0 * invSqrtDegrees[i] * invSqrtDegrees[j];
         }
+        lMatrix[i][i] += 1.0; /* Identity matrix: Add 1 to the primary diagonal */
     }
-    return lMatrix;
 }
 
 /* This function form T matrix from Lnorm eigenvalues, eigenvectors and k. */
-double **initTMatrix(Eigenvalue *eigenvalues, double **eigenvectorsMat, int n, int k) {
+double **initTMatrix(SpkContext *ctx, Eigenvalue *eigenvalues, double **eigenvectorsMat, int n,
+                     int k) {
     int i, j;
     double sumSqRow, value;
-    double **tMat = (double **) alloc2DArray(n, k, sizeof(double),
-                                             sizeof(double *), freeUsedMem);
+    double **tMat = arenaMatrix(ctx, matrixRegion, n, k);
 
     if (tMat != NULL) { /* Memory allocation fail */
         for (i = 0; i < n; ++i) {
@@ -190,11 +477,11 @@ double **initTMatrix(Eigenvalue *eigenvalues, double **eigenvectorsMat, int n, i
 }
 
 /* This function calculate the optimum k using Eigengap Heuristic method. */
-int eigengapHeuristicKCalc(Eigenvalue *eigenvalues, int n) {
+int eigengapHeuristicKCalc(Eigenvalue *eigenvalues, int n, int numOfEigenvalues) {
     int i, maxIndex, m;
     double maxDelta, delta;
 
-    m = n / 2; /* floor(n/2) */
+    m = MIN(n / 2, numOfEigenvalues - 1); /* floor(n/2) */
     maxDelta = -1;
     maxIndex = -1;
     for (i = 0; i < m; i++) {
@@ -208,279 +495,2607 @@ int eigengapHeuristicKCalc(Eigenvalue *eigenvalues, int n) {
     return maxIndex + 1; /* Index starts from 0 */
 }
 
+/* This function calculates the number of eigenvalues the eigengap heuristic looks at. */
+int eigengapCandidates(SpkContext *ctx, int n) {
+    int numOfCandidates = n / 2 + 1;
+
+    if (ctx->config.eigenCap > 0) /* At least one gap */
+        numOfCandidates = MIN(numOfCandidates, MAX(ctx->config.eigenCap, 2));
+    else if (ctx->config.solver == lanczos) /* Each candidate is a computed eigenpair */
+        numOfCandidates = MIN(numOfCandidates, LANCZOS_EIGEN_CAP);
+    return MIN(numOfCandidates, n);
+}
+
 /*******************************************************************************
-********************************** KMeans **************************************
+******************************* Sparse Affinity ********************************
 *******************************************************************************/
 
-/* This function runs the main KMeans clustering algorithm. */
-double **kMeans(double **vectorsArray, int numOfVectors, int dimension, int k,
-                const int *firstCentralIndexes, int maxIter) {
-    int i, changes;
-    Cluster *clustersArray;
-    double *vecToClusterLabeling, **finalCentroidsAndVecLabeling;
+/* The function builds the sparse W (goals wam, ddg) or Lnorm (lnorm, spk) of the datapoints. */
+CsrMatrix *sparseAdjustmentMatrices(SpkContext *ctx, double **datapointsArray, GOAL goal,
+                                    int dimension, int numOfDatapoints, double *degrees) {
+    int stage = stageBegin(ctx, "affinity");
+    double *ownDegrees = NULL;
+    CsrMatrix *wMatrix;
 
-    /* Initialize clusters arrays */
-    clustersArray = initClusters(vectorsArray, k, dimension, firstCentralIndexes);
-    vecToClusterLabeling = (double *) myAlloc(freeUsedMem, numOfVectors * sizeof(double));
-    if (vecToClusterLabeling == NULL || clustersArray == NULL) return NULL;
-
-    for (i = 0; i < maxIter; ++i) {
-        /* Update curr centroid to prev centroid and reset the counter */
-        initCurrCentroidAndCounter(clustersArray, k, dimension);
-        assignVectorsToClusters(vectorsArray, clustersArray, vecToClusterLabeling,
-                                k, numOfVectors, dimension);
-        /* Calculate new centroids */
-        changes = recalcCentroids(clustersArray, k, dimension);
-        if (changes == 0) {
-            /* Centroids stay unchanged in the current iteration == convergence */
-            break;
-        }
+    if (degrees == NULL) { /* Scratch - only Lnorm needs them */
+        ownDegrees = (double *) myAlloc(ctx, NULL, numOfDatapoints * sizeof(double));
+        if (ownDegrees == NULL) return NULL;
+        degrees = ownDegrees;
     }
-    /* Organize the results as a matrix */
-    finalCentroidsAndVecLabeling = buildFinalCentroidsMat(clustersArray, vecToClusterLabeling,
-                                                          k, dimension);
-    MyFree(clustersArray);
-    return finalCentroidsAndVecLabeling;
+    if (ctx->config.affinity == knn)
+        wMatrix = knnWeightedMatrix(ctx, datapointsArray, numOfDatapoints, dimension,
+                                    (int) ctx->config.affinityParam, degrees);
+    else
+        wMatrix = epsWeightedMatrix(ctx, datapointsArray, numOfDatapoints, dimension,
+                                    ctx->config.affinityParam, degrees);
+    if (wMatrix != NULL) {
+        ctx->report.affinity.n = wMatrix->n;
+        ctx->report.affinity.nnz = wMatrix->nnz;
+        if (goal != wam && goal != ddg) /* The Normalized Graph Laplacian, in place */
+            wMatrix = sparseLaplacian(ctx, wMatrix, degrees);
+    }
+    MyFree(ctx, ownDegrees);
+    stageEnd(ctx, stage, "nnz", ctx->report.affinity.nnz);
+    return wMatrix;
 }
 
-/* This function initialize the clusters array. */
-Cluster *initClusters(double **vectorsArray, int k, int dimension,
-                      const int *firstCentralIndexes) {
-    int i, j;
-    Cluster *clustersArray;
-    double **centroidMat;
-
-    /* Allocate memory for clustersArray */
-    clustersArray = (Cluster *) myAlloc(NULL, k * sizeof(Cluster));
-    centroidMat = (double **) alloc2DArray(k + 1, dimension * 2,
-                                           sizeof(double), sizeof(double *), freeUsedMem);
-    if (clustersArray == NULL || centroidMat == NULL) return NULL;
+/* This function builds the symmetrized K nearest neighbours W in CSR format. */
+CsrMatrix *knnWeightedMatrix(SpkContext *ctx, double **vectorsArray, int numOfVectors,
+                             int dimension, int numOfNeighbours, double *degrees) {
+    int i, j, t;
+    long p, numOfEntries, nnz, *position;
+    Neighbour neighbour;
+    SparseAffinityArgs args;
 
-    for (i = 0; i < k; ++i) {
-        clustersArray[i].counter = 0;
-        clustersArray[i].currCentroid = centroidMat[i];
-        clustersArray[i].prevCentroid = centroidMat[i] + dimension;
+    numOfNeighbours = MIN(numOfNeighbours, numOfVectors - 1);
+    args.vectors = vectorsArray;
+    args.n = numOfVectors;
+    args.dimension = dimension;
+    args.numOfNeighbours = numOfNeighbours;
+    args.degrees = degrees;
+    args.neighbours = (Neighbour *) myAlloc(ctx, NULL, (size_t) numOfVectors * numOfNeighbours *
+                                                       sizeof(Neighbour));
+    /* rowStart, rowCounts and the fill positions */
+    args.rowStart = (long *) myAlloc(ctx, NULL, (3 * (size_t) numOfVectors + 1) * sizeof(long));
+    if (args.neighbours == NULL || args.rowStart == NULL) return NULL;
+    args.rowCounts = args.rowStart + numOfVectors + 1;
+    position = args.rowCounts + numOfVectors;
+    parallelFor(ctx, knnTask, &args, numOfVectors, rowsChunkSize(ctx, numOfVectors));
 
-        if (firstCentralIndexes == NULL) { /* KMeans */
-            for (j = 0; j < dimension; ++j) {
-                /* Assign the first k vectors to their corresponding clusters */
-                clustersArray[i].currCentroid[j] = vectorsArray[i][j];
-            }
-        } else { /* KMeans++ */
-            /* Assign the initial k vectors to their corresponding clusters
-             * according to the ones calculated in python */
-            for (j = 0; j < dimension; ++j) {
-                clustersArray[i].currCentroid[j] = vectorsArray[firstCentralIndexes[i]][j];
-            }
+    /* Symmetrize - row i gets its diagonal, its neighbours and the points it
+     * is a neighbour of (duplicates merged later) */
+    for (i = 0; i < numOfVectors; i++) {
+        args.rowCounts[i] = 1 + numOfNeighbours;
+    }
+    for (p = 0; p < (long) numOfVectors * numOfNeighbours; p++) {
+        args.rowCounts[args.neighbours[p].index]++;
+    }
+    args.rowStart[0] = 0;
+    for (i = 0; i < numOfVectors; i++) {
+        args.rowStart[i + 1] = args.rowStart[i] + args.rowCounts[i];
+    }
+    numOfEntries = args.rowStart[numOfVectors];
+    args.entries = (Neighbour *) myAlloc(ctx, NULL, numOfEntries * sizeof(Neighbour));
+    if (args.entries == NULL) return NULL;
+    for (i = 0; i < numOfVectors; i++) {
+        position[i] = args.rowStart[i];
+        args.entries[position[i]].index = i; /* The diagonal */
+        args.entries[position[i]++].sqDist = 0.0;
+    }
+    for (i = 0; i < numOfVectors; i++) {
+        for (t = 0; t < numOfNeighbours; t++) {
+            neighbour = args.neighbours[(size_t) i * numOfNeighbours + t];
+            j = neighbour.index;
+            args.entries[position[i]++] = neighbour; /* i -> j */
+            neighbour.index = i;
+            args.entries[position[j]++] = neighbour; /* and j -> i */
         }
     }
-    return clustersArray;
+    MyFree(ctx, args.neighbours);
+    parallelFor(ctx, knnMergeTask, &args, numOfVectors, rowsChunkSize(ctx, numOfVectors));
+
+    nnz = 0;
+    for (i = 0; i < numOfVectors; i++) {
+        nnz += args.rowCounts[i];
+    }
+    args.csr = allocCsrMatrix(ctx, numOfVectors, nnz);
+    if (args.csr == NULL) return NULL;
+    args.csr->rowPtr[0] = 0;
+    for (i = 0; i < numOfVectors; i++) {
+        args.csr->rowPtr[i + 1] = args.csr->rowPtr[i] + args.rowCounts[i];
+    }
+    parallelFor(ctx, knnCopyTask, &args, numOfVectors, rowsChunkSize(ctx, numOfVectors));
+    MyFree(ctx, args.entries);
+    MyFree(ctx, args.rowStart);
+    parallelFor(ctx, csrWeightsTask, &args, numOfVectors, rowsChunkSize(ctx, numOfVectors));
+    return args.csr;
 }
 
-/* This function assign the closest cluster for each vector. */
-void assignVectorsToClusters(double **vectorsArray, Cluster *clustersArray,
-                             double *vecToClusterLabeling, int k,
-                             int numOfVectors, int dimension) {
-    int i, j, myCluster;
-    double *vec;
+/* This function builds the epsilon graph W (weights above minWeight) in CSR format. */
+CsrMatrix *epsWeightedMatrix(SpkContext *ctx, double **vectorsArray, int numOfVectors,
+                             int dimension, double minWeight, double *degrees) {
+    int i;
+    long nnz;
+    SparseAffinityArgs args;
 
-    for (i = 0; i < numOfVectors; ++i) {
-        vec = vectorsArray[i];
-        /* Set vector's cluster to his closest */
-        myCluster = findMyCluster(vec, clustersArray, k, dimension);
-        vecToClusterLabeling[i] = myCluster;
+    args.vectors = vectorsArray;
+    args.n = numOfVectors;
+    args.dimension = dimension;
+    args.degrees = degrees;
+    /* exp(-||x - y|| / 2) > E  <=>  ||x - y|| < -2ln(E) */
+    args.maxSqDist = SQ(-2.0 * log(minWeight));
+    args.rowCounts = (long *) myAlloc(ctx, NULL, numOfVectors * sizeof(long));
+    if (args.rowCounts == NULL) return NULL;
+    args.csr = NULL; /* Count */
+    parallelFor(ctx, epsTask, &args, numOfVectors, rowsChunkSize(ctx, numOfVectors));
 
-        for (j = 0; j < dimension; ++j) {
-            /* Summation of the vectors Components */
-            clustersArray[myCluster].currCentroid[j] += vec[j];
-        }
-        /* Count the number of vectors for each cluster */
-        clustersArray[myCluster].counter++;
+    nnz = 0;
+    for (i = 0; i < numOfVectors; i++) {
+        nnz += args.rowCounts[i];
     }
+    args.csr = allocCsrMatrix(ctx, numOfVectors, nnz);
+    if (args.csr == NULL) return NULL;
+    args.csr->rowPtr[0] = 0;
+    for (i = 0; i < numOfVectors; i++) {
+        args.csr->rowPtr[i + 1] = args.csr->rowPtr[i] + args.rowCounts[i];
+    }
+    MyFree(ctx, args.rowCounts);
+    /* Fill */
+    parallelFor(ctx, epsTask, &args, numOfVectors, rowsChunkSize(ctx, numOfVectors));
+    parallelFor(ctx, csrWeightsTask, &args, numOfVectors, rowsChunkSize(ctx, numOfVectors));
+    return args.csr;
 }
 
-/* This function finds vector's closest cluster (in terms of euclidean norm). */
-int findMyCluster(double *vec, Cluster *clustersArray, int k, int dimension) {
-    int myCluster, j;
-    double minNorm, norm;
+/* Parallel task - the K nearest neighbours of vectors [begin, end). */
+void knnTask(void *args, int begin, int end, int threadId) {
+    int i, j, size;
+    Neighbour candidate, *heap;
+    SparseAffinityArgs *affinityArgs = (SparseAffinityArgs *) args;
+    int numOfNeighbours = affinityArgs->numOfNeighbours;
+    (void) threadId;
 
-    myCluster = 0;
-    minNorm = vectorsSqNorm(vec, clustersArray[0].prevCentroid, dimension);
-    for (j = 1; j < k; ++j) { /* Find the min norm == the closest cluster */
-        norm = vectorsSqNorm(vec, clustersArray[j].prevCentroid, dimension);
-        if (norm < minNorm) {
-            myCluster = j;
-            minNorm = norm;
+    for (i = begin; i < end; i++) {
+        heap = affinityArgs->neighbours + (size_t) i * numOfNeighbours;
+        size = 0;
+        for (j = 0; j < affinityArgs->n && numOfNeighbours > 0; j++) {
+            if (j == i)
+                continue;
+            candidate.index = j;
+            candidate.sqDist = vectorsSqNorm(affinityArgs->vectors[i],
+                                             affinityArgs->vectors[j], affinityArgs->dimension);
+            if (size < numOfNeighbours) {
+                heap[size++] = candidate;
+                siftUpNeighbours(heap, size);
+            } else if (cmpNeighbours(&candidate, heap) < 0) { /* Closer than the farthest */
+                heap[0] = candidate;
+                siftDownNeighbours(heap, size);
+            }
         }
     }
-    return myCluster;
 }
 
-/* This function calculates the squared euclidean norm between two vectors. */
-double vectorsSqNorm(const double *vec1, const double *vec2, int dimension) {
-    double sqNorm = 0;
+/* Parallel task - sorts the symmetrized rows [begin, end) by column and merges duplicates. */
+void knnMergeTask(void *args, int begin, int end, int threadId) {
     int i;
+    long p, count;
+    Neighbour *row;
+    SparseAffinityArgs *affinityArgs = (SparseAffinityArgs *) args;
+    (void) threadId;
 
-    for (i = 0; i < dimension; ++i) {
-        sqNorm += SQ(vec1[i] - vec2[i]);
+    for (i = begin; i < end; i++) {
+        row = affinityArgs->entries + affinityArgs->rowStart[i];
+        qsort(row, affinityArgs->rowCounts[i], sizeof(Neighbour), cmpNeighbourIndexes);
+        count = 1;
+        for (p = 1; p < affinityArgs->rowCounts[i]; p++) {
+            if (row[p].index != row[count - 1].index)
+                row[count++] = row[p];
+        }
+        affinityArgs->rowCounts[i] = count;
     }
-    return sqNorm;
 }
 
-/* This function recalculates clusters centroids after one kmeans iteration. */
-int recalcCentroids(Cluster *clustersArray, int k, int dimension) {
-    Cluster cluster;
-    int i, j, changes = 0;
+/* Parallel task - copies the merged rows [begin, end) into the CSR matrix. */
+void knnCopyTask(void *args, int begin, int end, int threadId) {
+    int i;
+    long p, q;
+    SparseAffinityArgs *affinityArgs = (SparseAffinityArgs *) args;
+    CsrMatrix *csr = affinityArgs->csr;
+    (void) threadId;
 
-    for (i = 0; i < k; ++i) {
-        cluster = clustersArray[i];
-        for (j = 0; j < dimension; ++j) {
-            cluster.currCentroid[j] /= cluster.counter; /* Calc the mean value */
-            /* Count the number of changed centroids' components */
-            changes += cluster.prevCentroid[j] != cluster.currCentroid[j] ? 1: 0;
+    for (i = begin; i < end; i++) {
+        q = affinityArgs->rowStart[i];
+        for (p = csr->rowPtr[i]; p < csr->rowPtr[i + 1]; p++, q++) {
+            csr->colIndex[p] = affinityArgs->entries[q].index;
+            csr->values[p] = affinityArgs->entries[q].sqDist;
         }
     }
-    return changes;
 }
 
-/* This function organize clusters array for the next iteration:
- *      Reset counter and current centroid (to be zero vector)
- *      Update previous centroids to be current centroids */
-void initCurrCentroidAndCounter(Cluster *clustersArray, int k, int dimension) {
+/* Parallel task - epsilon graph rows [begin, end): counts the entries, or fills them. */
+void epsTask(void *args, int begin, int end, int threadId) {
     int i, j;
-    for (i = 0; i < k; ++i) {
-        for (j = 0; j < dimension; ++j) {
-            /* Set prev centroid to curr centroid */
-            clustersArray[i].prevCentroid[j] = clustersArray[i].currCentroid[j];
-            clustersArray[i].currCentroid[j] = 0; /* Reset curr centroid */
+    long count;
+    double sqDist;
+    SparseAffinityArgs *affinityArgs = (SparseAffinityArgs *) args;
+    CsrMatrix *csr = affinityArgs->csr;
+    (void) threadId;
+
+    for (i = begin; i < end; i++) {
+        count = 0;
+        for (j = 0; j < affinityArgs->n; j++) {
+            sqDist = j == i ? 0.0 : vectorsSqNorm(affinityArgs->vectors[i],
+                                                  affinityArgs->vectors[j],
+                                                  affinityArgs->dimension);
+            if (j != i && !(sqDist < affinityArgs->maxSqDist))
+                continue;
+            if (csr != NULL) { /* Fill - rowPtr from the count pass */
+                csr->colIndex[csr->rowPtr[i] + count] = j;
+                csr->values[csr->rowPtr[i] + count] = sqDist;
+            }
+            count++;
         }
-        clustersArray[i].counter = 0; /* Reset counter */
+        if (csr == NULL)
+            affinityArgs->rowCounts[i] = count;
     }
 }
 
-/* This function organize KMeans result into a matrix:
- *      First k rows - Clusters centroids
- *      Last row (Could be from different length) vectors to clusters labeling */
-double **buildFinalCentroidsMat(Cluster *clustersArray, double *vecToClusterLabeling,
-                                int k, int dimension) {
-    /* Restore first row pointer of centroid matrix from "initClusters" */
-    double **matrix = (double **)(clustersArray[k - 1].prevCentroid + dimension * 3);
-    /* Assign last row to point to vectors labeling array */
-    matrix[k] = vecToClusterLabeling;
-    return matrix;
+/* Parallel task - turns the squared distances of rows [begin, end) into weights. */
+void csrWeightsTask(void *args, int begin, int end, int threadId) {
+    int i;
+    long p;
+    double rowSum;
+    SparseAffinityArgs *affinityArgs = (SparseAffinityArgs *) args;
+    CsrMatrix *csr = affinityArgs->csr;
+    (void) threadId;
+
+    for (i = begin; i < end; i++) {
+        rowSum = 0.0;
+        for (p = csr->rowPtr[i]; p < csr->rowPtr[i + 1]; p++) {
+            /* exp(-||x - y|| / 2), W's diagonal is 0 */
+            csr->values[p] = csr->colIndex[p] == i ? 0.0 : exp(-0.5 * sqrt(csr->values[p]));
+            rowSum += csr->values[p];
+        }
+        affinityArgs->degrees[i] = rowSum;
+    }
 }
 
-/*******************************************************************************
-****************************** Jacobi Algorithm ********************************
-*******************************************************************************/
+/* This function scales a CSR W into Lnorm in place, as "laplacian". */
+CsrMatrix *sparseLaplacian(SpkContext *ctx, CsrMatrix *wMatrix, double *degrees) {
+    int i;
+    SparseAffinityArgs args;
 
-/* This function performs Jacobi's diagonal method on a symmetric matrix. */
-double **jacobiAlgorithm(double **matrix, int n) {
-    double diffOffNorm, **eigenvectorsMat;
-    int jacobiIterCounter, pivotRow, pivotCol;
+    /* Calc D^-1/2, isolated points - 0 */
+    for (i = 0; i < wMatrix->n; i++) {
+        degrees[i] = degrees[i] > 0.0 ? 1 / sqrt(degrees[i]) : 0.0;
+    }
+    args.csr = wMatrix;
+    args.degrees = degrees;
+    parallelFor(ctx, sparseLaplacianTask, &args, wMatrix->n, rowsChunkSize(ctx, wMatrix->n));
+    return wMatrix;
+}
 
-    eigenvectorsMat = initIdentityMatrix(n); /* Init the eigenvectors matrix */
+/* Parallel task - Lnorm's rows [begin, end), CSR. */
+void sparseLaplacianTask(void *args, int begin, int end, int threadId) {
+    int i;
+    long p;
+    SparseAffinityArgs *affinityArgs = (SparseAffinityArgs *) args;
+    CsrMatrix *csr = affinityArgs->csr;
+    const double *invSqrtDegrees = affinityArgs->degrees;
+    (void) threadId;
 
-    if (eigenvectorsMat != NULL) { /* Memory allocation fail */
-        jacobiIterCounter = 0;
-        do {
-            pivotIndex(matrix, n, &pivotRow, &pivotCol); /* Choose pivot index */
-            if (pivotRow == EOF) /* Matrix is already diagonal */
-                break;
-            /* perform rotation */
-            diffOffNorm = jacobiRotate(matrix, eigenvectorsMat, n, pivotRow, pivotCol);
-            jacobiIterCounter++;
-        } while (jacobiIterCounter < MAX_JACOBI_ITER && diffOffNorm > EPSILON);
+    for (i = begin; i < end; i++) {
+        for (p = csr->rowPtr[i]; p < csr->rowPtr[i + 1]; p++) {
+            csr->values[p] *= -1.0 * invSqrtDegrees[i] * invSqrtDegrees[csr->colIndex[p]];
+            if (csr->colIndex[p] == i) /* Identity matrix: Add 1 to the primary diagonal */
+                csr->values[p] += 1.0;
+        }
     }
-    return eigenvectorsMat;
 }
 
-/* This function performs a single jacobi rotation. */
-double jacobiRotate(double **a, double **v, int n, int i, int j) {
-    double theta, t, c, s;
-    double ij, ii, jj, ir, jr;
-    int r;
+/* Comparator function for the neighbours max-heap - by distance, then index. */
+int cmpNeighbours(const void *p1, const void *p2) {
+    const Neighbour *q1 = p1, *q2 = p2;
 
-    theta = a[j][j] - a[i][i];
-    theta /= (2 * a[i][j]);
-    t = 1.0 / (fabs(theta) + sqrt(SQ(theta) + 1.0));
-    t = theta < 0.0 ? -t : t;
-    c = 1.0 / sqrt(SQ(t) + 1.0);
-    s = t * c;
+    if (q1->sqDist > q2->sqDist)
+        return 1;
+    else if (q1->sqDist < q2->sqDist)
+        return -1;
+    return (q1->index - q2->index); /* Ties - the lower index is closer */
+}
 
-    ii = a[i][i];
-    jj = a[j][j];
-    ij = a[i][j];
-    a[i][j] = 0.0;
-    a[j][i] = 0.0;
-    for (r = 0; r < n; r++) {
-        if (r == i)
-            /* c^2 * Aii + s^2 * Ajj - 2scAij */
-            a[i][i] = SQ(c) * ii + SQ(s) * jj - 2 * s * c * ij;
-        else if (r == j)
-            /* s^2 * Aii + c^2 * Ajj + 2scAij */
-            a[j][j] = SQ(s) * ii + SQ(c) * jj + 2 * s * c * ij;
-        else { /* r != j, i */
-            ir = a[i][r];
-            jr = a[j][r];
-            a[i][r] = c * ir - s * jr;
-            a[j][r] = c * jr + s * ir;
-            /* Symmetry */
-            a[r][i] = a[i][r] ;
-            a[r][j] = a[j][r] ;
+/* Comparator function for the rows merge qsort - by index. */
+int cmpNeighbourIndexes(const void *p1, const void *p2) {
+    return ((const Neighbour *) p1)->index - ((const Neighbour *) p2)->index;
+}
 
-        }
+/* This function restores the max-heap property from the root down. */
+void siftDownNeighbours(Neighbour *heap, int size) {
+    int parent = 0, child;
+    Neighbour tmp;
 
-        /* Update the eigenvector matrix */
-        ir = v[i][r];
-        jr = v[j][r];
-        v[i][r] = c * ir - s * jr;
-        v[j][r] = c * jr + s * ir;
+    for (child = 1; child < size; parent = child, child = 2 * child + 1) {
+        if (child + 1 < size && cmpNeighbours(&heap[child + 1], &heap[child]) > 0)
+            child++; /* The farther child */
+        if (cmpNeighbours(&heap[child], &heap[parent]) <= 0)
+            break;
+        tmp = heap[parent];
+        heap[parent] = heap[child];
+        heap[child] = tmp;
     }
-
-    return 2 * SQ(ij); /* offNormDiff: Off(A)^2 - Off(A')^2 = 2 * Aij^2 */
 }
 
-/* This function chooses the pivot index for the jacobi rotation
- *      - the max abs off diagonal element > 0. */
-void pivotIndex(double **matrix, int n, int *pivotRow, int *pivotCol) {
-    int i, j;
-    double maxAbs = -1, tempValue;
-    for (i = 0; i < n; ++i) {
-        for (j = i + 1; j < n; ++j) {
-            tempValue = fabs(matrix[i][j]);
-            if (maxAbs < tempValue) {
-                maxAbs = tempValue;
-                *pivotRow = i;
-                *pivotCol = j;
-            }
-        }
+/* This function restores the max-heap property from the last element up. */
+void siftUpNeighbours(Neighbour *heap, int size) {
+    int child = size - 1, parent;
+    Neighbour tmp;
+
+    for (; child > 0; child = parent) {
+        parent = (child - 1) / 2;
+        if (cmpNeighbours(&heap[child], &heap[parent]) <= 0)
+            break;
+        tmp = heap[parent];
+        heap[parent] = heap[child];
+        heap[child] = tmp;
     }
-    if (maxAbs == 0.0)
-        *pivotRow = EOF; /* Matrix is diagonal */
 }
 
-/* Build an n * n identity matrix. */
-double **initIdentityMatrix(int n) {
-    int i, j;
-    double **matrix = (double **) alloc2DArray(n, n, sizeof(double),
-                                               sizeof(double *), freeUsedMem);
+/* This function copies a CSR matrix into a packed symmetric matrix. */
+double **csrToSymMatrix(SpkContext *ctx, const CsrMatrix *csr) {
+    int i;
+    long p;
+    double **matrix = arenaSymMatrix(ctx, matrixRegion, csr->n);
 
     if (matrix != NULL) { /* Memory allocation fail */
-        for (i = 0; i < n; ++i) {
-            for (j = 0; j < n; ++j) {
-                matrix[i][j] = i == j ? 1.0 : 0.0;
+        memset(matrix[0], 0, (size_t) csr->n * (csr->n + 1) / 2 * sizeof(double));
+        for (i = 0; i < csr->n; i++) {
+            for (p = csr->rowPtr[i]; p < csr->rowPtr[i + 1]; p++) {
+                if (csr->colIndex[p] >= i) /* Upper triangle */
+                    matrix[i][csr->colIndex[p]] = csr->values[p];
             }
         }
     }
     return matrix;
 }
 
-/* Sorting eigenvalues using qsort and comparator (makes it stable). */
-Eigenvalue *sortEigenvalues(double **a, int n) {
-    int i;
-    Eigenvalue *eigenvalues = myAlloc(NULL, n * sizeof(Eigenvalue));
-
+/*******************************************************************************
+*********************************** Nystrom ************************************
+*******************************************************************************/
+
+/* This function forms T out of a Nystrom approximation of W. */
+double **nystromTMatrix(SpkContext *ctx, double **datapointsArray, int *k, int dimension,
+                        int numOfDatapoints) {
+    int i, j, lane, rank, stage, *landmarks;
+    int n = numOfDatapoints, m = MIN(ctx->config.numOfLandmarks, numOfDatapoints);
+    double maxSigma, scale, *sums, *weights, **aMat, **qMat, **uMat;
+    Eigenvalue *eigenvalues;
+    NystromArgs args;
+    SOLVER solver = ctx->config.solver;
+
+    /* All the buffers are planned up front - the n * m block C among them */
+    if (!planNystromMemory(ctx, n))
+        return NULL; /* Memory allocation fail */
+    /* The landmarks and the n * m affinity block C */
+    landmarks = drawSeeds(ctx, datapointsArray, n, dimension, m, ctx->config.landmarks);
+    if (landmarks == NULL) return NULL; /* Memory allocation fail */
+    stage = stageBegin(ctx, "affinity");
+    args.vectorsArray = datapointsArray;
+    args.landmarks = landmarks;
+    args.numOfVectors = n;
+    args.dimension = dimension;
+    args.numOfLandmarks = m;
+    args.numOfLanes = nystromLanes(n);
+    args.laneSize = (n + args.numOfLanes - 1) / args.numOfLanes;
+    args.cMat = arenaMatrix(ctx, matrixRegion, n, m);
+    /* Lanes' column sums, then C^T * 1 and the weights */
+    args.laneSums = (double *) arenaAlloc(ctx, matrixRegion,
+                                          (args.numOfLanes + 2) * m * sizeof(double));
+    args.scratch = (double *) arenaAlloc(ctx, matrixRegion,
+                                         ctx->config.numOfThreads * m * sizeof(double));
+    aMat = arenaSymMatrix(ctx, matrixRegion, m);
+    if (args.cMat == NULL || args.laneSums == NULL || args.scratch == NULL || aMat == NULL)
+        return NULL; /* Memory allocation fail */
+    parallelFor(ctx, nystromAffinityTask, &args, args.numOfLanes, 1);
+    sums = args.laneSums + args.numOfLanes * m;
+    for (j = 0; j < m; ++j) { /* Reduce the lanes - fixed order */
+        sums[j] = 0.0;
+        for (lane = 0; lane < args.numOfLanes; ++lane) {
+            sums[j] += args.laneSums[lane * m + j];
+        }
+    }
+    for (i = 0; i < m; ++i) { /* A - the landmarks' rows */
+        for (j = i; j < m; ++j) {
+            aMat[i][j] = args.cMat[landmarks[i]][j];
+        }
+    }
+    stageEnd(ctx, stage, "landmarks", m);
+
+    /* A = Q * S * Q^T - its pseudo inverse's square root */
+    if (solver == classic) /* Capped rotations - not an eigensolver for the small problems */
+        ctx->config.solver = ql;
+    qMat = runEigensolver(ctx, aMat, m);
+    ctx->config.solver = solver;
+    if (qMat == NULL) return NULL;
+    maxSigma = 0.0;
+    for (i = 0; i < m; ++i) {
+        maxSigma = MAX(maxSigma, aMat[i][i]);
+    }
+    args.pMat = arenaMatrix(ctx, matrixRegion, m, m);
+    if (args.pMat == NULL) return NULL; /* Memory allocation fail */
+    weights = sums + m;
+    memset(weights, 0, m * sizeof(double));
+    for (i = 0, rank = 0; i < m; ++i) {
+        if (aMat[i][i] <= NYSTROM_RCOND * maxSigma)
+            continue; /* Dropped - A^+ */
+        /* weights = Q * S^+ * Q^T * (C^T * 1) */
+        scale = 0.0;
+        for (j = 0; j < m; ++j) {
+            scale += qMat[i][j] * sums[j];
+        }
+        scale /= aMat[i][i];
+        for (j = 0; j < m; ++j) {
+            weights[j] += scale * qMat[i][j];
+        }
+        scale = 1.0 / sqrt(aMat[i][i]);
+        for (j = 0; j < m; ++j) {
+            args.pMat[rank][j] = scale * qMat[i][j];
+        }
+        rank++;
+    }
+    ctx->report.nystrom.landmarks = m;
+    ctx->report.nystrom.rank = rank;
+    if (rank == 0) return NULL; /* Zero kernel */
+
+    /* G = D^-1/2 * C * P^T, in place of C, then G^T * G */
+    stage = stageBegin(ctx, "embedding");
+    args.weights = weights;
+    args.rank = rank;
+    parallelFor(ctx, nystromEmbeddingTask, &args, n, rowsChunkSize(ctx, n));
+    resetRegion(ctx, vectorsRegion); /* Q */
+    resetRegion(ctx, workRegion);
+    args.gram = arenaSymMatrix(ctx, matrixRegion, rank);
+    if (args.gram == NULL) return NULL; /* Memory allocation fail */
+    parallelFor(ctx, nystromGramTask, &args, rank, 1);
+    stageEnd(ctx, stage, "rank", rank);
+
+    /* G^T * G = U * L * U^T - Lnorm's eigenvalues ~ 1 - L */
+    if (solver == classic)
+        ctx->config.solver = ql;
+    uMat = runEigensolver(ctx, args.gram, rank);
+    ctx->config.solver = solver;
+    eigenvalues = (Eigenvalue *) arenaAlloc(ctx, matrixRegion, rank * sizeof(Eigenvalue));
+    if (uMat == NULL || eigenvalues == NULL) return NULL;
+    for (i = 0; i < rank; ++i) {
+        eigenvalues[i].value = 1.0 - args.gram[i][i];
+        eigenvalues[i].vector = i;
+    }
+    qsort(eigenvalues, rank, sizeof(Eigenvalue), cmpEigenvalues);
+
+    /* T's rows - G * U * L^-1/2 (G * G^T's eigenvectors), normalized */
+    stage = stageBegin(ctx, "tmatrix");
+    if (*k == 0) /* If k not provided */
+        *k = eigengapHeuristicKCalc(eigenvalues, n, MIN(rank, eigengapCandidates(ctx, n)));
+    if (*k > rank) return NULL; /* More clusters than the approximation's rank */
+    args.k = *k;
+    args.rMat = arenaMatrix(ctx, matrixRegion, *k, rank);
+    args.tMat = args.cMat; /* In place of G */
+    if (args.rMat == NULL) return NULL; /* Memory allocation fail */
+    for (i = 0; i < *k; ++i) {
+        scale = 1.0 - eigenvalues[i].value; /* G * G^T's eigenvalue */
+        scale = scale > 0.0 ? 1.0 / sqrt(scale) : 0.0;
+        for (j = 0; j < rank; ++j) {
+            args.rMat[i][j] = scale * uMat[eigenvalues[i].vector][j];
+        }
+    }
+    parallelFor(ctx, nystromTTask, &args, n, rowsChunkSize(ctx, n));
+    stageEnd(ctx, stage, "k", *k);
+    MyFree(ctx, landmarks);
+    for (i = 0; i < n; ++i) {
+        scale = 0.0;
+        for (j = 0; j < *k; ++j) {
+            scale += SQ(args.tMat[i][j]);
+        }
+        if (scale == 0.0) /* Zero line */
+            return NULL;
+    }
+    return args.tMat;
+}
+
+/* Parallel task - the affinity block's rows of lanes [begin, end) and their column sums. */
+void nystromAffinityTask(void *args, int begin, int end, int threadId) {
+    NystromArgs *nystrom = (NystromArgs *) args;
+    int i, j, t, lane, lastRow, m = nystrom->numOfLandmarks;
+    double dist, *row, *sums, *vector, *landmark;
+    (void) threadId;
+
+    for (lane = begin; lane < end; ++lane) {
+        sums = nystrom->laneSums + lane * m;
+        memset(sums, 0, m * sizeof(double));
+        lastRow = MIN((lane + 1) * nystrom->laneSize, nystrom->numOfVectors);
+        for (i = lane * nystrom->laneSize; i < lastRow; ++i) {
+            row = nystrom->cMat[i];
+            vector = nystrom->vectorsArray[i];
+            for (j = 0; j < m; ++j) {
+                landmark = nystrom->vectorsArray[nystrom->landmarks[j]];
+                dist = 0.0;
+                for (t = 0; t < nystrom->dimension; ++t) {
+                    dist += SQ(vector[t] - landmark[t]);
+                }
+                row[j] = exp(-0.5 * sqrt(dist)); /* The kernel - 1 on the diagonal */
+                sums[j] += row[j];
+            }
+        }
+    }
+}
+
+/* Parallel task - G's rows [begin, end), in place of C's. */
+void nystromEmbeddingTask(void *args, int begin, int end, int threadId) {
+    NystromArgs *nystrom = (NystromArgs *) args;
+    int i, j, m = nystrom->numOfLandmarks;
+    double degree, rowSum, *row, *scratch = nystrom->scratch + threadId * m;
+
+    for (i = begin; i < end; ++i) {
+        row = nystrom->cMat[i];
+        degree = -1.0; /* W's diagonal is 0 */
+        rowSum = 0.0;
+        for (j = 0; j < m; ++j) {
+            degree += row[j] * nystrom->weights[j];
+            rowSum += row[j];
+        }
+        if (degree <= 0.0) /* Poorly approximated - the landmarks' share */
+            degree = rowSum;
+        degree = degree > 0.0 ? 1.0 / sqrt(degree) : 0.0;
+        for (j = 0; j < m; ++j) {
+            scratch[j] = degree * row[j];
+        }
+        projectRow(scratch, nystrom->pMat, m, nystrom->rank, row);
+    }
+}
+
+/* Parallel task - G^T * G's packed rows [begin, end). */
+void nystromGramTask(void *args, int begin, int end, int threadId) {
+    NystromArgs *nystrom = (NystromArgs *) args;
+    int i, a, b, rank = nystrom->rank;
+    double value, *row, *gramRow;
+    (void) threadId;
+
+    for (a = begin; a < end; ++a) {
+        gramRow = nystrom->gram[a];
+        for (b = a; b < rank; ++b) {
+            gramRow[b] = 0.0;
+        }
+        for (i = 0; i < nystrom->numOfVectors; ++i) {
+            row = nystrom->cMat[i];
+            value = row[a];
+            for (b = a; b < rank; ++b) {
+                gramRow[b] += value * row[b];
+            }
+        }
+    }
+}
+
+/* Parallel task - T's rows [begin, end), normalized. */
+void nystromTTask(void *args, int begin, int end, int threadId) {
+    NystromArgs *nystrom = (NystromArgs *) args;
+    int i, j, k = nystrom->k;
+    double sumSqRow, *row, *scratch = nystrom->scratch + threadId * nystrom->numOfLandmarks;
+
+    for (i = begin; i < end; ++i) {
+        row = nystrom->tMat[i];
+        memcpy(scratch, nystrom->cMat[i], nystrom->rank * sizeof(double)); /* T replaces G */
+        projectRow(scratch, nystrom->rMat, nystrom->rank, k, row);
+        sumSqRow = 0.0;
+        for (j = 0; j < k; ++j) {
+            sumSqRow += SQ(row[j]);
+        }
+        if (sumSqRow == 0.0) /* Zero line */
+            continue;
+        sumSqRow = 1.0 / sqrt(sumSqRow);
+        for (j = 0; j < k; ++j) {
+            row[j] *= sumSqRow;
+        }
+    }
+}
+
+/* This function projects a row on a matrix's rows. */
+void projectRow(const double *row, double **mat, int n, int m, double *out) {
+    int i, j;
+    double sum;
+
+    for (j = 0; j < m; ++j) {
+        sum = 0.0;
+        for (i = 0; i < n; ++i) {
+            sum += row[i] * mat[j][i];
+        }
+        out[j] = sum;
+    }
+}
+
+/*******************************************************************************
+******************************** Range of K ************************************
+*******************************************************************************/
+
+/* This function runs the spk algorithm for a range of k - the eigenpairs once. */
+SpkClustering *spkRange(SpkContext *ctx, double **datapointsArray, const int *ks, int numOfKs,
+                        int dimension, int numOfDatapoints, int *eigengapK) {
+    int i, maxK = 0, numOfEigenpairs, numOfCandidates, stage;
+    SpkRangeArgs args;
+    SpkClustering *clusterings;
+
+    for (i = 0; i < numOfKs; ++i) {
+        if (ks[i] < 0 || ks[i] >= numOfDatapoints)
+            return NULL; /* As the spk goal - invalid */
+        maxK = MAX(maxK, ks[i]);
+    }
+    /* Steps 1 to 3 - the eigenpairs of the largest k and of the eigengap heuristic's
+     * candidates (bounded for lanczos) */
+    numOfCandidates = eigengapCandidates(ctx, numOfDatapoints);
+    args.eigenvectorsMat = spectralSteps(ctx, datapointsArray, spk, MAX(maxK, numOfCandidates),
+                                         dimension, numOfDatapoints, &args.eigenvalues,
+                                         &numOfEigenpairs);
+    if (args.eigenvectorsMat == NULL) return NULL;
+    *eigengapK = eigengapHeuristicKCalc(args.eigenvalues, numOfDatapoints,
+                                        ctx->config.solver == lanczos ? numOfCandidates :
+                                        numOfEigenpairs);
+
+    /* The results' buffers - the clusterings' contexts are freed when they end */
+    stage = stageBegin(ctx, "clusterings");
+    clusterings = (SpkClustering *) myAlloc(ctx, NULL, numOfKs * sizeof(SpkClustering));
+    args.status = (int *) myAlloc(ctx, NULL, numOfKs * sizeof(int));
+    if (clusterings == NULL || args.status == NULL) return NULL; /* Memory allocation fail */
+    for (i = 0; i < numOfKs; ++i) {
+        clusterings[i].k = ks[i] != 0 ? ks[i] : *eigengapK;
+        clusterings[i].centroids = (double **) alloc2DArray(ctx, clusterings[i].k,
+                                                            clusterings[i].k, sizeof(double),
+                                                            SIZE_OF_VOID_2PTR, NULL);
+        clusterings[i].labels = (double *) myAlloc(ctx, NULL, numOfDatapoints * sizeof(double));
+        if (clusterings[i].centroids == NULL || clusterings[i].labels == NULL)
+            return NULL; /* Memory allocation fail */
+    }
+    args.clusterings = clusterings;
+    args.numOfDatapoints = numOfDatapoints;
+    args.config = ctx->config;
+    args.config.verbose = 0;
+    args.config.profile = 0;
+    args.config.tracePath = NULL;
+    args.threadPool = NULL;
+    if (numOfKs >= ctx->config.numOfThreads) { /* A k per thread */
+        args.config.numOfThreads = 1;
+        parallelFor(ctx, spkRangeTask, &args, numOfKs, 1);
+    } else { /* Few ks - each kmeans on all the threads, ctx's pool */
+        if (ctx->config.numOfThreads > 1 && ctx->threadPool == NULL &&
+            initThreadPool(ctx, ctx->config.numOfThreads - 1) == EOF)
+            args.config.numOfThreads = 1; /* Couldn't start workers - run serially */
+        args.threadPool = ctx->threadPool;
+        spkRangeTask(&args, 0, numOfKs, 0);
+    }
+    for (i = 0; i < numOfKs; ++i) {
+        if (args.status[i] == EOF)
+            return NULL;
+    }
+    stageEnd(ctx, stage, "ks", numOfKs);
+    return clusterings;
+}
+
+/* Parallel task - the clusterings [begin, end) of a range of k, each in its own context. */
+void spkRangeTask(void *args, int begin, int end, int threadId) {
+    int i;
+    SpkContext work;
+    SpkRangeArgs *rangeArgs = (SpkRangeArgs *) args;
+    (void) threadId;
+
+    for (i = begin; i < end; i++) {
+        initContext(&work);
+        work.config = rangeArgs->config;
+        work.threadPool = rangeArgs->threadPool;
+        rangeArgs->status[i] = spkClusterK(&work, rangeArgs, &rangeArgs->clusterings[i]);
+        work.threadPool = NULL; /* Lent - stays with the caller */
+        freeAllMemory(&work);
+    }
+}
+
+/* This function forms one k's T out of the shared eigenpairs and clusters it. */
+int spkClusterK(SpkContext *ctx, const SpkRangeArgs *rangeArgs, SpkClustering *clustering) {
+    int i, j, label, k = clustering->k, n = rangeArgs->numOfDatapoints;
+    double inertia = 0.0, **tMat, **clusters;
+
+    /* Steps 4 + 5 - no arena here, T is a "myAlloc" block of the context */
+    tMat = initTMatrix(ctx, rangeArgs->eigenvalues, rangeArgs->eigenvectorsMat, n, k);
+    if (tMat == NULL) return EOF;
+    clusters = kMeans(ctx, tMat, n, k, k, NULL, MAX_KMEANS_ITER);
+    if (clusters == NULL) return EOF;
+    for (i = 0; i < k; ++i) {
+        memcpy(clustering->centroids[i], clusters[i], k * sizeof(double));
+    }
+    for (i = 0; i < n; ++i) {
+        label = (int) clusters[k][i];
+        clustering->labels[i] = clusters[k][i];
+        for (j = 0; j < k; ++j) {
+            inertia += SQ(tMat[i][j] - clusters[label][j]);
+        }
+    }
+    clustering->inertia = inertia;
+    clustering->iterations = ctx->report.kmeans.iterations;
+    return 0;
+}
+
+/*******************************************************************************
+****************************** Eigenpairs Cache ********************************
+*******************************************************************************/
+
+/* This function calculates the cache key of a run's eigenpairs. */
+void eigenpairsKey(SpkContext *ctx, double **datapointsArray, int numOfDatapoints,
+                   int dimension, char *key) {
+    int i, params[4];
+    unsigned long hash[FNV_LIMBS] = FNV_OFFSET_LIMBS;
+    SOLVER solver = ctx->config.solver;
+
+    params[0] = numOfDatapoints;
+    params[1] = dimension;
+    params[2] = solver;
+    params[3] = ctx->config.affinity;
+    fnv1a(hash, params, sizeof(params));
+    if (solver == cyclic || solver == parallel || solver == lanczos) /* classic, ql - none */
+        fnv1a(hash, &ctx->config.jacobiTol, sizeof(double));
+    if (solver == cyclic || solver == parallel)
+        fnv1a(hash, &ctx->config.maxSweeps, sizeof(int));
+    if (ctx->config.affinity != dense)
+        fnv1a(hash, &ctx->config.affinityParam, sizeof(double));
+    for (i = 0; i < numOfDatapoints; ++i) {
+        fnv1a(hash, datapointsArray[i], dimension * sizeof(double));
+    }
+    for (i = 0; i < FNV_LIMBS; ++i) { /* Most significant first */
+        sprintf(key + i * CACHE_KEY_CHARS / FNV_LIMBS, "%04lx", hash[FNV_LIMBS - 1 - i]);
+    }
+}
+
+/* This function adds bytes to a FNV-1a hash. */
+void fnv1a(unsigned long *hash, const void *data, size_t size) {
+    int i, j;
+    size_t b;
+    unsigned long carry, product[FNV_LIMBS], prime[FNV_LIMBS] = FNV_PRIME_LIMBS;
+    const unsigned char *bytes = (const unsigned char *) data;
+
+    for (b = 0; b < size; ++b) {
+        hash[0] ^= bytes[b];
+        /* hash * prime mod 2^64 - the prime's limbs are at most 9 bits */
+        carry = 0;
+        for (i = 0; i < FNV_LIMBS; ++i) {
+            product[i] = carry;
+            for (j = 0; j <= i; ++j) {
+                product[i] += hash[j] * prime[i - j];
+            }
+            carry = product[i] >> FNV_LIMB_BITS;
+            product[i] &= FNV_LIMB_MASK;
+        }
+        memcpy(hash, product, sizeof(product));
+    }
+}
+
+/* This function builds a key's cache file path. */
+char *eigenpairsPath(SpkContext *ctx, const char *key) {
+    char *path = (char *) myAlloc(ctx, NULL, strlen(ctx->config.cacheDir) + CACHE_PATH_EXTRA);
+
+    if (path != NULL) /* Else memory allocation fail */
+        sprintf(path, CACHE_FILE_FORMAT, ctx->config.cacheDir, key);
+    return path;
+}
+
+/* This function looks the eigenpairs up in the cache - a hit is memory mapped. */
+double **loadEigenpairs(SpkContext *ctx, const char *path, const char *key, int n, int k,
+                        Eigenvalue **eigenvalues, int *numOfEigenpairs) {
+    int i, fd, needed = n;
+    int64_t stored;
+    size_t regionSizes[NUM_OF_REGIONS];
+    struct stat fileStat;
+    void *addr;
+    const CacheHeader *header;
+    double *values, **eigenvectorsMat;
+    SpkMapping *mapping;
+
+    if (ctx->config.solver == lanczos) /* As "spectralSteps" - its eigenpairs */
+        needed = k != 0 ? k : eigengapCandidates(ctx, n);
+    ctx->report.cache.lookups++;
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return NULL; /* A miss */
+    if (fstat(fd, &fileStat) == -1 || fileStat.st_size < (off_t) sizeof(CacheHeader)) {
+        close(fd);
+        return NULL; /* Not a cache file */
+    }
+    addr = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); /* The mapping stays valid */
+    if (addr == MAP_FAILED) return NULL;
+    header = (const CacheHeader *) addr;
+    stored = header->numOfEigenpairs;
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        strncmp(header->dtype, nativeDtype(), sizeof(header->dtype)) != 0 ||
+        memcmp(header->key, key, CACHE_KEY_CHARS) != 0 || header->n != n ||
+        stored < needed || stored > n ||
+        (size_t) fileStat.st_size !=
+        sizeof(CacheHeader) + (size_t) stored * (n + 1) * sizeof(double)) {
+        munmap(addr, fileStat.st_size);
+        return NULL; /* Another key's, or fewer eigenpairs */
+    }
+    mapping = (SpkMapping *) myAlloc(ctx, NULL, sizeof(SpkMapping));
+    if (mapping == NULL) { /* Memory allocation fail */
+        munmap(addr, fileStat.st_size);
+        return NULL;
+    }
+    mapping->addr = addr;
+    mapping->length = fileStat.st_size;
+    mapping->next = ctx->mappings;
+    ctx->mappings = mapping;
+    madvise(addr, mapping->length, MADV_WILLNEED); /* Start reading ahead */
+
+    /* The hit's plan - the eigenvalues, and T as "planMemory"'s */
+    memset(regionSizes, 0, sizeof(regionSizes));
+    regionSizes[matrixRegion] = arenaMatrixBytes(n, k != 0 ? k : MAX(n / 2, 1));
+    regionSizes[vectorsRegion] = alignedSize(needed * sizeof(Eigenvalue));
+    if (!initArena(ctx, regionSizes)) return NULL;
+    *eigenvalues = (Eigenvalue *) arenaAlloc(ctx, vectorsRegion, needed * sizeof(Eigenvalue));
+    eigenvectorsMat = (double **) myAlloc(ctx, NULL, needed * sizeof(double *));
+    if (*eigenvalues == NULL || eigenvectorsMat == NULL) return NULL;
+    values = (double *) (header + 1); /* Read only - the eigenvectors aren't modified */
+    for (i = 0; i < needed; ++i) {
+        (*eigenvalues)[i].value = values[i];
+        (*eigenvalues)[i].vector = i;
+        eigenvectorsMat[i] = values + stored + (size_t) i * n;
+    }
+    *numOfEigenpairs = needed;
+    ctx->report.cache.hits++;
+    ctx->report.cache.bytes += (long) mapping->length;
+    return eigenvectorsMat;
+}
+
+/* This function writes the sorted eigenpairs to the cache (a temporary file, then renamed). */
+void storeEigenpairs(SpkContext *ctx, const char *path, const char *key, int n,
+                     double **eigenvectorsMat, const Eigenvalue *eigenvalues,
+                     int numOfEigenpairs) {
+    int i, written;
+    CacheHeader header;
+    FILE *file;
+    char *tempPath = (char *) myAlloc(ctx, NULL, strlen(path) + CACHE_PATH_EXTRA);
+
+    if (tempPath == NULL) return; /* Memory allocation fail */
+    sprintf(tempPath, CACHE_TEMP_FORMAT, path, (long) getpid(), (unsigned long) ctx);
+    file = fopen(tempPath, "wb");
+    if (file == NULL) { /* No cache directory - skip */
+        MyFree(ctx, tempPath);
+        return;
+    }
+    memset(&header, 0, sizeof(CacheHeader));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    memcpy(header.dtype, nativeDtype(), strlen(nativeDtype())); /* Zero padded */
+    memcpy(header.key, key, CACHE_KEY_CHARS);
+    header.n = n;
+    header.numOfEigenpairs = numOfEigenpairs;
+    written = fwrite(&header, sizeof(CacheHeader), 1, file) == 1;
+    for (i = 0; i < numOfEigenpairs && written; ++i) {
+        written = fwrite(&eigenvalues[i].value, sizeof(double), 1, file) == 1;
+    }
+    for (i = 0; i < numOfEigenpairs && written; ++i) {
+        written = fwrite(eigenvectorsMat[eigenvalues[i].vector], sizeof(double), n, file) ==
+                  (size_t) n;
+    }
+    if (fclose(file) == EOF || !written || rename(tempPath, path) != 0) {
+        remove(tempPath); /* Partial - the cache stays as is */
+    } else {
+        ctx->report.cache.writes++;
+        ctx->report.cache.bytes += (long) (sizeof(CacheHeader) +
+                                           numOfEigenpairs * (n + 1) * sizeof(double));
+    }
+    MyFree(ctx, tempPath);
+}
+
+/*******************************************************************************
+********************************** KMeans **************************************
+*******************************************************************************/
+
+/* This function runs the main KMeans clustering algorithm. */
+double **kMeans(SpkContext *ctx, double **vectorsArray, int numOfVectors, int dimension, int k,
+                const int *firstCentralIndexes, int maxIter) {
+    int i, changes, *seeds = NULL, stage = stageBegin(ctx, "kmeans");
+    Cluster *clustersArray;
+    KMeansBounds *bounds = NULL;
+    KMeansAssignArgs args;
+    KMeansReport *report = &ctx->report.kmeans;
+    double *vecToClusterLabeling, **finalCentroidsAndVecLabeling;
+
+    if (firstCentralIndexes == NULL && ctx->config.init != firstk) {
+        /* Seed the initial centroids */
+        firstCentralIndexes = seeds = kMeansSeeds(ctx, vectorsArray, numOfVectors, dimension, k);
+        if (seeds == NULL) return NULL; /* Memory allocation fail */
+    }
+    /* Initialize clusters arrays */
+    clustersArray = initClusters(ctx, vectorsArray, k, dimension, firstCentralIndexes);
+    vecToClusterLabeling = (double *) myAlloc(ctx, ctx->freeUsedMem, numOfVectors * sizeof(double));
+    if (vecToClusterLabeling == NULL || clustersArray == NULL) return NULL;
+    report->variant = ctx->config.kmeans;
+    if (report->variant == triangle)
+        report->variant = k < ELKAN_MIN_K ? hamerly : elkan;
+    report->k = k;
+    report->distances = 0;
+    report->changes = 0;
+    report->batchSize = 0;
+    if (report->variant == minibatch) {
+        report->batchSize = MIN(ctx->config.batchSize, numOfVectors);
+        report->iterations = miniBatchKMeans(ctx, vectorsArray, clustersArray,
+                                             vecToClusterLabeling, numOfVectors, dimension, k,
+                                             maxIter);
+        if (report->iterations == EOF) return NULL;
+        report->pruned = 0; /* No bounds */
+        finalCentroidsAndVecLabeling = buildFinalCentroidsMat(clustersArray,
+                                                              vecToClusterLabeling, k, dimension);
+        MyFree(ctx, clustersArray);
+        MyFree(ctx, seeds);
+        stageEnd(ctx, stage, "iterations", report->iterations);
+        return finalCentroidsAndVecLabeling;
+    }
+    if (report->variant != lloyd) {
+        bounds = initKMeansBounds(ctx, report->variant, numOfVectors, k);
+        if (bounds == NULL) return NULL; /* Memory allocation fail */
+    }
+    if (initKMeansLanes(ctx, &args, vectorsArray, clustersArray, vecToClusterLabeling, bounds,
+                        k, numOfVectors, dimension) == EOF)
+        return NULL; /* Memory allocation fail */
+
+    for (i = 0; i < maxIter; ++i) {
+        /* Update curr centroid to prev centroid and reset the counter */
+        initCurrCentroidAndCounter(clustersArray, k, dimension);
+        if (bounds != NULL && !bounds->valid)
+            args.bounds = NULL; /* Empty cluster - lloyd from now on */
+        args.firstIteration = i == 0;
+        assignVectorsToClusters(ctx, &args);
+        if (args.bounds == NULL)
+            report->distances += (long) numOfVectors * k;
+        /* Calculate new centroids */
+        changes = recalcCentroids(clustersArray, k, dimension);
+        report->changes += changes;
+        if (changes == 0) {
+            /* Centroids stay unchanged in the current iteration == convergence */
+            break;
+        }
+        if (args.bounds != NULL)
+            updateKMeansBounds(ctx, &args);
+    }
+    report->iterations = MIN(i + 1, maxIter);
+    if (bounds != NULL)
+        report->distances += bounds->distances;
+    report->pruned = (long) report->iterations * numOfVectors * k - report->distances;
+    /* Organize the results as a matrix */
+    finalCentroidsAndVecLabeling = buildFinalCentroidsMat(clustersArray, vecToClusterLabeling,
+                                                          k, dimension);
+    MyFree(ctx, clustersArray);
+    MyFree(ctx, bounds);
+    MyFree(ctx, args.laneSums);
+    MyFree(ctx, seeds);
+    stageEnd(ctx, stage, "iterations", report->iterations);
+    return finalCentroidsAndVecLabeling;
+}
+
+/* This function chooses the initial clusters' centroids. */
+int *kMeansSeeds(SpkContext *ctx, double **vectorsArray, int numOfVectors, int dimension,
+                 int k) {
+    return drawSeeds(ctx, vectorsArray, numOfVectors, dimension, k, ctx->config.init);
+}
+
+/* This function draws k seeds by a seeding method. */
+int *drawSeeds(SpkContext *ctx, double **vectorsArray, int numOfVectors, int dimension, int k,
+               INIT init) {
+    int i, j, tmp, *seeds, stage;
+    unsigned long state = ctx->config.seed;
+    SeedingArgs args;
+
+    seeds = (int *) myAlloc(ctx, NULL, k * sizeof(int));
+    if (seeds == NULL) return NULL; /* Memory allocation fail */
+    if (init == firstk) {
+        for (i = 0; i < k; ++i) {
+            seeds[i] = i;
+        }
+        return seeds;
+    }
+    stage = stageBegin(ctx, "seeding");
+    if (init == uniform) { /* Partial Fisher-Yates shuffle of the indexes */
+        args.centers = (int *) myAlloc(ctx, NULL, numOfVectors * sizeof(int));
+        if (args.centers == NULL) return NULL; /* Memory allocation fail */
+        for (i = 0; i < numOfVectors; ++i) {
+            args.centers[i] = i;
+        }
+        for (i = 0; i < k; ++i) {
+            j = i + (int) (randomUniform(&state) * (numOfVectors - i));
+            tmp = args.centers[j];
+            args.centers[j] = args.centers[i];
+            seeds[i] = args.centers[i] = tmp;
+        }
+        MyFree(ctx, args.centers);
+        stageEnd(ctx, stage, "vectors", numOfVectors);
+        return seeds;
+    }
+    /* Squared distances, closest candidates and the candidates - n each */
+    args.minSqDists = (double *) myAlloc(ctx, NULL, numOfVectors * (sizeof(double) +
+                                                                    2 * sizeof(int)));
+    if (args.minSqDists == NULL) return NULL; /* Memory allocation fail */
+    args.nearest = (int *) (args.minSqDists + numOfVectors);
+    args.centers = args.nearest + numOfVectors;
+    args.vectorsArray = vectorsArray;
+    args.numOfVectors = numOfVectors;
+    args.dimension = dimension;
+    for (i = 0; i < numOfVectors; ++i) {
+        args.minSqDists[i] = HUGE_VAL;
+    }
+    /* The first candidate - uniformly */
+    args.centers[0] = (int) (randomUniform(&state) * numOfVectors);
+    args.firstCenter = 0;
+    args.numOfCenters = 1;
+    updateSeedingDists(ctx, &args);
+    if (init == plusplus) { /* Each next seed by D^2 */
+        seeds[0] = args.centers[0];
+        for (i = 1; i < k; ++i) {
+            args.centers[i] = seeds[i] = weightedDraw(args.minSqDists, numOfVectors, &state);
+            args.firstCenter = i;
+            args.numOfCenters = i + 1;
+            updateSeedingDists(ctx, &args);
+        }
+    } else if (scalableSeeds(ctx, &args, seeds, numOfVectors, k, &state) == EOF)
+        return NULL; /* Memory allocation fail */
+    MyFree(ctx, args.minSqDists);
+    stageEnd(ctx, stage, "vectors", numOfVectors);
+    return seeds;
+}
+
+/* This function updates the vectors' squared distances to their closest candidate. */
+void updateSeedingDists(SpkContext *ctx, SeedingArgs *args) {
+    parallelFor(ctx, seedingDistsTask, args, args->numOfVectors,
+                rowsChunkSize(ctx, args->numOfVectors));
+}
+
+/* Parallel task - updates the squared distances of vectors [begin, end). */
+void seedingDistsTask(void *args, int begin, int end, int threadId) {
+    int i, c;
+    double sqDist;
+    SeedingArgs *sArgs = (SeedingArgs *) args;
+    (void) threadId;
+
+    for (i = begin; i < end; ++i) {
+        for (c = sArgs->firstCenter; c < sArgs->numOfCenters; ++c) {
+            sqDist = vectorsSqNorm(sArgs->vectorsArray[i],
+                                   sArgs->vectorsArray[sArgs->centers[c]], sArgs->dimension);
+            if (sqDist < sArgs->minSqDists[i]) {
+                sArgs->minSqDists[i] = sqDist;
+                sArgs->nearest[i] = c;
+            }
+        }
+    }
+}
+
+/* This function draws an index with probability weights[i] / sum(weights). */
+int weightedDraw(const double *weights, int n, unsigned long *state) {
+    int i, last = 0;
+    double total = 0.0, target = randomUniform(state);
+
+    for (i = 0; i < n; ++i) {
+        total += weights[i];
+    }
+    if (!(total > 0.0)) /* All zero - uniformly */
+        return (int) (target * n);
+    target *= total;
+    for (i = 0; i < n; ++i) {
+        if (weights[i] > 0.0) {
+            last = i;
+            target -= weights[i];
+            if (target < 0.0)
+                return i;
+        }
+    }
+    return last; /* Rounding errors - the last positive weight */
+}
+
+/* This function runs k-means|| - oversampling rounds, then weighted k-means++. */
+int scalableSeeds(SpkContext *ctx, SeedingArgs *args, int *seeds, int numOfVectors, int k,
+                  unsigned long *state) {
+    int i, c, round, chosen, numOfCandidates = 1;
+    double cost, sqDist, *weights, *candidateDists, *probabilities;
+
+    for (round = 0; round < SCALABLE_ROUNDS; ++round) {
+        cost = 0.0;
+        for (i = 0; i < numOfVectors; ++i) {
+            cost += args->minSqDists[i];
+        }
+        if (!(cost > 0.0))
+            break; /* Every vector is a candidate's duplicate */
+        args->firstCenter = numOfCandidates;
+        for (i = 0; i < numOfVectors; ++i) { /* A draw per vector, in order */
+            if (randomUniform(state) * cost < SCALABLE_OVERSAMPLING * k * args->minSqDists[i])
+                args->centers[numOfCandidates++] = i; /* Candidates' D^2 is 0 - drawn once */
+        }
+        args->numOfCenters = numOfCandidates;
+        updateSeedingDists(ctx, args);
+    }
+    if (numOfCandidates <= k) { /* Too few candidates - all of them + k-means++ */
+        for (i = 0; i < k; ++i) {
+            if (i >= numOfCandidates) {
+                args->centers[i] = weightedDraw(args->minSqDists, numOfVectors, state);
+                args->firstCenter = i;
+                args->numOfCenters = i + 1;
+                updateSeedingDists(ctx, args);
+            }
+            seeds[i] = args->centers[i];
+        }
+        return 0;
+    }
+    /* Candidates' weights - the vectors closest to each one */
+    weights = (double *) myAlloc(ctx, NULL, 3 * numOfCandidates * sizeof(double));
+    if (weights == NULL) return EOF; /* Memory allocation fail */
+    candidateDists = weights + numOfCandidates;
+    probabilities = candidateDists + numOfCandidates;
+    for (c = 0; c < numOfCandidates; ++c) {
+        weights[c] = 0.0;
+        candidateDists[c] = HUGE_VAL;
+    }
+    for (i = 0; i < numOfVectors; ++i) {
+        weights[args->nearest[i]]++;
+    }
+    /* Weighted k-means++ among the candidates */
+    chosen = weightedDraw(weights, numOfCandidates, state);
+    for (i = 0; i < k; ++i) {
+        if (i > 0) {
+            for (c = 0; c < numOfCandidates; ++c) {
+                probabilities[c] = weights[c] * candidateDists[c];
+            }
+            chosen = weightedDraw(probabilities, numOfCandidates, state);
+        }
+        seeds[i] = args->centers[chosen];
+        for (c = 0; c < numOfCandidates; ++c) {
+            sqDist = vectorsSqNorm(args->vectorsArray[args->centers[c]],
+                                   args->vectorsArray[seeds[i]], args->dimension);
+            candidateDists[c] = MIN(candidateDists[c], sqDist);
+        }
+    }
+    MyFree(ctx, weights);
+    return 0;
+}
+
+/* This function initialize the clusters array. */
+Cluster *initClusters(SpkContext *ctx, double **vectorsArray, int k, int dimension,
+                      const int *firstCentralIndexes) {
+    int i, j;
+    Cluster *clustersArray;
+    double **centroidMat;
+
+    /* Allocate memory for clustersArray */
+    clustersArray = (Cluster *) myAlloc(ctx, NULL, k * sizeof(Cluster));
+    centroidMat = (double **) alloc2DArray(ctx, k + 1, dimension * 2,
+                                           sizeof(double), sizeof(double *), ctx->freeUsedMem);
+    if (clustersArray == NULL || centroidMat == NULL) return NULL;
+
+    for (i = 0; i < k; ++i) {
+        clustersArray[i].counter = 0;
+        clustersArray[i].currCentroid = centroidMat[i];
+        clustersArray[i].prevCentroid = centroidMat[i] + dimension;
+
+        if (firstCentralIndexes == NULL) { /* KMeans */
+            for (j = 0; j < dimension; ++j) {
+                /* Assign the first k vectors to their corresponding clusters */
+                clustersArray[i].currCentroid[j] = vectorsArray[i][j];
+            }
+        } else { /* KMeans++ */
+            /* Assign the initial k vectors to their corresponding clusters
+             * according to the seeds (given, or "kMeansSeeds") */
+            for (j = 0; j < dimension; ++j) {
+                clustersArray[i].currCentroid[j] = vectorsArray[firstCentralIndexes[i]][j];
+            }
+        }
+    }
+    return clustersArray;
+}
+
+/* This function allocates the kmeans assignment step's lanes. */
+int initKMeansLanes(SpkContext *ctx, KMeansAssignArgs *args, double **vectorsArray,
+                    Cluster *clustersArray, double *vecToClusterLabeling, KMeansBounds *bounds,
+                    int k, int numOfVectors, int dimension) {
+    size_t laneDoubles = (size_t) k * dimension + k; /* Sums, then counters */
+    size_t laneBytes = laneDoubles * sizeof(double) + sizeof(long); /* + distances */
+
+    args->numOfLanes = MIN(KMEANS_LANES, (numOfVectors + KMEANS_LANE_MIN - 1) / KMEANS_LANE_MIN);
+    args->laneSize = (numOfVectors + args->numOfLanes - 1) / args->numOfLanes;
+    /* Per lane - sums and counters (as doubles - exact), then the distances */
+    args->laneSums = (double *) myAlloc(ctx, NULL, args->numOfLanes * laneBytes);
+    if (args->laneSums == NULL) return EOF; /* Memory allocation fail */
+    args->laneDistances = (long *) (args->laneSums + args->numOfLanes * laneDoubles);
+    args->vectorsArray = vectorsArray;
+    args->clustersArray = clustersArray;
+    args->vecToClusterLabeling = vecToClusterLabeling;
+    args->bounds = bounds;
+    args->k = k;
+    args->numOfVectors = numOfVectors;
+    args->dimension = dimension;
+    args->firstIteration = 1;
+    return 0;
+}
+
+/* This function assign the closest cluster for each vector. */
+void assignVectorsToClusters(SpkContext *ctx, KMeansAssignArgs *args) {
+    int lane, c, j, k = args->k, dimension = args->dimension;
+    double *laneSums;
+    Cluster *cluster;
+
+    if (args->bounds != NULL && !args->firstIteration)
+        centroidsHalfGaps(args->bounds, args->clustersArray, k, dimension);
+    parallelFor(ctx, kMeansAssignTask, args, args->numOfLanes, 1);
+    /* Reduce the lanes' sums and counters - fixed order */
+    for (lane = 0; lane < args->numOfLanes; ++lane) {
+        laneSums = args->laneSums + lane * ((size_t) k * dimension + k);
+        for (c = 0; c < k; ++c) {
+            cluster = args->clustersArray + c;
+            for (j = 0; j < dimension; ++j) {
+                cluster->currCentroid[j] += laneSums[c * dimension + j];
+            }
+            cluster->counter += (int) laneSums[k * dimension + c];
+        }
+        if (args->bounds != NULL)
+            args->bounds->distances += args->laneDistances[lane];
+    }
+}
+
+/* Parallel task - assigns the vectors of lanes [begin, end) and sums them per cluster. */
+void kMeansAssignTask(void *args, int begin, int end, int threadId) {
+    int lane, i, j, last, myCluster, label;
+    long distances;
+    double *vec, *sums;
+    KMeansAssignArgs *aArgs = (KMeansAssignArgs *) args;
+    int k = aArgs->k, dimension = aArgs->dimension;
+    (void) threadId;
+
+    for (lane = begin; lane < end; ++lane) {
+        sums = aArgs->laneSums + lane * ((size_t) k * dimension + k);
+        memset(sums, 0, ((size_t) k * dimension + k) * sizeof(double));
+        distances = 0;
+        last = MIN((lane + 1) * aArgs->laneSize, aArgs->numOfVectors);
+        for (i = lane * aArgs->laneSize; i < last; ++i) {
+            vec = aArgs->vectorsArray[i];
+            /* Set vector's cluster to his closest */
+            label = aArgs->firstIteration ? 0 : (int) aArgs->vecToClusterLabeling[i];
+            if (aArgs->bounds == NULL)
+                myCluster = findMyCluster(vec, aArgs->clustersArray, k, dimension);
+            else if (aArgs->bounds->variant == elkan)
+                myCluster = elkanAssign(aArgs->bounds, vec, i, aArgs->clustersArray, label, k,
+                                        dimension, aArgs->firstIteration, &distances);
+            else
+                myCluster = hamerlyAssign(aArgs->bounds, vec, i, aArgs->clustersArray, label, k,
+                                          dimension, aArgs->firstIteration, &distances);
+            aArgs->vecToClusterLabeling[i] = myCluster;
+
+            for (j = 0; j < dimension; ++j) {
+                /* Summation of the vectors Components */
+                sums[myCluster * dimension + j] += vec[j];
+            }
+            /* Count the number of vectors for each cluster */
+            sums[k * dimension + myCluster]++;
+        }
+        aArgs->laneDistances[lane] = distances;
+    }
+}
+
+/* This function finds vector's closest cluster (in terms of euclidean norm). */
+int findMyCluster(double *vec, Cluster *clustersArray, int k, int dimension) {
+    int myCluster, j;
+    double minNorm, norm;
+
+    myCluster = 0;
+    minNorm = vectorsSqNorm(vec, clustersArray[0].prevCentroid, dimension);
+    for (j = 1; j < k; ++j) { /* Find the min norm == the closest cluster */
+        norm = vectorsSqNorm(vec, clustersArray[j].prevCentroid, dimension);
+        if (norm < minNorm) {
+            myCluster = j;
+            minNorm = norm;
+        }
+    }
+    return myCluster;
+}
+
+/* This function calculates the squared euclidean norm between two vectors. */
+double vectorsSqNorm(const double *vec1, const double *vec2, int dimension) {
+    double sqNorm = 0;
+    int i;
+
+    for (i = 0; i < dimension; ++i) {
+        sqNorm += SQ(vec1[i] - vec2[i]);
+    }
+    return sqNorm;
+}
+
+/* This function recalculates clusters centroids after one kmeans iteration. */
+int recalcCentroids(Cluster *clustersArray, int k, int dimension) {
+    Cluster cluster;
+    int i, j, moved, changes = 0;
+
+    for (i = 0; i < k; ++i) {
+        cluster = clustersArray[i];
+        moved = 0;
+        for (j = 0; j < dimension; ++j) {
+            cluster.currCentroid[j] /= cluster.counter; /* Calc the mean value */
+            moved |= cluster.prevCentroid[j] != cluster.currCentroid[j];
+        }
+        changes += moved; /* Count the centroids that moved */
+    }
+    return changes;
+}
+
+/* This function organize clusters array for the next iteration:
+ *      Reset counter and current centroid (to be zero vector)
+ *      Update previous centroids to be current centroids */
+void initCurrCentroidAndCounter(Cluster *clustersArray, int k, int dimension) {
+    int i, j;
+    for (i = 0; i < k; ++i) {
+        for (j = 0; j < dimension; ++j) {
+            /* Set prev centroid to curr centroid */
+            clustersArray[i].prevCentroid[j] = clustersArray[i].currCentroid[j];
+            clustersArray[i].currCentroid[j] = 0; /* Reset curr centroid */
+        }
+        clustersArray[i].counter = 0; /* Reset counter */
+    }
+}
+
+/* This function allocates the accelerated kmeans' bounds. */
+KMeansBounds *initKMeansBounds(SpkContext *ctx, KMEANS variant, int numOfVectors, int k) {
+    int numOfBounds = variant == elkan ? k : 1;
+    size_t numOfDoubles = (size_t) numOfVectors * (1 + numOfBounds) + 2 * k +
+                          (variant == elkan ? (size_t) k * k : 0);
+    KMeansBounds *bounds = (KMeansBounds *) myAlloc(ctx, NULL, sizeof(KMeansBounds) +
+                                                               numOfDoubles * sizeof(double));
+
+    if (bounds != NULL) {
+        bounds->variant = variant;
+        bounds->numOfBounds = numOfBounds;
+        bounds->upper = (double *) (bounds + 1);
+        bounds->lower = bounds->upper + numOfVectors;
+        bounds->drift = bounds->lower + (size_t) numOfVectors * numOfBounds;
+        bounds->halfGap = bounds->drift + k;
+        bounds->halfDists = variant == elkan ? bounds->halfGap + k : NULL;
+        bounds->distances = 0;
+        bounds->valid = 1;
+    }
+    return bounds;
+}
+
+/* Hamerly's assignment of a single vector. */
+int hamerlyAssign(KMeansBounds *bounds, const double *vec, int i, Cluster *clustersArray,
+                  int label, int k, int dimension, int firstIteration, long *distances) {
+    int j, myCluster;
+    double sqNorm, labelNorm = 0.0, minNorm, secondNorm, bound;
+
+    if (!firstIteration) {
+        bound = MAX(bounds->halfGap[label], bounds->lower[i]);
+        if (surelyBelow(bounds->upper[i], bound))
+            return label; /* No other centroid can be closer */
+        /* Tighten the upper bound and test again */
+        labelNorm = vectorsSqNorm(vec, clustersArray[label].prevCentroid, dimension);
+        (*distances)++;
+        bounds->upper[i] = sqrt(labelNorm);
+        if (surelyBelow(bounds->upper[i], bound))
+            return label;
+    }
+    /* Full scan - lloyd's order and ties, keeps the two closest centroids */
+    myCluster = 0;
+    minNorm = secondNorm = HUGE_VAL;
+    for (j = 0; j < k; ++j) {
+        if (!firstIteration && j == label) {
+            sqNorm = labelNorm; /* Computed above */
+        } else {
+            sqNorm = vectorsSqNorm(vec, clustersArray[j].prevCentroid, dimension);
+            (*distances)++;
+        }
+        if (j == 0 || sqNorm < minNorm) {
+            secondNorm = MIN(secondNorm, minNorm);
+            myCluster = j;
+            minNorm = sqNorm;
+        } else {
+            secondNorm = MIN(secondNorm, sqNorm);
+        }
+    }
+    bounds->upper[i] = sqrt(minNorm);
+    bounds->lower[i] = sqrt(secondNorm);
+    return myCluster;
+}
+
+/* Elkan's assignment of a single vector. */
+int elkanAssign(KMeansBounds *bounds, const double *vec, int i, Cluster *clustersArray,
+                int label, int k, int dimension, int firstIteration, long *distances) {
+    int j, myCluster = label, tight = firstIteration;
+    double sqNorm, minNorm = HUGE_VAL, bound;
+    double *lower = bounds->lower + (size_t) i * k;
+
+    if (!firstIteration && surelyBelow(bounds->upper[i], bounds->halfGap[label]))
+        return label; /* No other centroid can be closer */
+    for (j = 0; j < k; ++j) {
+        if (firstIteration) { /* All the distances - lloyd's order and ties */
+            sqNorm = vectorsSqNorm(vec, clustersArray[j].prevCentroid, dimension);
+            (*distances)++;
+            lower[j] = sqrt(sqNorm);
+            if (j == 0 || sqNorm < minNorm) {
+                myCluster = j;
+                minNorm = sqNorm;
+            }
+            continue;
+        }
+        if (j == myCluster)
+            continue;
+        bound = MAX(lower[j], bounds->halfDists[(size_t) myCluster * k + j]);
+        if (surelyBelow(bounds->upper[i], bound))
+            continue; /* Centroid j is farther than myCluster's */
+        if (!tight) { /* Tighten the upper bound and test again */
+            minNorm = vectorsSqNorm(vec, clustersArray[myCluster].prevCentroid, dimension);
+            (*distances)++;
+            bounds->upper[i] = lower[myCluster] = sqrt(minNorm);
+            tight = 1;
+            if (surelyBelow(bounds->upper[i], bound))
+                continue;
+        }
+        sqNorm = vectorsSqNorm(vec, clustersArray[j].prevCentroid, dimension);
+        (*distances)++;
+        lower[j] = sqrt(sqNorm);
+        /* Closer, or as close with a lower index (lloyd's first minimum) */
+        if (sqNorm < minNorm || (sqNorm == minNorm && j < myCluster)) {
+            myCluster = j;
+            minNorm = sqNorm;
+            bounds->upper[i] = lower[j];
+        }
+    }
+    if (firstIteration)
+        bounds->upper[i] = sqrt(minNorm);
+    return myCluster;
+}
+
+/* This function computes the centroids' half gaps for the next assignment step. */
+void centroidsHalfGaps(KMeansBounds *bounds, Cluster *clustersArray, int k, int dimension) {
+    int i, j;
+    double halfDist;
+
+    for (i = 0; i < k; ++i) {
+        bounds->halfGap[i] = HUGE_VAL;
+    }
+    for (i = 0; i < k; ++i) {
+        if (bounds->halfDists != NULL)
+            bounds->halfDists[(size_t) i * k + i] = 0.0;
+        for (j = i + 1; j < k; ++j) {
+            halfDist = 0.5 * sqrt(vectorsSqNorm(clustersArray[i].prevCentroid,
+                                                clustersArray[j].prevCentroid, dimension));
+            bounds->halfGap[i] = MIN(bounds->halfGap[i], halfDist);
+            bounds->halfGap[j] = MIN(bounds->halfGap[j], halfDist);
+            if (bounds->halfDists != NULL)
+                bounds->halfDists[(size_t) i * k + j] = bounds->halfDists[(size_t) j * k + i] =
+                        halfDist;
+        }
+    }
+}
+
+/* This function moves the bounds by the centroids' drift after an update. */
+void updateKMeansBounds(SpkContext *ctx, KMeansAssignArgs *args) {
+    int j;
+    KMeansBounds *bounds = args->bounds;
+    Cluster *clustersArray = args->clustersArray;
+
+    bounds->maxDrift = 0.0;
+    for (j = 0; j < args->k; ++j) {
+        bounds->drift[j] = sqrt(vectorsSqNorm(clustersArray[j].prevCentroid,
+                                              clustersArray[j].currCentroid, args->dimension));
+        if (!(bounds->drift[j] < HUGE_VAL)) { /* Empty cluster - nan centroid */
+            bounds->valid = 0;
+            return;
+        }
+        bounds->maxDrift = MAX(bounds->maxDrift, bounds->drift[j]);
+    }
+    parallelFor(ctx, kMeansBoundsTask, args, args->numOfVectors,
+                rowsChunkSize(ctx, args->numOfVectors));
+}
+
+/* Parallel task - moves the bounds of vectors [begin, end). */
+void kMeansBoundsTask(void *args, int begin, int end, int threadId) {
+    int i, j;
+    double *lower;
+    KMeansAssignArgs *aArgs = (KMeansAssignArgs *) args;
+    KMeansBounds *bounds = aArgs->bounds;
+    int k = aArgs->k;
+    (void) threadId;
+
+    for (i = begin; i < end; ++i) {
+        bounds->upper[i] += bounds->drift[(int) aArgs->vecToClusterLabeling[i]];
+        if (bounds->variant == elkan) {
+            lower = bounds->lower + (size_t) i * k;
+            for (j = 0; j < k; ++j) {
+                lower[j] = MAX(lower[j] - bounds->drift[j], 0.0);
+            }
+        } else {
+            bounds->lower[i] = MAX(bounds->lower[i] - bounds->maxDrift, 0.0);
+        }
+    }
+}
+
+/* This function checks a bound test - a < b by the BOUND_SLACK margin. */
+int surelyBelow(double a, double b) {
+    return a * (1.0 + BOUND_SLACK) < b * (1.0 - BOUND_SLACK);
+}
+
+/* This function runs mini-batch kmeans (Sculley). */
+int miniBatchKMeans(SpkContext *ctx, double **vectorsArray, Cluster *clustersArray,
+                    double *vecToClusterLabeling, int numOfVectors, int dimension, int k,
+                    int maxIter) {
+    int i, j, b, c, steps, maxSteps, noImprovement = 0;
+    int batchSize = MIN(ctx->config.batchSize, numOfVectors), *batch;
+    unsigned long state = ctx->config.seed;
+    double eta, delta, move, inertia, smoothedInertia = 0.0, bestInertia = HUGE_VAL;
+    double *vec, *centroid;
+    /* Smoothing weight of a batch's inertia - about one epoch's memory */
+    double alpha = MIN(2.0 * batchSize / (numOfVectors + 1.0), 1.0);
+
+    batch = (int *) myAlloc(ctx, NULL, 2 * batchSize * sizeof(int));
+    if (batch == NULL) return EOF; /* Memory allocation fail */
+    for (c = 0; c < k; ++c) {
+        clustersArray[c].counter = 0; /* Vectors the centroid got so far */
+    }
+    maxSteps = (int) MIN((double) maxIter * ((numOfVectors + batchSize - 1) / batchSize),
+                         INT_MAX);
+    for (steps = 0; steps < maxSteps; ) {
+        /* Assign a random batch to the current centroids */
+        for (c = 0; c < k; ++c) { /* findMyCluster reads prevCentroid */
+            memcpy(clustersArray[c].prevCentroid, clustersArray[c].currCentroid,
+                   dimension * sizeof(double));
+        }
+        inertia = 0.0;
+        for (b = 0; b < batchSize; ++b) {
+            batch[b] = (int) (randomUniform(&state) * numOfVectors);
+            vec = vectorsArray[batch[b]];
+            batch[batchSize + b] = c = findMyCluster(vec, clustersArray, k, dimension);
+            inertia += vectorsSqNorm(vec, clustersArray[c].prevCentroid, dimension);
+        }
+        ctx->report.kmeans.distances += (long) batchSize * k;
+        steps++;
+        /* Gradient step - each centroid with its own learning rate */
+        for (b = 0; b < batchSize; ++b) {
+            vec = vectorsArray[batch[b]];
+            c = batch[batchSize + b];
+            centroid = clustersArray[c].currCentroid;
+            eta = 1.0 / ++clustersArray[c].counter;
+            for (j = 0; j < dimension; ++j) {
+                centroid[j] += eta * (vec[j] - centroid[j]);
+            }
+        }
+        /* Convergence - small centroids' move or no inertia improvement */
+        move = 0.0;
+        for (c = 0; c < k; ++c) {
+            delta = vectorsSqNorm(clustersArray[c].prevCentroid, clustersArray[c].currCentroid,
+                                  dimension);
+            ctx->report.kmeans.changes += delta != 0.0; /* The centroids that moved */
+            move += delta;
+        }
+        if (move / k <= ctx->config.batchTol)
+            break;
+        inertia /= batchSize;
+        smoothedInertia = steps == 1 ? inertia : smoothedInertia * (1.0 - alpha) +
+                                                 inertia * alpha;
+        if (smoothedInertia < bestInertia) {
+            bestInertia = smoothedInertia;
+            noImprovement = 0;
+        } else if (++noImprovement >= BATCH_PATIENCE)
+            break;
+    }
+    /* Label all the vectors by the final centroids */
+    for (c = 0; c < k; ++c) {
+        memcpy(clustersArray[c].prevCentroid, clustersArray[c].currCentroid,
+               dimension * sizeof(double));
+    }
+    for (i = 0; i < numOfVectors; ++i) {
+        vecToClusterLabeling[i] = findMyCluster(vectorsArray[i], clustersArray, k, dimension);
+    }
+    ctx->report.kmeans.distances += (long) numOfVectors * k;
+    MyFree(ctx, batch);
+    return steps;
+}
+
+/* This function organize KMeans result into a matrix:
+ *      First k rows - Clusters centroids
+ *      Last row (Could be from different length) vectors to clusters labeling */
+double **buildFinalCentroidsMat(Cluster *clustersArray, double *vecToClusterLabeling,
+                                int k, int dimension) {
+    /* Restore first row pointer of centroid matrix from "initClusters" */
+    double **matrix = (double **)(clustersArray[k - 1].prevCentroid + dimension * 3);
+    /* Assign last row to point to vectors labeling array */
+    matrix[k] = vecToClusterLabeling;
+    return matrix;
+}
+
+/*******************************************************************************
+****************************** Jacobi Algorithm ********************************
+*******************************************************************************/
+
+/* This function performs Jacobi's diagonal method on a symmetric matrix. */
+double **jacobiAlgorithm(SpkContext *ctx, double **matrix, int n) {
+    if (!planMemory(ctx, jacobi, n, n, 0))
+        return NULL; /* Memory allocation fail - before any rotation */
+    return runEigensolver(ctx, matrix, n);
+}
+
+/* This function runs the configured eigensolver within a planned run. */
+double **runEigensolver(SpkContext *ctx, double **matrix, int n) {
+    int solved, stage = stageBegin(ctx, "eigensolver");
+    double **eigenvectorsMat;
+
+    eigenvectorsMat = initIdentityMatrix(ctx, n); /* Init the eigenvectors matrix */
+
+    if (eigenvectorsMat != NULL) { /* Memory allocation fail */
+        if (ctx->config.solver != lanczos) { /* Lanczos fills its own report */
+            ctx->report.jacobi.n = n;
+            ctx->report.jacobi.sweeps = 0;
+            ctx->report.jacobi.rotations = 0;
+        }
+        switch (ctx->config.solver) {
+            case cyclic:
+                solved = jacobiCyclic(ctx, matrix, eigenvectorsMat, n);
+                break;
+            case parallel:
+                solved = jacobiParallel(ctx, matrix, eigenvectorsMat, n);
+                break;
+            case ql:
+                solved = tridiagonalQL(ctx, matrix, eigenvectorsMat, n);
+                break;
+            case lanczos:
+                solved = lanczosFull(ctx, matrix, eigenvectorsMat, n);
+                break;
+            default:
+                solved = jacobiClassic(ctx, matrix, eigenvectorsMat, n);
+        }
+        if (!solved) { /* Memory allocation fail or no convergence */
+            MyMatFree(ctx, eigenvectorsMat);
+        }
+    }
+    if (ctx->config.solver == lanczos)
+        stageEnd(ctx, stage, "mat-vecs", ctx->report.lanczos.matVecs);
+    else
+        stageEnd(ctx, stage, "rotations", ctx->report.jacobi.rotations);
+    return eigenvectorsMat;
+}
+
+/* Classic Jacobi - rotates the max abs off diagonal element each time. */
+int jacobiClassic(SpkContext *ctx, double **a, double **v, int n) {
+    double diffOffNorm;
+    int jacobiIterCounter, pivotRow, pivotCol, row, *rowArgmax;
+
+    rowArgmax = (int *) arenaAlloc(ctx, workRegion, n * sizeof(int));
+    if (rowArgmax == NULL) /* Memory allocation fail */
+        return 0;
+    for (row = 0; row < n; row++) {
+        rowArgmax[row] = rowMaxIndex(a, n, row);
+    }
+
+    jacobiIterCounter = 0;
+    do {
+        /* Choose pivot index */
+        pivotIndex(a, n, rowArgmax, &pivotRow, &pivotCol);
+        if (pivotRow == EOF) /* Matrix is already diagonal */
+            break;
+        /* perform rotation */
+        diffOffNorm = jacobiRotate(a, v, n, pivotRow, pivotCol);
+        updateRowMaxima(a, n, rowArgmax, pivotRow, pivotCol);
+        jacobiIterCounter++;
+    } while (jacobiIterCounter < MAX_JACOBI_ITER && diffOffNorm > EPSILON);
+    ctx->report.jacobi.rotations = jacobiIterCounter;
+    ctx->report.jacobi.offNorm = offDiagNorm(a, n, NULL);
+    MyFree(ctx, rowArgmax);
+    return 1;
+}
+
+/* Cyclic-by-row threshold Jacobi - sweeps over the upper triangle row by row. */
+int jacobiCyclic(SpkContext *ctx, double **a, double **v, int n) {
+    int p, q;
+    double off, diagSqSum, frobeniusNorm, threshold, absPq, negligible;
+    JacobiReport *report = &ctx->report.jacobi;
+
+    off = offDiagNorm(a, n, &diagSqSum);
+    frobeniusNorm = sqrt(SQ(off) + diagSqSum); /* Invariant under rotations */
+    while (report->sweeps < ctx->config.maxSweeps && off > ctx->config.jacobiTol * frobeniusNorm) {
+        /* The first sweeps rotate only elements above the mean abs off-diagonal
+         * element (scaled), later sweeps rotate all the non negligible ones */
+        threshold = report->sweeps < THRESHOLD_SWEEPS ? THRESHOLD_FACTOR * off / n : 0.0;
+        for (p = 0; p < n - 1; p++) {
+            for (q = p + 1; q < n; q++) {
+                absPq = fabs(a[p][q]);
+                negligible = NEGLIGIBLE_FACTOR * absPq;
+                if (report->sweeps >= THRESHOLD_SWEEPS &&
+                    fabs(a[p][p]) + negligible == fabs(a[p][p]) &&
+                    fabs(a[q][q]) + negligible == fabs(a[q][q])) {
+                    a[p][q] = 0.0; /* Below the diagonal's precision */
+                } else if (absPq > threshold && absPq > 0.0) {
+                    jacobiRotate(a, v, n, p, q);
+                    report->rotations++;
+                }
+            }
+        }
+        report->sweeps++;
+        off = offDiagNorm(a, n, NULL);
+    }
+    report->offNorm = off;
+    return 1;
+}
+
+/* Parallel (round-robin) threshold Jacobi. */
+int jacobiParallel(SpkContext *ctx, double **a, double **v, int n) {
+    int k, p, q, round, numOfPlayers, numOfPairs, *order, *first, *second;
+    double off, diagSqSum, frobeniusNorm, threshold, absPq, negligible, *cosines, *sines;
+    JacobiRoundArgs args;
+    JacobiReport *report = &ctx->report.jacobi;
+
+    numOfPlayers = n % 2 == 0 ? n : n + 1; /* Index n - no partner this round */
+    numOfPairs = numOfPlayers / 2;
+    order = (int *) arenaAlloc(ctx, workRegion, (numOfPlayers + 2 * numOfPairs) * sizeof(int));
+    cosines = (double *) arenaAlloc(ctx, workRegion, 2 * numOfPairs * sizeof(double));
+    if (order == NULL || cosines == NULL) /* Memory allocation fail */
+        return 0;
+    first = order + numOfPlayers;
+    second = first + numOfPairs;
+    sines = cosines + numOfPairs;
+    for (k = 0; k < numOfPlayers; k++) {
+        order[k] = k;
+    }
+    args.a = a;
+    args.v = v;
+    args.n = n;
+    args.numOfPairs = numOfPairs;
+    args.first = first;
+    args.second = second;
+    args.cosines = cosines;
+    args.sines = sines;
+
+    off = offDiagNorm(a, n, &diagSqSum);
+    frobeniusNorm = sqrt(SQ(off) + diagSqSum); /* Invariant under rotations */
+    while (report->sweeps < ctx->config.maxSweeps && off > ctx->config.jacobiTol * frobeniusNorm) {
+        threshold = report->sweeps < THRESHOLD_SWEEPS ? THRESHOLD_FACTOR * off / n : 0.0;
+        for (round = 0; round < numOfPlayers - 1; round++) {
+            /* The round's pairs and their rotations, all from the same matrix */
+            for (k = 0; k < numOfPairs; k++) {
+                p = MIN(order[k], order[numOfPlayers - 1 - k]);
+                q = order[k] + order[numOfPlayers - 1 - k] - p;
+                first[k] = p;
+                second[k] = q;
+                cosines[k] = 1.0; /* No rotation */
+                sines[k] = 0.0;
+                if (q == n)
+                    continue; /* No partner */
+                absPq = fabs(a[p][q]);
+                negligible = NEGLIGIBLE_FACTOR * absPq;
+                if (report->sweeps >= THRESHOLD_SWEEPS &&
+                    fabs(a[p][p]) + negligible == fabs(a[p][p]) &&
+                    fabs(a[q][q]) + negligible == fabs(a[q][q])) {
+                    a[p][q] = 0.0; /* Below the diagonal's precision */
+                } else if (absPq > threshold && absPq > 0.0) {
+                    jacobiRotationParams(a, p, q, &cosines[k], &sines[k]);
+                    report->rotations++;
+                }
+            }
+            parallelFor(ctx, jacobiRoundBlocksTask, &args, numOfPairs, 1);
+            parallelFor(ctx, jacobiRoundVectorsTask, &args, numOfPairs, rowsChunkSize(ctx,
+                                                                                      numOfPairs));
+            /* Next round - the first player stays, the others rotate */
+            p = order[numOfPlayers - 1];
+            memmove(order + 2, order + 1, (numOfPlayers - 2) * sizeof(int));
+            order[1] = p;
+        }
+        report->sweeps++;
+        off = offDiagNorm(a, n, NULL);
+    }
+    report->offNorm = off;
+    MyFree(ctx, order);
+    MyFree(ctx, cosines);
+    return 1;
+}
+
+/* This function calculates the rotation (c, s) zeroing a[p][q], as in "jacobiRotate". */
+void jacobiRotationParams(double **a, int p, int q, double *c, double *s) {
+    double theta, t;
+
+    theta = a[q][q] - a[p][p];
+    theta /= (2 * a[p][q]);
+    t = 1.0 / (fabs(theta) + sqrt(SQ(theta) + 1.0));
+    t = theta < 0.0 ? -t : t;
+    *c = 1.0 / sqrt(SQ(t) + 1.0);
+    *s = t * *c;
+}
+
+/* Parallel task - applies the round's rotations to A, one block row of pairs at a time. */
+void jacobiRoundBlocksTask(void *args, int begin, int end, int threadId) {
+    int k1, k2, x, y, rows[2], cols[2];
+    double c1, s1, c2, s2, pp, qq, pq, block[2][2], rotated[2][2], *elements[2][2];
+    JacobiRoundArgs *roundArgs = (JacobiRoundArgs *) args;
+    double **a = roundArgs->a;
+    int n = roundArgs->n;
+    (void) threadId;
+
+    for (k1 = begin; k1 < end; k1++) {
+        rows[0] = roundArgs->first[k1];
+        rows[1] = roundArgs->second[k1];
+        c1 = roundArgs->cosines[k1];
+        s1 = roundArgs->sines[k1];
+
+        if (s1 != 0.0) { /* Diagonal block - rotates a[p][q] to zero */
+            pp = a[rows[0]][rows[0]];
+            qq = a[rows[1]][rows[1]];
+            pq = a[rows[0]][rows[1]];
+            a[rows[0]][rows[1]] = 0.0;
+            /* c^2 * Aii + s^2 * Ajj - 2scAij */
+            a[rows[0]][rows[0]] = SQ(c1) * pp + SQ(s1) * qq - 2 * s1 * c1 * pq;
+            /* s^2 * Aii + c^2 * Ajj + 2scAij */
+            a[rows[1]][rows[1]] = SQ(s1) * pp + SQ(c1) * qq + 2 * s1 * c1 * pq;
+        }
+
+        for (k2 = k1 + 1; k2 < roundArgs->numOfPairs; k2++) {
+            c2 = roundArgs->cosines[k2];
+            s2 = roundArgs->sines[k2];
+            if (s1 == 0.0 && s2 == 0.0)
+                continue; /* Both identity */
+            cols[0] = roundArgs->first[k2];
+            cols[1] = roundArgs->second[k2];
+            /* Gather the block - index n (no partner) reads as zero */
+            for (x = 0; x < 2; x++) {
+                for (y = 0; y < 2; y++) {
+                    if (rows[x] == n || cols[y] == n) {
+                        elements[x][y] = NULL;
+                        block[x][y] = 0.0;
+                    } else {
+                        elements[x][y] = rows[x] < cols[y] ? &a[rows[x]][cols[y]] :
+                                         &a[cols[y]][rows[x]];
+                        block[x][y] = *elements[x][y];
+                    }
+                }
+            }
+            /* G1 * B, G = [c -s; s c] (the rows update of "jacobiRotate") */
+            for (y = 0; y < 2; y++) {
+                rotated[0][y] = c1 * block[0][y] - s1 * block[1][y];
+                rotated[1][y] = s1 * block[0][y] + c1 * block[1][y];
+            }
+            /* (G1 * B) * G2^T, scattered back */
+            for (x = 0; x < 2; x++) {
+                block[x][0] = c2 * rotated[x][0] - s2 * rotated[x][1];
+                block[x][1] = s2 * rotated[x][0] + c2 * rotated[x][1];
+                for (y = 0; y < 2; y++) {
+                    if (elements[x][y] != NULL)
+                        *elements[x][y] = block[x][y];
+                }
+            }
+        }
+    }
+}
+
+/* Parallel task - applies the round's rotations of pairs [begin, end) to the eigenvectors. */
+void jacobiRoundVectorsTask(void *args, int begin, int end, int threadId) {
+    int k, r;
+    double c, s, ir, jr, *vi, *vj;
+    JacobiRoundArgs *roundArgs = (JacobiRoundArgs *) args;
+    (void) threadId;
+
+    for (k = begin; k < end; k++) {
+        c = roundArgs->cosines[k];
+        s = roundArgs->sines[k];
+        if (s == 0.0)
+            continue; /* No rotation */
+        vi = roundArgs->v[roundArgs->first[k]];
+        vj = roundArgs->v[roundArgs->second[k]];
+        for (r = 0; r < roundArgs->n; r++) {
+            ir = vi[r];
+            jr = vj[r];
+            vi[r] = c * ir - s * jr;
+            vj[r] = c * jr + s * ir;
+        }
+    }
+}
+
+/* Householder tridiagonalization + implicit shift QL. */
+int tridiagonalQL(SpkContext *ctx, double **a, double **v, int n) {
+    int i, j, iterations;
+    double tmp, *d, *e;
+    JacobiReport *report = &ctx->report.jacobi;
+
+    d = (double *) arenaAlloc(ctx, workRegion, 2 * n * sizeof(double));
+    if (d == NULL) /* Memory allocation fail */
+        return 0;
+    e = d + n;
+
+    for (i = 0; i < n; i++) { /* Unpack A */
+        for (j = i; j < n; j++) {
+            v[i][j] = v[j][i] = a[i][j];
+        }
+    }
+    householderTridiagonal(v, d, e, n);
+    for (i = 0; i < n; i++) { /* QL rotates rows - transpose the transformation */
+        for (j = i + 1; j < n; j++) {
+            tmp = v[i][j];
+            v[i][j] = v[j][i];
+            v[j][i] = tmp;
+        }
+    }
+    iterations = implicitQL(ctx, v, d, e, n);
+    if (iterations == EOF) { /* No convergence (nan/inf input) */
+        MyFree(ctx, d);
+        return 0;
+    }
+
+    for (i = 0; i < n; i++) { /* Diagonal form, as the Jacobi solvers leave A */
+        a[i][i] = d[i];
+        for (j = i + 1; j < n; j++) {
+            a[i][j] = 0.0;
+        }
+    }
+    report->sweeps = iterations;
+    report->offNorm = 0.0;
+    MyFree(ctx, d);
+    return 1;
+}
+
+/* Householder reduction of a symmetric matrix to tridiagonal form (tred2). */
+void householderTridiagonal(double **v, double *d, double *e, int n) {
+    int i, j, k;
+    double scale, f, g, h, hh;
+
+    for (j = 0; j < n; j++) {
+        d[j] = v[n - 1][j];
+    }
+    for (i = n - 1; i > 0; i--) {
+        /* Scale to avoid under/overflow */
+        scale = 0.0;
+        h = 0.0;
+        for (k = 0; k < i; k++) {
+            scale += fabs(d[k]);
+        }
+        if (scale == 0.0) {
+            e[i] = d[i - 1];
+            for (j = 0; j < i; j++) {
+                d[j] = v[i - 1][j];
+                v[i][j] = 0.0;
+                v[j][i] = 0.0;
+            }
+        } else {
+            /* Generate the Householder vector */
+            for (k = 0; k < i; k++) {
+                d[k] /= scale;
+                h += SQ(d[k]);
+            }
+            f = d[i - 1];
+            g = sqrt(h);
+            g = f > 0 ? -g : g;
+            e[i] = scale * g;
+            h -= f * g;
+            d[i - 1] = f - g;
+            for (j = 0; j < i; j++) {
+                e[j] = 0.0;
+            }
+            /* Apply the similarity transformation to the remaining columns */
+            for (j = 0; j < i; j++) {
+                f = d[j];
+                v[j][i] = f;
+                g = e[j] + v[j][j] * f;
+                for (k = j + 1; k <= i - 1; k++) {
+                    g += v[k][j] * d[k];
+                    e[k] += v[k][j] * f;
+                }
+                e[j] = g;
+            }
+            f = 0.0;
+            for (j = 0; j < i; j++) {
+                e[j] /= h;
+                f += e[j] * d[j];
+            }
+            hh = f / (h + h);
+            for (j = 0; j < i; j++) {
+                e[j] -= hh * d[j];
+            }
+            for (j = 0; j < i; j++) {
+                f = d[j];
+                g = e[j];
+                for (k = j; k <= i - 1; k++) {
+                    v[k][j] -= (f * e[k] + g * d[k]);
+                }
+                d[j] = v[i - 1][j];
+                v[i][j] = 0.0;
+            }
+        }
+        d[i] = h;
+    }
+
+    /* Accumulate the transformations */
+    for (i = 0; i < n - 1; i++) {
+        v[n - 1][i] = v[i][i];
+        v[i][i] = 1.0;
+        h = d[i + 1];
+        if (h != 0.0) {
+            for (k = 0; k <= i; k++) {
+                d[k] = v[k][i + 1] / h;
+            }
+            for (j = 0; j <= i; j++) {
+                g = 0.0;
+                for (k = 0; k <= i; k++) {
+                    g += v[k][i + 1] * v[k][j];
+                }
+                for (k = 0; k <= i; k++) {
+                    v[k][j] -= g * d[k];
+                }
+            }
+        }
+        for (k = 0; k <= i; k++) {
+            v[k][i + 1] = 0.0;
+        }
+    }
+    for (j = 0; j < n; j++) {
+        d[j] = v[n - 1][j];
+        v[n - 1][j] = 0.0;
+    }
+    v[n - 1][n - 1] = 1.0;
+    e[0] = 0.0;
+}
+
+/* Implicit shift QL on a symmetric tridiagonal matrix (tql2). */
+int implicitQL(SpkContext *ctx, double **w, double *d, double *e, int n) {
+    int i, k, l, m, iter, iterations = 0;
+    double f, g, h, p, r, c, c2, c3, s, s2, el1, dl1, tst1, wi, *wi1;
+    JacobiReport *report = &ctx->report.jacobi;
+
+    for (i = 1; i < n; i++) {
+        e[i - 1] = e[i];
+    }
+    e[n - 1] = 0.0;
+    f = 0.0;
+    tst1 = 0.0;
+    for (l = 0; l < n; l++) {
+        /* Find a small subdiagonal element */
+        tst1 = MAX(tst1, fabs(d[l]) + fabs(e[l]));
+        for (m = l; m < n - 1 && fabs(e[m]) > QL_EPSILON * tst1; m++);
+
+        /* If m == l, d[l] is an eigenvalue, otherwise iterate */
+        for (iter = 0; m > l && fabs(e[l]) > QL_EPSILON * tst1; iter++) {
+            if (iter == MAX_QL_ITER)
+                return EOF;
+            iterations++;
+            /* Compute the implicit shift */
+            g = d[l];
+            p = (d[l + 1] - g) / (2.0 * e[l]);
+            r = hypot(p, 1.0);
+            r = p < 0 ? -r : r;
+            d[l] = e[l] / (p + r);
+            d[l + 1] = e[l] * (p + r);
+            dl1 = d[l + 1];
+            h = g - d[l];
+            for (i = l + 2; i < n; i++) {
+                d[i] -= h;
+            }
+            f += h;
+
+            /* Implicit QL transformation */
+            p = d[m];
+            c = 1.0;
+            c2 = c;
+            c3 = c;
+            el1 = e[l + 1];
+            s = 0.0;
+            s2 = 0.0;
+            for (i = m - 1; i >= l; i--) {
+                c3 = c2;
+                c2 = c;
+                s2 = s;
+                g = c * e[i];
+                h = c * p;
+                r = hypot(p, e[i]);
+                e[i + 1] = s * r;
+                s = e[i] / r;
+                c = p / r;
+                p = c * d[i] - s * g;
+                d[i + 1] = h + s * (c * g + s * d[i]);
+                /* Accumulate the rotation - rows i, i + 1 of the transposed transformation */
+                wi1 = w[i + 1];
+                for (k = 0; k < n; k++) {
+                    wi = w[i][k];
+                    h = wi1[k];
+                    wi1[k] = s * wi + c * h;
+                    w[i][k] = c * wi - s * h;
+                }
+                report->rotations++;
+            }
+            p = -s * s2 * c3 * el1 * e[l] / dl1;
+            e[l] = s * p;
+            d[l] = c * p;
+        }
+        d[l] += f;
+        e[l] = 0.0;
+    }
+    return iterations;
+}
+
+/* Full decomposition with the Lanczos solver (jacobi goal). */
+int lanczosFull(SpkContext *ctx, double **a, double **v, int n) {
+    int i, j, solved;
+    Eigenvalue *eigenvalues;
+    LinearOperator op;
+
+    eigenvalues = (Eigenvalue *) arenaAlloc(ctx, workRegion, n * sizeof(Eigenvalue));
+    if (eigenvalues == NULL || !symMatOperator(ctx, &op, a, n)) /* Memory allocation fail */
+        return 0;
+
+    solved = lanczosEigen(ctx, &op, n, v, eigenvalues);
+    if (solved) {
+        for (i = 0; i < n; i++) { /* Diagonal form, as the Jacobi solvers leave A */
+            a[i][i] = eigenvalues[i].value;
+            for (j = i + 1; j < n; j++) {
+                a[i][j] = 0.0;
+            }
+        }
+    }
+    MyFree(ctx, op.workspace);
+    MyFree(ctx, eigenvalues);
+    return solved;
+}
+
+/* This function computes the nev smallest eigenpairs with the Lanczos solver. */
+double **partialEigenpairs(SpkContext *ctx, const LinearOperator *op, int nev,
+                           Eigenvalue **eigenvalues) {
+    double **vectors;
+
+    vectors = arenaMatrix(ctx, vectorsRegion, nev, op->n);
+    *eigenvalues = (Eigenvalue *) arenaAlloc(ctx, vectorsRegion, nev * sizeof(Eigenvalue));
+    if (vectors == NULL || *eigenvalues == NULL)
+        return NULL; /* Memory allocation fail */
+
+    if (!lanczosEigen(ctx, op, nev, vectors, *eigenvalues)) {
+        MyMatFree(ctx, vectors);
+    }
+    return vectors;
+}
+
+/* This function sets a linear operator over a packed symmetric matrix. */
+int symMatOperator(SpkContext *ctx, LinearOperator *op, double **a, int n) {
+    op->apply = packedSymMatVec;
+    op->ctx = ctx;
+    op->matrix = a;
+    op->n = n;
+    op->workspace = (double *) arenaAlloc(ctx, workRegion, MATVEC_LANES * n * sizeof(double));
+    return op->workspace != NULL;
+}
+
+/* This function sets a linear operator over a CSR matrix. */
+void csrOperator(SpkContext *ctx, LinearOperator *op, const CsrMatrix *csr) {
+    op->apply = csrMatVec;
+    op->ctx = ctx;
+    op->matrix = csr;
+    op->n = csr->n;
+    op->workspace = NULL;
+}
+
+/* Thick restart Lanczos for the smallest eigenpairs, with full reorthogonalization. */
+int lanczosEigen(SpkContext *ctx, const LinearOperator *op, int nev, double **vectors,
+                 Eigenvalue *eigenvalues) {
+    int i, j, n, ncv, keep, numOfConverged, restart;
+    long matVecs;
+    double beta, scale, normA, residual, maxResidual, tmp, *h, *w, *theta, *e;
+    double **q, **t;
+    Eigenvalue *ritz;
+    LanczosReport *report = &ctx->report.lanczos;
+
+    n = op->n;
+    ncv = lanczosBasisSize(n, nev);
+    report->n = n;
+    report->nev = nev;
+    report->restarts = 0;
+    report->matVecs = 0;
+    report->converged = 0;
+    /* Basis q[0..ncv - 1] and the residual vector q[ncv] */
+    q = arenaMatrix(ctx, workRegion, ncv + 1, n);
+    /* The projected matrix Q^T * A * Q, replaced by its eigenvectors */
+    t = arenaMatrix(ctx, workRegion, ncv, ncv);
+    h = (double *) arenaAlloc(ctx, workRegion, (3 * ncv + 1 + n) * sizeof(double));
+    ritz = (Eigenvalue *) arenaAlloc(ctx, workRegion, ncv * sizeof(Eigenvalue));
+    if (q == NULL || t == NULL || h == NULL || ritz == NULL) /* Memory allocation fail */
+        return 0;
+    theta = h + ncv + 1;
+    e = theta + ncv;
+    w = e + ncv;
+
+    randomVector(q[0], n, 0);
+    beta = orthogonalize(q, 0, n, q[0], NULL); /* ||q[0]|| */
+    for (i = 0; i < n; i++) {
+        q[0][i] /= beta;
+    }
+    for (i = 0; i < ncv; i++) { /* Padded rows */
+        memset(t[i], 0, ncv * sizeof(double));
+    }
+    keep = 0;
+    scale = 0.0; /* ||T|| lower bound - the breakdown test's scale */
+    matVecs = 0;
+    maxResidual = 0.0;
+    for (restart = 0;; restart++) {
+        /* Extend the basis - q[j + 1] = (A * q[j])'s part orthogonal to q[0..j] */
+        for (j = keep; j < ncv; j++) {
+            op->apply(op, q[j], w);
+            matVecs++;
+            beta = orthogonalize(q, j + 1, n, w, h);
+            for (i = 0; i <= j; i++) {
+                t[i][j] = t[j][i] = h[i];
+            }
+            scale = MAX(scale, fabs(h[j]) + beta);
+            if (beta <= n * QL_EPSILON * scale) { /* Invariant subspace - a new direction */
+                randomVector(w, n, j + 1);
+                beta = j + 1 < n ? orthogonalize(q, j + 1, n, w, NULL) : 0.0;
+                for (i = 0; i < n && beta > 0.0; i++) {
+                    q[j + 1][i] = w[i] / beta;
+                }
+                beta = 0.0; /* No coupling with the new direction */
+            } else {
+                for (i = 0; i < n; i++) {
+                    q[j + 1][i] = w[i] / beta;
+                }
+            }
+        }
+
+        /* Rayleigh-Ritz - T's eigenpairs, the rows of t after the transpose */
+        householderTridiagonal(t, theta, e, ncv);
+        for (i = 0; i < ncv; i++) {
+            for (j = i + 1; j < ncv; j++) {
+                tmp = t[i][j];
+                t[i][j] = t[j][i];
+                t[j][i] = tmp;
+            }
+        }
+        if (implicitQL(ctx, t, theta, e, ncv) == EOF) /* No convergence (nan/inf input) */
+            return 0;
+        for (i = 0; i < ncv; i++) {
+            ritz[i].value = theta[i];
+            ritz[i].vector = i;
+        }
+        qsort(ritz, ncv, sizeof(Eigenvalue), cmpEigenvalues);
+
+        /* Residual of Ritz pair i - ||A * y - theta * y|| = |beta * s_i[ncv - 1]| */
+        normA = MAX(fabs(ritz[0].value), fabs(ritz[ncv - 1].value));
+        numOfConverged = 0;
+        maxResidual = 0.0;
+        for (i = 0; i < nev; i++) {
+            residual = fabs(beta * t[ritz[i].vector][ncv - 1]);
+            maxResidual = MAX(maxResidual, residual);
+            numOfConverged += residual <= ctx->config.jacobiTol * normA;
+        }
+        if (numOfConverged == nev || ncv == n || restart == MAX_LANCZOS_RESTARTS)
+            break;
+
+        /* Thick restart - keep the smallest Ritz vectors, then the residual direction */
+        keep = nev + (ncv - nev) / 2;
+        ritzVectors(q, t, ritz, keep, ncv, n, q, h);
+        memcpy(q[keep], q[ncv], n * sizeof(double));
+        for (i = 0; i < ncv; i++) {
+            memset(t[i], 0, ncv * sizeof(double));
+        }
+        for (i = 0; i < keep; i++) {
+            t[i][i] = ritz[i].value;
+        }
+    }
+
+    ritzVectors(q, t, ritz, nev, ncv, n, vectors, h);
+    for (i = 0; i < nev; i++) {
+        eigenvalues[i].value = ritz[i].value;
+        eigenvalues[i].vector = i;
+    }
+    report->restarts = restart;
+    report->matVecs = matVecs;
+    report->residual = maxResidual;
+    /* A full basis (ncv == n) - the Ritz pairs are A's eigenpairs */
+    report->converged = numOfConverged == nev || ncv == n;
+    MyMatFree(ctx, q);
+    MyMatFree(ctx, t);
+    MyFree(ctx, h);
+    MyFree(ctx, ritz);
+    return 1;
+}
+
+/* This function calculates the Lanczos basis size. */
+int lanczosBasisSize(int n, int nev) {
+    return MIN(n, MAX(2 * nev, nev + LANCZOS_EXTRA_VECTORS));
+}
+
+/* This function combines the Lanczos basis into Ritz vectors. */
+void ritzVectors(double **q, double **s, const Eigenvalue *ritz, int count, int ncv,
+                 int n, double **out, double *coords) {
+    int i, j, c;
+    double sum, *si;
+
+    for (c = 0; c < n; c++) { /* One coordinate at a time - out may be q */
+        for (j = 0; j < ncv; j++) {
+            coords[j] = q[j][c];
+        }
+        for (i = 0; i < count; i++) {
+            si = s[ritz[i].vector];
+            sum = 0.0;
+            for (j = 0; j < ncv; j++) {
+                sum += si[j] * coords[j];
+            }
+            out[i][c] = sum;
+        }
+    }
+}
+
+/* This function orthogonalizes x against q[0..count - 1] (classical Gram-Schmidt, twice). */
+double orthogonalize(double **q, int count, int n, double *x, double *h) {
+    int i, r, pass;
+    double dot, norm;
+
+    if (h != NULL) {
+        for (i = 0; i < count; i++) {
+            h[i] = 0.0;
+        }
+    }
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < count; i++) {
+            dot = 0.0;
+            for (r = 0; r < n; r++) {
+                dot += q[i][r] * x[r];
+            }
+            for (r = 0; r < n; r++) {
+                x[r] -= dot * q[i][r];
+            }
+            if (h != NULL)
+                h[i] += dot;
+        }
+    }
+    norm = 0.0;
+    for (r = 0; r < n; r++) {
+        norm += SQ(x[r]);
+    }
+    return sqrt(norm);
+}
+
+/* This function fills a vector with pseudo random values in [-0.5, 0.5). */
+void randomVector(double *x, int n, unsigned long seed) {
+    int i;
+    unsigned long state = seed;
+
+    for (i = 0; i < n; i++) {
+        x[i] = randomUniform(&state) - 0.5;
+    }
+}
+
+/* This function draws the next value of a pseudo random sequence (31 bit LCG). */
+double randomUniform(unsigned long *state) {
+    *state = (*state * RANDOM_MULTIPLIER + RANDOM_INCREMENT) & RANDOM_MASK;
+    return (double) *state / (RANDOM_MASK + 1.0);
+}
+
+/* Packed symmetric mat-vec, y = A * x. */
+void packedSymMatVec(const LinearOperator *op, const double *x, double *y) {
+    int i, lane, n = op->n;
+    double sum;
+    MatVecArgs args;
+
+    args.matrix = op->matrix;
+    args.x = x;
+    args.y = y;
+    args.laneSums = op->workspace;
+    args.n = n;
+    args.numOfLanes = MIN(MATVEC_LANES, (n + GRAM_BLOCK_SIZE - 1) / GRAM_BLOCK_SIZE);
+    parallelFor(op->ctx, packedMatVecTask, &args, args.numOfLanes, 1);
+    for (i = 0; i < n; i++) { /* Fixed lanes order */
+        sum = 0.0;
+        for (lane = 0; lane < args.numOfLanes; lane++) {
+            sum += args.laneSums[lane * n + i];
+        }
+        y[i] = sum;
+    }
+}
+
+/* Parallel task - the packed mat-vec of lanes [begin, end). */
+void packedMatVecTask(void *args, int begin, int end, int threadId) {
+    int i, j, lane, rowBlock, rowEnd;
+    double xi, sum, *aRow, *y;
+    MatVecArgs *matVecArgs = (MatVecArgs *) args;
+    double **a = (double **) matVecArgs->matrix;
+    const double *x = matVecArgs->x;
+    int n = matVecArgs->n;
+    (void) threadId;
+
+    for (lane = begin; lane < end; lane++) {
+        y = matVecArgs->laneSums + (size_t) lane * n;
+        memset(y, 0, n * sizeof(double));
+        /* Lane l owns row blocks l, l + numOfLanes, ... */
+        for (rowBlock = lane * GRAM_BLOCK_SIZE; rowBlock < n;
+             rowBlock += matVecArgs->numOfLanes * GRAM_BLOCK_SIZE) {
+            rowEnd = MIN(rowBlock + GRAM_BLOCK_SIZE, n);
+            for (i = rowBlock; i < rowEnd; i++) {
+                /* Row i's upper part - A[i][j] * x[j] and the mirrored A[j][i] * x[i] */
+                aRow = a[i];
+                xi = x[i];
+                sum = aRow[i] * xi;
+                for (j = i + 1; j < n; j++) {
+                    sum += aRow[j] * x[j];
+                    y[j] += aRow[j] * xi;
+                }
+                y[i] += sum;
+            }
+        }
+    }
+}
+
+/* CSR mat-vec, y = A * x. */
+void csrMatVec(const LinearOperator *op, const double *x, double *y) {
+    MatVecArgs args;
+
+    args.matrix = op->matrix;
+    args.x = x;
+    args.y = y;
+    args.laneSums = NULL;
+    args.n = op->n;
+    args.numOfLanes = 0;
+    parallelFor(op->ctx, csrMatVecTask, &args, op->n, rowsChunkSize(op->ctx, op->n));
+}
+
+/* Parallel task - the CSR mat-vec of rows [begin, end). */
+void csrMatVecTask(void *args, int begin, int end, int threadId) {
+    int i;
+    long p;
+    double sum;
+    MatVecArgs *matVecArgs = (MatVecArgs *) args;
+    const CsrMatrix *csr = (const CsrMatrix *) matVecArgs->matrix;
+    const double *x = matVecArgs->x;
+    (void) threadId;
+
+    for (i = begin; i < end; i++) {
+        sum = 0.0;
+        for (p = csr->rowPtr[i]; p < csr->rowPtr[i + 1]; p++) {
+            sum += csr->values[p] * x[csr->colIndex[p]];
+        }
+        matVecArgs->y[i] = sum;
+    }
+}
+
+/* This function calculates the Frobenius norm of a packed symmetric matrix's off-diagonal. */
+double offDiagNorm(double **a, int n, double *diagSqSum) {
+    int i, j;
+    double offSqSum = 0.0, diagSum = 0.0;
+
+    for (i = 0; i < n; i++) {
+        diagSum += SQ(a[i][i]);
+        for (j = i + 1; j < n; j++) {
+            offSqSum += SQ(a[i][j]);
+        }
+    }
+    if (diagSqSum != NULL)
+        *diagSqSum = diagSum;
+    return sqrt(2 * offSqSum); /* Both triangles */
+}
+
+/* This function performs a single jacobi rotation. */
+double jacobiRotate(double **a, double **v, int n, int i, int j) {
+    double theta, t, c, s;
+    double ij, ii, jj, ir, jr;
+    int r;
+
+    theta = a[j][j] - a[i][i];
+    theta /= (2 * a[i][j]);
+    t = 1.0 / (fabs(theta) + sqrt(SQ(theta) + 1.0));
+    t = theta < 0.0 ? -t : t;
+    c = 1.0 / sqrt(SQ(t) + 1.0);
+    s = t * c;
+
+    ii = a[i][i];
+    jj = a[j][j];
+    ij = a[i][j];
+    a[i][j] = 0.0;
+    /* c^2 * Aii + s^2 * Ajj - 2scAij */
+    a[i][i] = SQ(c) * ii + SQ(s) * jj - 2 * s * c * ij;
+    /* s^2 * Aii + c^2 * Ajj + 2scAij */
+    a[j][j] = SQ(s) * ii + SQ(c) * jj + 2 * s * c * ij;
+    /* Rows/columns i, j of the upper triangle: r < i < j */
+    for (r = 0; r < i; r++) {
+        ir = a[r][i];
+        jr = a[r][j];
+        a[r][i] = c * ir - s * jr;
+        a[r][j] = c * jr + s * ir;
+    }
+    /* i < r < j */
+    for (r = i + 1; r < j; r++) {
+        ir = a[i][r];
+        jr = a[r][j];
+        a[i][r] = c * ir - s * jr;
+        a[r][j] = c * jr + s * ir;
+    }
+    /* i < j < r */
+    for (r = j + 1; r < n; r++) {
+        ir = a[i][r];
+        jr = a[j][r];
+        a[i][r] = c * ir - s * jr;
+        a[j][r] = c * jr + s * ir;
+    }
+
+    /* Update the eigenvector matrix */
+    for (r = 0; r < n; r++) {
+        ir = v[i][r];
+        jr = v[j][r];
+        v[i][r] = c * ir - s * jr;
+        v[j][r] = c * jr + s * ir;
+    }
+
+    return 2 * SQ(ij); /* offNormDiff: Off(A)^2 - Off(A')^2 = 2 * Aij^2 */
+}
+
+/* This function chooses the pivot index for the jacobi rotation
+ *      - the max abs off diagonal element > 0, from the rows' cached maxima. */
+void pivotIndex(double **matrix, int n, const int *rowArgmax, int *pivotRow, int *pivotCol) {
+    int i;
+    double maxAbs = -1, tempValue;
+    for (i = 0; i < n - 1; ++i) {
+        tempValue = fabs(matrix[i][rowArgmax[i]]);
+        if (maxAbs < tempValue) { /* Strict - the first one in row-major order on ties */
+            maxAbs = tempValue;
+            *pivotRow = i;
+            *pivotCol = rowArgmax[i];
+        }
+    }
+    if (maxAbs <= 0.0)
+        *pivotRow = EOF; /* Matrix is diagonal */
+}
+
+/* This function finds the column of row's max abs element right of the diagonal. */
+int rowMaxIndex(double **matrix, int n, int row) {
+    int j, maxIndex = EOF;
+    double maxAbs = -1, tempValue;
+    for (j = row + 1; j < n; ++j) {
+        tempValue = fabs(matrix[row][j]);
+        if (maxAbs < tempValue) {
+            maxAbs = tempValue;
+            maxIndex = j;
+        }
+    }
+    return maxIndex;
+}
+
+/* This function updates the rows' cached maxima after a rotation of (i, j). */
+void updateRowMaxima(double **matrix, int n, int *rowArgmax, int i, int j) {
+    int r, k, col, cols[2];
+    double maxAbs, tempValue;
+
+    cols[0] = i;
+    cols[1] = j;
+    rowArgmax[i] = rowMaxIndex(matrix, n, i);
+    rowArgmax[j] = rowMaxIndex(matrix, n, j);
+    for (r = 0; r < j; r++) { /* Rows below j have no element in columns i, j */
+        if (r == i)
+            continue;
+        col = rowArgmax[r];
+        if (col == i || col == j) { /* The max may have decreased */
+            rowArgmax[r] = rowMaxIndex(matrix, n, r);
+            continue;
+        }
+        maxAbs = fabs(matrix[r][col]);
+        for (k = r < i ? 0 : 1; k < 2; k++) { /* Only columns right of the diagonal */
+            tempValue = fabs(matrix[r][cols[k]]);
+            if (maxAbs < tempValue || (maxAbs == tempValue && cols[k] < col)) {
+                maxAbs = tempValue;
+                col = cols[k];
+            }
+        }
+        rowArgmax[r] = col;
+    }
+}
+
+/* Build an n * n identity matrix. */
+double **initIdentityMatrix(SpkContext *ctx, int n) {
+    int i, j;
+    double **matrix = arenaMatrix(ctx, vectorsRegion, n, n);
+
+    if (matrix != NULL) { /* Memory allocation fail */
+        for (i = 0; i < n; ++i) {
+            for (j = 0; j < n; ++j) {
+                matrix[i][j] = i == j ? 1.0 : 0.0;
+            }
+        }
+    }
+    return matrix;
+}
+
+/* Sorting eigenvalues using qsort and comparator (makes it stable). */
+Eigenvalue *sortEigenvalues(SpkContext *ctx, double **a, int n) {
+    int i;
+    Eigenvalue *eigenvalues = arenaAlloc(ctx, vectorsRegion, n * sizeof(Eigenvalue));
+
     if (eigenvalues != NULL) { /* Memory allocation fail */
         for (i = 0; i < n; ++i) {
             eigenvalues[i].value = a[i][i];
@@ -508,91 +3123,505 @@ int cmpEigenvalues (const void *p1, const void *p2) {
 *******************************************************************************/
 
 /* The function allocates memory for any dynamic memory needed. */
-void *myAlloc(void *effectiveUsedMem, size_t size) {
+void *myAlloc(SpkContext *ctx, void *effectiveUsedMem, size_t size) {
     /* Get the "real" head of Block - with the pointers, if not NULL */
     void *usedMem = effectiveUsedMem != NULL ?
                     (void *)((char *)effectiveUsedMem - SIZE_OF_VOID_2PTR * 2) : NULL;
     void *blockMem;
     void **blockMemPlusPtr = (void **)realloc(usedMem, size + SIZE_OF_VOID_2PTR * 2);
     if(blockMemPlusPtr == NULL) return NULL; /* Memory allocation fail */
+    ctx->allocatedBytes += (long) size;
+
+    /* blockMemPlusPtr[0] == prev block pointer, blockMemPlusPtr[1] == next pointer */
+    blockMem = (void *)((char *)blockMemPlusPtr + SIZE_OF_VOID_2PTR * 2);
+    if (effectiveUsedMem == NULL) { /* New Allocation */
+        /* Set ptr to the prev/next dynamic allocated memory block */
+        blockMemPlusPtr[0] = NULL;
+        if (ctx->headOfMemList != NULL) { /* Not empty list */
+            blockMemPlusPtr[1] = ctx->headOfMemList;
+            ((void **)ctx->headOfMemList)[0] = blockMemPlusPtr;
+        } else
+            blockMemPlusPtr[1] = NULL;
+        ctx->headOfMemList = blockMemPlusPtr; /* Update head of memory list */
+    } else { /* Reallloc */
+        /* Update pointers */
+        if (usedMem != blockMemPlusPtr) { /* Block changed location in memory */
+            if (blockMemPlusPtr[0] != NULL)
+                ((void **)blockMemPlusPtr[0])[1] = blockMemPlusPtr;
+            else
+                ctx->headOfMemList = blockMemPlusPtr;
+            if(blockMemPlusPtr[1] != NULL)
+                ((void **)blockMemPlusPtr[1])[0] = blockMemPlusPtr;
+        }
+        if (ctx->freeUsedMem == effectiveUsedMem)
+            ctx->freeUsedMem = NULL; /* Unfree the memory - used again */
+    }
+    return blockMem;
+}
+
+/* The function builds a 2 dimension array (matrix) using "myAlloc" function. */
+void **alloc2DArray(SpkContext *ctx, int rows, int cols, size_t basicSize, size_t basicPtrSize,
+                    void *recycleMemBlock) {
+    int i;
+    void *blockMem, **matrix;
+    size_t rowSize = cols * basicSize;
+    /* Reallocate block of memory - use extra space at the end for row pointers */
+    blockMem = myAlloc(ctx, recycleMemBlock, rows * rowSize + rows * basicPtrSize);
+    if (blockMem == NULL) return NULL; /* Memory allocation fail */
+    matrix = (void **) ((char *)blockMem + rows * rowSize);
+
+    for (i = 0; i < rows; ++i) {
+        /* Set matrix to point to head of rows */
+        *((void **)((char *)matrix + i * basicPtrSize)) =
+                (void *) (((char *) blockMem) + i * rowSize);
+    }
+    return matrix;
+}
+
+/* The function builds a packed symmetric matrix using "myAlloc" function. */
+double **allocSymMatrix(SpkContext *ctx, int n, void *recycleMemBlock) {
+    double *blockMem;
+    size_t numOfElements = (size_t) n * (n + 1) / 2;
+    /* Reallocate block of memory - use extra space at the end for row pointers */
+    blockMem = (double *) myAlloc(ctx, recycleMemBlock, numOfElements * sizeof(double) +
+                                                        n * sizeof(double *));
+    if (blockMem == NULL) return NULL; /* Memory allocation fail */
+    return symMatrixRows(blockMem, n);
+}
+
+/* This function points a packed symmetric matrix's rows into a block. */
+double **symMatrixRows(double *blockMem, int n) {
+    int i;
+    double **matrix = (double **) (blockMem + (size_t) n * (n + 1) / 2);
+
+    for (i = 0; i < n; ++i) {
+        /* Row i starts after i rows of lengths n, n - 1, ..., n - i + 1.
+         * Shift back by i, so matrix[i][j] is column j */
+        matrix[i] = blockMem + (size_t) i * n - (size_t) i * (i - 1) / 2 - i;
+    }
+    return matrix;
+}
+
+/* This function allocates a CSR matrix as one "myAlloc" block. */
+CsrMatrix *allocCsrMatrix(SpkContext *ctx, int n, long nnz) {
+    CsrMatrix *csr = (CsrMatrix *) myAlloc(ctx, NULL, sizeof(CsrMatrix) + nnz * sizeof(double) +
+                                                      (n + 1) * sizeof(long) + nnz * sizeof(int));
+
+    if (csr != NULL) { /* Memory allocation fail */
+        csr->n = n;
+        csr->nnz = nnz;
+        csr->values = (double *) (csr + 1);
+        csr->rowPtr = (long *) (csr->values + nnz);
+        csr->colIndex = (int *) (csr->rowPtr + n + 1);
+    }
+    return csr;
+}
+
+/* The function packs a full symmetric matrix in place into the "allocSymMatrix" layout. */
+double **packSymMatrix(double **matrix, int n) {
+    int i;
+    double *blockMem = matrix[0], *packedRow;
+
+    /* Packed rows only move towards the head of the block, row pointers
+     * (at the end of the full block) are left untouched */
+    for (i = 0; i < n; ++i) {
+        packedRow = blockMem + (size_t) i * n - (size_t) i * (i - 1) / 2 - i;
+        memmove(packedRow + i, matrix[i] + i, (n - i) * sizeof(double));
+        matrix[i] = packedRow;
+    }
+    return matrix;
+}
+
+/* This function free unnecessary memory and keep the order of the memory list. */
+void myFree(SpkContext *ctx, void *effectiveBlockMem) {
+    if (effectiveBlockMem == NULL || isArenaMemory(ctx, effectiveBlockMem))
+        return; /* NULL pointer / released with its arena region - Do nothing */
+    myDetach(ctx, effectiveBlockMem);
+    myFreeDetached(effectiveBlockMem);
+}
+
+/* This function removes a block from the memory list, the caller owns it. */
+void myDetach(SpkContext *ctx, void *effectiveBlockMem) {
+    /* Get the "real" head of Block - with the pointers */
+    void **blockMem = (void **)((char *)effectiveBlockMem - SIZE_OF_VOID_2PTR * 2);
+
+    /* Unlink/delete from the list - update pointers */
+    if(blockMem[0] != NULL) {
+        /* Set prev's next to current next */
+        ((void **)blockMem[0])[1] = blockMem[1];
+    } else {
+        ctx->headOfMemList = blockMem[1];
+    }
+    if(blockMem[1] != NULL) {
+        /* Set next's prev to current prev */
+        ((void **)blockMem[1])[0] = blockMem[0];
+    }
+    if (ctx->freeUsedMem == effectiveBlockMem)
+        ctx->freeUsedMem = NULL; /* Not to be recycled */
+}
+
+/* This function frees a block removed from the memory list by "myDetach". */
+void myFreeDetached(void *effectiveBlockMem) {
+    if (effectiveBlockMem != NULL)
+        free((char *)effectiveBlockMem - SIZE_OF_VOID_2PTR * 2);
+}
+
+/* This function free all memory allocated at runtime. */
+void freeAllMemory(SpkContext *ctx) {
+    void **currBlock, **nextBlock;
+    SpkMapping *mapping;
+
+    destroyThreadPool(ctx); /* Workers are idle here - join them before freeing */
+    for (mapping = ctx->mappings; mapping != NULL; mapping = mapping->next) {
+        munmap(mapping->addr, mapping->length); /* The list's nodes are blocks below */
+    }
+    ctx->mappings = NULL;
+    currBlock = ctx->headOfMemList;
+
+    while (currBlock != NULL) {
+        nextBlock = currBlock[1];
+        free(currBlock);
+        currBlock = nextBlock;
+    }
+    ctx->headOfMemList = NULL; /* Empty list */
+    ctx->freeUsedMem = NULL;
+    ctx->arena = NULL; /* Arenas are list blocks */
+}
+
+/*******************************************************************************
+******************************** Memory Plan ***********************************
+*******************************************************************************/
+
+/* This function plans a run's stage buffers and allocates their arena. */
+int planMemory(SpkContext *ctx, GOAL goal, int n, int dimension, int k) {
+    int nev, maxK, packed;
+    size_t regionSizes[NUM_OF_REGIONS];
+    SOLVER solver = ctx->config.solver;
+    int sparse = ctx->config.affinity != dense && goal != jacobi;
+
+    memset(regionSizes, 0, sizeof(regionSizes));
+    if (!sparse && goal != jacobi) { /* W + its degrees and scratch */
+        regionSizes[matrixRegion] = arenaSymMatrixBytes(n);
+        regionSizes[vectorsRegion] = alignedSize(n * sizeof(double));
+        regionSizes[workRegion] = alignedSize(weightedMatrixScratch(ctx, n, dimension) *
+                                              sizeof(double));
+    } else if (sparse && goal != ddg && (goal != spk || solver != lanczos)) {
+        regionSizes[matrixRegion] = arenaSymMatrixBytes(n); /* Lnorm's packed copy */
+    }
+    if (goal == ddg) /* D replaces W */
+        regionSizes[matrixRegion] = MAX(regionSizes[matrixRegion], arenaMatrixBytes(n, n));
+
+    if (goal == spk || goal == jacobi) { /* The eigenpairs - replace the degrees */
+        nev = n;
+        if (goal == spk && solver == lanczos)
+            nev = k != 0 ? k : eigengapCandidates(ctx, n);
+        packed = !sparse || solver != lanczos;
+        regionSizes[vectorsRegion] = MAX(regionSizes[vectorsRegion], arenaMatrixBytes(nev, n) +
+                                         (goal == spk ? alignedSize(nev * sizeof(Eigenvalue)) : 0));
+        regionSizes[workRegion] = MAX(regionSizes[workRegion],
+                                      solverWorkBytes(ctx, n, goal == spk ? nev : n, packed));
+    }
+    if (goal == spk) { /* T replaces Lnorm - the eigengap heuristic's k <= n / 2 */
+        maxK = k != 0 ? k : MAX(n / 2, 1);
+        regionSizes[matrixRegion] = MAX(regionSizes[matrixRegion], arenaMatrixBytes(n, maxK));
+    }
+    return initArena(ctx, regionSizes);
+}
+
+/* This function calculates the eigensolver's workspace in the work region. */
+size_t solverWorkBytes(SpkContext *ctx, int n, int nev, int packed) {
+    int numOfPlayers, numOfPairs, ncv;
+    size_t bytes = 0;
+
+    switch (ctx->config.solver) {
+        case cyclic:
+            break;
+        case parallel:
+            numOfPlayers = n % 2 == 0 ? n : n + 1;
+            numOfPairs = numOfPlayers / 2;
+            bytes = alignedSize((numOfPlayers + 2 * numOfPairs) * sizeof(int)) +
+                    alignedSize(2 * numOfPairs * sizeof(double));
+            break;
+        case ql:
+            bytes = alignedSize(2 * n * sizeof(double));
+            break;
+        case lanczos:
+            ncv = lanczosBasisSize(n, nev);
+            if (nev == n) /* "lanczosFull" - the eigenvalues */
+                bytes += alignedSize(n * sizeof(Eigenvalue));
+            if (packed) /* The mat-vec's lanes */
+                bytes += alignedSize(MATVEC_LANES * n * sizeof(double));
+            bytes += arenaMatrixBytes(ncv + 1, n) + arenaMatrixBytes(ncv, ncv) +
+                     alignedSize((3 * ncv + 1 + n) * sizeof(double)) +
+                     alignedSize(ncv * sizeof(Eigenvalue));
+            break;
+        default:
+            bytes = alignedSize(n * sizeof(int));
+    }
+    return bytes;
+}
+
+/* This function plans the Nystrom approximation's buffers and allocates their arena. */
+int planNystromMemory(SpkContext *ctx, int n) {
+    int m = MIN(ctx->config.numOfLandmarks, n);
+    size_t regionSizes[NUM_OF_REGIONS];
+    SOLVER solver = ctx->config.solver;
+
+    /* C (G, then T in place), the lanes' sums, the threads' rows, A, P, G^T * G, R
+     * and the eigenvalues - rank <= m and k <= rank */
+    regionSizes[matrixRegion] = arenaMatrixBytes(n, m) +
+                                alignedSize((nystromLanes(n) + 2) * m * sizeof(double)) +
+                                alignedSize(ctx->config.numOfThreads * m * sizeof(double)) +
+                                2 * arenaSymMatrixBytes(m) + 2 * arenaMatrixBytes(m, m) +
+                                alignedSize(m * sizeof(Eigenvalue));
+    /* A's eigenvectors, then G^T * G's, and their solver's workspace */
+    regionSizes[vectorsRegion] = arenaMatrixBytes(m, m);
+    if (solver == classic) /* As "nystromTMatrix" */
+        ctx->config.solver = ql;
+    regionSizes[workRegion] = solverWorkBytes(ctx, m, m, 1);
+    ctx->config.solver = solver;
+    return initArena(ctx, regionSizes);
+}
+
+/* This function calculates the number of lanes of the Nystrom affinity block's rows. */
+int nystromLanes(int n) {
+    return MIN(NYSTROM_LANES, (n + NYSTROM_LANE_MIN - 1) / NYSTROM_LANE_MIN);
+}
+
+/* This function allocates the arena's single block and splits it into regions. */
+int initArena(SpkContext *ctx, const size_t *regionSizes) {
+    int region;
+    size_t size = 0;
+    SpkArena *arena;
+
+    for (region = 0; region < NUM_OF_REGIONS; region++) {
+        size += regionSizes[region];
+    }
+    arena = (SpkArena *) myAlloc(ctx, NULL, sizeof(SpkArena) + size + ARENA_ALIGNMENT - 1);
+    if (arena == NULL) /* Memory allocation fail */
+        return 0;
+    arena->prev = ctx->arena;
+    arena->base = (char *) (arena + 1);
+    arena->base += (ARENA_ALIGNMENT - (size_t) arena->base % ARENA_ALIGNMENT) % ARENA_ALIGNMENT;
+    arena->size = size;
+    size = 0;
+    for (region = 0; region < NUM_OF_REGIONS; region++) {
+        arena->regionStart[region] = size;
+        arena->regionSize[region] = regionSizes[region];
+        arena->regionUsed[region] = 0;
+        arena->highWater[region] = 0;
+        size += regionSizes[region];
+    }
+    ctx->arena = arena;
+    ctx->report.memory.planned = (long) arena->size;
+    ctx->report.memory.used = 0;
+    ctx->report.memory.overflows = 0;
+    return 1;
+}
+
+/* This function allocates a buffer from a region of the context's arena. */
+void *arenaAlloc(SpkContext *ctx, REGION region, size_t size) {
+    SpkArena *arena = ctx->arena;
+    char *buffer;
+
+    size = alignedSize(size);
+    if (arena == NULL || arena->regionUsed[region] + size > arena->regionSize[region]) {
+        ctx->report.memory.overflows++; /* Beyond the plan */
+        return myAlloc(ctx, NULL, size);
+    }
+    buffer = arena->base + arena->regionStart[region] + arena->regionUsed[region];
+    arena->regionUsed[region] += size;
+    ctx->allocatedBytes += (long) size;
+    if (arena->regionUsed[region] > arena->highWater[region]) {
+        ctx->report.memory.used += (long) (arena->regionUsed[region] - arena->highWater[region]);
+        arena->highWater[region] = arena->regionUsed[region];
+    }
+    return buffer;
+}
+
+/* This function builds a matrix with ARENA_ALIGNMENT aligned rows in an arena region. */
+double **arenaMatrix(SpkContext *ctx, REGION region, int rows, int cols) {
+    int i;
+    size_t stride = alignedSize(cols * sizeof(double)) / sizeof(double);
+    double *blockMem, **matrix;
+
+    blockMem = (double *) arenaAlloc(ctx, region, arenaMatrixBytes(rows, cols));
+    if (blockMem == NULL) return NULL; /* Memory allocation fail */
+    matrix = (double **) (blockMem + rows * stride); /* Row pointers follow the rows */
+
+    for (i = 0; i < rows; ++i) {
+        matrix[i] = blockMem + i * stride;
+    }
+    return matrix;
+}
+
+/* This function builds a packed symmetric matrix in an arena region. */
+double **arenaSymMatrix(SpkContext *ctx, REGION region, int n) {
+    double *blockMem = (double *) arenaAlloc(ctx, region, arenaSymMatrixBytes(n));
+
+    if (blockMem == NULL) return NULL; /* Memory allocation fail */
+    return symMatrixRows(blockMem, n);
+}
+
+/* This function releases all the buffers of an arena region. */
+void resetRegion(SpkContext *ctx, REGION region) {
+    if (ctx->arena != NULL)
+        ctx->arena->regionUsed[region] = 0;
+}
+
+/* This function checks whether memory belongs to one of the context's arenas. */
+int isArenaMemory(SpkContext *ctx, const void *mem) {
+    const SpkArena *arena;
+
+    for (arena = ctx->arena; arena != NULL; arena = arena->prev) {
+        if ((const char *) mem >= arena->base && (const char *) mem < arena->base + arena->size)
+            return 1;
+    }
+    return 0;
+}
+
+/* This function rounds a size up to a multiple of ARENA_ALIGNMENT. */
+size_t alignedSize(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+}
+
+/* This function calculates an "arenaMatrix" matrix's bytes. */
+size_t arenaMatrixBytes(int rows, int cols) {
+    return alignedSize((size_t) rows * alignedSize(cols * sizeof(double)) +
+                       rows * sizeof(double *));
+}
+
+/* This function calculates an "arenaSymMatrix" matrix's bytes. */
+size_t arenaSymMatrixBytes(int n) {
+    return alignedSize((size_t) n * (n + 1) / 2 * sizeof(double) + n * sizeof(double *));
+}
+
+/*******************************************************************************
+******************************** Thread Pool ***********************************
+*******************************************************************************/
+
+/* This function runs task over items [0, numOfItems) on ctx->config.numOfThreads threads. */
+void parallelFor(SpkContext *ctx, ParallelTask task, void *args, int numOfItems, int chunkSize) {
+    int numOfWorkers = ctx->config.numOfThreads - 1;
+    ThreadPool *pool;
+
+    if (numOfWorkers > 0 && (ctx->threadPool == NULL ||
+                             ctx->threadPool->numOfWorkers != numOfWorkers)) {
+        destroyThreadPool(ctx); /* Thread count changed */
+        if (initThreadPool(ctx, numOfWorkers) == EOF)
+            numOfWorkers = 0; /* Couldn't start workers - run serially */
+    }
+    if (numOfWorkers <= 0 || numOfItems <= chunkSize) {
+        task(args, 0, numOfItems, 0); /* Nothing to share */
+        return;
+    }
 
-    /* blockMemPlusPtr[0] == prev block pointer, blockMemPlusPtr[1] == next pointer */
-    blockMem = (void *)((char *)blockMemPlusPtr + SIZE_OF_VOID_2PTR * 2);
-    if (effectiveUsedMem == NULL) { /* New Allocation */
-        /* Set ptr to the prev/next dynamic allocated memory block */
-        blockMemPlusPtr[0] = NULL;
-        if (headOfMemList != NULL) { /* Not empty list */
-            blockMemPlusPtr[1] = headOfMemList;
-            ((void **)headOfMemList)[0] = blockMemPlusPtr;
-        } else
-            blockMemPlusPtr[1] = NULL;
-        headOfMemList = blockMemPlusPtr; /* Update head of memory list */
-    } else { /* Reallloc */
-        /* Update pointers */
-        if (usedMem != blockMemPlusPtr) { /* Block changed location in memory */
-            if (blockMemPlusPtr[0] != NULL)
-                ((void **)blockMemPlusPtr[0])[1] = blockMemPlusPtr;
-            else
-                headOfMemList = blockMemPlusPtr;
-            if(blockMemPlusPtr[1] != NULL)
-                ((void **)blockMemPlusPtr[1])[0] = blockMemPlusPtr;
-        }
-        if (freeUsedMem == effectiveUsedMem)
-            freeUsedMem = NULL; /* Unfree the memory - used again */
+    pool = ctx->threadPool;
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->args = args;
+    pool->numOfItems = numOfItems;
+    pool->chunkSize = chunkSize;
+    pool->nextItem = 0;
+    pool->activeWorkers = pool->numOfWorkers;
+    pool->jobId++;
+    pthread_cond_broadcast(&pool->jobReady);
+    runJobChunks(pool, 0); /* The caller works too */
+    while (pool->activeWorkers > 0) {
+        pthread_cond_wait(&pool->jobDone, &pool->lock);
     }
-    return blockMem;
+    pthread_mutex_unlock(&pool->lock);
 }
 
-/* The function builds a 2 dimension array (matrix) using "myAlloc" function. */
-void **alloc2DArray(int rows, int cols, size_t basicSize, size_t basicPtrSize,
-                    void *recycleMemBlock) {
+/* This function computes the chunk size for a row loop over n rows. */
+int rowsChunkSize(SpkContext *ctx, int n) {
+    int chunkSize = n / (ctx->config.numOfThreads * CHUNKS_PER_THREAD);
+    return chunkSize > 0 ? chunkSize : 1;
+}
+
+/* This function starts the thread pool workers. */
+int initThreadPool(SpkContext *ctx, int numOfWorkers) {
     int i;
-    void *blockMem, **matrix;
-    /* Reallocate block of memory - use extra space at the end for row pointers */
-    blockMem = myAlloc(recycleMemBlock, rows * cols * basicSize + rows * basicPtrSize);
-    if (blockMem == NULL) return NULL; /* Memory allocation fail */
-    matrix = (void **) ((char *)blockMem + rows * cols * basicSize);
+    /* The pool followed by the worker handles and the workers' arguments */
+    ThreadPool *pool = (ThreadPool *) myAlloc(ctx, NULL, sizeof(ThreadPool) + numOfWorkers *
+                                                         (sizeof(pthread_t) + sizeof(PoolWorker)));
 
-    for (i = 0; i < rows; ++i) {
-        /* Set matrix to point to head of rows */
-        *((void **)((char *)matrix + i * basicPtrSize)) =
-                (void *) (((char *) blockMem) + i * cols * basicSize);
+    if (pool == NULL) return EOF; /* Memory allocation fail */
+    pool->workers = (pthread_t *) (pool + 1);
+    pool->workerArgs = (PoolWorker *) (pool->workers + numOfWorkers);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->jobReady, NULL);
+    pthread_cond_init(&pool->jobDone, NULL);
+    pool->jobId = 0;
+    pool->shutdown = 0;
+    ctx->threadPool = pool;
+    for (i = 0; i < numOfWorkers; i++) {
+        pool->workerArgs[i].pool = pool;
+        pool->workerArgs[i].threadId = i + 1; /* Thread 0 is the caller */
+        if (pthread_create(&pool->workers[i], NULL, threadPoolWorker, &pool->workerArgs[i])) {
+            pool->numOfWorkers = i; /* Join the ones already started */
+            destroyThreadPool(ctx);
+            return EOF;
+        }
     }
-    return matrix;
+    pool->numOfWorkers = numOfWorkers;
+    return 0;
 }
 
-/* This function free unnecessary memory and keep the order of the memory list. */
-void myFree(void *effectiveBlockMem) {
-    void **blockMem;
-    if (effectiveBlockMem == NULL) /* NULL pointer - Do nothing */
-        return;
+/* The worker threads' main loop - waits for jobs until shutdown. */
+void *threadPoolWorker(void *worker) {
+    ThreadPool *pool = ((PoolWorker *) worker)->pool;
+    int threadId = ((PoolWorker *) worker)->threadId;
+    unsigned long lastJobId = 0;
 
-    /* Get the "real" head of Block - with the pointers */
-    blockMem = (void **)((char *)effectiveBlockMem - SIZE_OF_VOID_2PTR * 2);
-    /* Unlink/delete from the list - update pointers */
-    if(blockMem[0] != NULL) {
-        /* Set prev's next to current next */
-        ((void **)blockMem[0])[1] = blockMem[1];
-    } else {
-        headOfMemList = blockMem[1];
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->shutdown && pool->jobId == lastJobId) {
+            pthread_cond_wait(&pool->jobReady, &pool->lock);
+        }
+        if (pool->shutdown)
+            break;
+        lastJobId = pool->jobId;
+        runJobChunks(pool, threadId);
+        if (--pool->activeWorkers == 0) /* Last one out wakes the caller */
+            pthread_cond_signal(&pool->jobDone);
     }
-    if(blockMem[1] != NULL) {
-        /* Set next's prev to current prev */
-        ((void **)blockMem[1])[0] = blockMem[0];
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* This function runs the current job's chunks until none are left. */
+void runJobChunks(ThreadPool *pool, int threadId) {
+    int begin, end;
+
+    while (pool->nextItem < pool->numOfItems) {
+        begin = pool->nextItem;
+        end = MIN(begin + pool->chunkSize, pool->numOfItems);
+        pool->nextItem = end;
+        pthread_mutex_unlock(&pool->lock);
+        pool->task(pool->args, begin, end, threadId);
+        pthread_mutex_lock(&pool->lock);
     }
-    free(blockMem);
 }
 
-/* This function free all memory allocated at runtime. */
-void freeAllMemory() {
-    void **currBlock = headOfMemList, **nextBlock;
+/* This function joins the worker threads of the context's thread pool (if started). */
+void destroyThreadPool(SpkContext *ctx) {
+    int i;
+    ThreadPool *pool = ctx->threadPool;
 
-    while (currBlock != NULL) {
-        nextBlock = currBlock[1];
-        free(currBlock);
-        currBlock = nextBlock;
+    if (pool == NULL) /* Not started */
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->jobReady);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->numOfWorkers; i++) {
+        pthread_join(pool->workers[i], NULL);
     }
-    headOfMemList = NULL; /* Empty list */
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->jobReady);
+    pthread_cond_destroy(&pool->jobDone);
+    MyFree(ctx, ctx->threadPool);
 }
 
 /*******************************************************************************
@@ -601,37 +3630,167 @@ void freeAllMemory() {
 
 /* This function print matrix in csv format. */
 void printMatrix(double **matrix, int rows, int cols) {
+    outputHeader(rows, cols);
+    outputRows(matrix, rows, cols);
+    flushOutput();
+}
+
+/* This function print a packed symmetric matrix in csv format (both triangles). */
+void printSymMatrix(double **matrix, int n) {
     int i, j;
-    double value;
 
-    for (i = 0; i < rows; ++i) {
-        for (j = 0; j < cols; ++j) {
+    outputHeader(n, n);
+    for (i = 0; i < n; ++i) {
+        for (j = 0; j < n; ++j) {
             if (j > 0)
-                printf("%c", COMMA_CHAR);
-            value = matrix[i][j];
-            value = NegZero(value); /* Avoid -0.0000 presentation */
-            /* Print with an accuracy of desired digits after the decimal point */
-            printf(PRINT_FORMAT, value);
+                outputSeparator(COMMA_CHAR);
+            outputValue(SymElement(matrix, i, j));
+        }
+        outputSeparator(NEW_LINE_CHAR);
+    }
+    flushOutput();
+}
+
+/* This function print a CSR matrix - one "row,column,value" line per stored entry. */
+void printCsrMatrix(const CsrMatrix *csr) {
+    int i;
+    long p;
+
+    outputHeader(csr->nnz, 3);
+    for (i = 0; i < csr->n; ++i) {
+        for (p = csr->rowPtr[i]; p < csr->rowPtr[i + 1]; ++p) {
+            outputIndex(i);
+            outputSeparator(COMMA_CHAR);
+            outputIndex(csr->colIndex[p]);
+            outputSeparator(COMMA_CHAR);
+            outputValue(csr->values[p]);
+            outputSeparator(NEW_LINE_CHAR);
         }
-        printf("\n");
     }
+    flushOutput();
 }
 
 /* The function prints the jacobi result in csv format */
 void printJacobi(double **a, double **v, int n) {
     int i;
-    double value;
 
+    outputHeader(n + 1, n); /* Eigenvalues row + V^T */
     for (i = 0; i < n; ++i) {
         if (i != 0)
-            printf("%c", COMMA_CHAR);
-        value = a[i][i];
+            outputSeparator(COMMA_CHAR);
+        outputValue(a[i][i]);
+    }
+    outputSeparator(NEW_LINE_CHAR);
+    outputRows(v, n, n); /* Print eigenvectors matrix v == V^T */
+    flushOutput();
+}
+
+/* This function writes matrix's rows to the output buffer. */
+void outputRows(double **matrix, int rows, int cols) {
+    int i, j;
+
+    for (i = 0; i < rows; ++i) {
+        for (j = 0; j < cols; ++j) {
+            if (j > 0)
+                outputSeparator(COMMA_CHAR);
+            outputValue(matrix[i][j]);
+        }
+        outputSeparator(NEW_LINE_CHAR);
+    }
+}
+
+/* This function writes the binary format's header (binary mode only). */
+void outputHeader(long rows, int cols) {
+    BinaryHeader header;
+
+    if (!outputBuffer.binary)
+        return;
+    initBinaryHeader(&header, rows, cols);
+    if (outputBuffer.length + sizeof(BinaryHeader) > OUTPUT_BUFFER_SIZE)
+        flushOutput();
+    memcpy(outputBuffer.data + outputBuffer.length, &header, sizeof(BinaryHeader));
+    outputBuffer.length += sizeof(BinaryHeader);
+}
+
+/* This function writes a value - "%.4f" text or its raw 8 bytes. */
+void outputValue(double value) {
+    if (outputBuffer.length + MAX_VALUE_CHARS > OUTPUT_BUFFER_SIZE)
+        flushOutput();
+    if (outputBuffer.binary) {
+        memcpy(outputBuffer.data + outputBuffer.length, &value, sizeof(double));
+        outputBuffer.length += sizeof(double);
+    } else {
         value = NegZero(value); /* Avoid -0.0000 presentation */
         /* Print with an accuracy of desired digits after the decimal point */
-        printf(PRINT_FORMAT, value);
+        outputBuffer.length += formatValue(value, outputBuffer.data + outputBuffer.length);
+    }
+}
+
+/* This function writes an index - decimal text or a raw double. */
+void outputIndex(int index) {
+    if (outputBuffer.binary) {
+        outputValue((double) index);
+        return;
     }
-    printf("\n");
-    printMatrix(v, n, n); /* Print eigenvectors matrix v == V^T */
+    if (outputBuffer.length + MAX_INDEX_CHARS > OUTPUT_BUFFER_SIZE)
+        flushOutput();
+    outputBuffer.length += formatUnsigned((unsigned long) index,
+                                         outputBuffer.data + outputBuffer.length, 1);
+}
+
+/* This function writes a separator in text mode. */
+void outputSeparator(char ch) {
+    if (outputBuffer.binary)
+        return;
+    if (outputBuffer.length == OUTPUT_BUFFER_SIZE)
+        flushOutput();
+    outputBuffer.data[outputBuffer.length++] = ch;
+}
+
+/* This function writes the output buffer to stdout. */
+void flushOutput() {
+    size_t length = outputBuffer.length;
+
+    outputBuffer.length = 0;
+    MyAssert(fwrite(outputBuffer.data, 1, length, stdout) == length);
+    MyAssert(fflush(stdout) != EOF);
+}
+
+/* This function formats a value exactly as printf("%.4f") does. */
+int formatValue(double value, char *dest) {
+    int length = 0;
+    unsigned long units;
+    double scaled, whole, fraction;
+
+    scaled = fabs(value * FORMAT_SCALE); /* Within half an ulp of the exact product */
+    if (!(scaled < FORMAT_FAST_LIMIT)) /* Large, inf or nan */
+        return sprintf(dest, PRINT_FORMAT, value);
+    whole = floor(scaled);
+    fraction = scaled - whole; /* Exact below 2^52 */
+    if (fabs(fraction - 0.5) <= scaled * FORMAT_TIE_TOL)
+        return sprintf(dest, PRINT_FORMAT, value); /* Too close to a tie */
+    units = (unsigned long) whole + (fraction > 0.5);
+
+    if (value < 0.0 || (value == 0.0 && 1.0 / value < 0.0)) /* Sign bit, -0.0 included */
+        dest[length++] = '-';
+    length += formatUnsigned(units / (unsigned long) FORMAT_SCALE, dest + length, 1);
+    dest[length++] = '.';
+    length += formatUnsigned(units % (unsigned long) FORMAT_SCALE, dest + length, 4);
+    return length;
+}
+
+/* This function formats a non negative integer in decimal. */
+int formatUnsigned(unsigned long number, char *dest, int minDigits) {
+    char digits[MAX_INDEX_CHARS];
+    int i, numOfDigits = 0;
+
+    do { /* Least significant digit first */
+        digits[numOfDigits++] = (char) ('0' + number % 10);
+        number /= 10;
+    } while (number > 0 || numOfDigits < minDigits);
+    for (i = 0; i < numOfDigits; ++i)
+        dest[i] = digits[numOfDigits - 1 - i];
+    return numOfDigits;
 }
 
 /*******************************************************************************
@@ -639,7 +3798,8 @@ void printJacobi(double **a, double **v, int n) {
 *******************************************************************************/
 
 /* This function read cmd-line arguments, validate and assign them the matching variables. */
-void validateAndAssignInput(int argc, char **argv, int *k, GOAL *goal, char **filenamePtr) {
+void validateAndAssignInput(SpkContext *ctx, int argc, char **argv, int *k, GOAL *goal,
+                            char **filenamePtr) {
     char *nextCh;
 
     if (argc >= REQUIRED_NUM_OF_ARGUMENTS) {
@@ -648,11 +3808,13 @@ void validateAndAssignInput(int argc, char **argv, int *k, GOAL *goal, char **fi
         if (*goal < NUM_OF_GOALS) {
             if (*goal != spk) {
                 *k = 0; /* K is unnecessary */
-                return;
+                if (assignOptionalInput(ctx, argc, argv) != EOF)
+                    return;
             } else {
                 /* k greater than zero and the conversion succeeded, valid goal */
                 *k = strtol(argv[K_ARGUMENT], &nextCh, 10);
-                if (*k >= 0 && *nextCh == END_OF_STRING)
+                if (*k >= 0 && *nextCh == END_OF_STRING &&
+                    assignOptionalInput(ctx, argc, argv) != EOF)
                     return;
             }
         }
@@ -662,6 +3824,224 @@ void validateAndAssignInput(int argc, char **argv, int *k, GOAL *goal, char **fi
     exit(0);
 }
 
+/* This function reads the optional cmd-line arguments into ctx->config. */
+int assignOptionalInput(SpkContext *ctx, int argc, char **argv) {
+    int i;
+    long seed;
+
+    for (i = REQUIRED_NUM_OF_ARGUMENTS; i < argc; ++i) {
+        if (!strncmp(argv[i], THREADS_OPTION, strlen(THREADS_OPTION))) {
+            ctx->config.numOfThreads = str2PositiveInt(argv[i] + strlen(THREADS_OPTION));
+            if (ctx->config.numOfThreads == EOF)
+                return EOF;
+        } else if (!strncmp(argv[i], SOLVER_OPTION, strlen(SOLVER_OPTION))) {
+            ctx->config.solver = str2solver(argv[i] + strlen(SOLVER_OPTION));
+            if (ctx->config.solver == NUM_OF_SOLVERS)
+                return EOF;
+        } else if (!strncmp(argv[i], TOL_OPTION, strlen(TOL_OPTION))) {
+            ctx->config.jacobiTol = str2PositiveDouble(argv[i] + strlen(TOL_OPTION));
+            if (ctx->config.jacobiTol == EOF)
+                return EOF;
+        } else if (!strncmp(argv[i], EIGENCAP_OPTION, strlen(EIGENCAP_OPTION))) {
+            ctx->config.eigenCap = str2PositiveInt(argv[i] + strlen(EIGENCAP_OPTION));
+            if (ctx->config.eigenCap == EOF)
+                return EOF;
+        } else if (!strncmp(argv[i], AFFINITY_OPTION, strlen(AFFINITY_OPTION))) {
+            ctx->config.affinity = str2affinity(argv[i] + strlen(AFFINITY_OPTION),
+                                                &ctx->config.affinityParam);
+            if (ctx->config.affinity == NUM_OF_AFFINITIES)
+                return EOF;
+        } else if (!strncmp(argv[i], KMEANS_OPTION, strlen(KMEANS_OPTION))) {
+            ctx->config.kmeans = str2kmeans(argv[i] + strlen(KMEANS_OPTION));
+            if (ctx->config.kmeans == NUM_OF_KMEANS)
+                return EOF;
+        } else if (!strncmp(argv[i], BATCH_OPTION, strlen(BATCH_OPTION))) {
+            ctx->config.batchSize = str2PositiveInt(argv[i] + strlen(BATCH_OPTION));
+            if (ctx->config.batchSize == EOF)
+                return EOF;
+        } else if (!strncmp(argv[i], BATCH_TOL_OPTION, strlen(BATCH_TOL_OPTION))) {
+            ctx->config.batchTol = str2PositiveDouble(argv[i] + strlen(BATCH_TOL_OPTION));
+            if (ctx->config.batchTol == EOF)
+                return EOF;
+        } else if (!strncmp(argv[i], INIT_OPTION, strlen(INIT_OPTION))) {
+            ctx->config.init = str2init(argv[i] + strlen(INIT_OPTION));
+            if (ctx->config.init == NUM_OF_INITS)
+                return EOF;
+        } else if (!strncmp(argv[i], SEED_OPTION, strlen(SEED_OPTION))) {
+            seed = str2NonNegativeLong(argv[i] + strlen(SEED_OPTION));
+            if (seed == EOF)
+                return EOF;
+            ctx->config.seed = (unsigned long) seed;
+        } else if (!strncmp(argv[i], NYSTROM_OPTION, strlen(NYSTROM_OPTION))) {
+            ctx->config.numOfLandmarks = str2PositiveInt(argv[i] + strlen(NYSTROM_OPTION));
+            if (ctx->config.numOfLandmarks == EOF)
+                return EOF;
+        } else if (!strncmp(argv[i], LANDMARKS_OPTION, strlen(LANDMARKS_OPTION))) {
+            ctx->config.landmarks = str2init(argv[i] + strlen(LANDMARKS_OPTION));
+            if (ctx->config.landmarks == NUM_OF_INITS)
+                return EOF;
+        } else if (!strncmp(argv[i], SAVE_BINARY_OPTION, strlen(SAVE_BINARY_OPTION))) {
+            ctx->config.saveBinaryPath = argv[i] + strlen(SAVE_BINARY_OPTION);
+            if (*ctx->config.saveBinaryPath == END_OF_STRING)
+                return EOF;
+        } else if (!strncmp(argv[i], OUTPUT_OPTION, strlen(OUTPUT_OPTION))) {
+            if (!strcmp(argv[i] + strlen(OUTPUT_OPTION), OUTPUT_BINARY))
+                ctx->config.binaryOutput = 1;
+            else if (!strcmp(argv[i] + strlen(OUTPUT_OPTION), OUTPUT_TEXT))
+                ctx->config.binaryOutput = 0;
+            else
+                return EOF;
+        } else if (!strcmp(argv[i], VERBOSE_OPTION)) {
+            ctx->config.verbose = 1;
+        } else if (!strcmp(argv[i], PROFILE_OPTION)) {
+            ctx->config.profile = ctx->config.verbose = 1;
+        } else if (!strncmp(argv[i], TRACE_OPTION, strlen(TRACE_OPTION))) {
+            ctx->config.tracePath = argv[i] + strlen(TRACE_OPTION);
+            if (*ctx->config.tracePath == END_OF_STRING)
+                return EOF;
+            ctx->config.profile = 1;
+        } else if (!strncmp(argv[i], CACHE_OPTION, strlen(CACHE_OPTION))) {
+            ctx->config.cacheDir = argv[i] + strlen(CACHE_OPTION);
+            if (*ctx->config.cacheDir == END_OF_STRING)
+                return EOF;
+        } else
+            return EOF; /* Unknown option */
+    }
+    /* Nystrom approximates the dense W */
+    return ctx->config.numOfLandmarks > 0 && ctx->config.affinity != dense ? EOF : 0;
+}
+
+/* This function converts a string into a positive double. */
+double str2PositiveDouble(const char *str) {
+    char *nextCh;
+    double value = strtod(str, &nextCh);
+
+    if (nextCh == str || *nextCh != END_OF_STRING || !(value > 0.0))
+        return EOF;
+    return value;
+}
+
+/* This function converts a string into a positive int. */
+int str2PositiveInt(const char *str) {
+    char *nextCh;
+    long value = strtol(str, &nextCh, 10);
+
+    if (nextCh == str || *nextCh != END_OF_STRING || value <= 0 || value > INT_MAX)
+        return EOF;
+    return (int) value;
+}
+
+/* This function converts a string into a non negative long. */
+long str2NonNegativeLong(const char *str) {
+    char *nextCh;
+    long value = strtol(str, &nextCh, 10);
+
+    if (nextCh == str || *nextCh != END_OF_STRING || value < 0 || value == LONG_MAX)
+        return EOF;
+    return value;
+}
+
+/* This function initializes a context - empty memory list, default configuration. */
+void initContext(SpkContext *ctx) {
+    char *envValue = getenv(THREADS_ENV_VAR);
+
+    ctx->headOfMemList = NULL;
+    ctx->freeUsedMem = NULL;
+    ctx->threadPool = NULL;
+    ctx->arena = NULL;
+    ctx->mappings = NULL;
+    ctx->config.numOfThreads = DEFAULT_NUM_OF_THREADS;
+    if (envValue != NULL && str2PositiveInt(envValue) != EOF)
+        ctx->config.numOfThreads = str2PositiveInt(envValue);
+    ctx->config.solver = classic;
+    ctx->config.jacobiTol = DEFAULT_JACOBI_TOL;
+    ctx->config.maxSweeps = MAX_JACOBI_SWEEPS;
+    ctx->config.eigenCap = DEFAULT_EIGEN_CAP;
+    ctx->config.affinity = dense;
+    ctx->config.affinityParam = 0.0;
+    ctx->config.kmeans = triangle;
+    ctx->config.batchSize = DEFAULT_BATCH_SIZE;
+    ctx->config.batchTol = DEFAULT_BATCH_TOL;
+    ctx->config.init = firstk;
+    ctx->config.seed = DEFAULT_SEED;
+    ctx->config.numOfLandmarks = 0;
+    ctx->config.landmarks = uniform;
+    envValue = getenv(PROFILE_ENV_VAR); /* As "--profile" */
+    ctx->config.profile = ctx->config.verbose = envValue != NULL &&
+                                                *envValue != END_OF_STRING &&
+                                                strcmp(envValue, "0") != 0;
+    ctx->config.tracePath = getenv(TRACE_ENV_VAR);
+    if (ctx->config.tracePath != NULL && *ctx->config.tracePath == END_OF_STRING)
+        ctx->config.tracePath = NULL;
+    if (ctx->config.tracePath != NULL)
+        ctx->config.profile = 1;
+    ctx->config.cacheDir = getenv(CACHE_ENV_VAR);
+    if (ctx->config.cacheDir != NULL && *ctx->config.cacheDir == END_OF_STRING)
+        ctx->config.cacheDir = NULL;
+    ctx->config.saveBinaryPath = NULL;
+    ctx->config.binaryOutput = 0;
+    ctx->allocatedBytes = 0;
+    memset(&ctx->report, 0, sizeof(SpkReport));
+}
+
+/* This function frees the CLI's memory - the input file's mapping and the memory list. */
+void freeCliMemory() {
+    if (mappedInput.addr != NULL) { /* Memory mapped input file */
+        munmap(mappedInput.addr, mappedInput.length);
+        mappedInput.addr = NULL;
+    }
+    if (cliContext != NULL)
+        freeAllMemory(cliContext);
+}
+
+/* This function prints the algorithms' reports (ctx->report) to stderr. */
+void printReports(SpkContext *ctx) {
+    int i;
+    const SpkReport *report = &ctx->report;
+    const StageReport *stage;
+
+    if (report->jacobi.n > 0)
+        fprintf(stderr, "jacobi: solver=%s n=%d sweeps=%d rotations=%ld off-norm=%e\n",
+                solver2str(ctx->config.solver), report->jacobi.n, report->jacobi.sweeps,
+                report->jacobi.rotations, report->jacobi.offNorm);
+    if (report->lanczos.n > 0)
+        fprintf(stderr, "lanczos: n=%d nev=%d restarts=%d mat-vecs=%ld residual=%e "
+                "converged=%d\n", report->lanczos.n, report->lanczos.nev,
+                report->lanczos.restarts, report->lanczos.matVecs, report->lanczos.residual,
+                report->lanczos.converged);
+    if (report->affinity.n > 0)
+        fprintf(stderr, "affinity: mode=%s n=%d nnz=%ld\n",
+                affinity2str(ctx->config.affinity), report->affinity.n, report->affinity.nnz);
+    if (report->kmeans.k > 0)
+        fprintf(stderr, "kmeans: variant=%s k=%d iterations=%d batch=%d distances=%ld "
+                        "pruned=%ld changes=%ld\n", kmeans2str(report->kmeans.variant),
+                report->kmeans.k, report->kmeans.iterations, report->kmeans.batchSize,
+                report->kmeans.distances, report->kmeans.pruned, report->kmeans.changes);
+    if (report->nystrom.landmarks > 0)
+        fprintf(stderr, "nystrom: landmarks=%d rank=%d\n", report->nystrom.landmarks,
+                report->nystrom.rank);
+    if (report->cache.lookups > 0)
+        fprintf(stderr, "cache: lookups=%d hits=%d writes=%d bytes=%ld\n", report->cache.lookups,
+                report->cache.hits, report->cache.writes, report->cache.bytes);
+    if (report->memory.planned > 0)
+        fprintf(stderr, "memory: planned=%ld used=%ld overflows=%d\n",
+                report->memory.planned, report->memory.used, report->memory.overflows);
+    if (report->read.bytes > 0)
+        fprintf(stderr, "read: format=%s rows=%d cols=%d bytes=%ld time=%.3fs "
+                        "throughput=%.1fMB/s\n", report->read.binary ? "binary" : "csv",
+                report->read.rows, report->read.cols, report->read.bytes,
+                report->read.seconds, report->read.bytes / BYTES_PER_MB /
+                                      MAX(report->read.seconds, 1.0E-9));
+    for (i = 0; i < report->profile.numOfStages; ++i) {
+        stage = &report->profile.stages[i];
+        fprintf(stderr, "stage: name=%s start=%.6fs time=%.6fs bytes=%ld", stage->name,
+                stage->start, stage->seconds, stage->bytes);
+        if (stage->counterName != NULL)
+            fprintf(stderr, " %s=%ld", stage->counterName, stage->counter);
+        fprintf(stderr, "\n");
+    }
+}
+
 /* This function convert String to enum representation. */
 GOAL str2enum(char *str) {
     int j;
@@ -677,48 +4057,450 @@ GOAL str2enum(char *str) {
     return NUM_OF_GOALS; /* Invalid str to enum convert */
 }
 
+/* This function convert String to solver enum representation. */
+SOLVER str2solver(char *str) {
+    int j;
+    /* Str to lowercase */
+    for (j = 0; str[j] != END_OF_STRING; ++j){
+        str[j] = (char) tolower(str[j]);
+    }
+
+    for (j = 0; j < NUM_OF_SOLVERS; ++j) {
+        if (!strcmp(str, SOLVER_STRING[j]))
+            return j;
+    }
+    return NUM_OF_SOLVERS; /* Invalid str to enum convert */
+}
+
+/* This function convert solver enum to its name. */
+const char *solver2str(SOLVER solver) {
+    return SOLVER_STRING[solver];
+}
+
+/* This function convert String to affinity enum representation. */
+AFFINITY str2affinity(char *str, double *param) {
+    int j;
+    size_t nameLen;
+    char *paramStr = strchr(str, AFFINITY_PARAM_CHAR);
+    /* Str to lowercase */
+    for (j = 0; str[j] != END_OF_STRING; ++j){
+        str[j] = (char) tolower(str[j]);
+    }
+
+    nameLen = paramStr != NULL ? (size_t) (paramStr - str) : strlen(str);
+    for (j = 0; j < NUM_OF_AFFINITIES; ++j) {
+        if (strlen(AFFINITY_STRING[j]) == nameLen && !strncmp(str, AFFINITY_STRING[j], nameLen))
+            break;
+    }
+    switch (j) {
+        case dense: /* No parameter */
+            *param = 0.0;
+            return paramStr == NULL ? dense : NUM_OF_AFFINITIES;
+        case knn: /* Positive int */
+            *param = paramStr != NULL ? str2PositiveInt(paramStr + 1) : EOF;
+            return *param != EOF ? knn : NUM_OF_AFFINITIES;
+        case eps: /* 0 < E < 1 */
+            *param = paramStr != NULL ? str2PositiveDouble(paramStr + 1) : EOF;
+            return *param != EOF && *param < 1.0 ? eps : NUM_OF_AFFINITIES;
+        default:
+            return NUM_OF_AFFINITIES; /* Invalid str to enum convert */
+    }
+}
+
+/* This function convert affinity enum to its name. */
+const char *affinity2str(AFFINITY affinity) {
+    return AFFINITY_STRING[affinity];
+}
+
+/* This function convert String to kmeans variant enum representation. */
+KMEANS str2kmeans(char *str) {
+    int j;
+    /* Str to lowercase */
+    for (j = 0; str[j] != END_OF_STRING; ++j){
+        str[j] = (char) tolower(str[j]);
+    }
+
+    for (j = 0; j < NUM_OF_KMEANS; ++j) {
+        if (!strcmp(str, KMEANS_STRING[j]))
+            return j;
+    }
+    return NUM_OF_KMEANS; /* Invalid str to enum convert */
+}
+
+/* This function convert kmeans variant enum to its name. */
+const char *kmeans2str(KMEANS variant) {
+    return KMEANS_STRING[variant];
+}
+
+/* This function convert String to seeding enum representation. */
+INIT str2init(char *str) {
+    int j;
+    /* Str to lowercase */
+    for (j = 0; str[j] != END_OF_STRING; ++j){
+        str[j] = (char) tolower(str[j]);
+    }
+
+    for (j = 0; j < NUM_OF_INITS; ++j) {
+        if (!strcmp(str, INIT_STRING[j]))
+            return j;
+    }
+    return NUM_OF_INITS; /* Invalid str to enum convert */
+}
+
 /* The function read from csv format file (extension .txt/.csv) into matrix. */
-double **readDataFromFile(int *rows, int *cols, char *fileName, GOAL goal) {
-    int counter, maxLen;
-    char c;
-    double value;
-    FILE *file;
-    double **matrix, *dataBlock;
+double **readDataFromFile(SpkContext *ctx, int *rows, int *cols, char *fileName, GOAL goal) {
+    int capacity = 0, numOfValues;
+    char *line, *lineEnd;
+    double **matrix, *dataBlock = NULL, startTime = wallTime();
+    CsvReader reader;
+
+    if (isBinaryFile(fileName)) { /* No parsing - map the values */
+        matrix = mapBinaryFile(ctx, rows, cols, fileName);
+        MyAssert(goal != jacobi || *rows == *cols); /* Jacobi - a square matrix */
+        ctx->report.read.bytes = (long) mappedInput.length;
+        ctx->report.read.binary = 1;
+        ctx->report.read.rows = *rows;
+        ctx->report.read.cols = *cols;
+        ctx->report.read.seconds = wallTime() - startTime;
+        return matrix;
+    }
+    openCsvReader(ctx, &reader, fileName);
+    *rows = 0, *cols = 0;
+    while ((line = nextCsvLine(ctx, &reader, &lineEnd)) != NULL) {
+        if (skipSpaces(line, lineEnd) == lineEnd)
+            continue; /* Blank line */
+        if (*cols == 0) /* First line - the Data's number of features */
+            *cols = countCsvValues(line, lineEnd);
+        if (*rows == capacity) { /* Full - double the datapoints' block */
+            MyAssert(capacity <= INT_MAX / 2);
+            capacity = capacity > 0 ? 2 * capacity : INITIAL_ROWS_CAPACITY;
+            dataBlock = (double *) myAlloc(ctx, dataBlock, (size_t) capacity * (*cols) *
+                                                           sizeof(double));
+            MyAssert(dataBlock != NULL); /* Memory allocation fail */
+        }
+        numOfValues = parseCsvLine(line, lineEnd, dataBlock + (size_t) (*rows) * (*cols),
+                                   *cols);
+        MyAssert(numOfValues == *cols); /* Same number of features in all lines */
+        ++*rows;
+    }
+    MyAssert(!reader.error && *rows > 0); /* File read successfully */
+    MyAssert(goal != jacobi || *rows == *cols); /* Jacobi - a square matrix */
+    closeCsvReader(ctx, &reader);
+
+    /* Make it 2D array (shrinks the block to the rows read) */
+    matrix = (double **) alloc2DArray(ctx, *rows, *cols, sizeof(double),
+                                      sizeof(double *), dataBlock);
+    MyAssert(matrix != NULL); /* Memory allocation fail */
+    ctx->report.read.bytes = reader.bytes;
+    ctx->report.read.rows = *rows;
+    ctx->report.read.cols = *cols;
+    ctx->report.read.seconds = wallTime() - startTime;
+    return matrix;
+}
+
+/* This function checks if the file is in the binary input format. */
+int isBinaryFile(const char *fileName) {
+    char magic[sizeof(BINARY_MAGIC)];
+    size_t numOfBytes;
+    FILE *file = fopen(fileName, "rb");
 
-    maxLen = goal != jacobi ? MAX_FEATURES : MAX_DATAPOINTS;
-    dataBlock = (double *) myAlloc(NULL, maxLen * sizeof(double));
-    MyAssert(dataBlock != NULL); /* Memory allocation fail */
-    file = fopen(fileName, "r");
     MyAssert(file != NULL); /* File opened successfully */
-    calcDim(cols, file, dataBlock);
+    numOfBytes = fread(magic, 1, sizeof(magic), file);
+    MyAssert(fclose(file) != EOF); /* File closed successfully */
+    return numOfBytes == sizeof(magic) && !memcmp(magic, BINARY_MAGIC, sizeof(magic));
+}
 
-    maxLen = goal != jacobi ? MAX_DATAPOINTS : *cols;
-    /* Reallocate memory to hold the data */
-    dataBlock = (double *) myAlloc(dataBlock ,maxLen * (*cols) * sizeof(double));
-    MyAssert(dataBlock != NULL); /* Memory allocation fail */
+/* This function maps a binary input file and points the row pointers at its values. */
+double **mapBinaryFile(SpkContext *ctx, int *rows, int *cols, const char *fileName) {
+    int i, fd;
+    struct stat fileStat;
+    void *addr;
+    const BinaryHeader *header;
+    double *values, **matrix;
 
-    counter = *cols;
-    while (fscanf(file, "%lf%c", &value, &c) != EOF) {
-        dataBlock[counter++] = value;
+    fd = open(fileName, O_RDONLY);
+    MyAssert(fd != -1); /* File opened successfully */
+    if (fstat(fd, &fileStat) == -1 || fileStat.st_size < (off_t) sizeof(BinaryHeader)) {
+        close(fd);
+        MyAssert(0); /* Not a binary input file */
     }
-    MyAssert(fclose(file) != EOF); /* File closed successfully */
+    /* Private - jacobi and the in place stages write to the matrix, never to the file */
+    addr = mmap(NULL, fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); /* The mapping stays valid */
+    MyAssert(addr != MAP_FAILED);
+    mappedInput.addr = addr;
+    mappedInput.length = fileStat.st_size;
+    madvise(addr, mappedInput.length, MADV_WILLNEED); /* Start reading ahead */
 
-    *rows = counter / *cols;
-    /* Make it 2D array */
-    matrix = (double **) alloc2DArray(*rows, *cols, sizeof(double),
-                                      sizeof(double *), dataBlock);
+    header = (const BinaryHeader *) addr;
+    MyAssert(!strncmp(header->dtype, nativeDtype(), sizeof(header->dtype)));
+    MyAssert(header->rows > 0 && header->rows <= INT_MAX &&
+             header->cols > 0 && header->cols <= INT_MAX);
+    MyAssert((mappedInput.length - sizeof(BinaryHeader)) / sizeof(double) / header->cols ==
+             (size_t) header->rows &&
+             (mappedInput.length - sizeof(BinaryHeader)) % (header->cols * sizeof(double)) == 0);
+    *rows = (int) header->rows, *cols = (int) header->cols;
+
+    values = (double *) (header + 1);
+    matrix = (double **) myAlloc(ctx, NULL, *rows * sizeof(double *));
     MyAssert(matrix != NULL); /* Memory allocation fail */
+    for (i = 0; i < *rows; ++i)
+        matrix[i] = values + (size_t) i * (*cols);
     return matrix;
 }
 
-/* This function calculates and assign the Data's number of features,
- *      while reading the first line of the file. */
-void calcDim(int *dimension, FILE *file, double *firstLine) {
-    char c;
+/* This function writes a matrix in the binary input format. */
+void writeBinaryFile(const char *fileName, double **matrix, int rows, int cols) {
+    int i, written;
+    BinaryHeader header;
+    FILE *file = fopen(fileName, "wb");
+
+    MyAssert(file != NULL); /* File opened successfully */
+    initBinaryHeader(&header, rows, cols);
+    written = fwrite(&header, sizeof(BinaryHeader), 1, file) == 1;
+    for (i = 0; i < rows && written; ++i)
+        written = fwrite(matrix[i], sizeof(double), cols, file) == (size_t) cols;
+    MyAssert(fclose(file) != EOF && written); /* File written successfully */
+}
+
+/* This function fills a binary format's header. */
+void initBinaryHeader(BinaryHeader *header, long rows, int cols) {
+    memset(header, 0, sizeof(BinaryHeader));
+    memcpy(header->magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    memcpy(header->dtype, nativeDtype(), strlen(nativeDtype())); /* Zero padded */
+    header->rows = rows, header->cols = cols;
+}
+
+/* This function returns the binary format's dtype of this machine's byte order. */
+const char *nativeDtype() {
+    const int one = 1;
+
+    return *(const char *) &one ? BINARY_DTYPE_LE : BINARY_DTYPE_BE;
+}
+
+/* This function opens the file and allocates the reader's buffer. */
+void openCsvReader(SpkContext *ctx, CsvReader *reader, const char *fileName) {
+    reader->file = fopen(fileName, "rb");
+    MyAssert(reader->file != NULL); /* File opened successfully */
+    reader->capacity = READ_CHUNK_SIZE;
+    reader->buffer = (char *) myAlloc(ctx, NULL, reader->capacity + 1);
+    MyAssert(reader->buffer != NULL); /* Memory allocation fail */
+    reader->begin = reader->end = 0;
+    reader->bytes = 0;
+    reader->eof = reader->error = 0;
+}
+
+/* This function closes the reader's file and frees its buffer. */
+void closeCsvReader(SpkContext *ctx, CsvReader *reader) {
+    MyAssert(fclose(reader->file) != EOF); /* File closed successfully */
+    MyFree(ctx, reader->buffer);
+}
+
+/* This function reads the next chunk of the file into the reader's buffer. */
+int fillCsvBuffer(SpkContext *ctx, CsvReader *reader) {
+    size_t length = reader->end - reader->begin, numOfBytes;
+    char *buffer;
+
+    memmove(reader->buffer, reader->buffer + reader->begin, length);
+    reader->begin = 0, reader->end = length;
+    if (length == reader->capacity) { /* A line longer than the buffer */
+        buffer = (char *) myAlloc(ctx, reader->buffer, 2 * reader->capacity + 1);
+        if (buffer == NULL) { /* Memory allocation fail */
+            reader->error = 1;
+            return EOF;
+        }
+        reader->buffer = buffer;
+        reader->capacity *= 2;
+    }
+    numOfBytes = fread(reader->buffer + length, 1, reader->capacity - length, reader->file);
+    reader->end += numOfBytes;
+    reader->bytes += (long) numOfBytes;
+    reader->buffer[reader->end] = END_OF_STRING;
+    if (numOfBytes == 0) {
+        reader->eof = 1;
+        reader->error = ferror(reader->file) != 0;
+    }
+    return reader->error ? EOF : 0;
+}
+
+/* This function returns the next line of the file, refilling the buffer as needed. */
+char *nextCsvLine(SpkContext *ctx, CsvReader *reader, char **lineEnd) {
+    char *line, *newLine;
+    size_t length;
+
+    while (1) {
+        line = reader->buffer + reader->begin;
+        length = reader->end - reader->begin;
+        newLine = (char *) memchr(line, NEW_LINE_CHAR, length);
+        if (newLine != NULL || (reader->eof && length > 0)) {
+            *lineEnd = newLine != NULL ? newLine : line + length;
+            reader->begin += *lineEnd - line + (newLine != NULL);
+            return line;
+        }
+        if (reader->eof || fillCsvBuffer(ctx, reader) == EOF)
+            return NULL; /* End of file or read error */
+    }
+}
+
+/* This function parses one csv line of numbers. */
+int parseCsvLine(const char *line, const char *lineEnd, double *values, int maxValues) {
+    int numOfValues = 0;
+    const char *ch = line, *next;
+
+    while (numOfValues < maxValues) {
+        ch = skipSpaces(ch, lineEnd);
+        values[numOfValues++] = parseDouble(ch, &next);
+        if (next == ch || next > lineEnd)
+            return EOF; /* Not a number */
+        ch = skipSpaces(next, lineEnd);
+        if (ch == lineEnd)
+            return numOfValues;
+        if (*ch++ != COMMA_CHAR)
+            return EOF;
+    }
+    return EOF; /* Too many values */
+}
+
+/* This function counts the values of a csv line (commas + 1). */
+int countCsvValues(const char *line, const char *lineEnd) {
+    int numOfValues = 1;
+
+    while ((line = (const char *) memchr(line, COMMA_CHAR, lineEnd - line)) != NULL) {
+        ++numOfValues;
+        ++line;
+    }
+    return numOfValues;
+}
+
+/* This function skips spaces, tabs and carriage returns. */
+const char *skipSpaces(const char *str, const char *end) {
+    while (str < end && (*str == ' ' || *str == '\t' || *str == '\r'))
+        ++str;
+    return str;
+}
+
+/* This function parses a decimal floating point number (fast path + strtod fallback). */
+double parseDouble(const char *str, const char **end) {
+    const char *ch = str, *expCh;
+    int negative, numOfChars = 0, numOfDigits = 0, exp10 = 0, expValue = 0, expNegative;
+    unsigned long mantissa = 0; /* Wraps only past 19 digits - then not used */
     double value;
-    *dimension = 0;
-    do {
-        fscanf(file, "%lf%c", &value, &c);
-        firstLine[(*dimension)++] = value;
-    } while (c == COMMA_CHAR);
+    char *fallbackEnd;
+
+    negative = *ch == '-';
+    if (*ch == '-' || *ch == '+')
+        ++ch;
+    for (; *ch >= '0' && *ch <= '9'; ++ch, ++numOfChars) {
+        mantissa = mantissa * 10 + (*ch - '0');
+        numOfDigits += mantissa != 0; /* Significant digits - no leading zeros */
+    }
+    if (*ch == '.') {
+        for (++ch; *ch >= '0' && *ch <= '9'; ++ch, ++numOfChars, --exp10) {
+            mantissa = mantissa * 10 + (*ch - '0');
+            numOfDigits += mantissa != 0;
+        }
+    }
+    if (numOfChars > 0 && (*ch == 'e' || *ch == 'E')) {
+        expCh = ch + 1;
+        expNegative = *expCh == '-';
+        if (*expCh == '-' || *expCh == '+')
+            ++expCh;
+        if (*expCh >= '0' && *expCh <= '9') { /* Else 'e' isn't part of the number */
+            for (ch = expCh; *ch >= '0' && *ch <= '9'; ++ch) {
+                if (expValue < INT_MAX / 10 - 10)
+                    expValue = expValue * 10 + (*ch - '0');
+            }
+            exp10 += expNegative ? -expValue : expValue;
+        }
+    }
+    if (numOfChars == 0 || *ch == 'x' || *ch == 'X' || numOfDigits > FAST_PARSE_DIGITS ||
+        exp10 < -FAST_PARSE_MAX_EXP || exp10 > FAST_PARSE_MAX_EXP) {
+        /* Not a plain number (inf, nan, hex) or not exact - let strtod round it */
+        value = strtod(str, &fallbackEnd);
+        *end = fallbackEnd;
+        return value;
+    }
+    /* The mantissa and 10^|exp10| are exact, one rounding as in strtod */
+    value = (double) mantissa;
+    value = exp10 < 0 ? value / POW10[-exp10] : value * POW10[exp10];
+    *end = ch;
+    return negative ? -value : value;
+}
+
+/* This function returns a monotonic wall clock time in seconds. */
+double wallTime() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + now.tv_nsec * 1.0E-9;
+}
+
+/* This function starts recording a stage. */
+int stageBegin(SpkContext *ctx, const char *name) {
+    ProfileReport *profile = &ctx->report.profile;
+    StageReport *stage;
+    double now;
+
+    if (!ctx->config.profile || profile->numOfStages == MAX_STAGES)
+        return EOF; /* Not recorded */
+    now = wallTime();
+    if (profile->numOfStages == 0)
+        profile->origin = now;
+    stage = &profile->stages[profile->numOfStages];
+    stage->name = name;
+    stage->start = now - profile->origin;
+    stage->seconds = 0.0;
+    stage->bytes = ctx->allocatedBytes; /* Till "stageEnd" - the count at the start */
+    stage->counterName = NULL;
+    stage->counter = 0;
+    return profile->numOfStages++;
+}
+
+/* This function ends a stage's record. */
+void stageEnd(SpkContext *ctx, int stage, const char *counterName, long counter) {
+    StageReport *record;
+
+    if (stage == EOF)
+        return;
+    record = &ctx->report.profile.stages[stage];
+    record->seconds = wallTime() - ctx->report.profile.origin - record->start;
+    record->bytes = ctx->allocatedBytes - record->bytes;
+    record->counterName = counterName;
+    record->counter = counter;
+}
+
+/* This function writes the recorded stages as a Chrome trace. */
+int writeTrace(SpkContext *ctx, const char *path, int append) {
+    int i, written, tailLength = (int) strlen(TRACE_END), merged = 0;
+    char tail[sizeof(TRACE_END)];
+    const StageReport *stage;
+    FILE *file = append ? fopen(path, "r+") : NULL;
+
+    /* Merge - overwrite the previous trace's end with this call's events */
+    if (file != NULL && fseek(file, -tailLength, SEEK_END) == 0
+        && fread(tail, 1, tailLength, file) == (size_t) tailLength
+        && memcmp(tail, TRACE_END, tailLength) == 0)
+        merged = fseek(file, -tailLength, SEEK_END) == 0;
+    if (!merged) {
+        if (file != NULL)
+            fclose(file);
+        file = fopen(path, "w");
+        if (file == NULL) return EOF;
+        fprintf(file, "{\"traceEvents\": [");
+    }
+    for (i = 0; i < ctx->report.profile.numOfStages; ++i) {
+        stage = &ctx->report.profile.stages[i];
+        /* Complete event - start (since the monotonic clock's origin) and duration in us */
+        fprintf(file, "%s\n{\"name\": \"%s\", \"cat\": \"spk\", \"ph\": \"X\", "
+                      "\"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": 1, "
+                      "\"args\": {\"bytes\": %ld", i > 0 || merged ? "," : "", stage->name,
+                (ctx->report.profile.origin + stage->start) * 1.0E6, stage->seconds * 1.0E6,
+                (int) getpid(), stage->bytes);
+        if (stage->counterName != NULL)
+            fprintf(file, ", \"%s\": %ld", stage->counterName, stage->counter);
+        fprintf(file, "}}");
+    }
+    fputs(TRACE_END, file);
+    written = !ferror(file);
+    return fclose(file) != EOF && written ? 0 : EOF;
 }
\ No newline at end of file
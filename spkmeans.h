@@ -13,15 +13,30 @@
 *******************************************************************************/
 #define MAX_KMEANS_ITER 300
 #define SIZE_OF_VOID_2PTR sizeof(void **)
+#define DEFAULT_NUM_OF_THREADS 1
+#define THREADS_ENV_VAR "SPK_NUM_THREADS"
+#define DEFAULT_JACOBI_TOL 1.0E-12 /* Relative off-diagonal norm */
+#define MAX_JACOBI_SWEEPS 50
+#define DEFAULT_EIGEN_CAP 0 /* Lanczos eigengap scan - LANCZOS_EIGEN_CAP candidates */
+#define DEFAULT_BATCH_SIZE 1024 /* Mini-batch kmeans */
+#define DEFAULT_BATCH_TOL 1.0E-8 /* Mini-batch kmeans - mean squared centroid move */
+#define DEFAULT_SEED 0
+#define PROFILE_ENV_VAR "SPK_PROFILE" /* Set (not "0") - record the stages */
+#define TRACE_ENV_VAR "SPK_TRACE" /* Chrome trace file of the stages */
+#define CACHE_ENV_VAR "SPK_CACHE_DIR" /* Lnorm's eigenpairs cache directory */
+#define MAX_STAGES 64 /* Stages recorded per context, the rest are dropped */
 
 /*******************************************************************************
 ********************************* Macros ***************************************
 *******************************************************************************/
 /* Avoid -0.0000 representation */
 #define NegZero(value) (value) < 0.0 && (value) > -0.00005 ? -(value) : (value)
+/* Symmetric packed matrix element - only the upper triangle (j >= i) is stored */
+#define SymElement(matrix, i, j) ((i) <= (j) ? (matrix)[i][j] : (matrix)[j][i])
 /* Free macros */
-#define MyFree(block) myFree(block); block = NULL
-#define MyRecycleMatFree(block) freeUsedMem = *block; block = NULL
+#define MyFree(ctx, block) myFree(ctx, block); block = NULL
+#define MyRecycleMatFree(ctx, block) (ctx)->freeUsedMem = *block; block = NULL
+#define MyMatFree(ctx, block) myFree(ctx, *block); block = NULL /* "alloc2DArray" matrix */
 
 /* Enum macros */
 #define FOREACH_GOAL(GOAL) \
@@ -32,6 +47,62 @@ GOAL(lnorm)  \
 GOAL(spk)
 #define GENERATE_ENUM(ENUM) ENUM,
 
+/* Eigensolver backends:
+ * classic - max pivot Jacobi, stops after MAX_JACOBI_ITER rotations
+ * cyclic - cyclic-by-row threshold Jacobi, stops on the relative off-norm
+ * parallel - round-robin threshold Jacobi, n/2 independent rotations at a
+ *      time shared between the threads, stops on the relative off-norm
+ * ql - Householder tridiagonalization + implicit shift QL, runs to machine
+ *      precision
+ * lanczos - thick restart Lanczos, the spk goal computes only the smallest
+ *      eigenpairs it needs (k, or the eigengap candidates), stops on the
+ *      relative residual */
+#define FOREACH_SOLVER(SOLVER) \
+SOLVER(classic) \
+SOLVER(cyclic) \
+SOLVER(parallel) \
+SOLVER(ql) \
+SOLVER(lanczos)
+
+/* Affinity (W) modes:
+ * dense - all the pairs, packed n * n
+ * knn - the K nearest neighbours of each point (symmetrized - i ~ j if either
+ *      one is a neighbour of the other), CSR
+ * eps - the pairs with weight above E, CSR */
+#define FOREACH_AFFINITY(AFFINITY) \
+AFFINITY(dense) \
+AFFINITY(knn) \
+AFFINITY(eps)
+
+/* KMeans variants - the first four give identical results:
+ * lloyd - every vector's distance to every centroid
+ * hamerly - one upper and one lower bound per vector, skips the vectors
+ *      that can't change cluster (small k)
+ * elkan - an upper bound and k lower bounds per vector + the centroids'
+ *      distances, skips single distances (larger k)
+ * triangle - hamerly for k < ELKAN_MIN_K, else elkan
+ * minibatch - approximate, each step moves the centroids towards a random
+ *      batch of vectors (large N) */
+#define FOREACH_KMEANS(KMEANS) \
+KMEANS(lloyd) \
+KMEANS(hamerly) \
+KMEANS(elkan) \
+KMEANS(triangle) \
+KMEANS(minibatch)
+
+/* KMeans initial centroids (seeding):
+ * firstk - the first k vectors
+ * plusplus - k-means++, each next centroid drawn with probability D^2 (the
+ *      squared distance to the closest centroid so far)
+ * scalable - k-means|| - a few rounds oversampling ~2k candidates at a time
+ *      by D^2, then weighted k-means++ among the candidates
+ * uniform - k distinct vectors drawn uniformly (also Nystrom's default landmarks) */
+#define FOREACH_INIT(INIT) \
+INIT(firstk) \
+INIT(plusplus) \
+INIT(scalable) \
+INIT(uniform)
+
 /*******************************************************************************
 ********************************* Struct ***************************************
 *******************************************************************************/
@@ -40,12 +111,187 @@ typedef enum {
     NUM_OF_GOALS
 } GOAL;
 
-/*******************************************************************************
-******************************** Globals ***************************************
-*******************************************************************************/
-/* Global memory variables */
-void **headOfMemList;
-void *freeUsedMem;
+typedef enum {
+    FOREACH_SOLVER(GENERATE_ENUM)
+    NUM_OF_SOLVERS
+} SOLVER;
+
+typedef enum {
+    FOREACH_AFFINITY(GENERATE_ENUM)
+    NUM_OF_AFFINITIES
+} AFFINITY;
+
+typedef enum {
+    FOREACH_KMEANS(GENERATE_ENUM)
+    NUM_OF_KMEANS
+} KMEANS;
+
+typedef enum {
+    FOREACH_INIT(GENERATE_ENUM)
+    NUM_OF_INITS
+} INIT;
+
+/* Sparse symmetric matrix in CSR format, both triangles and the diagonal stored.
+ * Allocated as a single "myAlloc" block - the struct, values, rowPtr, colIndex */
+typedef struct {
+    int n;
+    long nnz;
+    double *values;
+    long *rowPtr; /* Row i's entries - [rowPtr[i], rowPtr[i + 1]), columns ascending */
+    int *colIndex;
+} CsrMatrix;
+
+/* Run configuration, shared by the CLI and the python module */
+typedef struct {
+    int numOfThreads; /* Workers for the O(n^2) stages, including the caller */
+    SOLVER solver; /* Eigensolver backend of "jacobiAlgorithm" */
+    double jacobiTol; /* Sweeps stop once Off(A) <= jacobiTol * ||A||_F */
+    int maxSweeps;
+    int eigenCap; /* k = 0 - max eigenvalues for the eigengap scan,
+                   * 0 - lanczos: LANCZOS_EIGEN_CAP, else n / 2 + 1 */
+    AFFINITY affinity; /* W's storage, dense or sparse (CSR) */
+    double affinityParam; /* knn - neighbours per point, eps - min weight */
+    KMEANS kmeans; /* "kMeans" variant */
+    int batchSize; /* Mini-batch kmeans - vectors per step */
+    double batchTol; /* Mini-batch kmeans - stops once the mean squared centroid move
+                      * of a step <= batchTol */
+    INIT init; /* "kMeans" seeding, if the initial centroids aren't given */
+    unsigned long seed; /* Random sequences' seed (seeding, mini-batch samples) */
+    int numOfLandmarks; /* spk - Nystrom's landmarks (dense affinity), 0 - the exact W */
+    INIT landmarks; /* Nystrom's landmarks sampling (see "kMeansSeeds") */
+    int verbose; /* Print the algorithms' reports to stderr */
+    int profile; /* Record the stages' time, memory and counters (see "stageBegin") */
+    char *tracePath; /* Also write the stages as a Chrome trace, NULL - don't */
+    char *cacheDir; /* spk - Lnorm's eigenpairs cache directory, NULL - none
+                     * (see "loadEigenpairs") */
+    char *saveBinaryPath; /* CLI - also write the input in binary format, NULL - don't */
+    int binaryOutput; /* CLI - print the results in binary format instead of csv */
+} SpkConfig;
+
+/* Jacobi's algorithm report */
+typedef struct {
+    int n; /* Matrix's dimension, 0 if jacobi didn't run */
+    int sweeps;
+    long rotations;
+    double offNorm; /* Final Off(A) - Frobenius norm of the off-diagonal */
+} JacobiReport;
+
+/* Lanczos solver report */
+typedef struct {
+    int n; /* Matrix's dimension, 0 if lanczos didn't run */
+    int nev; /* Eigenpairs computed */
+    int restarts;
+    long matVecs; /* Matrix-vector products */
+    double residual; /* Max Ritz residual ||A * y - theta * y|| of the eigenpairs */
+    int converged; /* 0 if stopped by MAX_LANCZOS_RESTARTS, above the tolerance */
+} LanczosReport;
+
+/* Sparse affinity report */
+typedef struct {
+    int n; /* Matrix's dimension, 0 if no sparse W was built */
+    long nnz; /* Stored entries, the diagonal included */
+} AffinityReport;
+
+/* KMeans report */
+typedef struct {
+    int k; /* Number of clusters, 0 if kmeans didn't run */
+    KMEANS variant; /* The variant that ran (triangle resolved) */
+    int iterations; /* minibatch - batches */
+    int batchSize; /* minibatch - vectors per batch, else 0 */
+    long distances; /* Vector to centroid distances computed */
+    long pruned; /* Distances skipped by the bounds - iterations * n * k - distances */
+    long changes; /* Centroids that moved, summed over the iterations (minibatch - batches) */
+} KMeansReport;
+
+/* Nystrom approximation report */
+typedef struct {
+    int landmarks; /* Landmarks sampled, 0 if the approximation didn't run */
+    int rank; /* Landmarks' kernel eigenvalues kept (above NYSTROM_RCOND) */
+} NystromReport;
+
+/* Eigenpairs cache report */
+typedef struct {
+    int lookups; /* 0 if no cache directory */
+    int hits;
+    int writes; /* Misses' eigenpairs written to the cache */
+    long bytes; /* Mapped and written */
+} CacheReport;
+
+/* Input file reader report (CLI) */
+typedef struct {
+    long bytes; /* File's size, 0 if no file was read */
+    int binary; /* Memory mapped binary file, 0 - parsed csv */
+    int rows;
+    int cols;
+    double seconds;
+} ReadReport;
+
+/* Stage buffers' memory report */
+typedef struct {
+    long planned; /* Arena's bytes, 0 if no pipeline ran */
+    long used; /* Regions' high water marks sum */
+    int overflows; /* Buffers beyond the plan, allocated with "myAlloc" */
+} MemoryReport;
+
+/* A stage's record - its wall time, memory and algorithm counter */
+typedef struct {
+    const char *name;
+    double start; /* Seconds since the context's first stage */
+    double seconds;
+    long bytes; /* Requested from "myAlloc" and the arena during the stage */
+    const char *counterName; /* NULL - no counter */
+    long counter;
+} StageReport;
+
+/* The recorded stages, in their start order (ctx->config.profile) */
+typedef struct {
+    int numOfStages;
+    double origin; /* First stage's start, "wallTime" */
+    StageReport stages[MAX_STAGES];
+} ProfileReport;
+
+/* Algorithms' reports of the last run */
+typedef struct {
+    JacobiReport jacobi;
+    LanczosReport lanczos;
+    AffinityReport affinity;
+    KMeansReport kmeans;
+    NystromReport nystrom;
+    CacheReport cache;
+    ReadReport read;
+    MemoryReport memory;
+    ProfileReport profile;
+} SpkReport;
+
+/* Worker threads of a context (defined in spkinnerfunctions.h) */
+typedef struct ThreadPool ThreadPool;
+/* Stage buffers of a run (defined in spkinnerfunctions.h) */
+typedef struct SpkArena SpkArena;
+/* Memory mapped cache file (defined in spkinnerfunctions.h) */
+typedef struct SpkMapping SpkMapping;
+
+/* Run context - everything a computation allocates, reads and reports.
+ * Contexts are independent, so separate threads may run computations
+ *      concurrently - each with its own context. Set up by "initContext". */
+typedef struct {
+    void **headOfMemList; /* "myAlloc" blocks, freed by "freeAllMemory" */
+    void *freeUsedMem; /* Freed matrix block to be recycled, NULL - none */
+    SpkConfig config;
+    SpkReport report;
+    ThreadPool *threadPool; /* Started on the first parallel stage, NULL - none */
+    SpkArena *arena; /* Last run's stage buffers, NULL - none (see "planMemory") */
+    SpkMapping *mappings; /* Mapped cache files, unmapped by "freeAllMemory" */
+    long allocatedBytes; /* Requested from "myAlloc" and the arena so far */
+} SpkContext;
+
+/* One k's spectral clustering (see "spkRange") */
+typedef struct {
+    int k; /* Resolved k - 0 was replaced by the eigengap heuristic's */
+    double **centroids; /* k * k - in T's space */
+    double *labels; /* Points' clusters, as "kMeans"' labeling row */
+    double inertia; /* Points' squared distances from their centroids (T's rows) */
+    int iterations; /* kmeans' iterations (minibatch - batches) */
+} SpkClustering;
 
 /*******************************************************************************
 **************************** Functions Declaration *****************************
@@ -55,49 +301,139 @@ void *freeUsedMem;
  * The function runs spk algorithm steps and stop at the desired goal.
  * The function returns the relevant matrix depended on the GOAL.
  * The function also calculates and assign K if not provided.
+ * @param ctx Run context (see "SpkContext")
  * @param datapointsArray Original data to adjust
  * @param goal Desired goal
  * @param k number of clusters (for kmeans)
  * @param dimension datapoints' number of features
  * @param numOfDatapoints number of datapoints
+ * The stage buffers are planned up front (see "planMemory") - NULL is returned
+ *      before any work if the run's peak memory can't be allocated.
  * @return Matrix: 'spk' - T, 'wam' - W, 'ddg' - D, 'lnorm' - Lnorm, NULL on failure.
+ *      W and Lnorm are packed symmetric matrices (see "allocSymMatrix"), also
+ *      with a sparse affinity (see "sparseAdjustmentMatrices" for the CSR form).
+ *      The matrix lives in the run's arena (see "isArenaMemory").
  */
-double **dataAdjustmentMatrices(double **datapointsArray, GOAL goal, int *k,
+double **dataAdjustmentMatrices(SpkContext *ctx, double **datapointsArray, GOAL goal, int *k,
                                 int dimension, int numOfDatapoints);
 
+/**
+ * The function builds the sparse W (goals wam, ddg) or Lnorm (lnorm, spk) of
+ *      the datapoints, with ctx->config's affinity mode (knn / eps).
+ * W's diagonal entries are stored (zeros), so Lnorm is W scaled in place.
+ * @param ctx Run context (see "SpkContext")
+ * @param datapointsArray Datapoints
+ * @param goal Goal
+ * @param dimension Datapoints' dimension
+ * @param numOfDatapoints Number of datapoints
+ * @param degrees To be assigned with W's degrees, NULL if not needed
+ * @return W / Lnorm in CSR format, NULL on failure
+ */
+CsrMatrix *sparseAdjustmentMatrices(SpkContext *ctx, double **datapointsArray, GOAL goal,
+                                    int dimension, int numOfDatapoints, double *degrees);
+
+/**
+ * This function forms T out of a Nystrom approximation of W (the spk goal with
+ *      ctx->config.numOfLandmarks) - O(n * m^2) time and O(n * m) memory
+ *      instead of O(n^3) and O(n^2).
+ * m landmarks are sampled (ctx->config.landmarks, see "kMeansSeeds") and only
+ *      the n * m affinity block C is computed. W ~ C * A^+ * C^T, where A is
+ *      the landmarks' m * m block (with its unit diagonal - W's zero diagonal
+ *      is left to the degrees). Lnorm's smallest eigenvectors are the largest
+ *      ones of G * G^T, G = D^-1/2 * C * A^-1/2 - out of G^T * G (rank * rank).
+ * The two small eigenproblems run with ctx->config.solver (ql for classic).
+ *      Fills ctx->report.nystrom.
+ * @param ctx Run context (see "SpkContext")
+ * @param datapointsArray Datapoints
+ * @param k Number of clusters, 0 - assigned by the eigengap heuristic
+ * @param dimension Datapoints' dimension
+ * @param numOfDatapoints Number of datapoints
+ * The n * m block and all the buffers are planned up front (see "planNystromMemory").
+ * @return T (in the arena, in place of C), NULL on failure
+ */
+double **nystromTMatrix(SpkContext *ctx, double **datapointsArray, int *k, int dimension,
+                        int numOfDatapoints);
+
+/**
+ * This function runs the spk algorithm for a range of k - W, Lnorm and its
+ *      eigenpairs once (the exact ones, "lanczos" computes the largest k's or
+ *      the eigengap's candidates - see "eigengapCandidates" - whichever is
+ *      more), then T and "kMeans" for each k.
+ * The ks are clustered concurrently, each in its own context on one thread
+ *      (fewer ks than threads - one after the other, each on all the threads
+ *      of ctx's thread pool).
+ *      Either way, each k's clusters are as "dataAdjustmentMatrices" + "kMeans"'
+ *      (lanczos - up to its tolerance, its eigenpairs are computed together).
+ * @param ctx Run context (see "SpkContext")
+ * @param datapointsArray Datapoints
+ * @param ks The k values, 0 <= k < numOfDatapoints (0 - the eigengap heuristic's)
+ * @param numOfKs Number of k values
+ * @param dimension Datapoints' dimension
+ * @param numOfDatapoints Number of datapoints
+ * @param eigengapK To be assigned with the eigengap heuristic's k
+ * @return numOfKs clusterings (in the ks' order), NULL on failure (also an invalid k)
+ */
+SpkClustering *spkRange(SpkContext *ctx, double **datapointsArray, const int *ks, int numOfKs,
+                        int dimension, int numOfDatapoints, int *eigengapK);
+
 /**
  * This function runs the main KMeans clustering algorithm.
+ * The assignment step is ctx->config.kmeans's variant - all of them give
+ *      the same clusters, but minibatch (see "miniBatchKMeans").
+ *      Fills ctx->report.kmeans.
+ * @param ctx Run context (see "SpkContext")
  * @param vectorsArray Vectors array to be clustered
  * @param numOfVectors Number of vectors
  * @param dimension Vectors' dimension
  * @param k Number of desired clusters
  * @param firstCentralIndexes First vectors indexes to be the initial clusters'
- *          centroids (for kmeans++ only), NULL for kmeans
+ *          centroids, NULL - seeded by ctx->config.init (see "kMeansSeeds")
  * @param maxIter Maximum number of kmeans iterations till convergence
  * @return Final clusters centroids and vector to cluster labeling as one matrix
  */
-double **kMeans(double **vectorsArray, int numOfVectors, int dimension, int k,
+double **kMeans(SpkContext *ctx, double **vectorsArray, int numOfVectors, int dimension, int k,
                 const int *firstCentralIndexes, int maxIter);
 
 /**
- * This function performs Jacobi's diagonal method on a symmetric matrix.
- * @param matrix A symmetric matrix
+ * This function chooses the initial clusters' centroids (ctx->config.init):
+ *      firstk, k-means++, k-means|| or uniform - reproducible for a given ctx->config.seed
+ *      (the squared distances are updated by the threads, the draws are serial).
+ * @param ctx Run context (see "SpkContext")
+ * @param vectorsArray Vectors array to be clustered
+ * @param numOfVectors Number of vectors
+ * @param dimension Vectors' dimension
+ * @param k Number of desired clusters
+ * @return k vectors indexes (distinct if the vectors have k distinct points),
+ *      NULL if memory allocation fail
+ */
+int *kMeansSeeds(SpkContext *ctx, double **vectorsArray, int numOfVectors, int dimension,
+                 int k);
+
+/**
+ * This function performs Jacobi's diagonal method on a symmetric matrix,
+ *      using the ctx->config.solver variant. Fills ctx->report.jacobi
+ *      (ctx->report.lanczos for lanczos).
+ * The eigenvectors and the solver's workspace are planned up front (see "planMemory").
+ * @param ctx Run context (see "SpkContext")
+ * @param matrix A packed symmetric matrix (see "allocSymMatrix")
  * @param n matrix's dimension
- * @return Transposed eigenvectors matrix (V^T), NULL on failure
+ * @return Transposed eigenvectors matrix (V^T) in the run's arena, NULL on failure
  */
-double **jacobiAlgorithm(double **matrix, int n);
+double **jacobiAlgorithm(SpkContext *ctx, double **matrix, int n);
 
 /**
  * The function allocates memory for any dynamic memory needed.
  * If use new memory space, add it to the list of memory blocks and update the pointers.
+ * @param ctx Run context (see "SpkContext")
  * @param effectiveUsedMem Block of allocated memory - without list's pointers
  * @param size Size of block in bytes
  * @return Pointer to head of effective block of memory, NULL on failure
  */
-void *myAlloc(void *effectiveUsedMem, size_t size);
+void *myAlloc(SpkContext *ctx, void *effectiveUsedMem, size_t size);
 
 /**
  * The function builds a 2 dimension array (matrix) using "myAlloc" function.
+ * @param ctx Run context (see "SpkContext")
  * @param rows Matrxi's number of rows
  * @param cols Matrxi's number of columns
  * @param basicSize sizeof(type) in bytes
@@ -105,20 +441,82 @@ void *myAlloc(void *effectiveUsedMem, size_t size);
  * @param recycleMemBlock Free used memory block pointer, NULL for new allocation
  * @return Pointer to a matrix array
  */
-void **alloc2DArray(int rows, int cols, size_t basicSize, size_t basicPtrSize,
+void **alloc2DArray(SpkContext *ctx, int rows, int cols, size_t basicSize, size_t basicPtrSize,
                     void *recycleMemBlock);
 
+/**
+ * The function builds a packed symmetric matrix using "myAlloc" function.
+ * Only the upper triangle is stored - row i holds columns i..n-1 and is
+ *      accessed as matrix[i][j] for j >= i (SymElement for any i, j).
+ * @param ctx Run context (see "SpkContext")
+ * @param n Matrix's dimension
+ * @param recycleMemBlock Free used memory block pointer, NULL for new allocation
+ * @return Pointer to a packed matrix, NULL on failure
+ */
+double **allocSymMatrix(SpkContext *ctx, int n, void *recycleMemBlock);
+
+/**
+ * The function packs a full symmetric matrix (from "alloc2DArray") in place
+ *      into the "allocSymMatrix" layout. The matrix's lower triangle is dropped.
+ * @param matrix A full n * n symmetric matrix
+ * @param n Matrix's dimension
+ * @return The packed matrix (same block of memory)
+ */
+double **packSymMatrix(double **matrix, int n);
+
 /**
  * This function free unnecessary memory and keep the order of the memory list.
+ * Arena buffers are skipped - they are released with their arena.
+ * @param ctx Run context (see "SpkContext")
+ * @param effectiveBlockMem Block of allocated memory - without list's pointers
+ */
+void myFree(SpkContext *ctx, void *effectiveBlockMem);
+
+/**
+ * This function removes a "myAlloc" block from the memory list without freeing
+ *      it - "freeAllMemory" skips it and the caller owns it from now on.
+ * @param ctx Run context (see "SpkContext")
  * @param effectiveBlockMem Block of allocated memory - without list's pointers
  */
-void myFree(void *effectiveBlockMem);
+void myDetach(SpkContext *ctx, void *effectiveBlockMem);
+
+/**
+ * This function checks whether memory belongs to one of the context's arenas
+ *      (stage buffers, see "planMemory") - it isn't a "myAlloc" block, so it
+ *      can't be detached. Arenas are freed by "freeAllMemory".
+ * @param ctx Run context (see "SpkContext")
+ * @param mem Memory address
+ * @return 1 if mem is in an arena, else 0
+ */
+int isArenaMemory(SpkContext *ctx, const void *mem);
+
+/**
+ * This function frees a block detached by "myDetach".
+ * @param effectiveBlockMem Detached block, NULL - do nothing
+ */
+void myFreeDetached(void *effectiveBlockMem);
 
 /**
  * This function free all memory allocated at runtime.
  * The function uses the memory list to support unexpected exit of program/errors.
+ * Also joins the context's worker threads - the context may be used again.
+ * @param ctx Run context (see "SpkContext")
  */
-void freeAllMemory();
+void freeAllMemory(SpkContext *ctx);
+
+/**
+ * This function initializes a context - an empty memory list, no worker threads,
+ *      zeroed reports and the default configuration (the number of threads
+ *      from the SPK_NUM_THREADS env var if set).
+ * @param ctx Context to initialize
+ */
+void initContext(SpkContext *ctx);
+
+/**
+ * This function joins the worker threads of the context's thread pool (if started).
+ * @param ctx Run context (see "SpkContext")
+ */
+void destroyThreadPool(SpkContext *ctx);
 
 /**
  * This function convert String to enum representation.
@@ -127,4 +525,85 @@ void freeAllMemory();
  */
 GOAL str2enum(char *str);
 
+/**
+ * This function convert String to solver enum representation.
+ * @param str Solver's name
+ * @return SOLVER enum, special value NUM_OF_SOLVERS on failure
+ */
+SOLVER str2solver(char *str);
+
+/**
+ * This function convert solver enum to its name.
+ * @param solver Solver enum
+ * @return Solver's name
+ */
+const char *solver2str(SOLVER solver);
+
+/**
+ * This function convert String to affinity enum representation -
+ *      "dense", "knn:K" (K positive int) or "eps:E" (0 < E < 1).
+ * @param str Affinity mode
+ * @param param To be assigned with K / E
+ * @return AFFINITY enum, special value NUM_OF_AFFINITIES on failure
+ */
+AFFINITY str2affinity(char *str, double *param);
+
+/**
+ * This function convert affinity enum to its name.
+ * @param affinity Affinity enum
+ * @return Affinity's name
+ */
+const char *affinity2str(AFFINITY affinity);
+
+/**
+ * This function convert String to kmeans variant enum representation.
+ * @param str Variant's name
+ * @return KMEANS enum, special value NUM_OF_KMEANS on failure
+ */
+KMEANS str2kmeans(char *str);
+
+/**
+ * This function convert kmeans variant enum to its name.
+ * @param variant KMEANS enum
+ * @return Variant's name
+ */
+const char *kmeans2str(KMEANS variant);
+
+/**
+ * This function starts recording a stage (if ctx->config.profile).
+ * Stages may nest - e.g. "kmeans" inside a caller's stage.
+ * @param ctx Run context (see "SpkContext")
+ * @param name Stage's name (a string literal - kept as is)
+ * @return Stage's index for "stageEnd", EOF if not recorded
+ */
+int stageBegin(SpkContext *ctx, const char *name);
+
+/**
+ * This function ends a stage's record - its time, memory and counter.
+ * @param ctx Run context (see "SpkContext")
+ * @param stage Stage's index ("stageBegin"), EOF - do nothing
+ * @param counterName Counter's name (a string literal), NULL - none
+ * @param counter Counter's value
+ */
+void stageEnd(SpkContext *ctx, int stage, const char *counterName, long counter);
+
+/**
+ * This function writes the recorded stages as a Chrome trace (JSON trace
+ *      event format - chrome://tracing, Perfetto), complete events in microseconds
+ *      since the monotonic clock's origin - appended runs follow each other in time.
+ * @param ctx Run context (see "SpkContext")
+ * @param path Trace file's path
+ * @param append 1 - merge the events into the file's trace (if it ends with "TRACE_END",
+ *      else the file is rewritten), 0 - overwrite the file
+ * @return 0 on success, EOF if the file couldn't be written
+ */
+int writeTrace(SpkContext *ctx, const char *path, int append);
+
+/**
+ * This function convert String to seeding enum representation.
+ * @param str Seeding's name
+ * @return INIT enum, special value NUM_OF_INITS on failure
+ */
+INIT str2init(char *str);
+
 #endif /*FINAL_PROJECT_SPKMEANS_H */
@@ -10,6 +10,7 @@ ERROR_MSG = "An Error Has Occured"
 COMMA = ','
 NEG_ZERO_LOWER_BOUND = -0.00005
 GOALS = ["jacobi", "wam", "ddg", "lnorm", "spk"]
+SEED = 0
 
 
 # The main algorithm - Spectral clustering.
@@ -17,28 +18,29 @@ GOALS = ["jacobi", "wam", "ddg", "lnorm", "spk"]
 def main():
     # Read and valid user input
     k, goal, file = validate_and_assign_input_user()
-    list_of_vectors = build_vectors_list(file)
-    n_vectors = len(list_of_vectors)
-    n_features = len(list_of_vectors[0])
+    vectors = build_vectors_array(file)
+    n_vectors, n_features = vectors.shape
     if k >= n_vectors and goal == "spk":
         print(INVALID_INPUT_MSG)
         exit()  # End program k >= n
 
     try:
         if goal != "jacobi":
-            calc_matrix = spk.calc_mat(list_of_vectors, goal, k, n_features, n_vectors)
+            calc_matrix = np.asarray(spk.calc_mat(vectors, goal, k, n_features, n_vectors))
             if goal == "spk":
                 if k == 0:  # K not provided - The Eigengap Heuristic result == T's n_features
-                    k = len(calc_matrix[0])
-                # Kmeans++
-                list_random_init_centrals_indexes = choose_random_centrals(calc_matrix, k)
+                    k = calc_matrix.shape[1]
+                # Kmeans++ (seeded in C)
+                list_random_init_centrals_indexes = spk.kmeans_seeds(calc_matrix, n_vectors, k, k,
+                                                                     seed=SEED)
                 calc_matrix, vec_to_cluster_labeling = spk.kmeans(calc_matrix, n_vectors, k, k,
                                                                   list_random_init_centrals_indexes)
+                calc_matrix = np.asarray(calc_matrix)
                 print(*list_random_init_centrals_indexes, sep=COMMA)
             print_matrix(calc_matrix)  # Print matrix according to the goal
         else:  # goal == "jacobi"
-            eigen_matrix, eigen_values = spk.jacobi(list_of_vectors, n_vectors)
-            print_matrix([eigen_values] + eigen_matrix)
+            eigen_matrix, eigen_values = spk.jacobi(vectors, n_vectors)
+            print_matrix(np.vstack((eigen_values, eigen_matrix)))
     except Exception:
         print(ERROR_MSG)
         exit(1)
@@ -60,36 +62,15 @@ def validate_and_assign_input_user():
 
 # The function read from csv format file (extension .txt/.csv) into matrix.
 # file - the csv filename/filepath
-# return: Reading result as list of lists (matrix)
-def build_vectors_list(file):
+# return: Reading result as a float64 numpy array (passed to spkmeansmodule without copying)
+def build_vectors_array(file):
     try:
-        with open(file, 'r') as read_file:
-            return [[float(x) for x in row.split(COMMA)] for row in read_file]
+        return np.loadtxt(file, delimiter=COMMA, ndmin=2)
     except IOError as err:
         print(ERROR_MSG)
         exit(err.errno)
 
 
-# Choosing the first k indexes to be the initial clusters' centroids for the kmeans algorithm.
-# The indexes are randomly selected according to the probability function,
-#   Which is constructed from the Euclidean norm from all other centroids.
-# k - number of clusters
-# Return: list of clusters first central indexes
-def choose_random_centrals(list_of_vectors, k):
-    np.random.seed(0)
-    n_vectors = len(list_of_vectors)
-    np_of_vectors = np.array(list_of_vectors)
-    list_rand_init_centrals_indexes = [np.random.choice(n_vectors)]  # chose the first index randomally
-    for i in range(k - 1):
-        # Calculate the euclidean norm from the last chosen index to all other points
-        np_subtract = np_of_vectors - np_of_vectors[list_rand_init_centrals_indexes[i]]
-        np_norms = np.linalg.norm(np_subtract, axis=1) ** 2
-        np_min_norms = np.minimum(np_min_norms, np_norms) if i > 0 else np_norms
-        np_prob = np_min_norms / np_min_norms.sum()  # Normalize to get probability function
-        list_rand_init_centrals_indexes.append(np.random.choice(n_vectors, p=np_prob))
-    return list_rand_init_centrals_indexes
-
-
 # Print matrix in csv format where floats formatted to 4 digits after the decimal point
 def print_matrix(matrix):
     for row in matrix:
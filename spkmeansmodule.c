@@ -1,7 +1,7 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
-#include "spkmeansmodule.h" /* Macros and functions declarations */
 #include "spkmeans.h" /* spk's public interface functions and macros */
+#include "spkmeansmodule.h" /* Macros and functions declarations */
 
 /**********************************
 ********* Module settings *********
@@ -10,23 +10,57 @@
 /* This array tells Python what methods this module has */
 static PyMethodDef method[] = {
         {"calc_mat", /* the Python method name that will be used */
-         (PyCFunction) calc_mat_connect,
+         (PyCFunction) (void (*)(void)) calc_mat_connect,
          /* the C-function that implements the Python function and returns static PyObject*  */
-         METH_VARARGS, /* flags indicating parameters are accepted for this function */
+         METH_VARARGS | METH_KEYWORDS, /* flags indicating parameters are accepted for this function */
          /*  The docstring for the function (PyDoc_STR("")) */
-         PyDoc_STR("Return calculated matrix (wMat/ddgMat/Lnorm/tMat) "
-                   "according to the goal provided.\n Spk goal returns tMat.")},
+         PyDoc_STR("Return calculated matrix (wMat/ddgMat/Lnorm) according to the goal"
+                   " provided.\n Spk goal returns tMat."
+                   "\nOptional keywords: threads, solver ('classic'/'cyclic'/'parallel'/"
+                   "'ql'/'lanczos'), tol - off-norm (lanczos - residual) tolerance,"
+                   " stats - also return the stats dict, eigencap - k = 0 eigenvalues cap,"
+                   " affinity ('dense'/'knn:K'/'eps:E' - sparse wam/lnorm as"
+                   " (data, indices, indptr)), nystrom - m landmarks (0 - exact),"
+                   " landmarks ('uniform'/'plusplus'/'scalable'/'firstk'), seed,"
+                   " cache - eigenpairs cache dir.")},
+
+        {"spk_range", (PyCFunction) (void (*)(void)) spk_range_connect,
+         METH_VARARGS | METH_KEYWORDS,
+         PyDoc_STR("Run spk for each k of a sequence (e.g. a range) - W, Lnorm and its"
+                   " eigenpairs are computed once."
+                   "\nReturn a list of dicts (k, centroids, labels, inertia, iterations),"
+                   " one per k (0 - the eigengap's), and the eigengap heuristic's k."
+                   "\nOptional keywords: threads, solver, tol, stats, eigencap, affinity,"
+                   " cache (as in calc_mat), kmeans, batch, batch_tol, init, seed (as in kmeans).")},
 
-        {"jacobi", (PyCFunction) jacobi_connect, METH_VARARGS,
+        {"jacobi", (PyCFunction) (void (*)(void)) jacobi_connect, METH_VARARGS | METH_KEYWORDS,
          PyDoc_STR("Run Jacobi's algorithm on a symmetric matrix."
-                   "\nReturn the eigenvectors matrix and list of eigenvalues.")},
+                   "\nReturn the eigenvectors matrix and list of eigenvalues."
+                   "\nOptional keywords: threads, solver, tol, stats (as in calc_mat).")},
 
-        {"kmeans", (PyCFunction) kmeans_connect, METH_VARARGS,
-         PyDoc_STR("Run KMeans algorithm. Return the final centroids and vectors labeling.")},
+        {"kmeans", (PyCFunction) (void (*)(void)) kmeans_connect, METH_VARARGS | METH_KEYWORDS,
+         PyDoc_STR("Run KMeans algorithm. Return the final centroids and vectors labeling."
+                   "\nThe initial indexes may be None - seeded by init."
+                   "\nOptional keywords: threads, kmeans - variant ('lloyd'/'hamerly'/"
+                   "'elkan'/'triangle'/'minibatch'), batch, batch_tol - minibatch's batch"
+                   " size and tolerance, init - seeding ('firstk'/'plusplus'/'scalable'/'uniform'),"
+                   " seed, stats.")},
+
+        {"kmeans_seeds", (PyCFunction) (void (*)(void)) kmeans_seeds_connect,
+         METH_VARARGS | METH_KEYWORDS,
+         PyDoc_STR("Choose the initial centroids' indexes for kmeans."
+                   "\nOptional keywords: threads, init - 'plusplus' (the default),"
+                   " 'scalable' (k-means||), 'uniform' or 'firstk', seed (reproducible).")},
 
          {NULL, NULL, 0, NULL} /* This is a sentinel */
 };
 
+/* SpkArray type - a static type, its slots typed (no function pointer casts),
+ *      filled and readied on the module's initialization */
+static PyBufferProcs spkArrayBufferProcs = {spkArrayGetBuffer, NULL};
+
+static PyTypeObject spkArrayType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
 /* This initiates the module using the above definitions. */
 static struct PyModuleDef moduledef = {
         PyModuleDef_HEAD_INIT,
@@ -46,7 +80,25 @@ static struct PyModuleDef moduledef = {
  */
 PyMODINIT_FUNC
 PyInit_spkmeansmodule(void) {
-    return PyModule_Create(&moduledef);
+    PyObject *module = PyModule_Create(&moduledef);
+
+    if (module == NULL)
+        return NULL;
+    spkArrayType.tp_name = "spkmeansmodule.SpkArray";
+    spkArrayType.tp_basicsize = sizeof(SpkArrayObject);
+    spkArrayType.tp_flags = Py_TPFLAGS_DEFAULT;
+    spkArrayType.tp_doc = PyDoc_STR("C-contiguous array owning spkmeans' result memory."
+                                    "\nUse numpy.asarray / memoryview to access it.");
+    spkArrayType.tp_dealloc = spkArrayDealloc;
+    spkArrayType.tp_as_buffer = &spkArrayBufferProcs;
+    Py_IncRef((PyObject *) &spkArrayType); /* Stolen by the module */
+    if (PyType_Ready(&spkArrayType) < 0 ||
+        PyModule_AddObject(module, "SpkArray", (PyObject *) &spkArrayType)) {
+        Py_DecRef((PyObject *) &spkArrayType);
+        Py_DecRef(module);
+        return NULL;
+    }
+    return module;
 }
 
 /**********************************
@@ -54,95 +106,273 @@ PyInit_spkmeansmodule(void) {
 **********************************/
 
 /* The C-function that implements the Python function calc_mat. */
-static PyObject *calc_mat_connect(PyObject *self, PyObject *args) {
+static PyObject *calc_mat_connect(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"", "", "", "", "", "threads", "solver", "tol", "stats",
+                             "eigencap", "affinity", "nystrom", "landmarks", "seed", "cache",
+                             NULL};
     PyObject *pyListOfLists, *pyResult;
-    int k, dimension, numOfDatapoints, cols;
+    int k, dimension, numOfDatapoints, cols, withStats = 0, asArrays;
     double **datapointsArray, **calcMat;
-    char *strGoal;
+    CsrMatrix *csrMat;
+    char *strGoal, *strSolver = NULL, *strAffinity = NULL, *strLandmarks = NULL;
     GOAL goal;
-    headOfMemList= NULL, freeUsedMem = NULL; /* Init C memory containers */
+    CallContext call;
+    initCallContext(&call); /* Init C memory containers */
 
-    MyAssert(PyArg_ParseTuple(args, "Osiii", &pyListOfLists, &strGoal, &k,
-                              &dimension, &numOfDatapoints));
+    MyAssert(&call, PyArg_ParseTupleAndKeywords(args, kwargs, "Osiii|$isdpisiskz", kwlist,
+                                                &pyListOfLists, &strGoal, &k, &dimension,
+                                                &numOfDatapoints, &call.spk.config.numOfThreads,
+                                                &strSolver, &call.spk.config.jacobiTol,
+                                                &withStats, &call.spk.config.eigenCap,
+                                                &strAffinity, &call.spk.config.numOfLandmarks,
+                                                &strLandmarks, &call.spk.config.seed,
+                                                &call.spk.config.cacheDir));
+    call.spk.config.profile |= withStats; /* The stats' stages */
     /* Assert fail == Type error - not in correct format */
+    MyAssert(&call, validateConfig(&call.spk.config, strSolver, strAffinity, NULL, NULL,
+                                   strLandmarks));
 
     goal = str2enum(strGoal);
     if (goal == NUM_OF_GOALS) { /* Not Valid goal */
         PyErr_SetString(PyExc_ValueError, "Not valid goal.");
+        freeModuleMemory(&call);
         return NULL;
     }
     /* Convert python matrix to C matrix */
-    datapointsArray = pyLOLToCMat(pyListOfLists, numOfDatapoints, dimension);
-    MyAssert(datapointsArray != NULL);
-    /* Calc matrix according to the goal provided */
-    calcMat = dataAdjustmentMatrices(datapointsArray, goal, &k, dimension,
+    asArrays = PyObject_CheckBuffer(pyListOfLists);
+    datapointsArray = pyMatrixToCMat(&call, pyListOfLists, numOfDatapoints, dimension, 0);
+    MyAssert(&call, datapointsArray != NULL);
+    if (call.spk.config.affinity != dense && (goal == wam || goal == lnorm)) {
+        /* Sparse W/Lnorm - CSR tuple */
+        Py_BEGIN_ALLOW_THREADS
+        csrMat = sparseAdjustmentMatrices(&call.spk, datapointsArray, goal, dimension,
+                                          numOfDatapoints, NULL);
+        Py_END_ALLOW_THREADS
+        MyAssert(&call, csrMat != NULL && traceCall(&call));
+        pyResult = asArrays ? cCsrToPyArrays(&call.spk, csrMat) : cCsrToPyTuple(csrMat);
+        if (withStats) /* Return ((data, indices, indptr), stats) */
+            pyResult = packWithStats(&call.spk, Py_BuildValue("(N)", pyResult));
+        MyAssert(&call, pyResult != NULL);
+
+        freeModuleMemory(&call);
+        return pyResult;
+    }
+    /* Calc matrix according to the goal provided - without the GIL */
+    Py_BEGIN_ALLOW_THREADS
+    calcMat = dataAdjustmentMatrices(&call.spk, datapointsArray, goal, &k, dimension,
                                      numOfDatapoints);
-    MyAssert(calcMat != NULL);
+    Py_END_ALLOW_THREADS
+    MyAssert(&call, calcMat != NULL && traceCall(&call));
 
-    if (goal == spk)
-        cols = k; /* T's dimensions - N x K */
-    else
-        cols = numOfDatapoints; /* Otherwise - N x N */
-    /* Convert result back to python type List of lists */
-    pyResult = cMatToPyLOL(calcMat, numOfDatapoints, cols);
-    MyAssert(pyResult != NULL);
+    /* Convert result back to python type - List of lists / SpkArray as the input */
+    if (goal == wam || goal == lnorm) /* Packed symmetric - N x N */
+        pyResult = asArrays ? cSymMatToPyArray(&call.spk, calcMat, numOfDatapoints) :
+                   cSymMatToPyLOL(calcMat, numOfDatapoints);
+    else {
+        cols = goal == spk ? k : numOfDatapoints; /* T - N x K, D - N x N */
+        pyResult = asArrays ? cMatToPyArray(&call.spk, calcMat, numOfDatapoints, cols) :
+                   cMatToPyLOL(calcMat, numOfDatapoints, cols);
+    }
+    MyAssert(&call, pyResult != NULL);
+    if (withStats) /* Return (matrix, stats) */
+        pyResult = packWithStats(&call.spk, pyResult);
+    MyAssert(&call, pyResult != NULL);
 
-    freeAllMemory();
+    freeModuleMemory(&call);
     return pyResult;
 }
 
 /* The C-function that implements the Python function kmeans. */
-static PyObject *kmeans_connect(PyObject *self, PyObject *args) {
+static PyObject *kmeans_connect(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"", "", "", "", "", "threads", "kmeans", "stats", "batch",
+                             "batch_tol", "seed", "init", NULL};
     PyObject *pyListOfLists, *pyResult, *pyListOfIndexes;
-    int k, dimension, numOfDatapoints, *firstCentralIndexes;
+    int k, dimension, numOfDatapoints, *firstCentralIndexes = NULL, asArrays, withStats = 0;
     double **datapointsArray, **calcMat;
-    headOfMemList= NULL, freeUsedMem = NULL; /* Init C memory containers */
+    char *strKMeans = NULL, *strInit = NULL;
+    CallContext call;
+    initCallContext(&call); /* Init C memory containers */
 
-    MyAssert(PyArg_ParseTuple(args, "OiiiO",&pyListOfLists, &numOfDatapoints,
-                              &dimension, &k, &pyListOfIndexes));
+    MyAssert(&call, PyArg_ParseTupleAndKeywords(args, kwargs, "OiiiO|$ispidks", kwlist,
+                                                &pyListOfLists, &numOfDatapoints, &dimension,
+                                                &k, &pyListOfIndexes,
+                                                &call.spk.config.numOfThreads, &strKMeans,
+                                                &withStats, &call.spk.config.batchSize,
+                                                &call.spk.config.batchTol,
+                                                &call.spk.config.seed, &strInit));
+    call.spk.config.profile |= withStats; /* The stats' stages */
     /* Assert fail == Type error - not in correct format */
+    MyAssert(&call, validateConfig(&call.spk.config, NULL, NULL, strKMeans, strInit, NULL));
 
     /* Convert python types to C types */
-    datapointsArray = pyLOLToCMat(pyListOfLists, numOfDatapoints, dimension);
-    firstCentralIndexes = pyIntListToCArray(pyListOfIndexes, k);
-    MyAssert(datapointsArray != NULL && firstCentralIndexes != NULL);
-    /* KMeans clustering using 'kmeans' implementation in C */
-    calcMat = kMeans(datapointsArray, numOfDatapoints, dimension, k,
+    asArrays = PyObject_CheckBuffer(pyListOfLists);
+    datapointsArray = pyMatrixToCMat(&call, pyListOfLists, numOfDatapoints, dimension, 0);
+    MyAssert(&call, datapointsArray != NULL);
+    if (pyListOfIndexes != Py_None) { /* None - seeded by kMeans ("init") */
+        firstCentralIndexes = pyIntListToCArray(&call.spk, pyListOfIndexes, k);
+        MyAssert(&call, firstCentralIndexes != NULL);
+    }
+    /* KMeans clustering using 'kmeans' implementation in C - without the GIL */
+    Py_BEGIN_ALLOW_THREADS
+    calcMat = kMeans(&call.spk, datapointsArray, numOfDatapoints, dimension, k,
                      firstCentralIndexes, MAX_KMEANS_ITER);
-    MyAssert(calcMat != NULL);
-    /* Convert result back to python type - tuple (LOL, List) */
-    pyResult = kmeansResToPyObject(calcMat, k, dimension, numOfDatapoints);
-    MyAssert(pyResult != NULL);
+    Py_END_ALLOW_THREADS
+    MyAssert(&call, calcMat != NULL && traceCall(&call));
+    /* Convert result back to python type - tuple (matrix, labeling) */
+    pyResult = kmeansResToPyObject(&call.spk, calcMat, k, dimension, numOfDatapoints,
+                                   asArrays);
+    MyAssert(&call, pyResult != NULL);
+    if (withStats) /* Return (centroids, labeling, stats) */
+        pyResult = packWithStats(&call.spk, pyResult);
+    MyAssert(&call, pyResult != NULL);
+
+    freeModuleMemory(&call);
+    return pyResult;
+}
+
+/* The C-function that implements the Python function kmeans_seeds. */
+static PyObject *kmeans_seeds_connect(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"", "", "", "", "threads", "init", "seed", NULL};
+    PyObject *pyListOfLists, *pyResult;
+    int i, k, dimension, numOfDatapoints, *seeds;
+    double **datapointsArray;
+    char *strInit = NULL;
+    CallContext call;
+    initCallContext(&call); /* Init C memory containers */
+
+    call.spk.config.init = plusplus;
+    MyAssert(&call, PyArg_ParseTupleAndKeywords(args, kwargs, "Oiii|$isk", kwlist,
+                                                &pyListOfLists, &numOfDatapoints, &dimension,
+                                                &k, &call.spk.config.numOfThreads, &strInit,
+                                                &call.spk.config.seed));
+    /* Assert fail == Type error - not in correct format */
+    MyAssert(&call, validateConfig(&call.spk.config, NULL, NULL, NULL, strInit, NULL));
+
+    datapointsArray = pyMatrixToCMat(&call, pyListOfLists, numOfDatapoints, dimension, 0);
+    MyAssert(&call, datapointsArray != NULL);
+    /* Seeding using 'kMeansSeeds' implementation in C - without the GIL */
+    Py_BEGIN_ALLOW_THREADS
+    seeds = kMeansSeeds(&call.spk, datapointsArray, numOfDatapoints, dimension, k);
+    Py_END_ALLOW_THREADS
+    MyAssert(&call, seeds != NULL && traceCall(&call));
+    /* Convert result back to python type - list of int */
+    pyResult = PyList_New(k);
+    MyAssert(&call, pyResult != NULL);
+    for (i = 0; i < k; ++i) {
+        PyList_SET_ITEM(pyResult, i, PyLong_FromLong(seeds[i]));
+        if (PyList_GET_ITEM(pyResult, i) == NULL) {
+            Py_DecRef(pyResult);
+            MyAssert(&call, 0);
+        }
+    }
+
+    freeModuleMemory(&call);
+    return pyResult;
+}
+
+/* The C-function that implements the Python function spk_range. */
+static PyObject *spk_range_connect(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"", "", "", "", "threads", "solver", "tol", "stats", "eigencap",
+                             "affinity", "kmeans", "batch", "batch_tol", "init", "seed", "cache",
+                             NULL};
+    PyObject *pyListOfLists, *pyKs, *pyResult;
+    int i, dimension, numOfDatapoints, numOfKs, *ks, eigengapK, withStats = 0, asArrays;
+    double **datapointsArray;
+    char *strSolver = NULL, *strAffinity = NULL, *strKMeans = NULL, *strInit = NULL;
+    SpkClustering *clusterings;
+    CallContext call;
+    initCallContext(&call); /* Init C memory containers */
+
+    MyAssert(&call, PyArg_ParseTupleAndKeywords(args, kwargs, "OOii|$isdpissidskz", kwlist,
+                                                &pyListOfLists, &pyKs, &dimension,
+                                                &numOfDatapoints, &call.spk.config.numOfThreads,
+                                                &strSolver, &call.spk.config.jacobiTol,
+                                                &withStats, &call.spk.config.eigenCap,
+                                                &strAffinity, &strKMeans,
+                                                &call.spk.config.batchSize,
+                                                &call.spk.config.batchTol, &strInit,
+                                                &call.spk.config.seed,
+                                                &call.spk.config.cacheDir));
+    call.spk.config.profile |= withStats; /* The stats' stages */
+    /* Assert fail == Type error - not in correct format */
+    MyAssert(&call, validateConfig(&call.spk.config, strSolver, strAffinity, strKMeans, strInit,
+                                   NULL));
+
+    /* Convert python types to C types */
+    numOfKs = (int) PySequence_Size(pyKs);
+    MyAssert(&call, numOfKs >= 0); /* Not a sequence */
+    ks = pyIntListToCArray(&call.spk, pyKs, numOfKs);
+    MyAssert(&call, ks != NULL);
+    for (i = 0; i < numOfKs; ++i) {
+        if (ks[i] < 0 || ks[i] >= numOfDatapoints)
+            break;
+    }
+    if (numOfKs == 0 || i < numOfKs) {
+        PyErr_SetString(PyExc_ValueError, "ks must be a non empty sequence of 0 <= k < n.");
+        MyAssert(&call, 0);
+    }
+    asArrays = PyObject_CheckBuffer(pyListOfLists);
+    datapointsArray = pyMatrixToCMat(&call, pyListOfLists, numOfDatapoints, dimension, 0);
+    MyAssert(&call, datapointsArray != NULL);
+    /* The range using 'spkRange' implementation in C - without the GIL */
+    Py_BEGIN_ALLOW_THREADS
+    clusterings = spkRange(&call.spk, datapointsArray, ks, numOfKs, dimension, numOfDatapoints,
+                           &eigengapK);
+    Py_END_ALLOW_THREADS
+    MyAssert(&call, clusterings != NULL && traceCall(&call));
+    /* Convert result back to python type - tuple (clusterings, eigengap k) */
+    pyResult = clusteringsToPyList(&call.spk, clusterings, numOfKs, numOfDatapoints, asArrays);
+    MyAssert(&call, pyResult != NULL);
+    pyResult = Py_BuildValue("(Ni)", pyResult, eigengapK);
+    MyAssert(&call, pyResult != NULL);
+    if (withStats) /* Return (clusterings, eigengap k, stats) */
+        pyResult = packWithStats(&call.spk, pyResult);
+    MyAssert(&call, pyResult != NULL);
 
-    freeAllMemory();
+    freeModuleMemory(&call);
     return pyResult;
 }
 
 /* The C-function that implements the Python function jacobi. */
-static PyObject *jacobi_connect(PyObject *self, PyObject *args) {
+static PyObject *jacobi_connect(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"", "", "threads", "solver", "tol", "stats", NULL};
     PyObject *pyListOfLists, *pyResult;
-    int i, n;
+    int i, n, withStats = 0, asArrays;
     double **eigenvectorsMat, **matrix;
-    headOfMemList= NULL, freeUsedMem = NULL; /* Init C memory containers */
+    char *strSolver = NULL;
+    CallContext call;
+    initCallContext(&call); /* Init C memory containers */
 
-    MyAssert(PyArg_ParseTuple(args, "Oi", &pyListOfLists, &n));
+    MyAssert(&call, PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|$isdp", kwlist,
+                                                &pyListOfLists, &n,
+                                                &call.spk.config.numOfThreads, &strSolver,
+                                                &call.spk.config.jacobiTol, &withStats));
+    call.spk.config.profile |= withStats; /* The stats' stages */
     /* Assert fail == Type error - not in correct format */
+    MyAssert(&call, validateConfig(&call.spk.config, strSolver, NULL, NULL, NULL, NULL));
 
-    /* Convert python types to C types */
-    matrix = pyLOLToCMat(pyListOfLists, n, n);
-    MyAssert(matrix != NULL);
-    /* Jacobi algorithm using 'jacobiAlgorithm' implementation in C */
-    eigenvectorsMat = jacobiAlgorithm(matrix, n);
-    MyAssert(eigenvectorsMat != NULL);
+    /* Convert python types to C types - a copy, jacobi works in place */
+    asArrays = PyObject_CheckBuffer(pyListOfLists);
+    matrix = pyMatrixToCMat(&call, pyListOfLists, n, n, 1);
+    MyAssert(&call, matrix != NULL);
+    matrix = packSymMatrix(matrix, n); /* Jacobi works on the upper triangle */
+    /* Jacobi algorithm using 'jacobiAlgorithm' implementation in C - without the GIL */
+    Py_BEGIN_ALLOW_THREADS
+    eigenvectorsMat = jacobiAlgorithm(&call.spk, matrix, n);
+    Py_END_ALLOW_THREADS
+    MyAssert(&call, eigenvectorsMat != NULL && traceCall(&call));
     for (i = 1; i < n; ++i) {
         /* Order the eigenvalues list in the first row of the diag matrix */
         matrix[0][i] = matrix[i][i];
     }
-    /* Convert result back to python type - tuple (LOL, List) */
-    pyResult = jacobiResToPyObject(eigenvectorsMat, matrix[0], n);
-    MyAssert(pyResult != NULL);
+    /* Convert result back to python type - tuple (matrix, eigenvalues) */
+    pyResult = jacobiResToPyObject(&call.spk, eigenvectorsMat, matrix[0], n, asArrays);
+    MyAssert(&call, pyResult != NULL);
+    if (withStats) /* Return (eigenvectors, eigenvalues, stats) */
+        pyResult = packWithStats(&call.spk, pyResult);
+    MyAssert(&call, pyResult != NULL);
 
-    freeAllMemory();
+    freeModuleMemory(&call);
     return pyResult;
 }
 
@@ -150,27 +380,253 @@ static PyObject *jacobi_connect(PyObject *self, PyObject *args) {
 ** C <-> python convert functions **
 ***********************************/
 
-/* This function Gets python int type list and convert it to C array. */
-int *pyIntListToCArray(PyObject *pyIntList, int len) {
+/* This function checks the configuration assigned from the keyword arguments. */
+int validateConfig(SpkConfig *config, char *strSolver, char *strAffinity, char *strKMeans,
+                   char *strInit, char *strLandmarks) {
+    if (config->numOfThreads <= 0) {
+        PyErr_SetString(PyExc_ValueError, "threads must be a positive int.");
+        return 0;
+    }
+    if (strSolver != NULL) {
+        config->solver = str2solver(strSolver);
+        if (config->solver == NUM_OF_SOLVERS) {
+            PyErr_SetString(PyExc_ValueError, "Not valid solver.");
+            return 0;
+        }
+    }
+    if (!(config->jacobiTol > 0.0)) {
+        PyErr_SetString(PyExc_ValueError, "tol must be positive.");
+        return 0;
+    }
+    if (config->eigenCap < 0) {
+        PyErr_SetString(PyExc_ValueError, "eigencap must be a non negative int.");
+        return 0;
+    }
+    if (strAffinity != NULL) {
+        config->affinity = str2affinity(strAffinity, &config->affinityParam);
+        if (config->affinity == NUM_OF_AFFINITIES) {
+            PyErr_SetString(PyExc_ValueError,
+                            "Not valid affinity ('dense', 'knn:K' or 'eps:E', 0 < E < 1).");
+            return 0;
+        }
+    }
+    if (config->batchSize <= 0) {
+        PyErr_SetString(PyExc_ValueError, "batch must be a positive int.");
+        return 0;
+    }
+    if (!(config->batchTol > 0.0)) {
+        PyErr_SetString(PyExc_ValueError, "batch_tol must be positive.");
+        return 0;
+    }
+    if (strKMeans != NULL) {
+        config->kmeans = str2kmeans(strKMeans);
+        if (config->kmeans == NUM_OF_KMEANS) {
+            PyErr_SetString(PyExc_ValueError, "Not valid kmeans variant.");
+            return 0;
+        }
+    }
+    if (strInit != NULL) {
+        config->init = str2init(strInit);
+        if (config->init == NUM_OF_INITS) {
+            PyErr_SetString(PyExc_ValueError,
+                            "Not valid init ('firstk', 'plusplus', 'scalable' or 'uniform').");
+            return 0;
+        }
+    }
+    if (config->numOfLandmarks < 0) {
+        PyErr_SetString(PyExc_ValueError, "nystrom must be a non negative int.");
+        return 0;
+    }
+    if (config->numOfLandmarks > 0 && config->affinity != dense) {
+        PyErr_SetString(PyExc_ValueError, "nystrom approximates the dense affinity.");
+        return 0;
+    }
+    if (strLandmarks != NULL) {
+        config->landmarks = str2init(strLandmarks);
+        if (config->landmarks == NUM_OF_INITS) {
+            PyErr_SetString(PyExc_ValueError, "Not valid landmarks ('uniform', 'plusplus', "
+                                              "'scalable' or 'firstk').");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* This function builds the stats dict out of the context's reports. */
+PyObject *reportsToPyDict(SpkContext *ctx) {
+    int status = 1;
+    PyObject *pyStats = PyDict_New();
+
+    if (pyStats == NULL)
+        return NULL;
+    if (status && ctx->report.jacobi.n > 0)
+        status = addReport(pyStats, "jacobi",
+                           Py_BuildValue("{s:s,s:i,s:i,s:l,s:d}",
+                                         "solver", solver2str(ctx->config.solver),
+                                         "n", ctx->report.jacobi.n,
+                                         "sweeps", ctx->report.jacobi.sweeps,
+                                         "rotations", ctx->report.jacobi.rotations,
+                                         "off_norm", ctx->report.jacobi.offNorm));
+    if (status && ctx->report.lanczos.n > 0)
+        status = addReport(pyStats, "lanczos",
+                           Py_BuildValue("{s:i,s:i,s:i,s:l,s:d,s:O}",
+                                         "n", ctx->report.lanczos.n,
+                                         "nev", ctx->report.lanczos.nev,
+                                         "restarts", ctx->report.lanczos.restarts,
+                                         "mat_vecs", ctx->report.lanczos.matVecs,
+                                         "residual", ctx->report.lanczos.residual,
+                                         "converged",
+                                         ctx->report.lanczos.converged ? Py_True : Py_False));
+    if (status && ctx->report.affinity.n > 0)
+        status = addReport(pyStats, "affinity",
+                           Py_BuildValue("{s:s,s:i,s:l}",
+                                         "mode", affinity2str(ctx->config.affinity),
+                                         "n", ctx->report.affinity.n,
+                                         "nnz", ctx->report.affinity.nnz));
+    if (status && ctx->report.kmeans.k > 0)
+        status = addReport(pyStats, "kmeans",
+                           Py_BuildValue("{s:s,s:i,s:i,s:i,s:l,s:l,s:l}",
+                                         "variant", kmeans2str(ctx->report.kmeans.variant),
+                                         "k", ctx->report.kmeans.k,
+                                         "iterations", ctx->report.kmeans.iterations,
+                                         "batch", ctx->report.kmeans.batchSize,
+                                         "distances", ctx->report.kmeans.distances,
+                                         "pruned", ctx->report.kmeans.pruned,
+                                         "changes", ctx->report.kmeans.changes));
+    if (status && ctx->report.nystrom.landmarks > 0)
+        status = addReport(pyStats, "nystrom",
+                           Py_BuildValue("{s:i,s:i}",
+                                         "landmarks", ctx->report.nystrom.landmarks,
+                                         "rank", ctx->report.nystrom.rank));
+    if (status && ctx->report.cache.lookups > 0)
+        status = addReport(pyStats, "cache",
+                           Py_BuildValue("{s:i,s:i,s:i,s:l}",
+                                         "lookups", ctx->report.cache.lookups,
+                                         "hits", ctx->report.cache.hits,
+                                         "writes", ctx->report.cache.writes,
+                                         "bytes", ctx->report.cache.bytes));
+    if (status && ctx->report.memory.planned > 0)
+        status = addReport(pyStats, "memory",
+                           Py_BuildValue("{s:l,s:l,s:i}",
+                                         "planned", ctx->report.memory.planned,
+                                         "used", ctx->report.memory.used,
+                                         "overflows", ctx->report.memory.overflows));
+    if (status && ctx->report.profile.numOfStages > 0)
+        status = addReport(pyStats, "stages", stagesToPyList(&ctx->report.profile));
+    if (!status) {
+        Py_DecRef(pyStats);
+        return NULL;
+    }
+    return pyStats;
+}
+
+/* This function adds a report's dict to the stats dict - the report's reference is dropped. */
+int addReport(PyObject *pyStats, const char *name, PyObject *pyReport) {
+    int status = pyReport != NULL && !PyDict_SetItemString(pyStats, name, pyReport);
+
+    Py_XDECREF(pyReport);
+    return status;
+}
+
+/* This function builds the list of the recorded stages' dicts. */
+PyObject *stagesToPyList(const ProfileReport *profile) {
+    PyObject *pyStages, *pyStage, *pyCounter;
+    const StageReport *stage;
+    int i;
+
+    pyStages = PyList_New(profile->numOfStages);
+    if (pyStages == NULL)
+        return NULL;
+    for (i = 0; i < profile->numOfStages; ++i) {
+        stage = &profile->stages[i];
+        pyStage = Py_BuildValue("{s:s,s:d,s:d,s:l}",
+                                "name", stage->name,
+                                "start", stage->start,
+                                "seconds", stage->seconds,
+                                "bytes", stage->bytes);
+        if (pyStage != NULL && stage->counterName != NULL) {
+            pyCounter = PyLong_FromLong(stage->counter);
+            if (pyCounter == NULL || PyDict_SetItemString(pyStage, stage->counterName,
+                                                          pyCounter)) {
+                Py_DecRef(pyStage);
+                pyStage = NULL;
+            }
+            Py_XDECREF(pyCounter);
+        }
+        if (pyStage == NULL) {
+            Py_DecRef(pyStages);
+            return NULL;
+        }
+        PyList_SET_ITEM(pyStages, i, pyStage); /* Steals the reference */
+    }
+    return pyStages;
+}
+
+/* This function appends the call's stages to the Chrome trace (if a trace path is set). */
+int traceCall(CallContext *call) {
+    if (call->spk.config.tracePath == NULL)
+        return 1;
+    if (writeTrace(&call->spk, call->spk.config.tracePath, 1) == EOF) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, call->spk.config.tracePath);
+        return 0;
+    }
+    return 1;
+}
+
+/* This function appends the stats dict to a result (a tuple is extended). */
+PyObject *packWithStats(SpkContext *ctx, PyObject *pyResult) {
+    PyObject *pyStats, *pyPacked, *pyItem;
+    Py_ssize_t i, size;
+
+    if (pyResult == NULL)
+        return NULL;
+    pyStats = reportsToPyDict(ctx);
+    if (pyStats == NULL) {
+        Py_DecRef(pyResult);
+        return NULL;
+    }
+    size = PyTuple_Check(pyResult) ? PyTuple_Size(pyResult) : 1;
+    pyPacked = PyTuple_New(size + 1);
+    if (pyPacked != NULL) {
+        for (i = 0; i < size; ++i) {
+            pyItem = PyTuple_Check(pyResult) ? PyTuple_GetItem(pyResult, i) : pyResult;
+            Py_IncRef(pyItem);
+            PyTuple_SetItem(pyPacked, i, pyItem); /* Steals the reference */
+        }
+        PyTuple_SetItem(pyPacked, size, pyStats);
+    } else
+        Py_DecRef(pyStats);
+    Py_DecRef(pyResult);
+    return pyPacked;
+}
+
+/* This function Gets python int type sequence and convert it to C array. */
+int *pyIntListToCArray(SpkContext *ctx, PyObject *pyIntList, int len) {
     Py_ssize_t i;
-    int *array, value;
-    PyObject *pyValue;
+    int *array = NULL, value;
+    PyObject *pySequence, *pyValue;
 
-    if (!PyList_Check(pyIntList)) { /* Not a list */
-        MyPy_TypeErr("list", pyIntList);
+    pySequence = PySequence_Fast(pyIntList, "a sequence of int is required");
+    if (pySequence == NULL) /* Not a sequence */
+        return NULL;
+    if (PySequence_Fast_GET_SIZE(pySequence) < len) {
+        PyErr_SetString(PyExc_ValueError, "Not enough initial indexes.");
+        Py_DecRef(pySequence);
         return NULL;
     }
-    array = (int *) myAlloc(freeUsedMem, len * sizeof(int));
+    array = (int *) myAlloc(ctx, ctx->freeUsedMem, len * sizeof(int));
     if (array != NULL) { /* Memory allocation fail */
         for (i = 0; i < len; ++i) {
-            pyValue = PyList_GetItem(pyIntList, i);
-            value = (int) (pyValue != NULL ? PyLong_AsLong(pyValue) : EOF);
+            pyValue = PySequence_Fast_GET_ITEM(pySequence, i);
+            value = (int) PyLong_AsLong(pyValue);
             if (PyErr_Occurred()) {
-                return NULL; /* Casting error to int */
+                array = NULL; /* Casting error to int */
+                break;
             }
             array[i] = value;
         }
     }
+    Py_DecRef(pySequence);
     return array;
 }
 
@@ -192,8 +648,77 @@ PyObject *cArrToPythonList(double *array, int len) {
     return pyList;
 }
 
+/* This function initializes a connect function's call context. */
+void initCallContext(CallContext *call) {
+    initContext(&call->spk);
+    call->inputViewHeld = 0;
+}
+
+/* This function releases the input buffer and frees all the call's C memory. */
+void freeModuleMemory(CallContext *call) {
+    if (call->inputViewHeld) {
+        PyBuffer_Release(&call->inputView);
+        call->inputViewHeld = 0;
+    }
+    freeAllMemory(&call->spk);
+}
+
+/* This function converts a python matrix (buffer / list of lists) into C double matrix. */
+double **pyMatrixToCMat(CallContext *call, PyObject *pyMatrix, int rows, int cols, int copy) {
+    if (PyObject_CheckBuffer(pyMatrix))
+        return pyBufferToCMat(call, pyMatrix, rows, cols, copy);
+    return pyLOLToCMat(&call->spk, pyMatrix, rows, cols); /* Fallback - lists */
+}
+
+/* This function gets a python buffer and points C double matrix rows into it (or copies it). */
+double **pyBufferToCMat(CallContext *call, PyObject *pyBuffer, int rows, int cols, int copy) {
+    int i;
+    double **matrix, *values;
+    Py_buffer *view = &call->inputView;
+
+    if (PyObject_GetBuffer(pyBuffer, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT))
+        return NULL; /* Not C-contiguous */
+    call->inputViewHeld = 1;
+    if (view->itemsize != sizeof(double) || !isFloat64Format(view->format)) {
+        PyErr_Format(PyExc_TypeError, "float64 buffer is required (got format '%s')",
+                     view->format);
+        return NULL;
+    }
+    if (view->ndim != 2 || view->shape[0] != rows || view->shape[1] != cols) {
+        PyErr_Format(PyExc_ValueError, "buffer of shape (%d, %d) is required", rows, cols);
+        return NULL;
+    }
+    values = (double *) view->buf;
+    if (copy) { /* Own copy in the "alloc2DArray" layout */
+        matrix = (double **) alloc2DArray(&call->spk, rows, cols, sizeof(double),
+                                          sizeof(double *), call->spk.freeUsedMem);
+        if (matrix != NULL) /* Memory allocation fail */
+            memcpy(matrix[0], values, (size_t) rows * cols * sizeof(double));
+        PyBuffer_Release(view);
+        call->inputViewHeld = 0;
+        return matrix;
+    }
+    /* In place - only the row pointers are allocated */
+    matrix = (double **) myAlloc(&call->spk, call->spk.freeUsedMem, rows * sizeof(double *));
+    if (matrix != NULL) { /* Memory allocation fail */
+        for (i = 0; i < rows; ++i)
+            matrix[i] = values + (size_t) i * cols;
+    }
+    return matrix;
+}
+
+/* This function checks a buffer's struct format is a native float64. */
+int isFloat64Format(const char *format) {
+    const int one = 1;
+    const char nativeOrder = *(const char *) &one ? '<' : '>';
+
+    if (*format == '@' || *format == '=' || *format == nativeOrder)
+        ++format; /* Native byte order */
+    return !strcmp(format, "d");
+}
+
 /* This function Gets python type list of lists (float) and convert into C double matrix. */
-double **pyLOLToCMat(PyObject *pyListOfLists, int rows, int cols) {
+double **pyLOLToCMat(SpkContext *ctx, PyObject *pyListOfLists, int rows, int cols) {
     Py_ssize_t i, j;
     double **matrix, value;
     PyObject *pyList, *pyValue;
@@ -203,8 +728,8 @@ double **pyLOLToCMat(PyObject *pyListOfLists, int rows, int cols) {
         return NULL;
     }
     /* Allocate memory for matrix */
-    matrix = (double **) alloc2DArray(rows, cols, sizeof(double), sizeof(double *),
-                                      freeUsedMem);
+    matrix = (double **) alloc2DArray(ctx, rows, cols, sizeof(double), sizeof(double *),
+                                      ctx->freeUsedMem);
     if (matrix != NULL) { /* Memory allocation fail */
         for (i = 0; i < rows; ++i) {
             pyList = PyList_GetItem(pyListOfLists, i);
@@ -256,28 +781,294 @@ PyObject *cMatToPyLOL(double **matrix, int rows, int cols) {
     return pyLOL;
 }
 
+/* This function Gets C packed symmetric matrix, build and return python type list of lists. */
+PyObject *cSymMatToPyLOL(double **matrix, int n) {
+    Py_ssize_t i, j;
+    PyObject *pyLOL, *pyList, *pyValue;
+
+    pyLOL = PyList_New(n);
+    if(pyLOL != NULL) { /* Memory allocation fail */
+        for (i = 0; i < n; ++i) {
+            pyList = PyList_New(n);
+            if (pyList == NULL) {
+                Py_DecRef(pyLOL);
+                return NULL; /* If NULL - alloc fail */
+            }
+            for (j = 0; j < n; ++j) {
+                pyValue = PyFloat_FromDouble(SymElement(matrix, i, j));
+                if (pyValue == NULL || PyList_SetItem(pyList, j, pyValue)) {
+                    Py_DecRef(pyLOL);
+                    Py_DecRef(pyList);
+                    return NULL; /* Set error */
+                }
+            }
+            if (PyList_SetItem(pyLOL, i, pyList)) {
+                Py_DecRef(pyLOL);
+                return NULL; /* Set error */
+            }
+        }
+    }
+    return pyLOL;
+}
+
+/* This function Gets C CSR matrix, build and return python tuple (data, indices, indptr). */
+PyObject *cCsrToPyTuple(const CsrMatrix *csr) {
+    Py_ssize_t p, i;
+    PyObject *pyData, *pyIndices, *pyIndptr, *pyValue;
+
+    pyData = PyList_New(csr->nnz);
+    pyIndices = PyList_New(csr->nnz);
+    pyIndptr = PyList_New(csr->n + 1);
+    if (pyData == NULL || pyIndices == NULL || pyIndptr == NULL) {
+        Py_XDECREF(pyData);
+        Py_XDECREF(pyIndices);
+        Py_XDECREF(pyIndptr);
+        return NULL; /* If NULL - alloc fail */
+    }
+    for (p = 0; p < csr->nnz; ++p) {
+        pyValue = PyFloat_FromDouble(csr->values[p]);
+        if (pyValue == NULL || PyList_SetItem(pyData, p, pyValue))
+            break; /* Set error */
+        pyValue = PyLong_FromLong(csr->colIndex[p]);
+        if (pyValue == NULL || PyList_SetItem(pyIndices, p, pyValue))
+            break; /* Set error */
+    }
+    for (i = 0; i <= csr->n && p == csr->nnz; ++i) {
+        pyValue = PyLong_FromLong(csr->rowPtr[i]);
+        if (pyValue == NULL || PyList_SetItem(pyIndptr, i, pyValue))
+            break; /* Set error */
+    }
+    if (p < csr->nnz || i <= csr->n) {
+        Py_DecRef(pyData);
+        Py_DecRef(pyIndices);
+        Py_DecRef(pyIndptr);
+        return NULL;
+    }
+    return Py_BuildValue("(NNN)", pyData, pyIndices, pyIndptr);
+}
+
+/* This function builds a SpkArray, taking over a detached block (or allocating one). */
+PyObject *newSpkArray(SpkContext *ctx, void *data, const char *format, Py_ssize_t itemsize,
+                      int ndim, Py_ssize_t rows, Py_ssize_t cols) {
+    SpkArrayObject *array;
+    size_t size = (size_t) rows * (ndim == 2 ? cols : 1) * itemsize;
+
+    if (data == NULL) {
+        data = myAlloc(ctx, NULL, size > 0 ? size : 1);
+        if (data == NULL) /* Memory allocation fail */
+            return PyErr_NoMemory();
+        myDetach(ctx, data);
+    }
+    array = (SpkArrayObject *) PyType_GenericAlloc(&spkArrayType, 0);
+    if (array == NULL) {
+        myFreeDetached(data);
+        return NULL;
+    }
+    array->data = data;
+    array->format = format;
+    array->itemsize = itemsize;
+    array->ndim = ndim;
+    array->shape[0] = rows, array->shape[1] = cols;
+    array->strides[0] = ndim == 2 ? cols * itemsize : itemsize;
+    array->strides[1] = itemsize;
+    return (PyObject *) array;
+}
+
+/* This function checks a C matrix is in the "alloc2DArray" layout. */
+int isContiguousMatrix(double **matrix, int rows, int cols) {
+    int i;
+
+    if (rows == 0 || (char *) matrix != (char *) (matrix[0] + (size_t) rows * cols))
+        return 0; /* Row pointers don't follow the values */
+    for (i = 1; i < rows; ++i) {
+        if (matrix[i] != matrix[0] + (size_t) i * cols)
+            return 0;
+    }
+    return 1;
+}
+
+/* This function Gets C double matrix and returns it as a SpkArray (no copy if possible). */
+PyObject *cMatToPyArray(SpkContext *ctx, double **matrix, int rows, int cols) {
+    int i;
+    double *values;
+    PyObject *pyArray;
+
+    /* Hand over a "myAlloc" block - arena buffers are freed with their arena */
+    if (isContiguousMatrix(matrix, rows, cols) && !isArenaMemory(ctx, matrix[0])) {
+        values = matrix[0];
+        myDetach(ctx, values);
+        return newSpkArray(ctx, values, "d", sizeof(double), 2, rows, cols);
+    }
+    pyArray = newSpkArray(ctx, NULL, "d", sizeof(double), 2, rows, cols);
+    if (pyArray != NULL) { /* Else error */
+        values = (double *) ((SpkArrayObject *) pyArray)->data;
+        for (i = 0; i < rows; ++i)
+            memcpy(values + (size_t) i * cols, matrix[i], cols * sizeof(double));
+    }
+    return pyArray;
+}
+
+/* This function Gets C packed symmetric matrix and returns a full SpkArray. */
+PyObject *cSymMatToPyArray(SpkContext *ctx, double **matrix, int n) {
+    int i, j;
+    double *values;
+    PyObject *pyArray = newSpkArray(ctx, NULL, "d", sizeof(double), 2, n, n);
+
+    if (pyArray != NULL) { /* Else error */
+        values = (double *) ((SpkArrayObject *) pyArray)->data;
+        for (i = 0; i < n; ++i) {
+            /* Upper triangle's row, then mirrored into the column */
+            memcpy(values + (size_t) i * n + i, matrix[i] + i, (n - i) * sizeof(double));
+            for (j = i + 1; j < n; ++j)
+                values[(size_t) j * n + i] = matrix[i][j];
+        }
+    }
+    return pyArray;
+}
+
+/* This function Gets C double array and returns a SpkArray copy. */
+PyObject *cArrToPyArray(SpkContext *ctx, const double *array, int len) {
+    PyObject *pyArray = newSpkArray(ctx, NULL, "d", sizeof(double), 1, len, 0);
+
+    if (pyArray != NULL) /* Else error */
+        memcpy(((SpkArrayObject *) pyArray)->data, array, len * sizeof(double));
+    return pyArray;
+}
+
+/* This function Gets C CSR matrix and returns a tuple of SpkArrays (data, indices, indptr). */
+PyObject *cCsrToPyArrays(SpkContext *ctx, const CsrMatrix *csr) {
+    PyObject *pyData, *pyIndices, *pyIndptr;
+
+    pyData = newSpkArray(ctx, NULL, "d", sizeof(double), 1, csr->nnz, 0);
+    pyIndices = newSpkArray(ctx, NULL, "i", sizeof(int), 1, csr->nnz, 0);
+    pyIndptr = newSpkArray(ctx, NULL, "l", sizeof(long), 1, csr->n + 1, 0);
+    if (pyData == NULL || pyIndices == NULL || pyIndptr == NULL) {
+        Py_XDECREF(pyData);
+        Py_XDECREF(pyIndices);
+        Py_XDECREF(pyIndptr);
+        return NULL; /* If NULL - alloc fail */
+    }
+    memcpy(((SpkArrayObject *) pyData)->data, csr->values, csr->nnz * sizeof(double));
+    memcpy(((SpkArrayObject *) pyIndices)->data, csr->colIndex, csr->nnz * sizeof(int));
+    memcpy(((SpkArrayObject *) pyIndptr)->data, csr->rowPtr, (csr->n + 1) * sizeof(long));
+    return Py_BuildValue("(NNN)", pyData, pyIndices, pyIndptr);
+}
+
 /* This function pack kmeans results into python tuple. */
-PyObject *kmeansResToPyObject(double **matrix, int rows, int cols, int numOfDatapoints) {
+PyObject *kmeansResToPyObject(SpkContext *ctx, double **matrix, int rows, int cols,
+                              int numOfDatapoints, int asArrays) {
     PyObject *pyCentroidsMat, *pyVecLabeling;
 
-    pyCentroidsMat = cMatToPyLOL(matrix, rows, cols);
-    pyVecLabeling = cArrToPythonList(matrix[rows], numOfDatapoints);
-    if (pyCentroidsMat == NULL || pyVecLabeling == NULL)
+    /* The labeling row first - the centroids' block may be handed over */
+    pyVecLabeling = asArrays ? cArrToPyArray(ctx, matrix[rows], numOfDatapoints) :
+                    cArrToPythonList(matrix[rows], numOfDatapoints);
+    pyCentroidsMat = asArrays ? cMatToPyArray(ctx, matrix, rows, cols) :
+                     cMatToPyLOL(matrix, rows, cols);
+    if (pyCentroidsMat == NULL || pyVecLabeling == NULL) {
+        Py_XDECREF(pyCentroidsMat);
+        Py_XDECREF(pyVecLabeling);
         return NULL; /* Error */
+    }
 
     /* Pack into tuple */
-    return PyTuple_Pack(2, pyCentroidsMat, pyVecLabeling);
+    return Py_BuildValue("(NN)", pyCentroidsMat, pyVecLabeling);
+}
+
+/* This function builds the list of a range's clustering dicts. */
+PyObject *clusteringsToPyList(SpkContext *ctx, const SpkClustering *clusterings, int numOfKs,
+                              int numOfDatapoints, int asArrays) {
+    int i;
+    PyObject *pyList, *pyCentroidsMat, *pyVecLabeling, *pyClustering;
+    const SpkClustering *clustering;
+
+    pyList = PyList_New(numOfKs);
+    if (pyList == NULL)
+        return NULL;
+    for (i = 0; i < numOfKs; ++i) {
+        clustering = &clusterings[i];
+        pyVecLabeling = asArrays ? cArrToPyArray(ctx, clustering->labels, numOfDatapoints) :
+                        cArrToPythonList(clustering->labels, numOfDatapoints);
+        pyCentroidsMat = asArrays ? cMatToPyArray(ctx, clustering->centroids, clustering->k,
+                                                  clustering->k) :
+                         cMatToPyLOL(clustering->centroids, clustering->k, clustering->k);
+        if (pyCentroidsMat == NULL || pyVecLabeling == NULL) {
+            Py_XDECREF(pyCentroidsMat);
+            Py_XDECREF(pyVecLabeling);
+            Py_DecRef(pyList);
+            return NULL; /* Error */
+        }
+        pyClustering = Py_BuildValue("{s:i,s:N,s:N,s:d,s:i}",
+                                     "k", clustering->k,
+                                     "centroids", pyCentroidsMat,
+                                     "labels", pyVecLabeling,
+                                     "inertia", clustering->inertia,
+                                     "iterations", clustering->iterations);
+        if (pyClustering == NULL) {
+            Py_DecRef(pyList);
+            return NULL;
+        }
+        PyList_SET_ITEM(pyList, i, pyClustering); /* Steals the reference */
+    }
+    return pyList;
 }
 
 /* This function pack jacobi results into python tuple. */
-PyObject *jacobiResToPyObject(double **eigenvectorsMat, double *eigenvalues, int n) {
+PyObject *jacobiResToPyObject(SpkContext *ctx, double **eigenvectorsMat, double *eigenvalues,
+                              int n, int asArrays) {
     PyObject *pyEigenvectorsMat, *pyEigenvalues;
 
-    pyEigenvectorsMat = cMatToPyLOL(eigenvectorsMat, n, n);
-    pyEigenvalues = cArrToPythonList(eigenvalues, n);
-    if (pyEigenvectorsMat == NULL || pyEigenvalues == NULL)
+    pyEigenvalues = asArrays ? cArrToPyArray(ctx, eigenvalues, n) :
+                    cArrToPythonList(eigenvalues, n);
+    pyEigenvectorsMat = asArrays ? cMatToPyArray(ctx, eigenvectorsMat, n, n) :
+                        cMatToPyLOL(eigenvectorsMat, n, n);
+    if (pyEigenvectorsMat == NULL || pyEigenvalues == NULL) {
+        Py_XDECREF(pyEigenvectorsMat);
+        Py_XDECREF(pyEigenvalues);
         return NULL; /* Error */
+    }
 
     /* Pack into tuple */
-    return PyTuple_Pack(2, pyEigenvectorsMat, pyEigenvalues);
-}
\ No newline at end of file
+    return Py_BuildValue("(NN)", pyEigenvectorsMat, pyEigenvalues);
+}
+
+/***********************************
+********* SpkArray type ************
+***********************************/
+
+/* This function exports the SpkArray's memory (buffer protocol) - only the requested fields. */
+static int spkArrayGetBuffer(PyObject *self, Py_buffer *view, int flags) {
+    SpkArrayObject *array = (SpkArrayObject *) self;
+
+    view->obj = NULL;
+    /* C-contiguous - a matrix of more than one row and column isn't F-contiguous */
+    if ((flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS && array->ndim == 2 &&
+        array->shape[0] > 1 && array->shape[1] > 1) {
+        PyErr_SetString(PyExc_BufferError, "SpkArray is not Fortran contiguous");
+        return -1;
+    }
+    view->obj = self;
+    Py_IncRef(self); /* Released by PyBuffer_Release */
+    view->buf = array->data;
+    view->len = array->shape[0] * (array->ndim == 2 ? array->shape[1] : 1) * array->itemsize;
+    view->readonly = 0; /* PyBUF_WRITABLE is granted - the array owns its block */
+    view->itemsize = array->itemsize;
+    /* NULL - unsigned bytes ("B") */
+    view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? (char *) array->format : NULL;
+    if ((flags & PyBUF_ND) == PyBUF_ND) {
+        view->ndim = array->ndim;
+        view->shape = array->shape;
+    } else { /* PyBUF_SIMPLE - the block as flat bytes */
+        view->ndim = 1;
+        view->shape = NULL;
+    }
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? array->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+/* This function frees the SpkArray and its block. */
+static void spkArrayDealloc(PyObject *self) {
+    myFreeDetached(((SpkArrayObject *) self)->data);
+    Py_TYPE(self)->tp_free(self);
+}
@@ -6,10 +6,10 @@
 /*******************************************************************************
 ********************************* Macros ***************************************
 *******************************************************************************/
-/* Custom logical assert macro - free memory and return NULL (error in python) */
-#define MyAssert(exp) \
+/* Custom logical assert macro - free the call's memory and return NULL (error in python) */
+#define MyAssert(call, exp) \
 if (!(exp)) {         \
-freeAllMemory();        \
+freeModuleMemory(call); \
 if (!PyErr_Occurred()) { PyErr_NoMemory(); }  \
 /* If none exception reported, raise memory exception */  \
 return NULL;            \
@@ -19,6 +19,30 @@ return NULL;            \
 #define MyPy_TypeErr(x, y) \
 PyErr_Format(PyExc_TypeError, "%s type is required (got type %s)", x ,Py_TYPE(y)->tp_name)
 
+/*******************************************************************************
+********************************* Struct ***************************************
+*******************************************************************************/
+/* A connect function's call - each call has its own C memory, configuration
+ *      and reports, so calls from different threads run concurrently (the
+ *      computation runs without the GIL) */
+typedef struct {
+    SpkContext spk;
+    Py_buffer inputView; /* Input buffer used in place - released by "freeModuleMemory" */
+    int inputViewHeld;
+} CallContext;
+
+/* SpkArray - a C-contiguous array exported with the buffer protocol
+ *      (numpy.asarray / memoryview share its memory). Owns its block. */
+typedef struct {
+    PyObject_HEAD
+    void *data; /* Block detached from the memory list (see "myDetach") */
+    const char *format; /* struct module format - "d", "i" or "l" */
+    Py_ssize_t itemsize;
+    int ndim;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} SpkArrayObject;
+
 /*******************************************************************************
 **************************** Functions Declaration *****************************
 *******************************************************************************/
@@ -27,42 +51,166 @@ PyErr_Format(PyExc_TypeError, "%s type is required (got type %s)", x ,Py_TYPE(y)
  * Gets vectors list as matrix and return matrix calculated according to the
  *      goal provided using 'dataAdjustmentMatrices' C function in "spkmeans.h".
  * @param args - Arguments from python:
- *      vectors list, goal, n_clusters (k), n_features, n_vectors (N)
- * @return Matrix (python list of lists): 'spk' - T, 'wam' - W, 'ddg' - D, 'lnorm' - Lnorm
+ *      vectors (list of lists or a float64 C-contiguous buffer, used in place),
+ *      goal, n_clusters (k), n_features, n_vectors (N)
+ * @param kwargs - Optional keyword arguments from python: threads, solver, tol, stats,
+ *      eigencap, affinity, nystrom, landmarks, seed (spk - see "nystromTMatrix"),
+ *      cache (spk - the eigenpairs cache directory, see "loadEigenpairs")
+ * @return Matrix: 'spk' - T, 'wam' - W, 'ddg' - D, 'lnorm' - Lnorm
+ *      (a sparse affinity's W / Lnorm - CSR tuple (data, indices, indptr))
+ *      (with stats=True - a tuple of the matrix and the stats dict).
+ *      Lists for a list input, SpkArrays for a buffer input.
  */
-static PyObject *calc_mat_connect(PyObject *self, PyObject *args);
+static PyObject *calc_mat_connect(PyObject *self, PyObject *args, PyObject *kwargs);
 
 /** The C-function that implements the Python function kmeans.
  * Gets vectors list as matrix and initial centroids list, runs kmeans clustering
  *      using 'kMeans' C function in "spkmeans.h".
  * @param args - Arguments from python:
- *      vectors list (matrix), n_vectors (N), n_features, n_clusters (k),
- *          list of indexes to be the initial clusters centroids
- * @return Final clusters' centroids (python list of lists) and vectors labeling
- *      (vector to cluster, list) as tuple
+ *      vectors (list of lists or a float64 C-contiguous buffer, used in place),
+ *          n_vectors (N), n_features, n_clusters (k),
+ *          sequence of indexes to be the initial clusters centroids
+ *          (None - seeded by init, see "kMeansSeeds")
+ * @param kwargs - Optional keyword arguments from python: threads, kmeans, stats,
+ *      batch, batch_tol (kmeans='minibatch'), init, seed
+ * @return Final clusters' centroids (matrix) and vectors labeling
+ *      (vector to cluster) as tuple - lists / SpkArrays as the vectors
+ *      (+ the stats dict with stats=True)
  */
-static PyObject *kmeans_connect(PyObject *self, PyObject *args);
+static PyObject *kmeans_connect(PyObject *self, PyObject *args, PyObject *kwargs);
+
+/** The C-function that implements the Python function kmeans_seeds.
+ * Gets vectors list as matrix, chooses the initial clusters' centroids using
+ *      'kMeansSeeds' C function in "spkmeans.h".
+ * @param args - Arguments from python:
+ *      vectors (list of lists or a float64 C-contiguous buffer, used in place),
+ *          n_vectors (N), n_features, n_clusters (k)
+ * @param kwargs - Optional keyword arguments from python: threads, init
+ *      ('plusplus' by default), seed
+ * @return List of the k initial centroids' indexes
+ */
+static PyObject *kmeans_seeds_connect(PyObject *self, PyObject *args, PyObject *kwargs);
+
+/** The C-function that implements the Python function spk_range.
+ * Gets vectors list as matrix and a sequence of k, runs spk for each k using
+ *      'spkRange' C function in "spkmeans.h" - the eigenpairs are computed once.
+ * @param args - Arguments from python:
+ *      vectors (list of lists or a float64 C-contiguous buffer, used in place),
+ *          ks (sequence of int, e.g. a range - 0 <= k < N, 0 - the eigengap's),
+ *          n_features, n_vectors (N)
+ * @param kwargs - Optional keyword arguments from python: threads, solver, tol, stats,
+ *      eigencap, affinity, cache (as calc_mat's), kmeans, batch, batch_tol, init, seed
+ *      (as kmeans')
+ * @return Tuple - list of dicts {"k", "centroids", "labels", "inertia", "iterations"}
+ *      (one per k, lists / SpkArrays as the vectors) and the eigengap heuristic's k
+ *      (+ the stats dict with stats=True)
+ */
+static PyObject *spk_range_connect(PyObject *self, PyObject *args, PyObject *kwargs);
 
 /** The C-function that implements the Python function jacobi.
  * Gets symmetrical matrix, runs jacobi diagonalizing algorithm using
  *      'jacobiAlgorithm' C function in "spkmeans.h".
- * @param args - Arguments from python: symmetrical matrix, dimension (n)
- * @return The transposed eigenvectors matrix (P^T as List of lists) and
- *      eigenvalues list packed in a tuple.
+ * @param args - Arguments from python: symmetrical matrix (list of lists or a
+ *      float64 C-contiguous buffer, copied), dimension (n)
+ * @param kwargs - Optional keyword arguments from python: threads, solver, tol, stats
+ * @return The transposed eigenvectors matrix (P^T) and eigenvalues packed in a
+ *      tuple (+ the stats dict with stats=True) - lists / SpkArrays as the matrix.
+ */
+static PyObject *jacobi_connect(PyObject *self, PyObject *args, PyObject *kwargs);
+
+/*
+ * This function checks the configuration assigned from the keyword arguments
+ *      and assigns the solver / affinity / kmeans variant / seeding / landmarks
+ *      sampling (if strSolver / strAffinity / strKMeans / strInit / strLandmarks
+ *      is not NULL).
+ * If not valid, set a python ValueError and return 0.
+ */
+int validateConfig(SpkConfig *config, char *strSolver, char *strAffinity, char *strKMeans,
+                   char *strInit, char *strLandmarks);
+
+/*
+ * This function builds the stats dict out of the context's reports:
+ *      {"jacobi": {"solver", "n", "sweeps", "rotations", "off_norm"},
+ *       "lanczos": {"n", "nev", "restarts", "mat_vecs", "residual", "converged"},
+ *       "affinity": {"mode", "n", "nnz"},
+ *       "kmeans": {"variant", "k", "iterations", "batch", "distances", "pruned",
+ *                  "changes"},
+ *       "nystrom": {"landmarks", "rank"},
+ *       "cache": {"lookups", "hits", "writes", "bytes"},
+ *       "memory": {"planned", "used", "overflows"},
+ *       "stages": [{"name", "start", "seconds", "bytes", counter's name}, ...]}
+ * If an error occur return NULL.
+ */
+PyObject *reportsToPyDict(SpkContext *ctx);
+
+/*
+ * This function adds a report's dict to the stats dict under its name, and
+ *      drops the report's reference (NULL - a failed build, e.g. Py_BuildValue's).
+ * If failed (a python error is set) return 0, else 1.
+ */
+int addReport(PyObject *pyStats, const char *name, PyObject *pyReport);
+
+/*
+ * This function builds the list of the recorded stages' dicts (see "stageBegin").
+ * If an error occur return NULL.
+ */
+PyObject *stagesToPyList(const ProfileReport *profile);
+
+/*
+ * This function appends the call's stages to the Chrome trace at the trace path
+ *      (env SPK_TRACE - see "writeTrace"), if set - the process' calls share one trace.
+ * If failed, set a python OSError and return 0.
  */
-static PyObject *jacobi_connect(PyObject *self, PyObject *args);
+int traceCall(CallContext *call);
+
+/*
+ * This function appends the stats dict to a result - a tuple is extended by
+ *      one item, any other object becomes (result, stats). Steals pyResult (may be NULL).
+ * If an error occur return NULL.
+ */
+PyObject *packWithStats(SpkContext *ctx, PyObject *pyResult);
 
 /*
  * This function Gets python type list of lists (float) and convert it to C double matrix.
  * If an error occur return NULL.
  */
-double **pyLOLToCMat(PyObject *pyListOfLists, int rows, int cols);
+double **pyLOLToCMat(SpkContext *ctx, PyObject *pyListOfLists, int rows, int cols);
+
+/*
+ * This function initializes a connect function's call context.
+ */
+void initCallContext(CallContext *call);
+
+/*
+ * This function releases the call's input buffer (if held) and frees all its C memory.
+ */
+void freeModuleMemory(CallContext *call);
+
+/*
+ * This function converts a python matrix into C double matrix - a float64
+ *      C-contiguous buffer of shape (rows, cols) is used in place (copied if
+ *      copy != 0, for algorithms that work in place), else a list of lists.
+ * If an error occur return NULL.
+ */
+double **pyMatrixToCMat(CallContext *call, PyObject *pyMatrix, int rows, int cols, int copy);
+
+/*
+ * This function gets a python buffer and points C double matrix rows into it
+ *      (or copies it). The buffer is held by the call till "freeModuleMemory".
+ * If an error occur return NULL.
+ */
+double **pyBufferToCMat(CallContext *call, PyObject *pyBuffer, int rows, int cols, int copy);
+
+/*
+ * This function checks a buffer's struct format is a native float64.
+ */
+int isFloat64Format(const char *format);
 
 /*
- * This function Gets python int type list and convert it to C array.
+ * This function Gets python int type sequence and convert it to C array.
  * If an error occurs return NULL.
  */
-int *pyIntListToCArray(PyObject *pyIntList, int len);
+int *pyIntListToCArray(SpkContext *ctx, PyObject *pyIntList, int len);
 
 /*
  * This function Gets C double array, build and return python type list (float).
@@ -77,15 +225,91 @@ PyObject *cArrToPythonList(double *array, int len);
 PyObject *cMatToPyLOL(double **matrix, int rows, int cols);
 
 /*
- * This function pack kmeans results into python tuple.
+ * This function Gets C packed symmetric matrix, build and return python type
+ *      list of lists (both triangles).
+ * If an error occur return NULL.
+ */
+PyObject *cSymMatToPyLOL(double **matrix, int n);
+
+/*
+ * This function Gets C CSR matrix, build and return python tuple of lists
+ *      (data, indices, indptr) - scipy.sparse.csr_matrix's layout.
+ * If an error occur return NULL.
+ */
+PyObject *cCsrToPyTuple(const CsrMatrix *csr);
+
+/*
+ * This function builds a SpkArray of shape (rows) / (rows, cols). Takes over a
+ *      detached block (see "myDetach"), or allocates one if data is NULL.
+ * If an error occur free data and return NULL.
+ */
+PyObject *newSpkArray(SpkContext *ctx, void *data, const char *format, Py_ssize_t itemsize,
+                      int ndim, Py_ssize_t rows, Py_ssize_t cols);
+
+/*
+ * This function checks a C matrix is in the "alloc2DArray" layout - contiguous
+ *      rows, in order, followed by the row pointers - so its block is matrix[0].
+ */
+int isContiguousMatrix(double **matrix, int rows, int cols);
+
+/*
+ * This function Gets C double matrix and returns it as a SpkArray - an
+ *      "alloc2DArray" matrix's block is handed over (no copy), else copied
+ *      (arena matrices - see "isArenaMemory").
+ * The matrix must not be used afterwards.
+ * If an error occur return NULL.
+ */
+PyObject *cMatToPyArray(SpkContext *ctx, double **matrix, int rows, int cols);
+
+/*
+ * This function Gets C packed symmetric matrix and returns a full SpkArray.
  * If an error occur return NULL.
  */
-PyObject *kmeansResToPyObject(double **matrix, int rows, int cols, int numOfDatapoints);
+PyObject *cSymMatToPyArray(SpkContext *ctx, double **matrix, int n);
 
 /*
- * This function pack jacobi results into python tuple.
+ * This function Gets C double array and returns a SpkArray copy.
  * If an error occur return NULL.
  */
-PyObject *jacobiResToPyObject(double **eigenvectorsMat, double *eigenvalues, int n);
+PyObject *cArrToPyArray(SpkContext *ctx, const double *array, int len);
+
+/*
+ * This function Gets C CSR matrix and returns a tuple of SpkArrays
+ *      (data - float64, indices - int32, indptr - int64).
+ * If an error occur return NULL.
+ */
+PyObject *cCsrToPyArrays(SpkContext *ctx, const CsrMatrix *csr);
+
+/*
+ * This function pack kmeans results into python tuple (lists / SpkArrays).
+ * If an error occur return NULL.
+ */
+PyObject *kmeansResToPyObject(SpkContext *ctx, double **matrix, int rows, int cols,
+                              int numOfDatapoints, int asArrays);
+
+/*
+ * This function builds the list of a range's clustering dicts (see "spk_range_connect").
+ * If an error occur return NULL.
+ */
+PyObject *clusteringsToPyList(SpkContext *ctx, const SpkClustering *clusterings, int numOfKs,
+                              int numOfDatapoints, int asArrays);
+
+/*
+ * This function pack jacobi results into python tuple (lists / SpkArrays).
+ * If an error occur return NULL.
+ */
+PyObject *jacobiResToPyObject(SpkContext *ctx, double **eigenvectorsMat, double *eigenvalues,
+                              int n, int asArrays);
+
+/* SpkArray type's functions */
+/*
+ * This function exports the SpkArray's memory (buffer protocol).
+ */
+static int spkArrayGetBuffer(PyObject *self, Py_buffer *view, int flags);
+
+/*
+ * This function frees the SpkArray and its block.
+ */
+static void spkArrayDealloc(PyObject *self);
 
 #endif /* FINAL_PROJECT_SPKMEANSMODULE_H */
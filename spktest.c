@@ -0,0 +1,379 @@
+#include <float.h>
+#include "spkmeans.h"
+#include "spkinnerfunctions.h"
+#include "spktest.h"
+/* This file implements the C regression tests - fast paths against their references */
+
+/* The checks, by command line name */
+static const TestCheck CHECKS[] = {
+        {"parse", parseTest},
+        {"format", formatTest},
+        {"kmeans", kmeansTest},
+        {"seeds", seedsTest},
+        {"cache", cacheTest}
+};
+
+/* The clustering checks' cases - k below and above ELKAN_MIN_K, a single cluster,
+ * n below and above 2 * KMEANS_LANE_MIN (several lanes) */
+static const TestCase CASES[] = {
+        {500, 2, 3}, {5000, 8, 8}, {3000, 16, 24}, {200, 4, 1}
+};
+
+/*******************************************************************************
+********************************** Main ****************************************
+*******************************************************************************/
+
+/**
+ * Regression tests program.
+ * Run the named check, return 1 on any mismatch.
+ */
+int main(int argc, char *argv[]) {
+    int i, mismatches;
+
+    for (i = 0; argc == 2 && i < (int) (sizeof(CHECKS) / sizeof(CHECKS[0])); ++i) {
+        if (!strcmp(argv[1], CHECKS[i].name)) {
+            mismatches = CHECKS[i].run();
+            fprintf(stderr, "spktest: %s - %d mismatches\n", CHECKS[i].name, mismatches);
+            return mismatches == 0 ? 0 : 1;
+        }
+    }
+    printf(INVALID_INPUT_MSG);
+    return 1;
+}
+
+/* This function draws a pseudo random value in [0, 1). */
+double testUniform(unsigned long *state) {
+    *state = (*state * RANDOM_MULTIPLIER + RANDOM_INCREMENT) & RANDOM_MASK;
+    return (double) *state / (RANDOM_MASK + 1.0);
+}
+
+/* This function generates k blobs of uniform noise. */
+double **testBlobs(SpkContext *ctx, const TestCase *tc, unsigned long *state) {
+    int i, j;
+    double **centers = (double **) alloc2DArray(ctx, tc->k, tc->d, sizeof(double),
+                                                SIZE_OF_VOID_2PTR, NULL);
+    double **vectors = (double **) alloc2DArray(ctx, tc->n, tc->d, sizeof(double),
+                                                SIZE_OF_VOID_2PTR, NULL);
+    if (centers == NULL || vectors == NULL) return NULL; /* Memory allocation fail */
+
+    for (i = 0; i < tc->k; ++i) {
+        for (j = 0; j < tc->d; ++j) {
+            centers[i][j] = (2.0 * testUniform(state) - 1.0) * TEST_BLOB_SPREAD;
+        }
+    }
+    for (i = 0; i < tc->n; ++i) {
+        for (j = 0; j < tc->d; ++j) {
+            vectors[i][j] = centers[i % tc->k][j] + (testUniform(state) - 0.5) * TEST_BLOB_NOISE;
+        }
+    }
+    MyMatFree(ctx, centers);
+    return vectors;
+}
+
+/*******************************************************************************
+********************************** Parser **************************************
+*******************************************************************************/
+
+/* This function checks "parseDouble" against strtod. */
+int parseTest() {
+    /* Boundary cases - fast path, then the FAST_PARSE_DIGITS / exponent fallbacks */
+    static const char *cases[] = {
+            "0", "-0", "-0.0", "+0.0", "0.5", "-0.00005", "0.00005", "2.5", "-1.5e-3",
+            ".5", "5.", "-.5e1", "+3", "0.1", "0.30000000000000004",
+            "123456789012345", "999999999999999", "0.000000000000001",
+            "000000000000000000001.5", /* Leading zeros aren't significant */
+            "1234567890123456", "9007199254740993", "3.141592653589793", /* 16, 17 digits */
+            "1.00000000000000000000", "12345678901234567890123", /* The mantissa wraps */
+            "1e22", "1e23", "1e-22", "1e-23", "123456789012345e-22", "8.5e-22",
+            "2.2250738585072014e-308", "4.9e-324", "1.7976931348623157e308", "1e309",
+            "1e999999999999", "1e-999999999999", "inf", "-Infinity", "nan", "0x1p3",
+            "1.5e", "1e+", "2E-", "e5", "-", "", ".", "1,2", "1e5x", "7\r"
+    };
+    int i, j, mismatches = 0;
+    unsigned long state = TEST_SEED;
+    double value;
+    char str[TEST_MAX_CHARS];
+
+    for (i = 0; i < (int) (sizeof(cases) / sizeof(cases[0])); ++i) {
+        mismatches += parseMismatch(cases[i]);
+    }
+    for (i = 0; i < TEST_RANDOM_VALUES; ++i) { /* Random magnitudes and precisions */
+        value = testUniform(&state) - 0.5;
+        value *= pow(10.0, (int) (testUniform(&state) * 60) - 30);
+        for (j = 6; j <= 17; ++j) {
+            sprintf(str, "%.*g", j, value);
+            mismatches += parseMismatch(str);
+        }
+    }
+    return mismatches;
+}
+
+/* This function checks one string's "parseDouble" against strtod. */
+int parseMismatch(const char *str) {
+    const char *end;
+    char *libcEnd;
+    double value = parseDouble(str, &end), libcValue = strtod(str, &libcEnd);
+
+    if (memcmp(&value, &libcValue, sizeof(double)) == 0 && end == libcEnd)
+        return 0;
+    fprintf(stderr, "spktest: parseDouble(\"%s\") = %.17g (%d chars), strtod = %.17g (%d chars)\n",
+            str, value, (int) (end - str), libcValue, (int) (libcEnd - str));
+    return 1;
+}
+
+/*******************************************************************************
+******************************** Formatter *************************************
+*******************************************************************************/
+
+/* This function checks "formatValue" and "formatUnsigned" against printf. */
+int formatTest() {
+    /* Boundary cases - exact ties (odd multiples of 1/32), near ties, the fallbacks */
+    static const double cases[] = {
+            0.0, 0.5, 0.00005, -0.00005, 0.00015, -0.00025, 0.49995, 2.5E-5, 1.00005,
+            0.03125, -0.03125, 0.15625, 1.03125, 99999.96875, 12345678.90625,
+            123.45675, -123.45665, 99999.99995, 1.0E10 + 0.00005, 99999999999.99995,
+            1.0E11, 1.0E11 + 0.03125, 1.0E15, -1.0E15, 1.0E300, DBL_MAX, DBL_MIN, 4.9E-324
+    };
+    static const unsigned long numbers[] = {0, 1, 9, 10, 99, 100, 9999, 10000, 65535,
+                                            ULONG_MAX / 10, ULONG_MAX};
+    int i, j, mismatches = 0;
+    unsigned long state = TEST_SEED, whole;
+    double value;
+
+    for (i = 0; i < (int) (sizeof(cases) / sizeof(cases[0])); ++i) {
+        value = cases[i];
+        mismatches += formatMismatch(value) + formatMismatch(-value) +
+                      formatMismatch(nextafter(value, HUGE_VAL)) +
+                      formatMismatch(nextafter(value, -HUGE_VAL));
+    }
+    mismatches += formatMismatch(HUGE_VAL) + formatMismatch(-HUGE_VAL) +
+                  formatMismatch(strtod("nan", NULL));
+    for (i = 0; i < TEST_RANDOM_VALUES; ++i) {
+        whole = (unsigned long) (testUniform(&state) * 1.0E9);
+        value = (2.0 * whole + 1.0) / 32.0; /* An exact tie */
+        mismatches += formatMismatch(value) + formatMismatch(-value);
+        value = (whole * 10.0 + 5.0) / 1.0E5; /* The nearest double to a tie */
+        mismatches += formatMismatch(value) + formatMismatch(-value);
+        value = testUniform(&state) - 0.5;
+        mismatches += formatMismatch(value * pow(10.0, (int) (testUniform(&state) * 40) - 20));
+    }
+    for (i = 0; i < (int) (sizeof(numbers) / sizeof(numbers[0])); ++i) {
+        for (j = 1; j <= MAX_INDEX_CHARS; ++j) {
+            mismatches += unsignedMismatch(numbers[i], j);
+        }
+    }
+    for (i = 0; i < TEST_RANDOM_VALUES; ++i) {
+        whole = (unsigned long) (testUniform(&state) * ULONG_MAX);
+        mismatches += unsignedMismatch(whole, 1) + unsignedMismatch(whole % 10000, 4);
+    }
+    return mismatches;
+}
+
+/* This function checks one value's "formatValue" against printf("%.4f"). */
+int formatMismatch(double value) {
+    char formatted[MAX_VALUE_CHARS + 1], libcFormatted[MAX_VALUE_CHARS + 1];
+    int length = formatValue(value, formatted);
+
+    formatted[length] = '\0';
+    sprintf(libcFormatted, PRINT_FORMAT, value);
+    if (strcmp(formatted, libcFormatted) == 0)
+        return 0;
+    fprintf(stderr, "spktest: formatValue(%.17g) = %s, printf = %s\n", value, formatted,
+            libcFormatted);
+    return 1;
+}
+
+/* This function checks one number's "formatUnsigned" against printf("%0*lu"). */
+int unsignedMismatch(unsigned long number, int minDigits) {
+    char formatted[MAX_INDEX_CHARS + 1], libcFormatted[MAX_INDEX_CHARS + 1];
+    int length = formatUnsigned(number, formatted, minDigits);
+
+    formatted[length] = '\0';
+    sprintf(libcFormatted, "%0*lu", minDigits, number);
+    if (strcmp(formatted, libcFormatted) == 0)
+        return 0;
+    fprintf(stderr, "spktest: formatUnsigned(%lu, %d) = %s, printf = %s\n", number, minDigits,
+            formatted, libcFormatted);
+    return 1;
+}
+
+/*******************************************************************************
+******************************** Clustering ************************************
+*******************************************************************************/
+
+/* This function checks that the exact kmeans variants give the same results. */
+int kmeansTest() {
+    int i, variant, threads, *seeds, mismatches = 0;
+    unsigned long state = TEST_SEED;
+    double **vectors, **result, **reference;
+    const TestCase *tc;
+    SpkContext data, run;
+
+    for (i = 0; i < (int) (sizeof(CASES) / sizeof(CASES[0])); ++i) {
+        tc = &CASES[i];
+        initContext(&data); /* The points, seeds and reference */
+        data.config.numOfThreads = 1;
+        data.config.init = plusplus;
+        data.config.seed = TEST_SEED;
+        vectors = testBlobs(&data, tc, &state);
+        MyAssert(vectors != NULL);
+        seeds = kMeansSeeds(&data, vectors, tc->n, tc->d, tc->k);
+        MyAssert(seeds != NULL);
+        data.config.kmeans = lloyd;
+        reference = kMeans(&data, vectors, tc->n, tc->d, tc->k, seeds, MAX_KMEANS_ITER);
+        MyAssert(reference != NULL);
+        for (variant = lloyd; variant <= triangle; ++variant) {
+            for (threads = 1; threads <= TEST_THREADS; threads += TEST_THREADS - 1) {
+                initContext(&run);
+                run.config.numOfThreads = threads;
+                run.config.kmeans = (KMEANS) variant;
+                result = kMeans(&run, vectors, tc->n, tc->d, tc->k, seeds, MAX_KMEANS_ITER);
+                MyAssert(result != NULL);
+                mismatches += kmeansMismatch(result, reference, tc, (KMEANS) variant, threads);
+                freeAllMemory(&run);
+            }
+        }
+        freeAllMemory(&data);
+    }
+    return mismatches;
+}
+
+/* This function checks one kmeans result against the reference. */
+int kmeansMismatch(double **result, double **reference, const TestCase *tc, KMEANS variant,
+                   int threads) {
+    int i, labels = 0, centroids = 0;
+
+    for (i = 0; i < tc->n; ++i) {
+        labels += result[tc->k][i] != reference[tc->k][i];
+    }
+    for (i = 0; i < tc->k; ++i) {
+        centroids += memcmp(result[i], reference[i], tc->d * sizeof(double)) != 0;
+    }
+    if (labels == 0 && centroids == 0)
+        return 0;
+    fprintf(stderr, "spktest: kmeans n=%d d=%d k=%d %s threads=%d - %d labels, %d centroids "
+                    "differ from lloyd's\n", tc->n, tc->d, tc->k, KMEANS_STRING[variant],
+            threads, labels, centroids);
+    return 1;
+}
+
+/* This function checks that "kMeansSeeds" doesn't depend on the threads. */
+int seedsTest() {
+    int i, init, *seeds, *threadedSeeds, mismatches = 0;
+    unsigned long state = TEST_SEED;
+    double **vectors;
+    const TestCase *tc;
+    SpkContext data, run;
+
+    for (i = 0; i < (int) (sizeof(CASES) / sizeof(CASES[0])); ++i) {
+        tc = &CASES[i];
+        initContext(&data);
+        vectors = testBlobs(&data, tc, &state);
+        MyAssert(vectors != NULL);
+        for (init = plusplus; init <= uniform; ++init) {
+            data.config.numOfThreads = 1;
+            data.config.init = (INIT) init;
+            data.config.seed = TEST_SEED;
+            seeds = kMeansSeeds(&data, vectors, tc->n, tc->d, tc->k);
+            initContext(&run);
+            run.config = data.config;
+            run.config.numOfThreads = TEST_THREADS;
+            threadedSeeds = kMeansSeeds(&run, vectors, tc->n, tc->d, tc->k);
+            MyAssert(seeds != NULL && threadedSeeds != NULL);
+            if (memcmp(seeds, threadedSeeds, tc->k * sizeof(int)) != 0) {
+                fprintf(stderr, "spktest: seeds n=%d d=%d k=%d %s - %d threads differ from 1\n",
+                        tc->n, tc->d, tc->k, INIT_STRING[init], TEST_THREADS);
+                mismatches++;
+            }
+            freeAllMemory(&run);
+        }
+        freeAllMemory(&data);
+    }
+    return mismatches;
+}
+
+/*******************************************************************************
+********************************** Cache ***************************************
+*******************************************************************************/
+
+/* This function checks that a cache hit gives the uncached spk output. */
+int cacheTest() {
+    int i, solver, k, mismatches = 0;
+    unsigned long state = TEST_SEED;
+    char cacheDir[] = TEST_CACHE_TEMPLATE;
+    double **vectors;
+    const TestCase *tc;
+    SpkContext data;
+
+    MyAssert(mkdtemp(cacheDir) != NULL);
+    for (i = 0; i < (int) (sizeof(CASES) / sizeof(CASES[0])); ++i) {
+        tc = &CASES[i];
+        if (tc->n > TEST_CACHE_MAX_N)
+            continue; /* The dense eigensolvers' time */
+        initContext(&data);
+        vectors = testBlobs(&data, tc, &state);
+        MyAssert(vectors != NULL);
+        for (solver = ql; solver <= lanczos; ++solver) {
+            for (k = tc->k; k >= 0; k = k > 0 ? 0 : -1) {
+                mismatches += cacheMismatch(vectors, tc, (SOLVER) solver, k, cacheDir);
+            }
+        }
+        freeAllMemory(&data);
+    }
+    MyAssert(rmdir(cacheDir) == 0); /* Empty - the cache files were removed */
+    return mismatches;
+}
+
+/* This function runs spk on the points - T, then its kmeans. */
+double **spkOutput(SpkContext *ctx, double **vectors, const TestCase *tc, SOLVER solver, int *k,
+                   char *cacheDir) {
+    double **tMat, **result;
+
+    initContext(ctx);
+    ctx->config.numOfThreads = TEST_THREADS;
+    ctx->config.solver = solver;
+    ctx->config.cacheDir = cacheDir;
+    tMat = dataAdjustmentMatrices(ctx, vectors, spk, k, tc->d, tc->n);
+    MyAssert(tMat != NULL);
+    result = kMeans(ctx, tMat, tc->n, *k, *k, NULL, MAX_KMEANS_ITER);
+    MyAssert(result != NULL);
+    return result;
+}
+
+/* This function checks one spk case's cache miss and hit against the uncached run. */
+int cacheMismatch(double **vectors, const TestCase *tc, SOLVER solver, int k, char *cacheDir) {
+    int i, r, differ = 0, ks[CACHE_RUNS];
+    char key[CACHE_KEY_CHARS + 1], *path;
+    double **results[CACHE_RUNS];
+    SpkContext runs[CACHE_RUNS]; /* Uncached, the miss (stored) and the hit */
+
+    for (r = 0; r < CACHE_RUNS; ++r) {
+        ks[r] = k;
+        results[r] = spkOutput(&runs[r], vectors, tc, solver, &ks[r], r > 0 ? cacheDir : NULL);
+    }
+    for (r = 1; r < CACHE_RUNS && !differ; ++r) {
+        differ = ks[r] != ks[0];
+        for (i = 0; i < ks[0] && !differ; ++i) {
+            differ = memcmp(results[r][i], results[0][i], ks[0] * sizeof(double)) != 0;
+        }
+        for (i = 0; i < tc->n && !differ; ++i) {
+            differ = results[r][ks[0]][i] != results[0][ks[0]][i];
+        }
+    }
+    eigenpairsKey(&runs[1], vectors, tc->n, tc->d, key);
+    path = eigenpairsPath(&runs[1], key);
+    MyAssert(path != NULL && remove(path) == 0); /* The miss stored it */
+    if (runs[1].report.cache.hits != 0 || runs[2].report.cache.hits != 1) {
+        fprintf(stderr, "spktest: cache n=%d d=%d k=%d %s - %d, %d hits (expected 0, 1)\n",
+                tc->n, tc->d, k, SOLVER_STRING[solver], runs[1].report.cache.hits,
+                runs[2].report.cache.hits);
+        differ = 1;
+    } else if (differ) {
+        fprintf(stderr, "spktest: cache n=%d d=%d k=%d %s - the cached runs' output differs "
+                        "from the uncached\n", tc->n, tc->d, k, SOLVER_STRING[solver]);
+    }
+    for (r = 0; r < CACHE_RUNS; ++r) {
+        freeAllMemory(&runs[r]);
+    }
+    return differ;
+}
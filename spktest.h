@@ -0,0 +1,166 @@
+#ifndef FINAL_PROJECT_SPKTEST_H
+#define FINAL_PROJECT_SPKTEST_H
+/* This header contains constants, types and functions of the C regression
+ *      tests - each check compares a fast path against its reference */
+
+/*******************************************************************************
+********************************* Constants ************************************
+*******************************************************************************/
+/* Random values on top of the boundary cases */
+#define TEST_RANDOM_VALUES 100000
+#define TEST_SEED 12345UL
+#define TEST_MAX_CHARS 64 /* A random value's text */
+/* Clustering checks - the multithreaded runs' threads, the blobs' centers and noise */
+#define TEST_THREADS 4
+#define TEST_BLOB_SPREAD 10.0 /* Centers uniform in [-spread, spread]^d */
+#define TEST_BLOB_NOISE 8.0 /* Points uniform in a cube of this side around them - overlapping */
+/* Cache check - the spk runs' temporary cache directory (mkdtemp) and the cases' max n */
+#define TEST_CACHE_TEMPLATE "/tmp/spktest-XXXXXX"
+#define TEST_CACHE_MAX_N 500
+#define CACHE_RUNS 3 /* Uncached, a miss and a hit */
+
+/*******************************************************************************
+*********************************** Types **************************************
+*******************************************************************************/
+/* A check - its command line name and the function that runs it */
+typedef struct {
+    const char *name;
+    int (*run)(); /* Returns the number of mismatches */
+} TestCheck;
+
+/* A clustering check's case - n points in d dimensions, in k blobs and clusters */
+typedef struct {
+    int n, d, k;
+} TestCase;
+
+/*******************************************************************************
+**************************** Functions Declaration *****************************
+*******************************************************************************/
+
+/**
+ * Regression tests program - runs one check (a CTest test each) and prints
+ *      its mismatches to stderr.
+ * @param argv - The check's name: parse, format, kmeans, seeds or cache
+ * @return 0 if the check passed, 1 otherwise (the exit code)
+ */
+int main(int argc, char *argv[]);
+
+/**
+ * This function draws a pseudo random value (31 bit LCG, as "randomVector").
+ * @param state The generator's state, advanced
+ * @return Value in [0, 1)
+ */
+double testUniform(unsigned long *state);
+
+/**
+ * This function generates k blobs of uniform noise - point i around center i mod k.
+ * @param ctx Run context (see "SpkContext") - holds the points
+ * @param tc Case - n, d and k
+ * @param state The generator's state, advanced
+ * @return n * d matrix ("alloc2DArray"), NULL if memory allocation fail
+ */
+double **testBlobs(SpkContext *ctx, const TestCase *tc, unsigned long *state);
+
+/**
+ * This function checks "parseDouble" against strtod - the value's bits and the
+ *      number's end - on boundary cases (the FAST_PARSE_DIGITS and exponent
+ *      limits, the strtod fallbacks, signed zeros, non numbers) and on random
+ *      values printed with 6 to 17 significant digits.
+ * @return Number of mismatches
+ */
+int parseTest();
+
+/**
+ * This function checks one string's "parseDouble" against strtod.
+ * @param str String
+ * @return 1 if they differ (printed to stderr), 0 otherwise
+ */
+int parseMismatch(const char *str);
+
+/**
+ * This function checks "formatValue" against printf("%.4f") and "formatUnsigned"
+ *      against printf("%0*lu") on boundary cases (exact .5 ties - the
+ *      FORMAT_TIE_TOL path - and their neighbours, -0.00005, signed zeros, the
+ *      FORMAT_FAST_LIMIT fallback, non finite values) and on random ties,
+ *      near ties and values of any magnitude.
+ * @return Number of mismatches
+ */
+int formatTest();
+
+/**
+ * This function checks one value's "formatValue" against printf("%.4f").
+ * @param value Value
+ * @return 1 if they differ (printed to stderr), 0 otherwise
+ */
+int formatMismatch(double value);
+
+/**
+ * This function checks one number's "formatUnsigned" against printf("%0*lu").
+ * @param number Number
+ * @param minDigits Min digits
+ * @return 1 if they differ (printed to stderr), 0 otherwise
+ */
+int unsignedMismatch(unsigned long number, int minDigits);
+
+/**
+ * This function checks that the exact kmeans variants (lloyd, hamerly, elkan,
+ *      triangle) give lloyd's single threaded labels and centroids - bit for
+ *      bit, from the same k-means++ seeds - at 1 and TEST_THREADS threads,
+ *      on blobs with k below and above ELKAN_MIN_K.
+ * @return Number of mismatching runs
+ */
+int kmeansTest();
+
+/**
+ * This function checks one kmeans result against the reference.
+ * @param result "kMeans"' result - k centroids, then the labels row
+ * @param reference The reference's result
+ * @param tc Case - n, d and k
+ * @param variant The result's variant
+ * @param threads The result's threads
+ * @return 1 if they differ (printed to stderr), 0 otherwise
+ */
+int kmeansMismatch(double **result, double **reference, const TestCase *tc, KMEANS variant,
+                   int threads);
+
+/**
+ * This function checks that "kMeansSeeds" draws the same seeds at 1 and at
+ *      TEST_THREADS threads, for each seeding (plusplus, scalable, uniform).
+ * @return Number of mismatching seedings
+ */
+int seedsTest();
+
+/**
+ * This function checks that spk gives the same output (T's kmeans - labels and
+ *      centroids, bit for bit) uncached, on a cache miss and on a cache hit, with
+ *      the ql and lanczos solvers, at the case's k and at k = 0 (eigengap).
+ * @return Number of mismatching runs
+ */
+int cacheTest();
+
+/**
+ * This function runs spk (T, then its kmeans - as the CLI) on the points.
+ * @param ctx Run context (see "SpkContext") - initialized here, freed by the caller
+ * @param vectors Points
+ * @param tc Case - n and d
+ * @param solver Eigensolver
+ * @param k The clusters, 0 - the eigengap's (assigned)
+ * @param cacheDir Eigenpairs cache directory, NULL - uncached
+ * @return "kMeans"' result - k centroids, then the labels row
+ */
+double **spkOutput(SpkContext *ctx, double **vectors, const TestCase *tc, SOLVER solver, int *k,
+                   char *cacheDir);
+
+/**
+ * This function checks one spk case's cache miss and hit against the uncached
+ *      run, and removes the cache file.
+ * @param vectors Points
+ * @param tc Case - n and d
+ * @param solver Eigensolver
+ * @param k The clusters, 0 - the eigengap's
+ * @param cacheDir Eigenpairs cache directory
+ * @return 1 if they differ or the second run missed (printed to stderr), 0 otherwise
+ */
+int cacheMismatch(double **vectors, const TestCase *tc, SOLVER solver, int k, char *cacheDir);
+
+#endif /* FINAL_PROJECT_SPKTEST_H */